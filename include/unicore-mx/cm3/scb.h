@@ -128,6 +128,47 @@
 
 /* MVFR1: Media and Floating-Point Feature Register 1 */
 #define SCB_MVFR1				MMIO32(SCB_BASE + 0x244)
+
+/* Cache registers, implemented only on Cortex-M7 (RAZ/WI otherwise) */
+
+/* CLIDR: Cache Level ID Register */
+#define SCB_CLIDR				MMIO32(SCB_BASE + 0x78)
+
+/* CTR: Cache Type Register */
+#define SCB_CTR					MMIO32(SCB_BASE + 0x7C)
+
+/* CCSIDR: Cache Size ID Register */
+#define SCB_CCSIDR				MMIO32(SCB_BASE + 0x80)
+
+/* CSSELR: Cache Size Selection Register */
+#define SCB_CSSELR				MMIO32(SCB_BASE + 0x84)
+
+/* ICIALLU: I-cache invalidate all to PoU */
+#define SCB_ICIALLU				MMIO32(SCB_BASE + 0x250)
+
+/* ICIMVAU: I-cache invalidate by address to PoU */
+#define SCB_ICIMVAU				MMIO32(SCB_BASE + 0x258)
+
+/* DCIMVAC: D-cache invalidate by address to PoC */
+#define SCB_DCIMVAC				MMIO32(SCB_BASE + 0x25C)
+
+/* DCISW: D-cache invalidate by set/way */
+#define SCB_DCISW				MMIO32(SCB_BASE + 0x260)
+
+/* DCCMVAU: D-cache clean by address to PoU */
+#define SCB_DCCMVAU				MMIO32(SCB_BASE + 0x264)
+
+/* DCCMVAC: D-cache clean by address to PoC */
+#define SCB_DCCMVAC				MMIO32(SCB_BASE + 0x268)
+
+/* DCCSW: D-cache clean by set/way */
+#define SCB_DCCSW				MMIO32(SCB_BASE + 0x26C)
+
+/* DCCIMVAC: D-cache clean and invalidate by address to PoC */
+#define SCB_DCCIMVAC				MMIO32(SCB_BASE + 0x270)
+
+/* DCCISW: D-cache clean and invalidate by set/way */
+#define SCB_DCCISW				MMIO32(SCB_BASE + 0x274)
 #endif
 
 /* --- SCB values ---------------------------------------------------------- */
@@ -273,6 +314,12 @@
 
 /* Those defined only on ARMv7 and above */
 #if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+/* BP: Branch prediction enable (Cortex-M7) */
+#define SCB_CCR_BP				(1 << 18)
+/* IC: Instruction cache enable (Cortex-M7) */
+#define SCB_CCR_IC				(1 << 17)
+/* DC: Data cache enable (Cortex-M7) */
+#define SCB_CCR_DC				(1 << 16)
 /* Bit 2: reserved - must be kept cleared */
 /* USERSETMPEND */
 #define SCB_CCR_USERSETMPEND			(1 << 1)
@@ -406,6 +453,27 @@
 #define SCB_CPACR_CP10				(1 << 20)
 /* CPACR [22:23]: Access privileges for coprocessor 11 */
 #define SCB_CPACR_CP11				(1 << 22)
+
+/* --- SCB_CCSIDR values --------------------------------------------------- */
+
+#define SCB_CCSIDR_NUMSETS_SHIFT		13
+#define SCB_CCSIDR_NUMSETS			(0x7FFF << SCB_CCSIDR_NUMSETS_SHIFT)
+#define SCB_CCSIDR_ASSOCIATIVITY_SHIFT		3
+#define SCB_CCSIDR_ASSOCIATIVITY		(0x3FF << SCB_CCSIDR_ASSOCIATIVITY_SHIFT)
+#define SCB_CCSIDR_LINESIZE_SHIFT		0
+#define SCB_CCSIDR_LINESIZE			(0x7 << SCB_CCSIDR_LINESIZE_SHIFT)
+
+/* --- SCB_CSSELR values --------------------------------------------------- */
+
+#define SCB_CSSELR_LEVEL_SHIFT			1
+#define SCB_CSSELR_IND				(1 << 0)
+
+/* D-cache line size of the Cortex-M7 (bytes) */
+#define SCB_DCACHE_LINE_SIZE			32
+
+/* Buffers accessed by DMA while the D-cache is enabled must not share a
+ * cache line with other data: align them (and round their size) to this. */
+#define SCB_DCACHE_ALIGNED	__attribute__((aligned(SCB_DCACHE_LINE_SIZE)))
 #endif
 
 /* --- SCB functions ------------------------------------------------------- */
@@ -435,6 +503,14 @@ void scb_reset_system(void) __attribute__((noreturn, naked));
 #if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
 void scb_reset_core(void) __attribute__((noreturn, naked));
 void scb_set_priority_grouping(uint32_t prigroup);
+
+void scb_enable_icache(void);
+void scb_disable_icache(void);
+void scb_enable_dcache(void);
+void scb_disable_dcache(void);
+void scb_clean_dcache_range(const void *addr, uint32_t len);
+void scb_invalidate_dcache_range(void *addr, uint32_t len);
+void scb_clean_invalidate_dcache_range(void *addr, uint32_t len);
 #endif
 
 END_DECLS
@@ -0,0 +1,90 @@
+/** @defgroup ethernet_lwip_netif_defines lwIP netif Defines
+ *
+ * @brief <b>Defined Constants and Types for the lwIP network interface</b>
+ *
+ * @ingroup ETH
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#ifndef UNICORE_MX_ETH_LWIP_NETIF
+#define UNICORE_MX_ETH_LWIP_NETIF
+
+/* Optional: lib/ethernet/lwip_netif.c is not part of the library, it is
+ * built by the application together with its lwIP sources and lwipopts.h.
+ */
+
+#include <unicore-mx/ethernet/mac.h>
+#include <unicore-mx/ethernet/phy.h>
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+
+/** Maximum number of pbufs of a frame sent without copy, longer chains
+ * are copied into a pool buffer
+ */
+#if !defined(ETH_NETIF_TX_SEGS)
+#	define ETH_NETIF_TX_SEGS	8
+#endif
+
+/** Maximum number of frames sent without copy and not yet given back by
+ * the MAC (at most the number of transmit descriptors is useful)
+ */
+#if !defined(ETH_NETIF_TX_FRAMES)
+#	define ETH_NETIF_TX_FRAMES	16
+#endif
+
+struct eth_netif;
+
+/** pbuf of a received frame, the frame stays in the pool buffer */
+struct eth_netif_pbuf {
+	struct pbuf_custom pbuf;
+	struct eth_netif *state;
+};
+
+/** State of the network interface, passed to netif_add()
+ *
+ * @a pool holds the buffers of the MAC rings (see eth_ring_init()), and
+ * @a pbufs one struct eth_netif_pbuf per buffer of the pool. Received
+ * frames are given to lwIP in these buffers without copy. The other
+ * fields are private to lwip_netif.c.
+ */
+struct eth_netif {
+	struct eth_pool *pool;
+	struct eth_netif_pbuf *pbufs;
+	uint8_t mac[6];
+
+	/* frames sent without copy: pbuf and pbufs left to give back */
+	struct pbuf *tx_pbuf[ETH_NETIF_TX_FRAMES];
+	uint8_t tx_left[ETH_NETIF_TX_FRAMES];
+	uint32_t tx_head;
+	uint32_t tx_tail;
+	bool tx_batch;
+};
+
+BEGIN_DECLS
+
+err_t eth_netif_init(struct netif *netif);
+uint32_t eth_netif_poll(struct netif *netif, uint32_t budget);
+void eth_netif_set_link(struct netif *netif, enum phy_status status);
+
+END_DECLS
+
+#endif
+
+/**@}*/
@@ -47,8 +47,72 @@
 #       error "Ethernet not yet supported on this platform."
 #endif
 
+/** Pool of fixed size buffers, used by the zero copy API
+ *
+ * @a free is the list of free buffers (linked through their first word),
+ * @a avail the number of free buffers and @a size the size of each buffer.
+ * @a start and @a end delimit the pool memory.
+ */
+struct eth_pool {
+	void *free;
+	uint32_t size;
+	uint32_t avail;
+	uint8_t *start;
+	uint8_t *end;
+};
+
+/** Offset of the frame inside the receive buffers, set by MACs that
+ * prepend data to the frame (ie. the LM3S frame length).
+ */
+#if !defined(ETH_RX_OFFSET)
+#	define ETH_RX_OFFSET 0
+#endif
+
+/** Set by MACs that handle the IP checksums (the LM3S only does the FCS) */
+#if !defined(ETH_CHECKSUM_OFFLOAD)
+#	define ETH_CHECKSUM_OFFLOAD 0
+#endif
+
+/** Part of a frame to transmit with eth_tx_queue() */
+struct eth_tx_seg {
+	void *buf;
+	uint32_t len;
+};
+
+/** Called when a transmitted buffer that does not belong to the pool
+ * (ie. a buffer of the TCP/IP stack) is given back by the driver. The
+ * buffers are given back in the order they were queued.
+ */
+typedef void (*eth_tx_release_callback)(void *arg, void *buf);
+
+/** Maximum number of frames handled by one eth_rx_service() call */
+#if !defined(ETH_RX_BUDGET)
+#	define ETH_RX_BUDGET 16
+#endif
+
+/** Called by eth_rx_service() for each received frame. The ownership of
+ * @a buf is passed to the callee (give it back with eth_pool_free()).
+ */
+typedef void (*eth_rx_callback)(void *buf, uint32_t len);
+
+/** Receive ring statistics
+ *
+ * @a frames received and given to the application, @a dropped frames with
+ * error or too large for a buffer, @a missed frames lost because no
+ * descriptor was free, @a overflow frames lost on receive FIFO overflow.
+ */
+struct eth_rx_stats {
+	uint32_t frames;
+	uint32_t dropped;
+	uint32_t missed;
+	uint32_t overflow;
+};
+
 BEGIN_DECLS
 
+void eth_smi_start(uint8_t phy, uint8_t reg, bool write, uint16_t data);
+bool eth_smi_busy(void);
+uint16_t eth_smi_data(void);
 void eth_smi_write(uint8_t phy, uint8_t reg, uint16_t data);
 uint16_t eth_smi_read(uint8_t phy, uint8_t reg);
 void eth_smi_bit_op(uint8_t phy, uint8_t reg, uint16_t bits, uint16_t mask);
@@ -56,10 +120,28 @@ void eth_smi_bit_clear(uint8_t phy, uint8_t reg, uint16_t clearbits);
 void eth_smi_bit_set(uint8_t phy, uint8_t reg, uint16_t setbits);
 
 void eth_set_mac(uint8_t *mac);
+void eth_set_link(bool fast, bool fd);
 void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx, uint32_t cRx, bool isext);
 bool eth_tx(uint8_t *ppkt, uint32_t n);
 bool eth_rx(uint8_t *ppkt, uint32_t *len, uint32_t maxlen);
 
+void eth_pool_init(struct eth_pool *pool, void *mem, uint32_t count, uint32_t size);
+void *eth_pool_alloc(struct eth_pool *pool);
+void eth_pool_free(struct eth_pool *pool, void *buf);
+bool eth_pool_owns(struct eth_pool *pool, void *buf);
+
+void eth_ring_init(uint8_t *desc, uint32_t nTx, uint32_t nRx, bool isext, struct eth_pool *pool);
+void eth_set_tx_release_callback(eth_tx_release_callback release, void *arg);
+bool eth_tx_buf(void *buf, uint32_t len);
+bool eth_tx_queue(const struct eth_tx_seg *seg, uint32_t count);
+void eth_tx_flush(void);
+uint32_t eth_tx_reclaim(void);
+void *eth_rx_buf(uint32_t *len);
+void eth_rx_refill(void);
+bool eth_rx_irq(void);
+uint32_t eth_rx_service(uint32_t budget, eth_rx_callback callback);
+void eth_rx_get_stats(struct eth_rx_stats *stats, bool reset);
+
 void eth_init(uint8_t phy, enum eth_clk clock);
 void eth_start(void);
 
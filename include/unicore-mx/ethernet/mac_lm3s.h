@@ -22,9 +22,28 @@
 #define ETH_RCTL_CRCFILTER		(1 << 3)
 #define ETH_RCTL_CLRFIFO		(1 << 4)
 
+/* Ethernet MII Management Control Values	*/
+#define ETH_MCTL_START			(1 << 0)
+#define ETH_MCTL_WRITE			(1 << 1)
+#define ETH_MCTL_REGADR_SHIFT		3
+
 
 #define SYSTEMCONTROL_ETH       0x20105000
 
+/* Frames are stored after the 2 byte FIFO length field, so a buffer
+ * aligned on a word boundary gives word accesses on both FIFO sides and
+ * an aligned IP header.
+ */
+#define ETH_RX_OFFSET			2
+
+/* The FCS stays at the end of the received frames */
+#define ETH_RX_FCS_LEN			4
+
+/* Size of one software ring slot, eth_ring_init() needs
+ * (nTx + nRx) * ETH_RING_SLOT_SIZE bytes.
+ */
+#define ETH_RING_SLOT_SIZE		8
+
 
 enum eth_clk {
 	ETH_CLK_50MHZ = 1
@@ -557,6 +557,7 @@
 #define ETH_DMAMFBOCR_MFC_SHIFT		0
 #define ETH_DMAMFBOCR_MFC		(0xFFFF << ETH_DMAMFBOCR_MFC_SHIFT)
 #define ETH_DMAMFBOCR_OMFC		(1<<16)
+#define ETH_DMAMFBOCR_MFA_SHIFT		17
 #define ETH_DMAMFBOCR_MFA		(0x7FF << ETH_DMAMFBOCR_MFA_SHIFT)
 #define ETH_DMAMFBOCR_OFOC		(1<<28)
 
@@ -618,7 +619,7 @@
 #define ETH_TDES1_TBS1			(0x1FFF<<ETH_TDES1_TBS1_SHIFT)
 
 #define ETH_TDES1_TBS2_SHIFT		16
-#define ETH_TDES1_TBS2			(0x1FFF<<ETH_TDES1_TBS1_SHIFT)
+#define ETH_TDES1_TBS2			(0x1FFF<<ETH_TDES1_TBS2_SHIFT)
 
 /*---------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -705,6 +706,73 @@ enum eth_clk {
 	ETH_CLK_150_168MHZ = ETH_MACMIIAR_CR_HCLK_DIV_102,
 };
 
+/** MMC counters, accumulated in software (see eth_mmc_read()) */
+struct eth_mmc_counters {
+	uint64_t tx_good;
+	uint64_t tx_single_collision;
+	uint64_t tx_multi_collision;
+	uint64_t rx_good_unicast;
+	uint64_t rx_crc_error;
+	uint64_t rx_align_error;
+};
+
+/** IP, TCP, UDP and ICMP checksums are generated and checked by the MAC
+ * after eth_enable_checksum_offload()
+ */
+#define ETH_CHECKSUM_OFFLOAD		1
+
+/** Length of the FCS left at the end of the received frames */
+#if defined(STM32F1)
+/* APCS only strips the FCS of 802.3 (length) frames */
+#define ETH_RX_FCS_LEN			4
+#else
+/* stripped by ETH_MACCR_CSTF */
+#define ETH_RX_FCS_LEN			0
+#endif
+
+/** Number of additional MAC addresses for perfect filtering (MACA1 - 3) */
+#define ETH_PERFECT_FILTERS		3
+
+BEGIN_DECLS
+
+void eth_mmc_init(void);
+bool eth_mmc_irq(void);
+void eth_mmc_read(struct eth_mmc_counters *counters, bool reset);
+
+uint32_t eth_hash_index(const uint8_t *mac);
+void eth_set_filter(const uint8_t *macs, uint32_t count);
+
+END_DECLS
+
+/* IEEE 1588 PTP */
+
+/** Nanoseconds in one second (PTP clock subseconds, digital rollover) */
+#define ETH_PTP_NS_PER_SEC		1000000000UL
+
+/** Called when the transmit timestamp of a frame is available.
+ * @a buf is the first buffer of the frame (only as an identifier, the
+ * buffer may already be given back), @a ns the PTP time of transmission.
+ */
+typedef void (*eth_ptp_tx_callback)(void *buf, uint64_t ns);
+
+/* STM32F4 / STM32F7 only (digital rollover, extended descriptors) */
+#if defined(STM32F4) || defined(STM32F7)
+BEGIN_DECLS
+
+void eth_ptp_init(uint32_t hclk);
+uint64_t eth_ptp_get_time(void);
+void eth_ptp_set_time(uint64_t ns);
+void eth_ptp_adjust_time(int64_t delta);
+void eth_ptp_adjust_freq(int32_t ppb);
+void eth_ptp_set_target(uint64_t ns);
+bool eth_ptp_irq(void);
+void eth_ptp_set_tx_callback(eth_ptp_tx_callback callback);
+bool eth_ptp_rx_timestamp(uint64_t *ns);
+
+END_DECLS
+
+#endif
+
 
 /*
  * Usage:
@@ -62,6 +62,12 @@
 #define PHY_REG_BSR_FAULT	(1<<4)
 #define PHY_REG_BSR_ANDONE	(1<<5)
 
+/* Autonegotiation advertisement / link partner ability */
+#define PHY_REG_AN_10HD		(1<<5)
+#define PHY_REG_AN_10FD		(1<<6)
+#define PHY_REG_AN_100HD	(1<<7)
+#define PHY_REG_AN_100FD	(1<<8)
+
 #define PHY0			0
 #define PHY1			1
 
@@ -77,6 +83,50 @@ enum phy_status {
 	LINK_FD_10000M,
 };
 
+/** Number of MDIO transactions that can be queued */
+#if !defined(PHY_MDIO_QUEUE_SIZE)
+#	define PHY_MDIO_QUEUE_SIZE	8
+#endif
+
+/** Number of phy_link_tick() calls to wait for the end of the PHY reset */
+#if !defined(PHY_RESET_TIMEOUT)
+#	define PHY_RESET_TIMEOUT	100
+#endif
+
+/** Called when a queued MDIO transaction is done, @a data is the value read
+ * (or written).
+ */
+typedef void (*phy_mdio_callback)(void *arg, uint16_t data);
+
+/** Called when the link goes up or down */
+typedef void (*phy_link_callback)(uint8_t phy, enum phy_status status);
+
+enum phy_state {
+	PHY_STATE_RESET,
+	PHY_STATE_RESET_WAIT,
+	PHY_STATE_RESET_CHECK,
+	PHY_STATE_POLL,
+	PHY_STATE_LINK,
+	PHY_STATE_ADV,
+	PHY_STATE_LPA,
+};
+
+/** Link state machine, advanced by phy_link_tick()
+ *
+ * @a data is the result of the last transaction, @a adv the advertised
+ * abilities while resolving the link.
+ */
+struct phy_link {
+	uint8_t phy;
+	bool pending;
+	enum phy_state state;
+	enum phy_status status;
+	uint16_t data;
+	uint16_t adv;
+	uint32_t timer;
+	phy_link_callback callback;
+};
+
 void phy_reset(uint8_t phy);
 bool phy_link_isup(uint8_t phy);
 
@@ -85,6 +135,14 @@ enum phy_status phy_link_status(uint8_t phy);
 void phy_autoneg_force(uint8_t phy, enum phy_status mode);
 void phy_autoneg_enable(uint8_t phy);
 
+bool phy_mdio_queue(uint8_t phy, uint8_t reg, bool write, uint16_t data,
+		    phy_mdio_callback callback, void *arg);
+void phy_mdio_poll(void);
+
+void phy_link_init(struct phy_link *link, uint8_t phy,
+		   phy_link_callback callback);
+void phy_link_tick(struct phy_link *link);
+
 /**@}*/
 
 
@@ -39,6 +39,9 @@ specific memorymap.h header before including this header file.*/
 
 #define SYSCFG_PMC			MMIO32(SYSCFG_BASE + 0x04)
 
+/* Ethernet PHY interface selection (F2/F4/F7), set before the MAC reset */
+#define SYSCFG_PMC_MII_RMII_SEL		(1 << 23)
+
 /* External interrupt configuration registers [0..3] (SYSCFG_EXTICR[1..4]) */
 #define SYSCFG_EXTICR(i)		MMIO32(SYSCFG_BASE + 0x08 + (i)*4)
 #define SYSCFG_EXTICR1			SYSCFG_EXTICR(0)
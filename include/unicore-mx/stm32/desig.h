@@ -50,6 +50,16 @@ void desig_get_unique_id(uint32_t *result);
 void desig_get_unique_id_as_string(char *string,
 				   unsigned int string_len);
 
+/**
+ * Read the full 96 bit unique identifier and write it as UTF-16 characters
+ * (not zero-terminated). Useful for USB serial number string descriptor.
+ * @param string memory region to write the result to
+ * @param string_len number of characters in string (24 for full identifier)
+ * @return number of characters written (at most 24)
+ */
+unsigned int desig_get_unique_id_as_utf16(uint16_t *string,
+					   unsigned int string_len);
+
 END_DECLS
 
 #endif
@@ -62,6 +62,31 @@ LGPL License Terms @ref lgpl_license
 #define USB_MIDI_ASSOCIATION_CONTROL		0x01
 
 
+/* Table 4-1: Code Index Number Classifications */
+#define USB_MIDI_CIN_MISC			0x0
+#define USB_MIDI_CIN_CABLE_EVENT		0x1
+#define USB_MIDI_CIN_SYSCOMMON_2BYTE		0x2
+#define USB_MIDI_CIN_SYSCOMMON_3BYTE		0x3
+#define USB_MIDI_CIN_SYSEX_START		0x4
+#define USB_MIDI_CIN_SYSEX_END_1BYTE		0x5
+#define USB_MIDI_CIN_SYSEX_END_2BYTE		0x6
+#define USB_MIDI_CIN_SYSEX_END_3BYTE		0x7
+#define USB_MIDI_CIN_NOTE_OFF			0x8
+#define USB_MIDI_CIN_NOTE_ON			0x9
+#define USB_MIDI_CIN_POLY_KEYPRESS		0xA
+#define USB_MIDI_CIN_CONTROL_CHANGE		0xB
+#define USB_MIDI_CIN_PROGRAM_CHANGE		0xC
+#define USB_MIDI_CIN_CHANNEL_PRESSURE		0xD
+#define USB_MIDI_CIN_PITCH_BEND			0xE
+#define USB_MIDI_CIN_SINGLE_BYTE		0xF
+
+/* Section 4: USB-MIDI Event Packet (byte 0: cable number | CIN) */
+#define USB_MIDI_EVENT_SIZE			4
+#define USB_MIDI_EVENT_HEADER(cable, cin)	\
+	((uint8_t)((((cable) & 0xF) << 4) | ((cin) & 0xF)))
+#define USB_MIDI_EVENT_CABLE(header)		(((header) >> 4) & 0xF)
+#define USB_MIDI_EVENT_CIN(header)		((header) & 0xF)
+
 /* Table 6-2: Class-Specific MS Interface Header Descriptor */
 struct usb_midi_header_descriptor {
 	uint8_t bLength;
@@ -0,0 +1,91 @@
+/**
+ * @defgroup usbd_midi_defines USB MIDI Type Definitions
+ *
+ * @brief <b>Defined Constants and Types for the USB MIDI Streaming class</b>
+ *
+ * @ingroup USBD_defines
+ *
+ * LGPL License Terms @ref lgpl_license
+*/
+
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#ifndef UNICOREMX_USBD_MIDI_H
+#define UNICOREMX_USBD_MIDI_H
+
+#include <unicore-mx/usbd/usbd.h>
+#include <unicore-mx/usb/class/midi.h>
+
+/**
+ * Number of 4-byte USB-MIDI event packets that can be queued
+ * for transmission. Must be a power of 2.
+ */
+#if !defined(USBD_MIDI_QUEUE_LENGTH)
+# define USBD_MIDI_QUEUE_LENGTH 64
+#endif
+
+/**
+ * Largest bulk endpoint size supported (Full speed: 64, High speed: 512)
+ */
+#if !defined(USBD_MIDI_MAX_PACKET_SIZE)
+# define USBD_MIDI_MAX_PACKET_SIZE 64
+#endif
+
+/**
+ * Number of MIDI objects that can be initalized
+ *  (one per USB device)
+ */
+#if !defined(USBD_MIDI_MAX)
+# define USBD_MIDI_MAX 1
+#endif
+
+typedef struct usbd_midi usbd_midi;
+
+/**
+ * Called when USB-MIDI event packets are received from host
+ * @param midi MIDI object
+ * @param events Received event packets (4 byte each)
+ * @param count Number of event packets
+ */
+typedef void (*usbd_midi_recv_callback)(usbd_midi *midi,
+				const uint8_t *events, unsigned count);
+
+usbd_midi *usbd_midi_init(usbd_device *dev,
+				uint8_t ep_in, uint16_t ep_in_size,
+				uint8_t ep_out, uint16_t ep_out_size,
+				usbd_midi_recv_callback recv_callback);
+
+void usbd_midi_start(usbd_midi *midi);
+
+bool usbd_midi_write_event(usbd_midi *midi, const uint8_t event[4]);
+
+bool usbd_midi_write_message(usbd_midi *midi, uint8_t cable,
+				const uint8_t *msg, unsigned len);
+
+unsigned usbd_midi_write_sysex(usbd_midi *midi, uint8_t cable,
+				const uint8_t *data, unsigned len);
+
+void usbd_midi_flush(usbd_midi *midi);
+
+unsigned usbd_midi_queue_free(usbd_midi *midi);
+
+#endif
+
+/**@}*/
@@ -46,6 +46,14 @@
 #include <unicore-mx/usbd/usbd.h>
 #include <unicore-mx/usb/class/msc.h>
 
+/**
+ * Number of MSC objects that can be initalized
+ *  (one per USB device)
+ */
+#if !defined(USBD_MSC_MAX)
+# define USBD_MSC_MAX 1
+#endif
+
 typedef struct usbd_msc usbd_msc;
 typedef struct usbd_msc_backend usbd_msc_backend;
 
@@ -0,0 +1,242 @@
+/**
+ * @defgroup usbd_composite_defines USB Composite Device
+ *
+ * @brief <b>Build a composite device from multiple functions</b>
+ *
+ * @ingroup USBD_defines
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#ifndef UNICOREMX_USBD_COMPOSITE_H
+#define UNICOREMX_USBD_COMPOSITE_H
+
+#include <unicore-mx/usbd/usbd.h>
+
+/*
+ * A composite device is made of functions (MSC, CDC, HID, MIDI ...).
+ * Each function describe what it need (number of interface, endpoints)
+ *  and the composite layer:
+ *  - assign interface number and endpoint address
+ *  - compute the endpoint size and double buffer flags for the
+ *     available endpoint memory
+ *  - generate the configuration descriptor (with IAD for function that
+ *     have more than one interface)
+ *  - prepare the endpoints on SET_CONFIGURATION (of the generated
+ *     configuration only)
+ *  - route control request to the owner function using a lookup table
+ *
+ * Device descriptor of a composite device that use IAD should have
+ *  bDeviceClass = 0xEF, bDeviceSubClass = 0x02, bDeviceProtocol = 0x01
+ */
+
+/** Maximum number of function in a composite device */
+#if !defined(USBD_COMPOSITE_FUNCTION_MAX)
+# define USBD_COMPOSITE_FUNCTION_MAX 4
+#endif
+
+/** Maximum number of endpoints a function can request */
+#if !defined(USBD_COMPOSITE_FUNCTION_EP_MAX)
+# define USBD_COMPOSITE_FUNCTION_EP_MAX 4
+#endif
+
+/** Maximum number of interfaces of the composite device */
+#if !defined(USBD_COMPOSITE_INTERFACE_MAX)
+# define USBD_COMPOSITE_INTERFACE_MAX 8
+#endif
+
+/** Marker for interface/endpoint that is not owned by any function */
+#define USBD_COMPOSITE_NO_OWNER 0xFF
+
+typedef struct usbd_composite usbd_composite;
+typedef struct usbd_composite_function usbd_composite_function;
+
+/**
+ * Endpoint required by a function
+ */
+struct usbd_composite_ep {
+	/** Direction: USB_ENDPOINT_ADDR_IN(0) or USB_ENDPOINT_ADDR_OUT(0) */
+	uint8_t dir;
+
+	/** Endpoint type */
+	usbd_ep_type type;
+
+	/**
+	 * Maximum packet size.
+	 * 0 mean largest size allowed for the type and speed
+	 *  (ie bulk, Full speed: 64, High speed: 512).
+	 */
+	uint16_t max_size;
+
+	/** bInterval for the endpoint descriptor */
+	uint8_t interval;
+
+	/**
+	 * Allow the endpoint to be double buffered
+	 *  if enough memory is available
+	 */
+	bool want_double_buffer;
+};
+
+/**
+ * A function of the composite device.
+ * The "Provided by function" part is filled by the class code,
+ *  the "Assigned" part is filled by usbd_composite_build()
+ */
+struct usbd_composite_function {
+	/* Provided by function */
+
+	/** Number of interfaces used by function */
+	uint8_t iface_count;
+
+	/** Used for IAD (when @a iface_count > 1) */
+	uint8_t bFunctionClass;
+	uint8_t bFunctionSubClass;
+	uint8_t bFunctionProtocol;
+	uint8_t iFunction;
+
+	/** Endpoints required */
+	uint8_t ep_count;
+	const struct usbd_composite_ep *ep;
+
+	/**
+	 * Write interface, class specific and endpoint descriptors of function.
+	 * Interface number and endpoint address/size should be taken from the
+	 *  assigned part. usbd_composite_ep_descriptor() can be used to
+	 *  write standard endpoint descriptor.
+	 * @param[in] fn Function
+	 * @param[out] buf Buffer to write to
+	 * @param[in] len Length of @a buf
+	 * @return Number of bytes written
+	 * @return 0 if @a buf is not large enough
+	 */
+	uint16_t (*descriptor)(usbd_composite_function *fn, void *buf,
+					uint16_t len);
+
+	/**
+	 * Control request directed to one of the function interface/endpoint
+	 *  (Optional, can be NULL)
+	 * @return true if handled (ie data/status stage has been started)
+	 * @return false if not handled (will be stalled)
+	 */
+	bool (*setup)(usbd_composite_function *fn, usbd_device *dev,
+					const struct usb_setup_data *setup_data);
+
+	/**
+	 * Device has been configured, endpoints are prepared.
+	 *  Function can start its transfers. (Optional, can be NULL)
+	 */
+	void (*set_config)(usbd_composite_function *fn, usbd_device *dev);
+
+	/**
+	 * SET_INTERFACE on one of the function interface
+	 *  (Optional, can be NULL)
+	 */
+	void (*set_interface)(usbd_composite_function *fn, usbd_device *dev,
+					const struct usb_interface_descriptor *iface);
+
+	/** Private data of the function */
+	void *user_data;
+
+	/* Assigned */
+
+	/** Interface number of the first interface of function */
+	uint8_t first_iface;
+
+	/** Endpoint address (with direction), same order as @a ep */
+	uint8_t ep_addr[USBD_COMPOSITE_FUNCTION_EP_MAX];
+
+	/** Endpoint size (wMaxPacketSize), same order as @a ep */
+	uint16_t ep_size[USBD_COMPOSITE_FUNCTION_EP_MAX];
+
+	/** Flags passed to usbd_ep_prepare(), same order as @a ep */
+	usbd_ep_flags ep_flags[USBD_COMPOSITE_FUNCTION_EP_MAX];
+};
+
+/**
+ * Configuration parameters for usbd_composite_build()
+ */
+struct usbd_composite_config {
+	/** Speed the descriptor is generated for */
+	usbd_speed speed;
+
+	/** Number of endpoints supported by backend (including EP0) */
+	uint8_t ep_count;
+
+	/**
+	 * Backend the device will use (for the endpoint memory rounding,
+	 *  and if it support double buffering).
+	 *  (NULL = sizes counted as is, double buffering allowed)
+	 */
+	const usbd_backend *backend;
+
+	/**
+	 * Number of bytes of endpoint memory (excluding EP0).
+	 *  Sizes are reduced (if possible) to fit the memory and the
+	 *  remaining memory is used for double buffering.
+	 *  (0 = Do not care)
+	 */
+	uint16_t mem_size;
+
+	/* Configuration descriptor fields */
+	uint8_t bConfigurationValue;
+	uint8_t iConfiguration;
+	uint8_t bmAttributes;
+	uint8_t bMaxPower;
+};
+
+/**
+ * Composite device.
+ * @note Application only allocate the object, fields are private.
+ */
+struct usbd_composite {
+	usbd_composite_function *func[USBD_COMPOSITE_FUNCTION_MAX];
+	uint8_t func_count;
+
+	/** Index of owner function in @a func, using interface number as index */
+	uint8_t iface_owner[USBD_COMPOSITE_INTERFACE_MAX];
+
+	/** Index of owner function in @a func ([0]: OUT, [1]: IN) */
+	uint8_t ep_owner[2][16];
+
+	/** Buffer for the generated configuration descriptor */
+	uint8_t *desc;
+	uint16_t desc_size;
+};
+
+void usbd_composite_init(usbd_composite *comp, void *desc_buf,
+					uint16_t desc_buf_size);
+
+bool usbd_composite_add(usbd_composite *comp, usbd_composite_function *fn);
+
+const struct usb_config_descriptor *
+usbd_composite_build(usbd_composite *comp,
+					const struct usbd_composite_config *config);
+
+void usbd_composite_attach(usbd_composite *comp, usbd_device *dev);
+
+uint16_t usbd_composite_ep_descriptor(const usbd_composite_function *fn,
+					unsigned index, void *buf, uint16_t len);
+
+#endif
+
+/**@}*/
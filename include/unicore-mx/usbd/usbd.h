@@ -429,6 +429,28 @@ typedef void (*usbd_setup_callback)(usbd_device *dev, uint8_t addr,
 
 typedef void (* usbd_generic_callback)(usbd_device *dev);
 
+/** Offset value for a string descriptor provided at runtime */
+#define USBD_STRING_DYNAMIC 0xFFFF
+
+/**
+ * Packed string table (see scripts/usb-string-table.py)
+ * All descriptors are stored back to back in @a data.
+ */
+struct usbd_string_table {
+	/** String descriptors */
+	const uint8_t *data;
+
+	/**
+	 * Offset of descriptor in @a data.
+	 * Index: (lang * usbd_info_string::count) + (string index - 1)
+	 * USBD_STRING_DYNAMIC: send @a dynamic
+	 */
+	const uint16_t *offset;
+
+	/** Runtime generated descriptor (example: serial number) */
+	const struct usb_string_descriptor *dynamic;
+};
+
 struct usbd_info_string {
 	const struct usb_string_descriptor *lang_list;
 
@@ -444,6 +466,9 @@ struct usbd_info_string {
 	 * GET_DESCRIPTOR(string) index 255 convert to "data[lang][254]"
 	 */
 	const struct usb_string_descriptor ***data;
+
+	/* If not NULL, used instead of "data" */
+	const struct usbd_string_table *table;
 };
 
 struct usbd_info {
@@ -474,6 +499,10 @@ typedef struct usbd_info usbd_info;
  * @param[in] config Backend configuration (NULL for None)
  * @param[in] info Information
  * @return the usb device initialized for use.
+ * @note Every backend (peripheral) has its own device object and all the
+ *  stack state is kept in it, so different backends (example: OTG_FS and
+ *  OTG_HS) can be used at the same time, each polled (or interrupt driven)
+ *  independently.
  */
 usbd_device* usbd_init(const usbd_backend *backend,
 		const usbd_backend_config *config, const struct usbd_info *info);
@@ -774,6 +803,68 @@ void usbd_ep0_transfer(usbd_device *dev,
  */
 void usbd_ep0_stall(usbd_device *dev);
 
+enum usbd_control_handler_flags {
+	/** Match any wIndex */
+	USBD_CONTROL_HANDLER_NONE = 0,
+
+	/** Only match if wIndex is equal to usbd_control_handler::wIndex */
+	USBD_CONTROL_HANDLER_MATCH_INDEX = (1 << 0),
+
+	/**
+	 * Do not perform callback, send usbd_control_handler::data
+	 *  (device to host request only)
+	 */
+	USBD_CONTROL_HANDLER_CONST_DATA = (1 << 1)
+};
+
+typedef enum usbd_control_handler_flags usbd_control_handler_flags;
+
+/**
+ * Control request handler callback
+ * @param[in] dev USB Device
+ * @param[in] setup_data Setup Data
+ * @param[in] user_data Data passed to usbd_register_control_handlers()
+ * @return true if handled (data/status stage has been started or EP0 stalled)
+ * @return false to pass the request to the SETUP callback or usbd_ep0_setup()
+ */
+typedef bool (*usbd_control_handler_callback)(usbd_device *dev,
+		const struct usb_setup_data *setup_data, void *user_data);
+
+/**
+ * Entry of control request dispatch table.
+ * Table must be sorted (ascending) by (bmRequestType, bRequest).
+ * Entry with USBD_CONTROL_HANDLER_MATCH_INDEX take precedence over
+ *  entry without it for the same (bmRequestType, bRequest).
+ */
+struct usbd_control_handler {
+	uint8_t bmRequestType;
+	uint8_t bRequest;
+	uint16_t wIndex;
+	usbd_control_handler_flags flags;
+
+	/** Callback (used when USBD_CONTROL_HANDLER_CONST_DATA not set) */
+	usbd_control_handler_callback callback;
+
+	/** Data to send (used when USBD_CONTROL_HANDLER_CONST_DATA set) */
+	const void *data;
+	uint16_t length;
+};
+
+typedef struct usbd_control_handler usbd_control_handler;
+
+/**
+ * Register a dispatch table for control request on endpoint 0.
+ * The table is looked up (binary search) before SETUP callback and
+ *  usbd_ep0_setup(), so class and vendor request are resolved in one lookup.
+ * @param[in] dev USB Device
+ * @param[in] table Sorted handlers table (NULL to remove)
+ * @param[in] count Number of entries in @a table
+ * @param[in] user_data Passed to callbacks
+ * @note @a table need to be valid till it is registered.
+ */
+void usbd_register_control_handlers(usbd_device *dev,
+		const usbd_control_handler *table, unsigned count, void *user_data);
+
 END_DECLS
 
 #endif
@@ -0,0 +1,158 @@
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNICOREMX_USBH_CLASS_CDC_H
+#define UNICOREMX_USBH_CLASS_CDC_H
+
+#include <unicore-mx/usbh/usbh.h>
+#include <unicore-mx/usb/class/cdc.h>
+
+/**
+ * Number of CDC objects that can be initalized
+ *  (one per USB device)
+ */
+#if !defined(USBH_CDC_MAX)
+# define USBH_CDC_MAX 1
+#endif
+
+/**
+ * Size of receive buffer (bytes). Must be a power of 2.
+ */
+#if !defined(USBH_CDC_RX_BUFFER)
+# define USBH_CDC_RX_BUFFER 1024
+#endif
+
+/**
+ * Size of transmit buffer (bytes). Must be a power of 2.
+ */
+#if !defined(USBH_CDC_TX_BUFFER)
+# define USBH_CDC_TX_BUFFER 512
+#endif
+
+/**
+ * Largest bulk OUT endpoint size supported (bytes).
+ *  64 is enough for full speed devices.
+ */
+#if !defined(USBH_CDC_TX_PACKET_MAX)
+# define USBH_CDC_TX_PACKET_MAX 512
+#endif
+
+typedef struct usbh_cdc usbh_cdc;
+
+/**
+ * Called when new data has been received
+ * @param cdc CDC object
+ * @param available Number of bytes that can be read
+ */
+typedef void (*usbh_cdc_rx_callback)(usbh_cdc *cdc, unsigned available);
+
+/**
+ * Called when a control request complete
+ * @param cdc CDC object
+ * @param success Device accepted the request
+ */
+typedef void (*usbh_cdc_ctrl_callback)(usbh_cdc *cdc, bool success);
+
+/**
+ * Initalize the CDC object for an ACM interface and start receiving.
+ * @param dev USB Device (configured)
+ * @param interface bInterfaceNumber of the communication interface
+ * @param ep_in Bulk IN endpoint address (data interface)
+ * @param ep_in_size Bulk IN endpoint size
+ * @param ep_out Bulk OUT endpoint address (data interface)
+ * @param ep_out_size Bulk OUT endpoint size
+ * @param rx_callback Called when new data is received (can be NULL)
+ * @return CDC object
+ * @return NULL if no CDC object is free (or endpoint size not supported)
+ * @note Upto USBH_CDC_MAX USB devices can be handled.
+ * @note read/write functions are expected to be called from the same
+ *   context as usbh_poll()
+ */
+usbh_cdc *usbh_cdc_init(usbh_device *dev, uint8_t interface,
+	uint8_t ep_in, uint16_t ep_in_size,
+	uint8_t ep_out, uint16_t ep_out_size,
+	usbh_cdc_rx_callback rx_callback);
+
+/**
+ * Release the CDC object (ie on device disconnect)
+ * @param cdc CDC object
+ */
+void usbh_cdc_release(usbh_cdc *cdc);
+
+/**
+ * Retry the transfers that could not be started
+ *  (no host channel available). Call after usbh_poll().
+ * @param cdc CDC object
+ */
+void usbh_cdc_poll(usbh_cdc *cdc);
+
+/**
+ * Number of received bytes waiting to be read
+ * @param cdc CDC object
+ * @return number of bytes
+ */
+unsigned usbh_cdc_available(usbh_cdc *cdc);
+
+/**
+ * Read received data
+ * @param cdc CDC object
+ * @param buf Buffer
+ * @param len Size of @a buf
+ * @return number of bytes copied to @a buf
+ */
+unsigned usbh_cdc_read(usbh_cdc *cdc, void *buf, unsigned len);
+
+/**
+ * Free space in transmit buffer
+ * @param cdc CDC object
+ * @return number of bytes
+ */
+unsigned usbh_cdc_write_free(usbh_cdc *cdc);
+
+/**
+ * Queue data for transmission.
+ * Data written while a transfer is in progress is sent together
+ *  in the next transfer (full packets).
+ * @param cdc CDC object
+ * @param buf Data
+ * @param len Length of @a buf
+ * @return number of bytes queued
+ */
+unsigned usbh_cdc_write(usbh_cdc *cdc, const void *buf, unsigned len);
+
+/**
+ * Perform SET_LINE_CODING
+ * @param cdc CDC object
+ * @param coding Line coding
+ * @param callback Called when done (can be NULL)
+ * @return false if a control request is already in progress
+ */
+bool usbh_cdc_set_line_coding(usbh_cdc *cdc,
+	const struct usb_cdc_line_coding *coding, usbh_cdc_ctrl_callback callback);
+
+/**
+ * Perform SET_CONTROL_LINE_STATE
+ * @param cdc CDC object
+ * @param dtr Data Terminal Ready
+ * @param rts Request To Send
+ * @param callback Called when done (can be NULL)
+ * @return false if a control request is already in progress
+ */
+bool usbh_cdc_set_control_line_state(usbh_cdc *cdc, bool dtr, bool rts,
+	usbh_cdc_ctrl_callback callback);
+
+#endif
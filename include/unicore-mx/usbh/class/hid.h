@@ -23,6 +23,21 @@
 #include <unicore-mx/usbh/usbh.h>
 #include <unicore-mx/usb/class/hid.h>
 
+/**
+ * Maximum number of Usage (local item) before a main item
+ *  that the report descriptor parser keep track of
+ */
+#if !defined(USBH_HID_LOCAL_USAGE_MAX)
+# define USBH_HID_LOCAL_USAGE_MAX 16
+#endif
+
+/**
+ * Maximum number of report ID the report descriptor parser keep track of
+ */
+#if !defined(USBH_HID_REPORT_ID_MAX)
+# define USBH_HID_REPORT_ID_MAX 8
+#endif
+
 /**
  * Perform a SET_PROTOCOL @a protcol to @a dev on @a interface
  * @param dev USB Device
@@ -61,4 +76,153 @@ usbh_urb_id usbh_hid_get_report(usbh_device *dev, uint16_t type,
 usbh_urb_id usbh_hid_set_idle(usbh_device *dev, uint8_t duration,
 	uint8_t report_id, uint8_t interface, usbh_transfer_callback callback);
 
+/**
+ * Read the report descriptor of @a interface
+ * @param dev USB Device
+ * @param interface HID Interface
+ * @param buf Store report descriptor to
+ * @param len wDescriptorLength of HID descriptor
+ * @param callback Callback when done
+ * @return URB ID
+ */
+usbh_urb_id usbh_hid_read_report_desc(usbh_device *dev, uint8_t interface,
+	void *buf, uint16_t len, usbh_transfer_callback callback);
+
+/** Make a usage value from @a page and @a id */
+#define USBH_HID_USAGE(page, id) (((uint32_t) (page) << 16) | (id))
+
+/* Usage pages */
+#define USBH_HID_PAGE_GENERIC_DESKTOP	0x01
+#define USBH_HID_PAGE_KEYBOARD			0x07
+#define USBH_HID_PAGE_BUTTON			0x09
+#define USBH_HID_PAGE_DIGITIZER			0x0D
+
+/* Generic desktop usages */
+#define USBH_HID_USAGE_X		USBH_HID_USAGE(USBH_HID_PAGE_GENERIC_DESKTOP, 0x30)
+#define USBH_HID_USAGE_Y		USBH_HID_USAGE(USBH_HID_PAGE_GENERIC_DESKTOP, 0x31)
+#define USBH_HID_USAGE_Z		USBH_HID_USAGE(USBH_HID_PAGE_GENERIC_DESKTOP, 0x32)
+#define USBH_HID_USAGE_RX		USBH_HID_USAGE(USBH_HID_PAGE_GENERIC_DESKTOP, 0x33)
+#define USBH_HID_USAGE_RY		USBH_HID_USAGE(USBH_HID_PAGE_GENERIC_DESKTOP, 0x34)
+#define USBH_HID_USAGE_RZ		USBH_HID_USAGE(USBH_HID_PAGE_GENERIC_DESKTOP, 0x35)
+#define USBH_HID_USAGE_WHEEL	USBH_HID_USAGE(USBH_HID_PAGE_GENERIC_DESKTOP, 0x38)
+#define USBH_HID_USAGE_HAT		USBH_HID_USAGE(USBH_HID_PAGE_GENERIC_DESKTOP, 0x39)
+#define USBH_HID_USAGE_BUTTON(n)	USBH_HID_USAGE(USBH_HID_PAGE_BUTTON, (n))
+#define USBH_HID_USAGE_KEY(n)	USBH_HID_USAGE(USBH_HID_PAGE_KEYBOARD, (n))
+
+/** Field is signed (logical minimum is negative) */
+#define USBH_HID_FIELD_SIGNED	(1 << 0)
+/** Field report relative value (ie mouse movement) */
+#define USBH_HID_FIELD_RELATIVE	(1 << 1)
+/** Field is an array, value is 1 if the usage is present in any slot */
+#define USBH_HID_FIELD_ARRAY	(1 << 2)
+
+/**
+ * Extraction plan of one usage from input report.
+ * Compiled from report descriptor by usbh_hid_compile().
+ * @param report_id Report ID (0 if device do not use report ID)
+ * @param flags USBH_HID_FIELD_*
+ * @param size Field size in bits (0 if usage was not found)
+ * @param count Number of slots (array only)
+ * @param byte Offset of first byte in report (including report ID byte)
+ * @param shift Bit position in first byte
+ * @param index Array index value of the usage (array only)
+ * @param logical_min Logical minimum
+ * @param logical_max Logical maximum
+ */
+struct usbh_hid_field {
+	uint8_t report_id;
+	uint8_t flags;
+	uint8_t size;
+	uint8_t count;
+	uint16_t byte;
+	uint8_t shift;
+	int32_t index;
+	int32_t logical_min;
+	int32_t logical_max;
+};
+
+/**
+ * Compile report descriptor: build the extraction plan of
+ *  each usage in @a usages (Input items only)
+ * @param desc Report descriptor
+ * @param len Length of @a desc
+ * @param usages Usages of interest (USBH_HID_USAGE())
+ * @param[out] fields Extraction plan of each usage
+ * @param count Number of items in @a usages and @a fields
+ * @return number of usages found
+ * @note the first Input field of a usage is used
+ */
+unsigned usbh_hid_compile(const uint8_t *desc, unsigned len,
+	const uint32_t *usages, struct usbh_hid_field *fields, unsigned count);
+
+/**
+ * Extract a raw field value of @a size bits at @a shift in @a p
+ * @param p First byte
+ * @param shift Bit position in first byte
+ * @param size Size in bits (1 - 32)
+ * @param sign Sign extend the value
+ * @return value
+ */
+static inline int32_t usbh_hid_bits(const uint8_t *p, uint8_t shift,
+	uint8_t size, bool sign)
+{
+	unsigned bytes = (shift + size + 7) / 8;
+	uint64_t raw = 0;
+	unsigned i;
+
+	for (i = 0; i < bytes; i++) {
+		raw |= (uint64_t) p[i] << (i * 8);
+	}
+
+	uint32_t value = (uint32_t) (raw >> shift);
+	if (size < 32) {
+		value &= (1UL << size) - 1;
+		if (sign && (value & (1UL << (size - 1)))) {
+			value |= ~((1UL << size) - 1);
+		}
+	}
+
+	return (int32_t) value;
+}
+
+/**
+ * Get the value of @a field from an input report
+ * @param field Field (compiled with usbh_hid_compile())
+ * @param report Input report (including report ID byte)
+ * @param len Length of @a report
+ * @param[out] value Value
+ * @return false if the field is not in @a report
+ */
+static inline bool usbh_hid_field_value(const struct usbh_hid_field *field,
+	const uint8_t *report, unsigned len, int32_t *value)
+{
+	unsigned end = field->byte + (field->shift +
+		(unsigned) field->size * (field->count ? field->count : 1) + 7) / 8;
+
+	if (!field->size || end > len ||
+			(field->report_id && report[0] != field->report_id)) {
+		return false;
+	}
+
+	bool sign = field->flags & USBH_HID_FIELD_SIGNED;
+
+	if (!(field->flags & USBH_HID_FIELD_ARRAY)) {
+		*value = usbh_hid_bits(report + field->byte, field->shift,
+			field->size, sign);
+		return true;
+	}
+
+	unsigned i, bit = field->shift;
+	*value = 0;
+	for (i = 0; i < field->count; i++, bit += field->size) {
+		if (usbh_hid_bits(report + field->byte + (bit / 8), bit % 8,
+				field->size, sign) == field->index) {
+			*value = 1;
+			break;
+		}
+	}
+
+	return true;
+}
+
 #endif
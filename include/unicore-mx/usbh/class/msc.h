@@ -0,0 +1,166 @@
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNICOREMX_USBH_CLASS_MSC_H
+#define UNICOREMX_USBH_CLASS_MSC_H
+
+#include <unicore-mx/usbh/usbh.h>
+#include <unicore-mx/usb/class/msc.h>
+
+/**
+ * Number of MSC objects that can be initalized
+ *  (one per USB device)
+ */
+#if !defined(USBH_MSC_MAX)
+# define USBH_MSC_MAX 1
+#endif
+
+/**
+ * Number of read/write request that can be queued per MSC object.
+ * Must be a power of 2.
+ */
+#if !defined(USBH_MSC_QUEUE_LENGTH)
+# define USBH_MSC_QUEUE_LENGTH 4
+#endif
+
+/**
+ * Timeout (milliseconds) of each bulk transfer
+ *  (some drive take seconds to spin up or flush)
+ */
+#if !defined(USBH_MSC_TIMEOUT)
+# define USBH_MSC_TIMEOUT 5000
+#endif
+
+/**
+ * Number of TEST UNIT READY attempts (each followed by REQUEST SENSE)
+ *  before the drive is reported as not ready
+ */
+#if !defined(USBH_MSC_READY_RETRY)
+# define USBH_MSC_READY_RETRY 20
+#endif
+
+enum usbh_msc_status {
+	/** Success */
+	USBH_MSC_SUCCESS = 0,
+
+	/** Command failed, sense data available via usbh_msc_sense() */
+	USBH_MSC_ERR_CHECK = -1,
+
+	/** Transport error (drive has been reset) */
+	USBH_MSC_ERR_IO = -2,
+
+	/** Device is gone or MSC object has been released */
+	USBH_MSC_ERR_NO_DEVICE = -3,
+
+	/** Invalid request (out of range, drive not ready) */
+	USBH_MSC_ERR_INVALID = -4
+};
+
+typedef enum usbh_msc_status usbh_msc_status;
+
+typedef struct usbh_msc usbh_msc;
+
+/**
+ * Called when a request complete
+ * @param msc MSC object
+ * @param status Status
+ * @param user_data User data provided with request
+ */
+typedef void (*usbh_msc_callback)(usbh_msc *msc, usbh_msc_status status,
+	void *user_data);
+
+/**
+ * Initalize the MSC object for a Bulk-Only Transport (SCSI) interface.
+ * The drive is brought up (GET MAX LUN, TEST UNIT READY, READ CAPACITY)
+ *  and @a ready is called with the result.
+ * Only LUN 0 is used.
+ * @param dev USB Device (configured)
+ * @param interface bInterfaceNumber of the MSC interface
+ * @param ep_in Bulk IN endpoint address
+ * @param ep_in_size Bulk IN endpoint size
+ * @param ep_out Bulk OUT endpoint address
+ * @param ep_out_size Bulk OUT endpoint size
+ * @param ready Called when drive is ready (or failed)
+ * @param user_data Passed to @a ready
+ * @return MSC object
+ * @return NULL if no MSC object is free
+ * @note Upto USBH_MSC_MAX USB devices can be handled.
+ */
+usbh_msc *usbh_msc_init(usbh_device *dev, uint8_t interface,
+	uint8_t ep_in, uint16_t ep_in_size,
+	uint8_t ep_out, uint16_t ep_out_size,
+	usbh_msc_callback ready, void *user_data);
+
+/**
+ * Release the MSC object (ie on device disconnect).
+ * Queued request are completed with USBH_MSC_ERR_NO_DEVICE
+ * @param msc MSC object
+ */
+void usbh_msc_release(usbh_msc *msc);
+
+/**
+ * Get the drive capacity (valid after ready callback with success)
+ * @param msc MSC object
+ * @param[out] block_count Number of blocks
+ * @param[out] block_size Size of block (bytes)
+ * @return true if drive is ready
+ */
+bool usbh_msc_capacity(usbh_msc *msc, uint32_t *block_count,
+	uint32_t *block_size);
+
+/**
+ * Get the sense data of last failed command (USBH_MSC_ERR_CHECK)
+ * @param msc MSC object
+ * @param[out] key Sense key
+ * @param[out] asc Additional sense code
+ * @param[out] ascq Additional sense code qualifier
+ */
+void usbh_msc_sense(usbh_msc *msc, uint8_t *key, uint8_t *asc, uint8_t *ascq);
+
+/**
+ * Queue a READ(10) of @a count blocks from @a lba into @a buf.
+ * Data is transferred directly to @a buf.
+ * Request are executed in order, the next request start
+ *  as soon as the previous one complete.
+ * @param msc MSC object
+ * @param lba Logical block address
+ * @param count Number of blocks
+ * @param buf Buffer (atleast @a count * block size)
+ * @param callback Called when complete
+ * @param user_data Passed to @a callback
+ * @return true if queued
+ * @return false if queue is full or request is invalid
+ */
+bool usbh_msc_read(usbh_msc *msc, uint32_t lba, uint16_t count, void *buf,
+	usbh_msc_callback callback, void *user_data);
+
+/**
+ * Queue a WRITE(10) of @a count blocks to @a lba from @a buf.
+ * @param msc MSC object
+ * @param lba Logical block address
+ * @param count Number of blocks
+ * @param buf Data (@a count * block size)
+ * @param callback Called when complete
+ * @param user_data Passed to @a callback
+ * @return true if queued
+ * @return false if queue is full or request is invalid
+ * @see usbh_msc_read()
+ */
+bool usbh_msc_write(usbh_msc *msc, uint32_t lba, uint16_t count,
+	const void *buf, usbh_msc_callback callback, void *user_data);
+
+#endif
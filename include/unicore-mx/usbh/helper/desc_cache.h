@@ -0,0 +1,148 @@
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNICOREMX_USBH_HELPER_DESC_CACHE_H
+#define UNICOREMX_USBH_HELPER_DESC_CACHE_H
+
+#include <unicore-mx/usbh/usbh.h>
+#include <unicore-mx/usb/usbstd.h>
+
+/*
+ * Descriptor cache.
+ *
+ * Device and (first) configuration descriptor of recently seen devices
+ *  are kept in RAM, keyed by the device identity
+ *  (device descriptor and serial number string).
+ * When a known device is connected again, only the device descriptor
+ *  (and serial number string, if any) is read to verify the identity.
+ *  The configuration descriptor is served from the cache.
+ *
+ * Entries can be persisted (ie to flash) with a store callback and
+ *  restored at startup with usbh_desc_cache_load().
+ *
+ * A device that cannot be cached (configuration descriptor larger than
+ *  USBH_DESC_CACHE_CONFIG_MAX, serial number string not readable) is
+ *  reported with USBH_DESC_CACHE_NOT_CACHED: the device descriptor is
+ *  provided, the configuration descriptor has to be read by the caller.
+ */
+
+/**
+ * Number of devices that can be cached
+ */
+#if !defined(USBH_DESC_CACHE_ENTRIES)
+# define USBH_DESC_CACHE_ENTRIES 2
+#endif
+
+/**
+ * Maximum configuration descriptor (wTotalLength) that can be cached
+ */
+#if !defined(USBH_DESC_CACHE_CONFIG_MAX)
+# define USBH_DESC_CACHE_CONFIG_MAX 256
+#endif
+
+/**
+ * Number of devices that can be fetched at the same time
+ */
+#if !defined(USBH_DESC_CACHE_FETCH_MAX)
+# define USBH_DESC_CACHE_FETCH_MAX 1
+#endif
+
+/**
+ * Cached descriptors of one device
+ * @param device Device descriptor
+ * @param serial Hash of serial number string descriptor (0 if no serial)
+ * @param config_length Length of @a config (0 if entry is unused)
+ * @param config Configuration descriptor (index 0) with all
+ *   interface, endpoint and class descriptors
+ */
+struct usbh_desc_cache_entry {
+	struct usb_device_descriptor device;
+	uint32_t serial;
+	uint16_t config_length;
+	uint8_t config[USBH_DESC_CACHE_CONFIG_MAX];
+};
+
+enum usbh_desc_cache_status {
+	/** Entry was already in the cache
+	 *  (configuration descriptor was not read from device) */
+	USBH_DESC_CACHE_HIT = 1,
+
+	/** Configuration descriptor read from device and added to the cache */
+	USBH_DESC_CACHE_MISS = 0,
+
+	/** Device cannot be cached, only the device descriptor is provided
+	 *  (config_length is 0) */
+	USBH_DESC_CACHE_NOT_CACHED = -1,
+
+	/** Device descriptor could not be read (entry is NULL) */
+	USBH_DESC_CACHE_ERR = -2
+};
+
+typedef enum usbh_desc_cache_status usbh_desc_cache_status;
+
+/**
+ * Called when descriptors are available
+ * @param dev USB Device
+ * @param entry Descriptors (NULL on USBH_DESC_CACHE_ERR)
+ * @param status Fetch status
+ * @note @a entry remain valid till the next usbh_desc_cache_fetch()
+ */
+typedef void (*usbh_desc_cache_callback)(usbh_device *dev,
+	const struct usbh_desc_cache_entry *entry, usbh_desc_cache_status status);
+
+/**
+ * Called when an entry is added to the cache (to persist it)
+ * @param index Entry index (0 to USBH_DESC_CACHE_ENTRIES - 1)
+ * @param entry Entry
+ */
+typedef void (*usbh_desc_cache_store_callback)(unsigned index,
+	const struct usbh_desc_cache_entry *entry);
+
+/**
+ * Get the device and configuration descriptor of @a dev.
+ * The device descriptor (and serial number) is always read from device,
+ *  the configuration descriptor only if the device is not in the cache
+ *  (and not at all if the device cannot be cached).
+ * @param dev USB Device (addressed, not configured)
+ * @param callback Called when done
+ * @return false if no fetch object is free
+ */
+bool usbh_desc_cache_fetch(usbh_device *dev, usbh_desc_cache_callback callback);
+
+/**
+ * Register a callback to persist new entries
+ * @param store Callback (NULL to disable)
+ */
+void usbh_desc_cache_register_store_callback(
+	usbh_desc_cache_store_callback store);
+
+/**
+ * Restore an entry (ie from flash at startup)
+ * @param index Entry index (0 to USBH_DESC_CACHE_ENTRIES - 1)
+ * @param entry Entry (as provided to store callback)
+ * @return false if @a index or @a entry is invalid
+ */
+bool usbh_desc_cache_load(unsigned index,
+	const struct usbh_desc_cache_entry *entry);
+
+/**
+ * Remove an entry (ie device firmware updated, SET_CONFIGURATION failed)
+ * @param entry Entry (as provided to fetch callback)
+ */
+void usbh_desc_cache_invalidate(const struct usbh_desc_cache_entry *entry);
+
+#endif
@@ -127,7 +127,16 @@ enum usbh_transfer_flags {
 	 * Do not perform success callback.
 	 * No callback with transfer status = USBH_SUCCESS will be performed.
 	 */
-	USBH_FLAG_NO_SUCCESS_CALLBACK = (1 << 4)
+	USBH_FLAG_NO_SUCCESS_CALLBACK = (1 << 4),
+
+	/**
+	 * Isochronous only: usbh_transfer::iso_packets is used as a ring.
+	 * After the last packet, the transfer continue with the first packet
+	 *  (till cancelled). The transfer never complete with USBH_SUCCESS.
+	 * Use with USBH_FLAG_PER_PACKET_CALLBACK to consume (IN)
+	 *  or provide (OUT) the packets.
+	 */
+	USBH_FLAG_ISO_RING = (1 << 5)
 };
 
 typedef enum usbh_transfer_flags usbh_transfer_flags;
@@ -185,6 +194,22 @@ enum usbh_transfer_status {
 
 typedef enum usbh_transfer_status usbh_transfer_status;
 
+/**
+ * Isochronous packet descriptor.
+ * One packet is transferred per interval, packet @a n use the data at
+ *  (usbh_transfer::data + n * usbh_transfer::ep_size).
+ */
+struct usbh_iso_packet {
+	/** Number of bytes.
+	 *  OUT: to transmit (provided by application)
+	 *  IN: received (set by library) */
+	uint16_t length;
+
+	/** Packet status (set by library).
+	 *  A failed packet do not fail the transfer. */
+	usbh_transfer_status status;
+};
+
 /* Though this is ugly but could be useful in future. */
 typedef uint64_t usbh_urb_id;
 
@@ -240,6 +265,19 @@ struct usbh_transfer {
 	/** Setup data (control endpoint only) */
 	struct usb_setup_data setup;
 
+	/** Packet descriptors (isochronous endpoint only).
+	 *  @a data should be atleast (@a iso_count * @a ep_size) bytes */
+	struct usbh_iso_packet *iso_packets;
+
+	/** Number of @a iso_packets */
+	uint16_t iso_count;
+
+	/** Packet of the USBH_ONE_PACKET_DATA callback (isochronous only).
+	 *  IN: packet that has been received, OUT: packet to be transmitted
+	 *  @warning Manipulated by library internally. not accepted from user
+	 */
+	uint16_t iso_index;
+
 	/** User can keep any pointer that it may require later */
 	void *user_data;
 };
@@ -271,7 +309,12 @@ struct usbh_backend_config {
 		USBH_FEATURE_NONE = 0,
 		USBH_PHY_EXT = (1 << 0),
 		USBH_VBUS_SENSE = (1 << 1),
-		USBH_VBUS_EXT = (1 << 2)
+		USBH_VBUS_EXT = (1 << 2),
+
+		/* Internal DMA (OTG_HS only).
+		 *  Data is transferred by the core directly from/to transfer buffer
+		 *  (word aligned buffer, or copied via a small per channel buffer) */
+		USBH_DMA = (1 << 3)
 	} feature;
 };
 
@@ -313,6 +356,9 @@ usbh_device *usb_device_by_address(usbh_host *host, uint8_t address);
  * @param us Number of microseconds passed since the last poll or init
  * @note it is recommended to poll every millisecond
  * @note it is recommended to provide atleast 0.1ms resolution in @a us
+ * @note periodic transfer are scheduled on start of frame.
+ *   For exact (micro)frame scheduling, call from the peripheral interrupt
+ *   handler (DWC OTG unmask the SOF interrupt for the purpose).
  */
 void usbh_poll(usbh_host *host, uint32_t us);
 
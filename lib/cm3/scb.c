@@ -43,3 +43,114 @@ void scb_set_priority_grouping(uint32_t prigroup)
 	SCB_AIRCR = SCB_AIRCR_VECTKEY | prigroup;
 }
 #endif
+
+/* Those are defined only on CM3, CM4 or CM7. Caches are only present on CM7,
+ * range operations do nothing while the D-cache is disabled. */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+static inline void scb_dsb_isb(void)
+{
+	__asm__ volatile ("dsb\n\tisb" : : : "memory");
+}
+
+/* Apply a set/way operation to every line of the L1 D-cache */
+static void scb_dcache_set_way(volatile uint32_t *op)
+{
+	uint32_t ccsidr, sets, ways, way_shift, line_shift;
+	uint32_t set, way;
+
+	SCB_CSSELR = 0; /* L1 data cache */
+	scb_dsb_isb();
+	ccsidr = SCB_CCSIDR;
+
+	sets = (ccsidr & SCB_CCSIDR_NUMSETS) >> SCB_CCSIDR_NUMSETS_SHIFT;
+	ways = (ccsidr & SCB_CCSIDR_ASSOCIATIVITY) >>
+		SCB_CCSIDR_ASSOCIATIVITY_SHIFT;
+	line_shift = (ccsidr & SCB_CCSIDR_LINESIZE) + 4;
+	way_shift = ways ? __builtin_clz(ways) : 0;
+
+	for (set = 0; set <= sets; set++) {
+		for (way = 0; way <= ways; way++) {
+			*op = (way << way_shift) | (set << line_shift);
+		}
+	}
+
+	scb_dsb_isb();
+}
+
+/* Apply an address operation to every line covering [addr, addr + len) */
+static void scb_dcache_range(volatile uint32_t *op, uintptr_t addr,
+			     uint32_t len)
+{
+	uintptr_t end = addr + len;
+
+	if (!len || !(SCB_CCR & SCB_CCR_DC)) {
+		return;
+	}
+
+	addr &= ~(uintptr_t)(SCB_DCACHE_LINE_SIZE - 1);
+
+	__asm__ volatile ("dsb" : : : "memory");
+	for (; addr < end; addr += SCB_DCACHE_LINE_SIZE) {
+		*op = addr;
+	}
+	scb_dsb_isb();
+}
+
+void scb_enable_icache(void)
+{
+	if (SCB_CCR & SCB_CCR_IC) {
+		return;
+	}
+
+	scb_dsb_isb();
+	SCB_ICIALLU = 0;
+	scb_dsb_isb();
+	SCB_CCR |= SCB_CCR_IC;
+	scb_dsb_isb();
+}
+
+void scb_disable_icache(void)
+{
+	scb_dsb_isb();
+	SCB_CCR &= ~SCB_CCR_IC;
+	SCB_ICIALLU = 0;
+	scb_dsb_isb();
+}
+
+void scb_enable_dcache(void)
+{
+	if (SCB_CCR & SCB_CCR_DC) {
+		return;
+	}
+
+	scb_dcache_set_way(&SCB_DCISW);
+	SCB_CCR |= SCB_CCR_DC;
+	scb_dsb_isb();
+}
+
+void scb_disable_dcache(void)
+{
+	if (!(SCB_CCR & SCB_CCR_DC)) {
+		return;
+	}
+
+	SCB_CCR &= ~SCB_CCR_DC;
+	scb_dsb_isb();
+	scb_dcache_set_way(&SCB_DCCISW);
+}
+
+void scb_clean_dcache_range(const void *addr, uint32_t len)
+{
+	scb_dcache_range(&SCB_DCCMVAC, (uintptr_t)addr, len);
+}
+
+void scb_invalidate_dcache_range(void *addr, uint32_t len)
+{
+	scb_dcache_range(&SCB_DCIMVAC, (uintptr_t)addr, len);
+}
+
+void scb_clean_invalidate_dcache_range(void *addr, uint32_t len)
+{
+	scb_dcache_range(&SCB_DCCIMVAC, (uintptr_t)addr, len);
+}
+#endif
@@ -0,0 +1,335 @@
+/** @defgroup ethernet_lwip_netif_file lwIP netif
+ *
+ * @ingroup ETH
+ *
+ * @brief <b>lwIP network interface on the zero copy MAC API</b>
+ *
+ * Not built into the library: add this file to the application, next to
+ * its lwIP sources.
+ *
+ * Initialization order:
+ * eth_init(), eth_pool_init(), eth_ring_init(), netif_add() with
+ * eth_netif_init(), then eth_start(). eth_netif_poll() has to be called
+ * from the lwIP context (main loop with NO_SYS, tcpip thread otherwise),
+ * ie. when eth_rx_irq() returned true and periodically.
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <unicore-mx/ethernet/lwip_netif.h>
+
+#include "lwip/opt.h"
+#include "lwip/stats.h"
+#include "lwip/etharp.h"
+#include "netif/ethernet.h"
+
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "lwip_netif needs LWIP_SUPPORT_CUSTOM_PBUF"
+#endif
+
+#if ETH_PAD_SIZE > ETH_RX_OFFSET
+#error "ETH_PAD_SIZE larger than the room in front of the received frames"
+#endif
+
+/**@{*/
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give back the buffer of a received frame, when freed by lwIP
+ */
+static void eth_netif_pbuf_free(struct pbuf *p)
+{
+	struct eth_netif_pbuf *rx = (struct eth_netif_pbuf *)p;
+	struct eth_pool *pool = rx->state->pool;
+	uint32_t idx = rx - rx->state->pbufs;
+
+	eth_pool_free(pool, pool->start + idx * pool->size);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Release a pbuf sent without copy (eth_tx_release_callback)
+ *
+ * Called by the MAC for each segment, in the order they were queued. The
+ * pbuf chain is freed with its last segment.
+ */
+static void eth_netif_tx_release(void *arg, void *buf)
+{
+	struct eth_netif *state = arg;
+	uint32_t i = state->tx_tail % ETH_NETIF_TX_FRAMES;
+
+	(void)buf;
+
+	if (state->tx_tail == state->tx_head) {
+		return;
+	}
+
+	if (--state->tx_left[i] == 0) {
+		pbuf_free(state->tx_pbuf[i]);
+		state->tx_tail++;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue a copy of the frame in a pool buffer
+ */
+static err_t eth_netif_output_copy(struct eth_netif *state, struct pbuf *p)
+{
+	struct eth_pool *pool = state->pool;
+	uint32_t len = p->tot_len - ETH_PAD_SIZE;
+	struct eth_tx_seg seg;
+	uint8_t *buf;
+
+	if (len > pool->size - ETH_RX_OFFSET) {
+		LINK_STATS_INC(link.lenerr);
+		return ERR_BUF;
+	}
+
+	buf = eth_pool_alloc(pool);
+	if (buf == NULL) {
+		eth_tx_reclaim();
+		buf = eth_pool_alloc(pool);
+		if (buf == NULL) {
+			LINK_STATS_INC(link.memerr);
+			return ERR_MEM;
+		}
+	}
+
+	/* same offset as the received frames, word aligned on the LM3S FIFO */
+	seg.buf = buf + ETH_RX_OFFSET;
+	seg.len = len;
+	pbuf_copy_partial(p, seg.buf, len, ETH_PAD_SIZE);
+
+	if (!eth_tx_queue(&seg, 1)) {
+		eth_pool_free(pool, buf);
+		LINK_STATS_INC(link.drop);
+		return ERR_MEM;
+	}
+
+	return ERR_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue the pbuf chain itself, one segment per pbuf
+ *
+ * The chain is referenced till the MAC gives back its last segment.
+ * Returns ERR_ARG if the chain has to be copied: too many pbufs, no room
+ * to track the frame, or a pbuf in the pool (ie. a received frame sent
+ * back by lwIP), that the MAC would give back to the pool.
+ */
+static err_t eth_netif_output_ref(struct eth_netif *state, struct pbuf *p)
+{
+	struct eth_tx_seg seg[ETH_NETIF_TX_SEGS];
+	uint32_t count = 0, skip = ETH_PAD_SIZE, i;
+	struct pbuf *q;
+
+	if (state->tx_head - state->tx_tail >= ETH_NETIF_TX_FRAMES) {
+		eth_tx_reclaim();
+		if (state->tx_head - state->tx_tail >= ETH_NETIF_TX_FRAMES) {
+			return ERR_ARG;
+		}
+	}
+
+	for (q = p; q != NULL; q = q->next) {
+		if (q->len <= skip) {
+			skip -= q->len;
+			continue;
+		}
+
+		if (count == ETH_NETIF_TX_SEGS ||
+		    eth_pool_owns(state->pool, q->payload)) {
+			return ERR_ARG;
+		}
+
+		seg[count].buf = (uint8_t *)q->payload + skip;
+		seg[count].len = q->len - skip;
+		count++;
+		skip = 0;
+	}
+
+	if (count == 0) {
+		return ERR_ARG;
+	}
+
+	if (!eth_tx_queue(seg, count)) {
+		LINK_STATS_INC(link.drop);
+		return ERR_MEM;
+	}
+
+	pbuf_ref(p);
+	i = state->tx_head % ETH_NETIF_TX_FRAMES;
+	state->tx_pbuf[i] = p;
+	state->tx_left[i] = count;
+	state->tx_head++;
+
+	return ERR_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Transmit a frame (netif linkoutput)
+ *
+ * The pbuf chain is handed to the MAC without copy when possible (see
+ * eth_netif_output_ref()), copied otherwise. During eth_netif_poll() the
+ * frames are only queued, and the transmit DMA is started once at its end.
+ */
+static err_t eth_netif_output(struct netif *netif, struct pbuf *p)
+{
+	struct eth_netif *state = netif->state;
+	err_t err = eth_netif_output_ref(state, p);
+
+	if (err == ERR_ARG) {
+		err = eth_netif_output_copy(state, p);
+	}
+
+	if (err != ERR_OK) {
+		return err;
+	}
+
+	if (!state->tx_batch) {
+		eth_tx_flush();
+	}
+
+	LINK_STATS_INC(link.xmit);
+	return ERR_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the network interface
+ *
+ * To be given to netif_add(), with @a state pointing to a struct eth_netif.
+ * The MAC address is set, and the checksums are left to the MAC if it is
+ * able to (ETH_CHECKSUM_OFFLOAD, needs LWIP_CHECKSUM_CTRL_PER_NETIF).
+ *
+ * @param[in] netif struct netif* Network interface
+ * @returns err_t ERR_OK
+ */
+err_t eth_netif_init(struct netif *netif)
+{
+	struct eth_netif *state = netif->state;
+	uint32_t i, count = (state->pool->end - state->pool->start) /
+			    state->pool->size;
+
+	for (i = 0; i < count; i++) {
+		state->pbufs[i].pbuf.custom_free_function = eth_netif_pbuf_free;
+		state->pbufs[i].state = state;
+	}
+
+	state->tx_head = 0;
+	state->tx_tail = 0;
+	state->tx_batch = false;
+	eth_set_tx_release_callback(eth_netif_tx_release, state);
+
+	netif->name[0] = 'e';
+	netif->name[1] = 'n';
+	netif->hwaddr_len = ETH_HWADDR_LEN;
+	memcpy(netif->hwaddr, state->mac, ETH_HWADDR_LEN);
+	netif->mtu = 1500;
+	netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP |
+		       NETIF_FLAG_ETHERNET | NETIF_FLAG_IGMP;
+#if LWIP_IPV4
+	netif->output = etharp_output;
+#endif
+	netif->linkoutput = eth_netif_output;
+
+	eth_set_mac(state->mac);
+
+#if ETH_CHECKSUM_OFFLOAD
+	eth_enable_checksum_offload();
+	NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_DISABLE_ALL);
+#endif
+
+	return ERR_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give the received frames to lwIP
+ *
+ * Up to @a budget frames are passed to netif->input() in their receive
+ * buffer. Frames sent by lwIP meanwhile are started together at the end,
+ * and the transmitted buffers are reclaimed.
+ *
+ * @param[in] netif struct netif* Network interface
+ * @param[in] budget uint32_t Maximum number of frames (ie. ETH_RX_BUDGET)
+ * @returns uint32_t Number of frames received
+ */
+uint32_t eth_netif_poll(struct netif *netif, uint32_t budget)
+{
+	struct eth_netif *state = netif->state;
+	struct eth_pool *pool = state->pool;
+	uint32_t n;
+
+	state->tx_batch = true;
+
+	for (n = 0; n < budget; n++) {
+		uint32_t len, idx;
+		uint8_t *frame = eth_rx_buf(&len);
+		uint8_t *base;
+		struct pbuf *p;
+
+		if (frame == NULL) {
+			break;
+		}
+
+		idx = (frame - pool->start) / pool->size;
+		base = pool->start + idx * pool->size;
+
+		p = pbuf_alloced_custom(PBUF_RAW,
+				len - ETH_RX_FCS_LEN + ETH_PAD_SIZE,
+				PBUF_REF, &state->pbufs[idx].pbuf,
+				frame - ETH_PAD_SIZE,
+				pool->size - (frame - ETH_PAD_SIZE - base));
+		if (p == NULL) {
+			eth_pool_free(pool, frame);
+			LINK_STATS_INC(link.lenerr);
+			continue;
+		}
+
+		LINK_STATS_INC(link.recv);
+
+		if (netif->input(p, netif) != ERR_OK) {
+			pbuf_free(p);
+			LINK_STATS_INC(link.drop);
+		}
+	}
+
+	state->tx_batch = false;
+
+	eth_tx_flush();
+	eth_tx_reclaim();
+	eth_rx_refill();
+
+	return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Follow the link state, ie. from the phy_link_callback
+ *
+ * @param[in] netif struct netif* Network interface
+ * @param[in] status enum phy_status Link status
+ */
+void eth_netif_set_link(struct netif *netif, enum phy_status status)
+{
+	if (status == LINK_DOWN) {
+		netif_set_link_down(netif);
+	} else {
+		netif_set_link_up(netif);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+
+/**@}*/
@@ -30,11 +30,96 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
 #include <unicore-mx/ethernet/mac.h>
 #include <unicore-mx/ethernet/phy.h>
+#include <unicore-mx/cm3/scb.h>
 
 /**@{*/
 
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize buffer pool
+ *
+ * The memory is split in @a count buffers of @a size bytes (rounded up to
+ * a multiple of 4, of the cache line on STM32F7). Free buffers are linked
+ * through their first word.
+ *
+ * @param[out] pool struct eth_pool* Pool to initialize
+ * @param[in] mem void* Memory for the buffers (word aligned,
+ *   SCB_DCACHE_ALIGNED on STM32F7)
+ * @param[in] count uint32_t Number of buffers
+ * @param[in] size uint32_t Size of each buffer
+ */
+void eth_pool_init(struct eth_pool *pool, void *mem, uint32_t count,
+		   uint32_t size)
+{
+	uint8_t *p = mem;
+
+#if defined(STM32F7)
+	/* buffers must not share a cache line (D-cache maintenance) */
+	size = (size + SCB_DCACHE_LINE_SIZE - 1) & ~(SCB_DCACHE_LINE_SIZE - 1);
+#else
+	size = (size + 3) & ~3;
+#endif
+
+	pool->free = NULL;
+	pool->size = size;
+	pool->avail = 0;
+	pool->start = p;
+	pool->end = p + count * size;
+
+	while (count--) {
+		eth_pool_free(pool, p);
+		p += size;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Take a buffer from the pool
+ *
+ * @param[in] pool struct eth_pool* Pool
+ * @returns void* Buffer, NULL if the pool is empty
+ */
+void *eth_pool_alloc(struct eth_pool *pool)
+{
+	void **buf = pool->free;
+
+	if (buf != NULL) {
+		pool->free = *buf;
+		pool->avail--;
+	}
+
+	return buf;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give back a buffer to the pool
+ *
+ * @param[in] pool struct eth_pool* Pool
+ * @param[in] buf void* Buffer returned by eth_pool_alloc(), or any pointer
+ * inside it (ie. a frame at ETH_RX_OFFSET)
+ */
+void eth_pool_free(struct eth_pool *pool, void *buf)
+{
+	uint32_t off = (uint8_t *)buf - pool->start;
+
+	buf = pool->start + off - (off % pool->size);
+	*(void **)buf = pool->free;
+	pool->free = buf;
+	pool->avail++;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Check if the buffer belongs to the pool
+ *
+ * @param[in] pool struct eth_pool* Pool
+ * @param[in] buf void* Buffer
+ * @returns bool true, if @a buf is inside the pool memory
+ */
+bool eth_pool_owns(struct eth_pool *pool, void *buf)
+{
+	return (uint8_t *)buf >= pool->start && (uint8_t *)buf < pool->end;
+}
 
 /*---------------------------------------------------------------------------*/
 
@@ -1,5 +1,6 @@
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <unicore-mx/ethernet/mac.h>
 #include <unicore-mx/ethernet/phy.h>
 #include <unicore-mx/cm3/nvic.h>
@@ -16,12 +17,532 @@ void eth_set_mac(uint8_t *mac)
     ETH_MAC_ADDR1 = (mac[4]<< 24) | (mac[6] << 16);
 }
 
+/* The PHY is internal, its address is ignored by the MII management */
+
+void eth_smi_start(uint8_t phy, uint8_t reg, bool write, uint16_t data)
+{
+    (void)phy;
+    if (write) {
+        ETH_MAC_MTXD = data;
+    }
+
+    ETH_MAC_MCTL = (reg << ETH_MCTL_REGADR_SHIFT) |
+                   (write ? ETH_MCTL_WRITE : 0) | ETH_MCTL_START;
+}
+
+bool eth_smi_busy(void)
+{
+    return ETH_MAC_MCTL & ETH_MCTL_START;
+}
+
+uint16_t eth_smi_data(void)
+{
+    return ETH_MAC_MRXD & 0xFFFF;
+}
+
+void eth_smi_write(uint8_t phy, uint8_t reg, uint16_t data)
+{
+    while (eth_smi_busy());
+    eth_smi_start(phy, reg, true, data);
+    while (eth_smi_busy());
+}
+
+uint16_t eth_smi_read(uint8_t phy, uint8_t reg)
+{
+    while (eth_smi_busy());
+    eth_smi_start(phy, reg, false, 0);
+    while (eth_smi_busy());
+    return eth_smi_data();
+}
+
+void eth_smi_bit_op(uint8_t phy, uint8_t reg, uint16_t bits, uint16_t mask)
+{
+    uint16_t val = eth_smi_read(phy, reg);
+    eth_smi_write(phy, reg, (val & mask) | bits);
+}
+
+void eth_smi_bit_clear(uint8_t phy, uint8_t reg, uint16_t clearbits)
+{
+    uint16_t val = eth_smi_read(phy, reg);
+    eth_smi_write(phy, reg, val & (uint16_t)~(clearbits));
+}
+
+void eth_smi_bit_set(uint8_t phy, uint8_t reg, uint16_t setbits)
+{
+    uint16_t val = eth_smi_read(phy, reg);
+    eth_smi_write(phy, reg, val | setbits);
+}
+
+/* The speed follows the PHY, only the duplex mode has to be set */
+void eth_set_link(bool fast, bool fd)
+{
+    (void)fast;
+    if (fd)
+        ETH_MAC_TCTL |= ETH_TCTL_DUPLEX;
+    else
+        ETH_MAC_TCTL &= ~ETH_TCTL_DUPLEX;
+}
+
 // void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx, uint32_t cRx, bool isext);
 
+/* Software frame rings
+ *
+ * The MAC has no DMA, frames are moved between the FIFOs and pool buffers
+ * by eth_rx_irq(). Every index is written by one side only (interrupt or
+ * application) and only counts up, so the rings need no locking.
+ *
+ * RX: RxFill (app) - buffers given to the ring, RxHead (irq) - frames
+ *     received, RxTail (app) - frames taken by the application.
+ * TX: TxHead (app) - segments queued, TxSent (irq) - segments written to
+ *     the FIFO, TxTail (app) - segments released.
+ */
+
+struct eth_slot {
+    void *buf;
+    uint16_t len;
+    uint16_t last;
+};
+
+static struct eth_pool *RingPool;
+static eth_tx_release_callback TxRelease;
+static void *TxReleaseArg;
+static volatile struct eth_slot *TxSlot;
+static volatile struct eth_slot *RxSlot;
+static uint32_t TxCount, RxCount;
+static volatile uint32_t TxHead, TxSent, TxTail;
+static volatile uint32_t RxFill, RxHead, RxTail;
+static volatile struct eth_rx_stats RxStats;
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the software frame rings (zero copy API)
+ *
+ * Once called, eth_tx() and eth_rx() copy through the rings. The ETH
+ * interrupt has to be enabled in the NVIC and call eth_rx_irq().
+ *
+ * @param[in] desc uint8_t* Memory for (nTx + nRx) * ETH_RING_SLOT_SIZE bytes
+ * @param[in] nTx uint32_t Count of transmit segments
+ * @param[in] nRx uint32_t Count of receive frames
+ * @param[in] isext bool Unused, there are no descriptors
+ * @param[in] pool struct eth_pool* Buffers, word aligned and at least
+ * ETH_RX_OFFSET + 1518 bytes (rounded up to a word) large
+ */
+void eth_ring_init(uint8_t *desc, uint32_t nTx, uint32_t nRx, bool isext,
+                   struct eth_pool *pool)
+{
+    (void)isext;
+
+    ETH_MAC_IM &= ~(ETH_INT_RXC | ETH_INT_TXC | ETH_INT_TXE | ETH_INT_RXO);
+
+    TxSlot = (struct eth_slot *)desc;
+    RxSlot = TxSlot + nTx;
+    TxCount = nTx;
+    RxCount = nRx;
+    TxHead = TxSent = TxTail = 0;
+    RxFill = RxHead = RxTail = 0;
+    memset((void *)&RxStats, 0, sizeof(RxStats));
+    RingPool = pool;
+
+    eth_rx_refill();
+
+    ETH_MAC_RISACK = ETH_INT_RXC | ETH_INT_TXC | ETH_INT_TXE | ETH_INT_RXO;
+    ETH_MAC_IM |= ETH_INT_RXC | ETH_INT_TXC | ETH_INT_TXE | ETH_INT_RXO;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the callback for transmitted buffers not owned by the pool
+ *
+ * @param[in] release eth_tx_release_callback Callback (NULL to ignore)
+ * @param[in] arg void* First argument of @a release
+ */
+void eth_set_tx_release_callback(eth_tx_release_callback release, void *arg)
+{
+    TxRelease = release;
+    TxReleaseArg = arg;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue a frame made of several buffers (zero copy API)
+ *
+ * The buffers are gathered into the transmit FIFO by eth_rx_irq() after
+ * eth_tx_flush(), and given back by eth_tx_reclaim().
+ *
+ * @param[in] seg const struct eth_tx_seg* Segments of the frame
+ * @param[in] count uint32_t Number of segments
+ * @returns bool true, if the frame was queued
+ */
+bool eth_tx_queue(const struct eth_tx_seg *seg, uint32_t count)
+{
+    uint32_t i, n = 0;
+
+    for (i = 0; i < count; i++) {
+        n += seg[i].len;
+    }
+
+    if (count == 0 || n < 14 || n > (2048 - 2)) {
+        return false;
+    }
+
+    if (TxHead - TxTail + count > TxCount) {
+        eth_tx_reclaim();
+        if (TxHead - TxTail + count > TxCount) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        volatile struct eth_slot *s = &TxSlot[(TxHead + i) % TxCount];
+        s->buf = seg[i].buf;
+        s->len = seg[i].len;
+        s->last = (i == count - 1);
+    }
+
+    /* publish the whole frame at once */
+    TxHead += count;
+    return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Let the interrupt handler write the queued frames to the FIFO
+ */
+void eth_tx_flush(void)
+{
+    nvic_set_pending_irq(NVIC_ETH_IRQ);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Transmit a buffer (zero copy API)
+ *
+ * @param[in] buf void* Frame
+ * @param[in] len uint32_t Length of the frame
+ * @returns bool true, if the frame was queued
+ */
+bool eth_tx_buf(void *buf, uint32_t len)
+{
+    struct eth_tx_seg seg = { buf, len };
+
+    if (!eth_tx_queue(&seg, 1)) {
+        return false;
+    }
+
+    eth_tx_flush();
+    return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give back the buffers written to the FIFO
+ *
+ * @returns uint32_t Number of buffers released
+ */
+uint32_t eth_tx_reclaim(void)
+{
+    uint32_t n = 0;
+
+    while (TxTail != TxSent) {
+        void *buf = TxSlot[TxTail % TxCount].buf;
+
+        if (eth_pool_owns(RingPool, buf)) {
+            eth_pool_free(RingPool, buf);
+        } else if (TxRelease != NULL) {
+            TxRelease(TxReleaseArg, buf);
+        }
+
+        TxTail++;
+        n++;
+    }
+
+    return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Pack bytes into FIFO words
+ *
+ * @a word holds @a count pending bytes. Word aligned data is written
+ * directly once no byte is pending.
+ */
+static void eth_fifo_put(uint32_t *word, uint32_t *count,
+                         const uint8_t *data, uint32_t len)
+{
+    while (len) {
+        if (*count == 0 && ((uintptr_t)data & 3) == 0) {
+            const uint32_t *p = (const uint32_t *)data;
+
+            for (; len >= 4; len -= 4) {
+                ETH_MAC_DATA = *p++;
+            }
+
+            data = (const uint8_t *)p;
+            if (len == 0) {
+                break;
+            }
+        }
+
+        *word |= (uint32_t)*data++ << (8 * *count);
+        len--;
+
+        if (++*count == 4) {
+            ETH_MAC_DATA = *word;
+            *word = 0;
+            *count = 0;
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write the next queued frame to the transmit FIFO
+ */
+static void eth_tx_fill(void)
+{
+    volatile struct eth_slot *s;
+    uint32_t i, n = 0, count = 0, word, bytes;
+
+    if (ETH_MAC_TR != 0 || TxSent == TxHead) {
+        return;
+    }
+
+    do {
+        s = &TxSlot[(TxSent + count++) % TxCount];
+        n += s->len;
+    } while (!s->last);
+
+    /* the length field is followed by the destination address */
+    word = (n - 14) & 0xFFFF;
+    bytes = 2;
+
+    for (i = 0; i < count; i++) {
+        s = &TxSlot[(TxSent + i) % TxCount];
+        eth_fifo_put(&word, &bytes, s->buf, s->len);
+    }
+
+    if (bytes) {
+        ETH_MAC_DATA = word;
+    }
+
+    ETH_MAC_TR = 1;
+    TxSent += count;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Move the frames from the receive FIFO to the ring
+ */
+static void eth_rx_drain(void)
+{
+    while ((ETH_MAC_NP & 0x3F) != 0) {
+        uint32_t word = ETH_MAC_DATA;
+        /* length field, frame and FCS */
+        uint32_t len = word & 0xFFFF;
+        uint32_t words = (len + 3) / 4;
+        uint32_t *p;
+
+        if (RxHead == RxFill || len < 6 || words * 4 > RingPool->size) {
+            if (RxHead == RxFill) {
+                RxStats.missed++;
+            } else {
+                RxStats.dropped++;
+            }
+
+            for (; words > 1; words--) {
+                (void)ETH_MAC_DATA;
+            }
+            continue;
+        }
+
+        p = RxSlot[RxHead % RxCount].buf;
+        *p++ = word;
+
+        for (; words >= 5; words -= 4) {
+            p[0] = ETH_MAC_DATA;
+            p[1] = ETH_MAC_DATA;
+            p[2] = ETH_MAC_DATA;
+            p[3] = ETH_MAC_DATA;
+            p += 4;
+        }
+
+        while (--words) {
+            *p++ = ETH_MAC_DATA;
+        }
+
+        RxSlot[RxHead % RxCount].len = len - 2;
+        RxHead++;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Ethernet interrupt handler
+ *
+ * To be called from the ETH interrupt (eth_isr()). Moves received frames
+ * into the ring and writes the next queued frame to the transmit FIFO.
+ *
+ * @returns bool true, if eth_rx_service() has to be scheduled
+ */
+bool eth_rx_irq(void)
+{
+    uint32_t ris = ETH_MAC_RISACK;
+
+    ETH_MAC_RISACK = ris & (ETH_INT_RXC | ETH_INT_TXC | ETH_INT_TXE |
+                            ETH_INT_RXO);
+
+    if (ris & ETH_INT_RXO) {
+        RxStats.overflow++;
+    }
+
+    eth_rx_drain();
+    eth_tx_fill();
+
+    return RxHead != RxTail;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give free pool buffers to the receive ring
+ */
+void eth_rx_refill(void)
+{
+    while (RxFill - RxTail < RxCount) {
+        void *buf = eth_pool_alloc(RingPool);
+
+        if (buf == NULL) {
+            break;
+        }
+
+        RxSlot[RxFill % RxCount].buf = buf;
+        RxFill++;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Take a received frame (zero copy API)
+ *
+ * The frame is at ETH_RX_OFFSET in a pool buffer, give it back with
+ * eth_pool_free().
+ *
+ * @param[out] len uint32_t* Length of the frame (with ETH_RX_FCS_LEN bytes of FCS)
+ * @returns void* Frame, or NULL if none was received
+ */
+void *eth_rx_buf(uint32_t *len)
+{
+    uint8_t *buf;
+
+    if (RxTail == RxHead) {
+        return NULL;
+    }
+
+    /* the refill below reuses the slot */
+    buf = RxSlot[RxTail % RxCount].buf;
+    *len = RxSlot[RxTail % RxCount].len;
+    RxTail++;
+    RxStats.frames++;
+
+    eth_rx_refill();
+    return buf + ETH_RX_OFFSET;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Process received frames (zero copy API)
+ *
+ * @param[in] budget uint32_t Maximum number of frames (ie. ETH_RX_BUDGET)
+ * @param[in] callback eth_rx_callback Called for each frame
+ * @returns uint32_t Number of frames processed
+ */
+uint32_t eth_rx_service(uint32_t budget, eth_rx_callback callback)
+{
+    uint32_t n = 0, len;
+    void *buf;
+
+    while (n < budget && (buf = eth_rx_buf(&len)) != NULL) {
+        callback(buf, len);
+        n++;
+    }
+
+    return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the receive ring statistics
+ *
+ * @param[out] stats struct eth_rx_stats* Statistics
+ * @param[in] reset bool Clear the counters
+ */
+void eth_rx_get_stats(struct eth_rx_stats *stats, bool reset)
+{
+    /* the counters are incremented by eth_rx_irq() */
+    uint32_t im = ETH_MAC_IM;
+
+    ETH_MAC_IM = 0;
+
+    stats->frames = RxStats.frames;
+    stats->dropped = RxStats.dropped;
+    stats->missed = RxStats.missed;
+    stats->overflow = RxStats.overflow;
+
+    if (reset) {
+        memset((void *)&RxStats, 0, sizeof(RxStats));
+    }
+
+    ETH_MAC_IM = im;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Transmit a copy of the frame through the ring
+ */
+static bool eth_tx_copy(uint8_t *ppkt, uint32_t n)
+{
+    uint8_t *buf;
+
+    if (n > RingPool->size - ETH_RX_OFFSET) {
+        return false;
+    }
+
+    buf = eth_pool_alloc(RingPool);
+    if (buf == NULL) {
+        eth_tx_reclaim();
+        buf = eth_pool_alloc(RingPool);
+        if (buf == NULL) {
+            return false;
+        }
+    }
+
+    /* keep the copy word aligned after the length field */
+    buf += ETH_RX_OFFSET;
+    memcpy(buf, ppkt, n);
+
+    if (!eth_tx_buf(buf, n)) {
+        eth_pool_free(RingPool, buf);
+        return false;
+    }
+
+    return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Copy a received frame out of the ring
+ */
+static bool eth_rx_copy(uint8_t *ppkt, uint32_t *len, uint32_t maxlen)
+{
+    uint32_t l;
+    void *buf = eth_rx_buf(&l);
+
+    if (buf == NULL) {
+        return false;
+    }
+
+    if (l <= maxlen) {
+        memcpy(ppkt, buf, l);
+        *len = l;
+    }
+
+    eth_pool_free(RingPool, buf);
+
+    return l <= maxlen;
+}
+
+/*---------------------------------------------------------------------------*/
+
 bool eth_tx(uint8_t *ppkt, uint32_t n)
 {
     uint32_t word;
     unsigned int i = 0;
+    if (RingPool != NULL)
+        return eth_tx_copy(ppkt, n);
+
     if (n > (2048 - 2))
         return false;
 
@@ -57,6 +578,9 @@ bool eth_rx(uint8_t *ppkt, uint32_t *len, uint32_t maxlen)
 {
     uint32_t word;
     unsigned int i = 0;
+    if (RingPool != NULL)
+        return eth_rx_copy(ppkt, len, maxlen);
+
     if ((ETH_MAC_NP & 0x3F) == 0) {
         return false;
     }
@@ -34,12 +34,53 @@
 #include <unicore-mx/ethernet/phy.h>
 #include <unicore-mx/stm32/gpio.h>
 #include <unicore-mx/cm3/nvic.h>
+#include <unicore-mx/cm3/scb.h>
 
 /**@{*/
 
 uint32_t TxBD;
 uint32_t RxBD;
 
+/* Zero copy descriptor ring (eth_ring_init()).
+ * RingPool is NULL when the descriptors are set up by eth_desc_init().
+ * TxDirty is the oldest transmit descriptor not yet reclaimed, RxDirty the
+ * oldest receive descriptor without buffer. */
+static struct eth_pool *RingPool;
+static eth_tx_release_callback TxRelease;
+static void *TxReleaseArg;
+static uint32_t TxRing, RxRing, DesSize;
+static uint32_t TxCount, RxCount;
+static uint32_t TxDirty, TxBusy;
+static uint32_t RxDirty, RxEmpty;
+static struct eth_rx_stats RxStats;
+
+/* PTP: transmit timestamp callback (timestamps requested when set), first
+ * buffer of the frame being reclaimed, timestamp of the last received frame
+ * and nominal addend of the clock */
+static void (*PtpTxCallback)(void *buf, uint64_t ns);
+static void *TxFrame;
+static bool RxStampValid;
+static uint64_t RxStamp;
+static uint32_t PtpAddend;
+
+/* MMC counters accumulated from the hardware (reset on read) counters */
+static struct eth_mmc_counters MmcCounters;
+
+/* D-cache maintenance of the memory shared with the DMA (Cortex-M7).
+ * A descriptor is cleaned after the CPU wrote it and invalidated before the
+ * CPU reads what the DMA wrote, so it has to fill whole cache lines. */
+#if defined(STM32F7)
+#define DES_CLEAN(bd)		scb_clean_dcache_range((void *)(bd), DesSize)
+#define DES_INVALIDATE(bd)	scb_invalidate_dcache_range((void *)(bd), DesSize)
+#define BUF_CLEAN(p, n)		scb_clean_dcache_range((void *)(p), (n))
+#define BUF_INVALIDATE(p, n)	scb_invalidate_dcache_range((void *)(p), (n))
+#else
+#define DES_CLEAN(bd)		do { } while (0)
+#define DES_INVALIDATE(bd)	do { } while (0)
+#define BUF_CLEAN(p, n)		do { } while (0)
+#define BUF_INVALIDATE(p, n)	do { } while (0)
+#endif
+
 /*---------------------------------------------------------------------------*/
 /** @brief Set MAC to the PHY
  *
@@ -71,6 +112,9 @@ void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx,
 	uint32_t bd = (uint32_t)buf;
 	uint32_t sz = isext ? ETH_DES_EXT_SIZE : ETH_DES_STD_SIZE;
 
+	RingPool = NULL;
+	DesSize = sz;
+
 	/* enable / disable extended frames */
 	if (isext) {
 		ETH_DMABMR |= ETH_DMABMR_EDFE;
@@ -106,11 +150,551 @@ void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx,
 	ETH_DES1(bd) = ETH_RDES1_RCH | cRx;
 	ETH_DES2(bd) = bd + sz;
 	ETH_DES3(bd) = RxBD;
+	BUF_CLEAN(buf, bd + sz + cRx - (uint32_t)buf);
 
 	ETH_DMARDLAR = (uint32_t) RxBD;
 	ETH_DMATDLAR = (uint32_t) TxBD;
 }
 
+/*---------------------------------------------------------------------------*/
+/** @brief Next transmit descriptor
+ *
+ * @param[in] bd uint32_t Descriptor
+ * @returns uint32_t Descriptor following @a bd in the ring / chain
+ */
+static uint32_t eth_tx_next(uint32_t bd)
+{
+	if (ETH_DES0(bd) & ETH_TDES0_TCH) {
+		return ETH_DES3(bd);
+	}
+
+	return (ETH_DES0(bd) & ETH_TDES0_TER) ? TxRing : bd + DesSize;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Next receive descriptor
+ *
+ * @param[in] bd uint32_t Descriptor
+ * @returns uint32_t Descriptor following @a bd in the ring / chain
+ */
+static uint32_t eth_rx_next(uint32_t bd)
+{
+	if (ETH_DES1(bd) & ETH_RDES1_RCH) {
+		return ETH_DES3(bd);
+	}
+
+	return (ETH_DES1(bd) & ETH_RDES1_RER) ? RxRing : bd + DesSize;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize descriptors for the zero copy API
+ *
+ * The descriptors are laid out as a ring (no buffer behind them). Receive
+ * descriptors are given buffers from @a pool, transmit descriptors get the
+ * buffers passed to eth_tx_buf(). The pool buffers must be large enough for
+ * a complete frame (1524 bytes, or more with VLAN tags).
+ *
+ * With the D-cache enabled (STM32F7), descriptors have to be extended ones
+ * and the descriptors and pool memory aligned with SCB_DCACHE_ALIGNED.
+ *
+ * @param[in] desc uint8_t* Memory for nTx + nRx descriptors (word aligned)
+ * @param[in] nTx uint32_t Count of Transmit Descriptors
+ * @param[in] nRx uint32_t Count of Receive Descriptors
+ * @param[in] isext bool true, if extended descriptors should be used
+ * @param[in] pool struct eth_pool* Buffer pool
+ */
+void eth_ring_init(uint8_t *desc, uint32_t nTx, uint32_t nRx, bool isext,
+		   struct eth_pool *pool)
+{
+	uint32_t i;
+
+	DesSize = isext ? ETH_DES_EXT_SIZE : ETH_DES_STD_SIZE;
+	memset(desc, 0, (nTx + nRx) * DesSize);
+
+	/* enable / disable extended frames, descriptors are contiguous */
+	if (isext) {
+		ETH_DMABMR |= ETH_DMABMR_EDFE;
+	} else {
+		ETH_DMABMR &= ~ETH_DMABMR_EDFE;
+	}
+
+	RingPool = pool;
+	TxCount = nTx;
+	RxCount = nRx;
+
+	TxRing = TxBD = TxDirty = (uint32_t)desc;
+	TxBusy = 0;
+	ETH_DES0(TxRing + (nTx - 1) * DesSize) = ETH_TDES0_TER;
+
+	RxRing = RxBD = RxDirty = TxRing + nTx * DesSize;
+	RxEmpty = nRx;
+	for (i = 0; i < nRx; i++) {
+		ETH_DES1(RxRing + i * DesSize) = (i == nRx - 1) ? ETH_RDES1_RER : 0;
+	}
+
+	eth_rx_refill();
+	BUF_CLEAN(desc, (nTx + nRx) * DesSize);
+
+	ETH_DMARDLAR = RxRing;
+	ETH_DMATDLAR = TxRing;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the callback for transmitted buffers not owned by the pool
+ *
+ * Buffers that belong to the ring pool always go back to the pool.
+ *
+ * @param[in] release eth_tx_release_callback Callback (NULL to drop)
+ * @param[in] arg void* First argument of @a release
+ */
+void eth_set_tx_release_callback(eth_tx_release_callback release, void *arg)
+{
+	TxRelease = release;
+	TxReleaseArg = arg;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Request the DMA to poll the transmit descriptors
+ *
+ * Start the transmission of the frames queued by eth_tx_queue(). Several
+ * frames can be queued before a single poll demand.
+ */
+void eth_tx_flush(void)
+{
+	if (ETH_DMASR & ETH_DMASR_TBUS) {
+		ETH_DMASR = ETH_DMASR_TBUS;
+		ETH_DMATPDR = 0;
+	}
+
+	/* If the DMA engine is stalled then a restart request is issued.*/
+	if ((ETH_DMASR & ETH_DMASR_TPS) == ETH_DMASR_TPS_SUSPEND) {
+		ETH_DMASR   = ETH_DMASR_TBUS;
+		ETH_DMATPDR = ETH_DMASR_TBUS; /* Any value is OK.*/
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Transmit a buffer without copying (zero copy API)
+ *
+ * The ownership of @a buf is passed to the driver. After transmission it is
+ * given back by eth_tx_reclaim(): to the pool, or to the release callback
+ * if it does not belong to the pool.
+ *
+ * @param[in] buf void* Complete frame
+ * @param[in] len uint32_t Size of the frame
+ * @returns bool true, if queued. false, if no descriptor is free
+ */
+bool eth_tx_buf(void *buf, uint32_t len)
+{
+	struct eth_tx_seg seg = { buf, len };
+
+	if (!eth_tx_queue(&seg, 1)) {
+		return false;
+	}
+
+	eth_tx_flush();
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue a frame made of several buffers (zero copy API)
+ *
+ * Each descriptor carries two buffers (TBS1 / TBS2), so the frame uses
+ * (count + 1) / 2 descriptors. The ownership of the buffers is passed to
+ * the driver as with eth_tx_buf(). The transmission only starts on the
+ * next eth_tx_flush().
+ *
+ * @param[in] seg const struct eth_tx_seg* Buffers of the frame, in order
+ * @param[in] count uint32_t Number of buffers
+ * @returns bool true, if queued. false, if not enough descriptors are free
+ */
+bool eth_tx_queue(const struct eth_tx_seg *seg, uint32_t count)
+{
+	uint32_t need = (count + 1) / 2;
+	uint32_t first = TxBD;
+	uint32_t bd = TxBD;
+	uint32_t i;
+
+	if (RingPool == NULL || count == 0 || need > TxCount) {
+		return false;
+	}
+
+	if (TxCount - TxBusy < need) {
+		eth_tx_reclaim();
+		if (TxCount - TxBusy < need) {
+			return false;
+		}
+	}
+
+	for (i = 0; i < count; i += 2) {
+		uint32_t des0 = ETH_DES0(bd) & (ETH_TDES0_TER | ETH_TDES0_CIC);
+		uint32_t next = eth_tx_next(bd);
+
+		ETH_DES2(bd) = (uint32_t)seg[i].buf;
+		ETH_DES1(bd) = seg[i].len & ETH_TDES1_TBS1;
+		ETH_DES3(bd) = 0;
+		BUF_CLEAN(seg[i].buf, seg[i].len);
+
+		if (i + 1 < count) {
+			ETH_DES3(bd) = (uint32_t)seg[i + 1].buf;
+			ETH_DES1(bd) |= (seg[i + 1].len << ETH_TDES1_TBS2_SHIFT) &
+				ETH_TDES1_TBS2;
+			BUF_CLEAN(seg[i + 1].buf, seg[i + 1].len);
+		}
+
+		/* first descriptor is given to the DMA when the frame is complete */
+		if (bd != first) {
+			des0 |= ETH_TDES0_OWN;
+		} else if (PtpTxCallback != NULL) {
+			des0 |= ETH_TDES0_FS | ETH_TDES0_TTSE;
+		} else {
+			des0 |= ETH_TDES0_FS;
+		}
+		if (i + 2 >= count) {
+			des0 |= ETH_TDES0_LS;
+		}
+
+		ETH_DES0(bd) = des0;
+		DES_CLEAN(bd);
+		bd = next;
+	}
+
+	TxBD = bd;
+	TxBusy += need;
+	ETH_DES0(first) |= ETH_TDES0_OWN;
+	DES_CLEAN(first);
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give back a transmitted buffer
+ *
+ * @param[in] buf void* Buffer (NULL if unused)
+ */
+static void eth_tx_release(void *buf)
+{
+	if (buf == NULL) {
+		return;
+	}
+
+	if (eth_pool_owns(RingPool, buf)) {
+		eth_pool_free(RingPool, buf);
+	} else if (TxRelease != NULL) {
+		TxRelease(TxReleaseArg, buf);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give back the transmitted buffers (zero copy API)
+ *
+ * @returns uint32_t Number of buffers given back
+ */
+uint32_t eth_tx_reclaim(void)
+{
+	uint32_t n = 0;
+
+	while (TxBusy) {
+		void *buf1, *buf2;
+
+		DES_INVALIDATE(TxDirty);
+		if (ETH_DES0(TxDirty) & ETH_TDES0_OWN) {
+			break;
+		}
+
+		buf1 = (void *)ETH_DES2(TxDirty);
+		buf2 = (void *)ETH_DES3(TxDirty);
+
+		if (ETH_DES0(TxDirty) & ETH_TDES0_FS) {
+			TxFrame = buf1;
+		}
+
+		/* timestamp is written back in the last descriptor */
+		if ((ETH_DES0(TxDirty) & (ETH_TDES0_LS | ETH_TDES0_TTSS)) ==
+				(ETH_TDES0_LS | ETH_TDES0_TTSS) &&
+				PtpTxCallback != NULL && DesSize == ETH_DES_EXT_SIZE) {
+			PtpTxCallback(TxFrame, (uint64_t)ETH_DES7(TxDirty) *
+				ETH_PTP_NS_PER_SEC + ETH_DES6(TxDirty));
+		}
+		ETH_DES2(TxDirty) = 0;
+		ETH_DES3(TxDirty) = 0;
+		DES_CLEAN(TxDirty);
+		TxDirty = eth_tx_next(TxDirty);
+		TxBusy--;
+
+		eth_tx_release(buf1);
+		eth_tx_release(buf2);
+		n += (buf1 != NULL) + (buf2 != NULL);
+	}
+
+	return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give pool buffers to the receive descriptors that have none
+ *
+ * Called internally on each receive, the application only needs it when
+ * the pool ran empty and buffers have been given back since.
+ */
+void eth_rx_refill(void)
+{
+	uint32_t rbs;
+
+	if (RingPool == NULL) {
+		return;
+	}
+
+	rbs = RingPool->size & ETH_RDES1_RBS1;
+	while (RxEmpty) {
+		void *buf = eth_pool_alloc(RingPool);
+		if (buf == NULL) {
+			break;
+		}
+
+		/* dirty lines of the previous user must not be evicted over
+		 * the received data */
+		BUF_INVALIDATE(buf, RingPool->size);
+
+		ETH_DES2(RxDirty) = (uint32_t)buf;
+		ETH_DES1(RxDirty) = (ETH_DES1(RxDirty) & ETH_RDES1_RER) | rbs;
+		ETH_DES0(RxDirty) = ETH_RDES0_OWN;
+		DES_CLEAN(RxDirty);
+		RxDirty = eth_rx_next(RxDirty);
+		RxEmpty--;
+	}
+
+	/* If the DMA engine is stalled then a restart request is issued.*/
+	if ((ETH_DMASR & ETH_DMASR_RPS) == ETH_DMASR_RPS_SUSPEND) {
+		ETH_DMASR   = ETH_DMASR_RBUS;
+		ETH_DMARPDR = ETH_DMASR_RBUS; /* Any value is OK.*/
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Check if a received frame is waiting in the ring
+ *
+ * @returns bool true, if the next descriptor is owned by the CPU
+ */
+static bool eth_rx_ready(void)
+{
+	if (RxEmpty == RxCount) {
+		return false;
+	}
+
+	DES_INVALIDATE(RxBD);
+	return !(ETH_DES0(RxBD) & ETH_RDES0_OWN);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Receive a frame without copying (zero copy API)
+ *
+ * The ownership of the returned buffer is passed to the application, which
+ * has to give it back with eth_pool_free(). Frames with errors, or that do
+ * not fit in one buffer, are dropped.
+ *
+ * @param[out] len uint32_t* Length of the frame (with ETH_RX_FCS_LEN bytes of FCS)
+ * @returns void* Buffer with the frame, NULL if none received
+ */
+void *eth_rx_buf(uint32_t *len)
+{
+	void *buf = NULL;
+
+	while (eth_rx_ready()) {
+		uint32_t des0 = ETH_DES0(RxBD);
+		uint32_t bd = RxBD;
+
+		RxBD = eth_rx_next(bd);
+
+		if ((des0 & (ETH_RDES0_FS | ETH_RDES0_LS | ETH_RDES0_ES)) ==
+				(ETH_RDES0_FS | ETH_RDES0_LS)) {
+			buf = (void *)ETH_DES2(bd);
+			*len = (des0 & ETH_RDES0_FL) >> ETH_RDES0_FL_SHIFT;
+
+			RxStampValid = (des0 & ETH_RDES0_TSV) &&
+				DesSize == ETH_DES_EXT_SIZE;
+			if (RxStampValid) {
+				RxStamp = (uint64_t)ETH_DES7(bd) *
+					ETH_PTP_NS_PER_SEC + ETH_DES6(bd);
+			}
+
+			ETH_DES2(bd) = 0;
+			DES_CLEAN(bd);
+			BUF_INVALIDATE(buf, *len);
+			RxEmpty++;
+			RxStats.frames++;
+			break;
+		}
+
+		/* drop: back to the pool, eth_rx_refill() rearms the descriptors
+		 * in ring order from RxDirty */
+		if (des0 & ETH_RDES0_LS) {
+			RxStats.dropped++;
+		}
+
+		eth_pool_free(RingPool, (void *)ETH_DES2(bd));
+		ETH_DES2(bd) = 0;
+		DES_CLEAN(bd);
+		RxEmpty++;
+	}
+
+	eth_rx_refill();
+
+	return buf;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Receive interrupt handler
+ *
+ * To be called from the ETH interrupt, with ETH_DMAIER_NISE and
+ * ETH_DMAIER_RIE enabled. On frame reception the receive interrupt is
+ * masked till eth_rx_service() has emptied the ring.
+ *
+ * @returns bool true, if eth_rx_service() has to be scheduled
+ */
+bool eth_rx_irq(void)
+{
+	if (!(ETH_DMASR & ETH_DMASR_RS) || !(ETH_DMAIER & ETH_DMAIER_RIE)) {
+		return false;
+	}
+
+	ETH_DMAIER &= ~ETH_DMAIER_RIE;
+	ETH_DMASR = ETH_DMASR_NIS;
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Collect the missed frame counters of the DMA
+ */
+static void eth_rx_update_missed(void)
+{
+	uint32_t reg = ETH_DMAMFBOCR; /* cleared on read */
+
+	RxStats.missed += (reg & ETH_DMAMFBOCR_OMFC) ? ETH_DMAMFBOCR_MFC :
+		(reg & ETH_DMAMFBOCR_MFC) >> ETH_DMAMFBOCR_MFC_SHIFT;
+	RxStats.overflow += (reg & ETH_DMAMFBOCR_OFOC) ?
+		ETH_DMAMFBOCR_MFA >> ETH_DMAMFBOCR_MFA_SHIFT :
+		(reg & ETH_DMAMFBOCR_MFA) >> ETH_DMAMFBOCR_MFA_SHIFT;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Process received frames (zero copy API)
+ *
+ * Give up to @a budget frames to @a callback. When less than @a budget
+ * frames were waiting, the ring is empty and the receive interrupt is
+ * enabled again. Otherwise it stays masked and the call has to be repeated.
+ *
+ * @param[in] budget uint32_t Maximum number of frames (ie. ETH_RX_BUDGET)
+ * @param[in] callback eth_rx_callback Called for each frame
+ * @returns uint32_t Number of frames processed
+ */
+uint32_t eth_rx_service(uint32_t budget, eth_rx_callback callback)
+{
+	uint32_t n = 0;
+	uint32_t len;
+	void *buf;
+
+	eth_rx_update_missed();
+
+	for (;;) {
+		while (n < budget && (buf = eth_rx_buf(&len)) != NULL) {
+			callback(buf, len);
+			n++;
+		}
+
+		if (n == budget) {
+			return n;
+		}
+
+		/* frame received after the ack is caught by the next check */
+		ETH_DMASR = ETH_DMASR_RS;
+		if (!eth_rx_ready()) {
+			break;
+		}
+	}
+
+	ETH_DMAIER |= ETH_DMAIER_RIE;
+
+	return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get the receive ring statistics
+ *
+ * @param[out] stats struct eth_rx_stats* Statistics
+ * @param[in] reset bool true, if the counters have to be cleared
+ */
+void eth_rx_get_stats(struct eth_rx_stats *stats, bool reset)
+{
+	eth_rx_update_missed();
+
+	*stats = RxStats;
+
+	if (reset) {
+		memset(&RxStats, 0, sizeof(RxStats));
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Transmit packet through a pool buffer (eth_ring_init() mode)
+ *
+ * @param[in] ppkt uint8_t* Pointer to the beginning of the packet
+ * @param[in] n uint32_t Size of the packet
+ * @returns bool true, if success
+ */
+static bool eth_tx_copy(uint8_t *ppkt, uint32_t n)
+{
+	void *buf;
+
+	if (n > RingPool->size) {
+		return false;
+	}
+
+	eth_tx_reclaim();
+
+	buf = eth_pool_alloc(RingPool);
+	if (buf == NULL) {
+		return false;
+	}
+
+	memcpy(buf, ppkt, n);
+
+	if (!eth_tx_buf(buf, n)) {
+		eth_pool_free(RingPool, buf);
+		return false;
+	}
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Receive packet from a pool buffer (eth_ring_init() mode)
+ *
+ * @param[inout] ppkt uint8_t* Pointer to the data buffer where to store data
+ * @param[inout] len uint32_t* Pointer to the variable with the packet length
+ * @param[in] maxlen uint32_t Maximum length of the packet
+ * @returns bool true, if the buffer contains readed packet data
+ */
+static bool eth_rx_copy(uint8_t *ppkt, uint32_t *len, uint32_t maxlen)
+{
+	uint32_t l;
+	void *buf = eth_rx_buf(&l);
+
+	if (buf == NULL) {
+		return false;
+	}
+
+	if (l <= maxlen) {
+		memcpy(ppkt, buf, l);
+		*len = l;
+	}
+
+	eth_pool_free(RingPool, buf);
+
+	return l <= maxlen;
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief Transmit packet
  *
@@ -120,26 +704,24 @@ void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx,
  */
 bool eth_tx(uint8_t *ppkt, uint32_t n)
 {
+	if (RingPool != NULL) {
+		return eth_tx_copy(ppkt, n);
+	}
+
+	DES_INVALIDATE(TxBD);
 	if (ETH_DES0(TxBD) & ETH_TDES0_OWN) {
 		return false;
 	}
 
 	memcpy((void *)ETH_DES2(TxBD), ppkt, n);
+	BUF_CLEAN(ETH_DES2(TxBD), n);
 
 	ETH_DES1(TxBD) = n & ETH_TDES1_TBS1;
 	ETH_DES0(TxBD) |= ETH_TDES0_LS | ETH_TDES0_FS | ETH_TDES0_OWN;
+	DES_CLEAN(TxBD);
 	TxBD = ETH_DES3(TxBD);
 
-	if (ETH_DMASR & ETH_DMASR_TBUS) {
-		ETH_DMASR = ETH_DMASR_TBUS;
-		ETH_DMATPDR = 0;
-	}
-
-	/* If the DMA engine is stalled then a restart request is issued.*/
-	if ((ETH_DMASR & ETH_DMASR_TPS) == ETH_DMASR_TPS_SUSPEND) {
-		ETH_DMASR   = ETH_DMASR_TBUS;
-		ETH_DMATPDR = ETH_DMASR_TBUS; /* Any value is OK.*/
-	}
+	eth_tx_flush();
 
 	return true;
 }
@@ -160,6 +742,11 @@ bool eth_rx(uint8_t *ppkt, uint32_t *len, uint32_t maxlen)
 	uint32_t l = 0;
     uint8_t *pkt_ptr = ppkt;
 
+	if (RingPool != NULL) {
+		return eth_rx_copy(ppkt, len, maxlen);
+	}
+
+	DES_INVALIDATE(RxBD);
 	while (!(ETH_DES0(RxBD) & ETH_RDES0_OWN) && !ls) {
 		l = (ETH_DES0(RxBD) & ETH_RDES0_FL) >> ETH_RDES0_FL_SHIFT;
 
@@ -169,6 +756,7 @@ bool eth_rx(uint8_t *ppkt, uint32_t *len, uint32_t maxlen)
 		overrun |= fs && (maxlen < l);
 
 		if (!overrun) {
+			BUF_INVALIDATE(ETH_DES2(RxBD), l);
 			memcpy(pkt_ptr, (void *)ETH_DES2(RxBD), l);
             if (!ls) {
                 pkt_ptr = ppkt + l;
@@ -179,7 +767,9 @@ bool eth_rx(uint8_t *ppkt, uint32_t *len, uint32_t maxlen)
 		}
 
 		ETH_DES0(RxBD) = ETH_RDES0_OWN;
+		DES_CLEAN(RxBD);
 		RxBD = ETH_DES3(RxBD);
+		DES_INVALIDATE(RxBD);
 	}
 
 	/* If the DMA engine is stalled then a restart request is issued.*/
@@ -235,6 +825,27 @@ void eth_init(uint8_t phy, enum eth_clk clock)
 		ETH_DMABMR_PM_2_1 | ETH_DMABMR_USP;
 }
 
+/*---------------------------------------------------------------------------*/
+/** @brief Set the MAC speed and duplex mode to the negotiated link
+ *
+ * @param[in] fast bool true for 100Mbit, false for 10Mbit
+ * @param[in] fd bool true for full duplex
+ */
+void eth_set_link(bool fast, bool fd)
+{
+	uint32_t reg = ETH_MACCR & ~(ETH_MACCR_FES | ETH_MACCR_DM);
+
+	if (fast) {
+		reg |= ETH_MACCR_FES;
+	}
+
+	if (fd) {
+		reg |= ETH_MACCR_DM;
+	}
+
+	ETH_MACCR = reg;
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief Enable the Ethernet IRQ
  *
@@ -291,7 +902,8 @@ void eth_enable_checksum_offload(void)
 	uint32_t tab = TxBD;
 	do {
 		ETH_DES0(tab) |= ETH_TDES0_CIC_IPPLPH;
-		tab = ETH_DES3(tab);
+		DES_CLEAN(tab);
+		tab = eth_tx_next(tab);
 	}
 	while (tab != TxBD);
 
@@ -299,35 +911,380 @@ void eth_enable_checksum_offload(void)
 }
 
 /*---------------------------------------------------------------------------*/
-/** @brief Process pending SMI transaction and wait to be done.
+/** @brief Initialize the MMC counters
+ *
+ * The hardware counters are reset and set to reset on read, their value
+ * is accumulated in 64 bit software counters. The half-full interrupts are
+ * enabled so that eth_mmc_irq() collect the counters before they wrap.
+ */
+void eth_mmc_init(void)
+{
+	ETH_MMCCR = ETH_MMCCR_ROR | ETH_MMCCR_CR;
+
+	ETH_MMCRIMR &= ~(ETH_MMCRIMR_RFCEM | ETH_MMCRIMR_RFAEM |
+			ETH_MMCRIMR_RGUFM);
+	ETH_MMCTIMR &= ~(ETH_MMCTIMR_TGFSCS | ETH_MMCTIMR_TGFMSCS |
+			ETH_MMCTIMR_TGFS);
+
+	memset(&MmcCounters, 0, sizeof(MmcCounters));
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Accumulate the hardware MMC counters (reset on read)
  */
-static void eth_smi_transact(void)
+static void eth_mmc_collect(void)
 {
-	/* Begin transaction. */
-	ETH_MACMIIAR |= ETH_MACMIIAR_MB;
+	MmcCounters.tx_good += ETH_MMCTGFCR;
+	MmcCounters.tx_single_collision += ETH_MMCTGFSCCR;
+	MmcCounters.tx_multi_collision += ETH_MMCTGFMSCCR;
+	MmcCounters.rx_good_unicast += ETH_MMCRGUFCR;
+	MmcCounters.rx_crc_error += ETH_MMCRFCECR;
+	MmcCounters.rx_align_error += ETH_MMCRFAECR;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief MMC interrupt handler
+ *
+ * To be called from the ETH interrupt. Reading the counters clears the
+ * half-full status (ETH_MMCRIR / ETH_MMCTIR).
+ *
+ * @returns bool true, if a counter reached half of its range
+ */
+bool eth_mmc_irq(void)
+{
+	if (!(ETH_MACSR & (ETH_MACSR_MMCRS | ETH_MACSR_MMCTS))) {
+		return false;
+	}
 
-	/* Wait for not busy. */
-	while (ETH_MACMIIAR & ETH_MACMIIAR_MB);
+	eth_mmc_collect();
+
+	return true;
 }
 
 /*---------------------------------------------------------------------------*/
-/** @brief Write 16-bit register to the PHY
+/** @brief Read the MMC counters
  *
- * @param[in] phy uint8_t ID of the PHY (defaults to 1)
+ * Must not be interrupted by eth_mmc_irq() (call it from the same context
+ * or with the ETH interrupt disabled).
+ *
+ * @param[out] counters struct eth_mmc_counters* Counters
+ * @param[in] reset bool true, if the counters have to be cleared
+ */
+void eth_mmc_read(struct eth_mmc_counters *counters, bool reset)
+{
+	eth_mmc_collect();
+
+	*counters = MmcCounters;
+
+	if (reset) {
+		memset(&MmcCounters, 0, sizeof(MmcCounters));
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Hash table bit of a MAC address
+ *
+ * The upper 6 bits of the bit reversed CRC32 of the address select one of
+ * the 64 bits of ETH_MACHTHR:ETH_MACHTLR.
+ *
+ * @param[in] mac const uint8_t* MAC address (6 bytes)
+ * @returns uint32_t Bit index (0 - 63)
+ */
+uint32_t eth_hash_index(const uint8_t *mac)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	uint32_t index = 0;
+	int i, j;
+
+	for (i = 0; i < 6; i++) {
+		crc ^= mac[i];
+		for (j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+
+	crc = ~crc;
+	for (i = 0; i < 6; i++) {
+		index = (index << 1) | ((crc >> i) & 1);
+	}
+
+	return index;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Program the receive address filter
+ *
+ * Only frames to the own MAC address (eth_set_mac()), broadcast and to the
+ * addresses of the list are received. The first ETH_PERFECT_FILTERS
+ * addresses use perfect filtering, the others the hash table (which can let
+ * other addresses with the same hash through). Disables the promiscuous /
+ * receive all mode set by eth_init().
+ *
+ * @param[in] macs const uint8_t* Addresses, 6 bytes each (NULL if none)
+ * @param[in] count uint32_t Number of addresses
+ */
+void eth_set_filter(const uint8_t *macs, uint32_t count)
+{
+	uint32_t hash[2] = { 0, 0 };
+	uint32_t ffr = ETH_MACFFR_HPF;
+	uint32_t i;
+
+	for (i = 0; i < ETH_PERFECT_FILTERS; i++) {
+		const uint8_t *mac;
+
+		if (i >= count) {
+			ETH_MACAHR(i + 1) = 0;
+			continue;
+		}
+
+		mac = macs + i * 6;
+		ETH_MACAHR(i + 1) = ((uint32_t)mac[5] << 8) | mac[4] |
+			ETH_MACAHR_AE;
+		ETH_MACALR(i + 1) = ((uint32_t)mac[3] << 24) |
+			((uint32_t)mac[2] << 16) | ((uint32_t)mac[1] << 8) | mac[0];
+	}
+
+	for (; i < count; i++) {
+		const uint8_t *mac = macs + i * 6;
+		uint32_t index = eth_hash_index(mac);
+
+		hash[index >> 5] |= 1 << (index & 31);
+		ffr |= (mac[0] & 0x01) ? ETH_MACFFR_HM : ETH_MACFFR_HU;
+	}
+
+	ETH_MACHTHR = hash[1];
+	ETH_MACHTLR = hash[0];
+	ETH_MACFFR = ffr;
+}
+
+#if defined(STM32F4) || defined(STM32F7)
+/*---------------------------------------------------------------------------*/
+/** @brief Load the PTP clock addend
+ *
+ * @param[in] addend uint32_t Addend (fine correction)
+ */
+static void eth_ptp_set_addend(uint32_t addend)
+{
+	ETH_PTPTSAR = addend;
+	ETH_PTPTSCR |= ETH_PTPTSCR_TTSARU;
+	while (ETH_PTPTSCR & ETH_PTPTSCR_TTSARU);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the PTP clock
+ *
+ * Timestamping is enabled for all frames, the clock counts nanoseconds
+ * (digital rollover) with fine correction, and is set to 0. Timestamps are
+ * stored in the descriptors, so extended descriptors are required.
+ *
+ * @param[in] hclk uint32_t HCLK frequency (Hz)
+ */
+void eth_ptp_init(uint32_t hclk)
+{
+	/* the accumulator overflows at half HCLK (at most), leaving room for
+	 * the fine correction */
+	uint32_t inc = (2 * ETH_PTP_NS_PER_SEC + hclk - 1) / hclk;
+
+	PtpAddend = ((uint64_t)ETH_PTP_NS_PER_SEC << 32) /
+		((uint64_t)inc * hclk);
+
+	ETH_MACIMR |= ETH_MACIMR_TSTIM;
+	ETH_PTPTSCR = ETH_PTPTSCR_TSE | ETH_PTPTSCR_TSSARFE | ETH_PTPTSCR_TSSSR;
+	ETH_PTPSSIR = inc & ETH_PTPSSIR_STSSI;
+
+	eth_ptp_set_addend(PtpAddend);
+	ETH_PTPTSCR |= ETH_PTPTSCR_TSFCU;
+
+	eth_ptp_set_time(0);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the PTP clock
+ *
+ * @returns uint64_t Time (ns)
+ */
+uint64_t eth_ptp_get_time(void)
+{
+	uint32_t sec, ns;
+
+	/* read again if the seconds changed in between */
+	do {
+		sec = ETH_PTPTSHR;
+		ns = ETH_PTPTSLR & ETH_PTPTSLR_STSS;
+	} while (sec != ETH_PTPTSHR);
+
+	return (uint64_t)sec * ETH_PTP_NS_PER_SEC + ns;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the PTP clock
+ *
+ * @param[in] ns uint64_t Time (ns)
+ */
+void eth_ptp_set_time(uint64_t ns)
+{
+	ETH_PTPTSHUR = ns / ETH_PTP_NS_PER_SEC;
+	ETH_PTPTSLUR = ns % ETH_PTP_NS_PER_SEC;
+
+	ETH_PTPTSCR |= ETH_PTPTSCR_TSSTI;
+	while (ETH_PTPTSCR & ETH_PTPTSCR_TSSTI);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Coarse correction of the PTP clock
+ *
+ * @param[in] delta int64_t Time added to the clock (ns, can be negative)
+ */
+void eth_ptp_adjust_time(int64_t delta)
+{
+	uint64_t mag = (delta < 0) ? -delta : delta;
+	uint32_t ns = mag % ETH_PTP_NS_PER_SEC;
+
+	/* In digital rollover mode, the subseconds to subtract are
+	 * programmed as 10^9 - ns (the seconds stay as is), and 0 for a
+	 * whole number of seconds (10^9 is out of range).
+	 */
+	if (delta < 0) {
+		ns = (ns ? (ETH_PTP_NS_PER_SEC - ns) : 0) | ETH_PTPTSLUR_TSUPNS;
+	}
+
+	ETH_PTPTSHUR = mag / ETH_PTP_NS_PER_SEC;
+	ETH_PTPTSLUR = ns;
+
+	ETH_PTPTSCR |= ETH_PTPTSCR_TSSTU;
+	while (ETH_PTPTSCR & ETH_PTPTSCR_TSSTU);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Fine correction of the PTP clock frequency
+ *
+ * @param[in] ppb int32_t Frequency offset from nominal (parts per billion)
+ */
+void eth_ptp_adjust_freq(int32_t ppb)
+{
+	int64_t diff = (int64_t)PtpAddend * ppb / (int64_t)ETH_PTP_NS_PER_SEC;
+
+	eth_ptp_set_addend(PtpAddend + diff);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Arm the target time interrupt
+ *
+ * The interrupt is raised once when the PTP clock reach @a ns. Enable the
+ * ETH interrupt with ETH_DMAIER_NISE and handle it with eth_ptp_irq().
+ *
+ * @param[in] ns uint64_t Target time (ns)
+ */
+void eth_ptp_set_target(uint64_t ns)
+{
+	ETH_PTPTTHR = ns / ETH_PTP_NS_PER_SEC;
+	ETH_PTPTTLR = ns % ETH_PTP_NS_PER_SEC;
+
+	ETH_MACIMR &= ~ETH_MACIMR_TSTIM;
+	ETH_PTPTSCR |= ETH_PTPTSCR_TSITE;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Target time interrupt handler
+ *
+ * @returns bool true, if the target time has been reached
+ */
+bool eth_ptp_irq(void)
+{
+	if (!(ETH_MACSR & ETH_MACSR_TSTS)) {
+		return false;
+	}
+
+	(void)ETH_PTPTSSR; /* clears the status */
+	ETH_MACIMR |= ETH_MACIMR_TSTIM;
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the transmit timestamp callback
+ *
+ * While a callback is set, a timestamp is requested for every frame queued
+ * and the callback is called from eth_tx_reclaim().
+ *
+ * @param[in] callback eth_ptp_tx_callback Callback (NULL to disable)
+ */
+void eth_ptp_set_tx_callback(eth_ptp_tx_callback callback)
+{
+	PtpTxCallback = callback;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Timestamp of the last frame returned by eth_rx_buf()
+ *
+ * @param[out] ns uint64_t* PTP time of reception
+ * @returns bool true, if the frame has a timestamp
+ */
+bool eth_ptp_rx_timestamp(uint64_t *ns)
+{
+	if (RxStampValid) {
+		*ns = RxStamp;
+	}
+
+	return RxStampValid;
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start a SMI transaction, without waiting for it to be done
+ *
+ * The previous transaction has to be done (see eth_smi_busy()).
+ *
+ * @param[in] phy uint8_t ID of the PHY
  * @param[in] reg uint8_t Register address
+ * @param[in] write bool true to write @a data, false to read
  * @param[in] data uint16_t Data to write
  */
-void eth_smi_write(uint8_t phy, uint8_t reg, uint16_t data)
+void eth_smi_start(uint8_t phy, uint8_t reg, bool write, uint16_t data)
 {
-	/* Write operation MW=1*/
+	if (write) {
+		ETH_MACMIIDR = data & ETH_MACMIIDR_MD;
+	}
+
 	ETH_MACMIIAR = (ETH_MACMIIAR & ETH_MACMIIAR_CR) | /* save clocks */
 			(phy << ETH_MACMIIAR_PA_SHIFT) |
 			(reg << ETH_MACMIIAR_MR_SHIFT) |
-			ETH_MACMIIAR_MW;
+			(write ? ETH_MACMIIAR_MW : 0) |
+			ETH_MACMIIAR_MB;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Is a SMI transaction in progress ?
+ *
+ * @returns bool true, if busy
+ */
+bool eth_smi_busy(void)
+{
+	return ETH_MACMIIAR & ETH_MACMIIAR_MB;
+}
 
-	ETH_MACMIIDR = data & ETH_MACMIIDR_MD;
+/*---------------------------------------------------------------------------*/
+/** @brief Data of the last SMI read transaction
+ *
+ * @returns uint16_t Readed data
+ */
+uint16_t eth_smi_data(void)
+{
+	return (uint16_t)(ETH_MACMIIDR & ETH_MACMIIDR_MD);
+}
 
-	eth_smi_transact();
+/*---------------------------------------------------------------------------*/
+/** @brief Write 16-bit register to the PHY
+ *
+ * @param[in] phy uint8_t ID of the PHY (defaults to 1)
+ * @param[in] reg uint8_t Register address
+ * @param[in] data uint16_t Data to write
+ */
+void eth_smi_write(uint8_t phy, uint8_t reg, uint16_t data)
+{
+	while (eth_smi_busy());
+	eth_smi_start(phy, reg, true, data);
+	while (eth_smi_busy());
 }
 
 /*---------------------------------------------------------------------------*/
@@ -339,14 +1296,11 @@ void eth_smi_write(uint8_t phy, uint8_t reg, uint16_t data)
  */
 uint16_t eth_smi_read(uint8_t phy, uint8_t reg)
 {
-	/* Read operation MW=0*/
-	ETH_MACMIIAR = (ETH_MACMIIAR & ETH_MACMIIAR_CR) | /* save clocks */
-			(phy << ETH_MACMIIAR_PA_SHIFT) |
-			(reg << ETH_MACMIIAR_MR_SHIFT);
-
-	eth_smi_transact();
+	while (eth_smi_busy());
+	eth_smi_start(phy, reg, false, 0);
+	while (eth_smi_busy());
 
-	return (uint16_t)(ETH_MACMIIDR & ETH_MACMIIDR_MD);
+	return eth_smi_data();
 }
 
 /*---------------------------------------------------------------------------*/
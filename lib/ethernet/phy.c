@@ -30,6 +30,7 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
 #include <unicore-mx/ethernet/mac.h>
 #include <unicore-mx/ethernet/phy.h>
 
@@ -58,6 +59,254 @@ void phy_reset(uint8_t phy)
 	while (eth_smi_read(phy, PHY_REG_BCR) & PHY_REG_BCR_RESET);
 }
 
+/*---------------------------------------------------------------------------*/
+/* Asynchronous MDIO
+ *
+ * Transactions are queued and processed one at a time by phy_mdio_poll(),
+ * so the caller never waits for the SMI. The queue is not interrupt safe,
+ * and the blocking eth_smi_*() functions must not be used while it is busy.
+ */
+
+struct phy_mdio_op {
+	phy_mdio_callback callback;
+	void *arg;
+	uint16_t data;
+	uint8_t phy;
+	uint8_t reg;
+	bool write;
+};
+
+static struct phy_mdio_op MdioQueue[PHY_MDIO_QUEUE_SIZE];
+static uint32_t MdioHead, MdioTail;
+static bool MdioActive;
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue a MDIO transaction
+ *
+ * @param[in] phy uint8_t phy ID of the PHY
+ * @param[in] reg uint8_t Register address
+ * @param[in] write bool true to write @a data, false to read
+ * @param[in] data uint16_t Data to write
+ * @param[in] callback phy_mdio_callback Called when done (can be NULL)
+ * @param[in] arg void* Argument of @a callback
+ * @returns bool true, if queued
+ */
+bool phy_mdio_queue(uint8_t phy, uint8_t reg, bool write, uint16_t data,
+		    phy_mdio_callback callback, void *arg)
+{
+	struct phy_mdio_op *op;
+
+	if (MdioHead - MdioTail >= PHY_MDIO_QUEUE_SIZE) {
+		return false;
+	}
+
+	op = &MdioQueue[MdioHead % PHY_MDIO_QUEUE_SIZE];
+	op->callback = callback;
+	op->arg = arg;
+	op->data = data;
+	op->phy = phy;
+	op->reg = reg;
+	op->write = write;
+	MdioHead++;
+
+	phy_mdio_poll();
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Complete the current MDIO transaction and start the next one
+ *
+ * Never waits, to be called periodically (phy_link_tick() does).
+ */
+void phy_mdio_poll(void)
+{
+	struct phy_mdio_op *op;
+
+	if (MdioTail == MdioHead || eth_smi_busy()) {
+		return;
+	}
+
+	op = &MdioQueue[MdioTail % PHY_MDIO_QUEUE_SIZE];
+
+	if (MdioActive) {
+		uint16_t data = op->write ? op->data : eth_smi_data();
+
+		MdioActive = false;
+		MdioTail++;
+
+		if (op->callback != NULL) {
+			op->callback(op->arg, data);
+		}
+
+		if (MdioTail == MdioHead || MdioActive) {
+			return;
+		}
+
+		op = &MdioQueue[MdioTail % PHY_MDIO_QUEUE_SIZE];
+	}
+
+	eth_smi_start(op->phy, op->reg, op->write, op->data);
+	MdioActive = true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Store the result of a link state machine transaction
+ */
+static void phy_link_done(void *arg, uint16_t data)
+{
+	struct phy_link *link = arg;
+
+	link->data = data;
+	link->pending = false;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue a transaction and enter @a next when queued
+ */
+static void phy_link_op(struct phy_link *link, uint8_t reg, bool write,
+			uint16_t data, enum phy_state next)
+{
+	link->pending = true;
+
+	if (phy_mdio_queue(link->phy, reg, write, data, phy_link_done, link)) {
+		link->state = next;
+	} else {
+		link->pending = false; /* retried on next tick */
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Resolve the negotiated link from the common abilities
+ */
+static enum phy_status phy_link_resolve(uint16_t common)
+{
+	if (common & PHY_REG_AN_100FD) {
+		return LINK_FD_100M;
+	} else if (common & PHY_REG_AN_100HD) {
+		return LINK_HD_100M;
+	} else if (common & PHY_REG_AN_10FD) {
+		return LINK_FD_10M;
+	}
+
+	/* 10M half duplex, also for a partner without autonegotiation */
+	return LINK_HD_10M;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Report a link change and set the MAC to it
+ */
+static void phy_link_set(struct phy_link *link, enum phy_status status)
+{
+	if (link->status == status) {
+		return;
+	}
+
+	link->status = status;
+
+	if (status != LINK_DOWN) {
+		eth_set_link(status == LINK_HD_100M || status == LINK_FD_100M,
+			     status >= LINK_FD_10M);
+	}
+
+	if (link->callback != NULL) {
+		link->callback(link->phy, status);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the link state machine
+ *
+ * The PHY is reset and the autonegotiation started by phy_link_tick().
+ *
+ * @param[in] link struct phy_link* State machine
+ * @param[in] phy uint8_t phy ID of the PHY
+ * @param[in] callback phy_link_callback Called on link change (can be NULL)
+ */
+void phy_link_init(struct phy_link *link, uint8_t phy,
+		   phy_link_callback callback)
+{
+	link->phy = phy;
+	link->pending = false;
+	link->state = PHY_STATE_RESET;
+	link->status = LINK_DOWN;
+	link->data = 0;
+	link->adv = 0;
+	link->timer = 0;
+	link->callback = callback;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Advance the link state machine
+ *
+ * Never waits for the PHY: each call handles the result of the previous
+ * MDIO transaction and queues the next one. To be called periodically
+ * (ie. every 10ms), the link is checked on every call once negotiated.
+ *
+ * @param[in] link struct phy_link* State machine
+ */
+void phy_link_tick(struct phy_link *link)
+{
+	phy_mdio_poll();
+
+	if (link->pending) {
+		return;
+	}
+
+	switch (link->state) {
+	case PHY_STATE_RESET:
+		link->timer = 0;
+		phy_link_set(link, LINK_DOWN);
+		phy_link_op(link, PHY_REG_BCR, true, PHY_REG_BCR_RESET,
+			    PHY_STATE_RESET_WAIT);
+		break;
+
+	case PHY_STATE_RESET_WAIT:
+		phy_link_op(link, PHY_REG_BCR, false, 0, PHY_STATE_RESET_CHECK);
+		break;
+
+	case PHY_STATE_RESET_CHECK:
+		if (!(link->data & PHY_REG_BCR_RESET)) {
+			phy_link_op(link, PHY_REG_BCR, true,
+				    PHY_REG_BCR_AN | PHY_REG_BCR_ANRST,
+				    PHY_STATE_POLL);
+		} else if (++link->timer > PHY_RESET_TIMEOUT) {
+			link->state = PHY_STATE_RESET;
+		} else {
+			link->state = PHY_STATE_RESET_WAIT;
+		}
+		break;
+
+	case PHY_STATE_POLL:
+		phy_link_op(link, PHY_REG_BSR, false, 0, PHY_STATE_LINK);
+		break;
+
+	case PHY_STATE_LINK:
+		if ((link->data & (PHY_REG_BSR_UP | PHY_REG_BSR_ANDONE)) !=
+		    (PHY_REG_BSR_UP | PHY_REG_BSR_ANDONE)) {
+			phy_link_set(link, LINK_DOWN);
+			link->state = PHY_STATE_POLL;
+		} else if (link->status == LINK_DOWN) {
+			phy_link_op(link, PHY_REG_ANTX, false, 0,
+				    PHY_STATE_ADV);
+		} else {
+			link->state = PHY_STATE_POLL;
+		}
+		break;
+
+	case PHY_STATE_ADV:
+		link->adv = link->data;
+		phy_link_op(link, PHY_REG_ANRX, false, 0, PHY_STATE_LPA);
+		break;
+
+	case PHY_STATE_LPA:
+		phy_link_set(link, phy_link_resolve(link->adv & link->data));
+		link->state = PHY_STATE_POLL;
+		break;
+	}
+
+	phy_mdio_poll();
+}
+
 /*---------------------------------------------------------------------------*/
 
 /**@}*/
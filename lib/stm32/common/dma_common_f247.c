@@ -46,6 +46,9 @@ LGPL License Terms @ref lgpl_license
 /**@{*/
 
 #include <unicore-mx/stm32/dma.h>
+#if defined(STM32F7)
+#include <unicore-mx/cm3/scb.h>
+#endif
 
 /*---------------------------------------------------------------------------*/
 /** @brief DMA Stream Reset
@@ -680,15 +683,65 @@ void dma_set_fifo_threshold(uint32_t dma, uint8_t stream, uint32_t threshold)
 	DMA_SFCR(dma, stream) = (reg32 | threshold);
 }
 
+#if defined(STM32F7)
+/*---------------------------------------------------------------------------*/
+/** @brief DMA Stream D-cache maintenance before the transfer
+
+Memory read by the stream is cleaned, memory written by the stream is cleaned
+and invalidated so that no dirty line is evicted over the transferred data.
+The size is taken from the number of data and peripheral data size.
+
+@param[in] dma unsigned int32. DMA controller base address: DMA1 or DMA2
+@param[in] stream unsigned int8. Stream number: @ref dma_st_number
+*/
+
+static void dma_cache_prepare(uint32_t dma, uint8_t stream)
+{
+	uint32_t reg32 = DMA_SCR(dma, stream);
+	uint32_t len = DMA_SNDTR(dma, stream) <<
+		((reg32 & DMA_SxCR_PSIZE_MASK) >> DMA_SxCR_PSIZE_SHIFT);
+
+	switch (reg32 & DMA_SxCR_DIR_MASK) {
+	case DMA_SxCR_DIR_MEM_TO_PERIPHERAL:
+		scb_clean_dcache_range((void *)DMA_SM0AR(dma, stream), len);
+		if (reg32 & DMA_SxCR_DBM) {
+			scb_clean_dcache_range((void *)DMA_SM1AR(dma, stream), len);
+		}
+		break;
+	case DMA_SxCR_DIR_MEM_TO_MEM:
+		scb_clean_dcache_range((void *)DMA_SPAR(dma, stream), len);
+		scb_clean_invalidate_dcache_range((void *)DMA_SM0AR(dma, stream),
+						  len);
+		break;
+	default:
+		scb_clean_invalidate_dcache_range((void *)DMA_SM0AR(dma, stream),
+						  len);
+		if (reg32 & DMA_SxCR_DBM) {
+			scb_clean_invalidate_dcache_range(
+				(void *)DMA_SM1AR(dma, stream), len);
+		}
+		break;
+	}
+}
+#endif
+
 /*---------------------------------------------------------------------------*/
 /** @brief DMA Stream Enable
 
+@note On STM32F7 the D-cache is cleaned for the memory to be transferred
+(see the stream configuration). Memory written by the stream has to be
+invalidated with scb_invalidate_dcache_range() before the CPU read it.
+The buffers should be aligned with SCB_DCACHE_ALIGNED.
+
 @param[in] dma unsigned int32. DMA controller base address: DMA1 or DMA2
 @param[in] stream unsigned int8. Stream number: @ref dma_st_number
 */
 
 void dma_enable_stream(uint32_t dma, uint8_t stream)
 {
+#if defined(STM32F7)
+	dma_cache_prepare(dma, stream);
+#endif
 	DMA_SCR(dma, stream) |= DMA_SxCR_EN;
 }
 
@@ -51,3 +51,25 @@ void desig_get_unique_id_as_string(char *string,
 	string[len] = '\0';
 }
 
+unsigned int desig_get_unique_id_as_utf16(uint16_t *string,
+					   unsigned int string_len)
+{
+	unsigned int i;
+	uint32_t dev_id_buf[3];
+	uint8_t *device_id = (uint8_t *)dev_id_buf;
+	const char chars[] = "0123456789ABCDEF";
+
+	desig_get_unique_id(dev_id_buf);
+
+	/* Each byte produces two characters */
+	if (string_len > 2 * sizeof(dev_id_buf)) {
+		string_len = 2 * sizeof(dev_id_buf);
+	}
+
+	for (i = 0; i < string_len; i++) {
+		uint8_t nibble = device_id[i / 2] >> ((i & 1) ? 0 : 4);
+		string[i] = chars[nibble & 0x0F];
+	}
+
+	return string_len;
+}
@@ -267,6 +267,35 @@ void dwc_otg_ep_prepare(usbd_device *dev, uint8_t addr,
 	}
 }
 
+/**
+ * FIFO memory used by an endpoint, same accounting as dwc_otg_ep_prepare():
+ *  IN endpoint get a dedicated TX FIFO (words, at least 16).
+ *  OUT endpoint share the RX FIFO, the packet part is counted for each
+ *  of them (so the total can be larger than what is actually used).
+ */
+uint16_t dwc_otg_ep_mem_size(uint8_t addr, usbd_ep_type type,
+					uint16_t max_size, usbd_ep_flags flags)
+{
+	uint16_t fifo_word;
+
+	if (flags & USBD_EP_DOUBLE_BUFFER) {
+		max_size *= 2;
+	}
+
+	fifo_word = DIVIDE_AND_CEIL(max_size, 4);
+
+	if (IS_IN_ENDPOINT(addr)) {
+		fifo_word = MAX(fifo_word, 16);
+	} else {
+		fifo_word += (type == USBD_EP_CONTROL) ? 13 + 2 + 1 : 2 + 1;
+		if (flags & USBD_EP_DOUBLE_BUFFER) {
+			fifo_word += 1;
+		}
+	}
+
+	return fifo_word * 4;
+}
+
 void dwc_otg_ep_prepare_end(usbd_device *dev)
 {
 	uint16_t fifo_rx = dev->private_data.fifo_rx_usage_overall +
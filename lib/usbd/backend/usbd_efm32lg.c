@@ -78,6 +78,7 @@ const struct usbd_backend usbd_efm32lg = {
 	.ep_prepare_start = dwc_otg_ep_prepare_start,
 	.ep_prepare = dwc_otg_ep_prepare,
 	.ep_prepare_end = dwc_otg_ep_prepare_end,
+	.ep_mem_size = dwc_otg_ep_mem_size,
 	.set_ep_dtog = dwc_otg_set_ep_dtog,
 	.get_ep_dtog = dwc_otg_get_ep_dtog,
 	.set_ep_stall = dwc_otg_set_ep_stall,
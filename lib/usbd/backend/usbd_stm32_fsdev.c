@@ -534,7 +534,11 @@ static void ep_prepare(usbd_device *dev, uint8_t addr, usbd_ep_type type,
 	LOG_CALL
 
 	(void) interval;
-	(void) flags;
+
+	if (flags & USBD_EP_DOUBLE_BUFFER) {
+		LOGF_LN("DOUBLE_BUFFER flag for endpoint 0x%"PRIx8
+			" not supported, ignored", addr);
+	}
 
 	uint8_t num = ENDPOINT_NUMBER(addr);
 	uint16_t reg16 = USB_EP(num) & ~(USB_EP_EA_MASK | USB_EP_TYPE_MASK);
@@ -571,6 +575,29 @@ static void ep_prepare(usbd_device *dev, uint8_t addr, usbd_ep_type type,
 	}
 }
 
+/**
+ * PMA used by an endpoint, rounded like ep_prepare() do.
+ * Double buffering is not supported: it would need the endpoint number
+ *  for itself (both buffer descriptors) and transfer code that follow
+ *  the software buffer toggle.
+ */
+static uint16_t ep_mem_size(uint8_t addr, usbd_ep_type type,
+				uint16_t max_size, usbd_ep_flags flags)
+{
+	(void) type;
+
+	if (flags & USBD_EP_DOUBLE_BUFFER) {
+		return 0;
+	}
+
+	if (IS_IN_ENDPOINT(addr)) {
+		return (max_size + 1) & ~1;
+	}
+
+	calc_ep_count_rx(&max_size);
+	return max_size;
+}
+
 static void set_ep_stall(usbd_device *dev, uint8_t addr, bool stall)
 {
 	(void) dev;
@@ -1069,6 +1096,7 @@ const struct usbd_backend usbd_stm32_fsdev = {
 	.get_address = get_address,
 	.ep_prepare_start = ep_prepare_start,
 	.ep_prepare = ep_prepare,
+	.ep_mem_size = ep_mem_size,
 	.get_ep_dtog = get_ep_dtog,
 	.set_ep_dtog = set_ep_dtog,
 	.set_ep_stall = set_ep_stall,
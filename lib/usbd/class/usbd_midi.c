@@ -0,0 +1,480 @@
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unicore-mx/cm3/common.h>
+#include <unicore-mx/usbd/usbd.h>
+#include <unicore-mx/usbd/class/midi.h>
+#include "../usbd_private.h"
+
+/*
+ * Event packets written by application are not sent to host immediately.
+ * They are queued and sent in batch (upto one full bulk packet per transfer)
+ * when:
+ *  - the queue has enough event to fill a packet
+ *  - usbd_midi_flush() is called (application call it from SOF callback)
+ *
+ * This keep the number of URB used to (atmost) one for IN endpoint
+ * irrespective of the event rate.
+ */
+
+#if (USBD_MIDI_QUEUE_LENGTH & (USBD_MIDI_QUEUE_LENGTH - 1)) != 0
+# error "USBD_MIDI_QUEUE_LENGTH need to be power of 2"
+#endif
+
+#if USBD_MIDI_QUEUE_LENGTH > 32768
+# error "USBD_MIDI_QUEUE_LENGTH is too large"
+#endif
+
+#if (USBD_MIDI_MAX_PACKET_SIZE % USB_MIDI_EVENT_SIZE) != 0
+# error "USBD_MIDI_MAX_PACKET_SIZE need to be multiple of 4"
+#endif
+
+#define QUEUE_MASK (USBD_MIDI_QUEUE_LENGTH - 1)
+
+struct usbd_midi {
+	usbd_device *dev;
+	uint8_t ep_in;
+	uint16_t ep_in_size;
+	uint8_t ep_out;
+	uint16_t ep_out_size;
+	usbd_midi_recv_callback recv_callback;
+
+	/* Free running index, masked on access */
+	uint16_t head, tail;
+	uint8_t queue[USBD_MIDI_QUEUE_LENGTH][USB_MIDI_EVENT_SIZE];
+
+	/* IN transfer in progress (data in tx_buf) */
+	bool tx_busy;
+	uint8_t tx_buf[USBD_MIDI_MAX_PACKET_SIZE];
+	uint8_t rx_buf[USBD_MIDI_MAX_PACKET_SIZE];
+
+	/* SysEx bytes that do not make a complete event packet yet */
+	uint8_t sysex_buf[3];
+	uint8_t sysex_len;
+};
+
+static usbd_midi _midi[USBD_MIDI_MAX];
+
+static inline unsigned queue_used(usbd_midi *midi)
+{
+	return (uint16_t) (midi->head - midi->tail);
+}
+
+static inline unsigned queue_free(usbd_midi *midi)
+{
+	return USBD_MIDI_QUEUE_LENGTH - queue_used(midi);
+}
+
+/** Number of event packet that make a full bulk packet */
+static inline unsigned events_per_packet(usbd_midi *midi)
+{
+	return midi->ep_in_size / USB_MIDI_EVENT_SIZE;
+}
+
+static void queue_push(usbd_midi *midi, uint8_t header,
+				uint8_t b0, uint8_t b1, uint8_t b2)
+{
+	uint8_t *ev = midi->queue[midi->head & QUEUE_MASK];
+	ev[0] = header;
+	ev[1] = b0;
+	ev[2] = b1;
+	ev[3] = b2;
+	midi->head++;
+}
+
+static void send_to_host(usbd_midi *midi);
+
+static void send_to_host_callback(usbd_device *dev,
+		const usbd_transfer *transfer, usbd_transfer_status status,
+		usbd_urb_id urb_id)
+{
+	(void) dev;
+	(void) urb_id;
+
+	usbd_midi *midi = transfer->user_data;
+
+	/* Transfer is gone (success or not), the events are not retried.
+	 *  On error (cancel, config change, disconnect...) there is
+	 *  nobody to receive them anyway */
+	midi->tx_busy = false;
+
+	/* Keep streaming as long as there is a full packet.
+	 *  Remaining will be sent on next usbd_midi_flush() */
+	if (status == USBD_SUCCESS &&
+			queue_used(midi) >= events_per_packet(midi)) {
+		send_to_host(midi);
+	}
+}
+
+/**
+ * Move (upto one bulk packet of) queued events to @a midi->tx_buf
+ *  and submit them to host.
+ */
+static void send_to_host(usbd_midi *midi)
+{
+	unsigned i, count = MIN(queue_used(midi), events_per_packet(midi));
+
+	if (midi->tx_busy || !count) {
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		memcpy(&midi->tx_buf[i * USB_MIDI_EVENT_SIZE],
+			midi->queue[(midi->tail + i) & QUEUE_MASK],
+			USB_MIDI_EVENT_SIZE);
+	}
+
+	const usbd_transfer transfer = {
+		.ep_type = USBD_EP_BULK,
+		.ep_addr = midi->ep_in,
+		.ep_size = midi->ep_in_size,
+		.ep_interval = USBD_INTERVAL_NA,
+		.buffer = midi->tx_buf,
+		.length = count * USB_MIDI_EVENT_SIZE,
+		.flags = USBD_FLAG_NONE,
+		.timeout = USBD_TIMEOUT_NEVER,
+		.callback = send_to_host_callback,
+		.user_data = midi
+	};
+
+	midi->tx_busy = true;
+
+	if (usbd_transfer_submit(midi->dev, &transfer) == USBD_INVALID_URB_ID) {
+		/* Keep the events in queue, try again on next flush */
+		midi->tx_busy = false;
+		return;
+	}
+
+	midi->tail += count;
+}
+
+/**
+ * Send if a full bulk packet worth of events is queued.
+ */
+static inline void send_if_full(usbd_midi *midi)
+{
+	if (queue_used(midi) >= events_per_packet(midi)) {
+		send_to_host(midi);
+	}
+}
+
+static void recv_from_host(usbd_midi *midi);
+
+static void recv_from_host_callback(usbd_device *dev,
+		const usbd_transfer *transfer, usbd_transfer_status status,
+		usbd_urb_id urb_id)
+{
+	(void) urb_id;
+
+	switch (status) {
+	case USBD_SUCCESS:
+	break;
+	case USBD_ERR_TIMEOUT:
+	case USBD_ERR_IO:
+	case USBD_ERR_BABBLE:
+	case USBD_ERR_DTOG:
+	case USBD_ERR_SHORT_PACKET:
+	case USBD_ERR_OVERFLOW:
+		usbd_transfer_submit(dev, transfer);
+	return;
+	default:
+	return;
+	}
+
+	usbd_midi *midi = transfer->user_data;
+
+	if (midi->recv_callback != NULL) {
+		unsigned count = transfer->transferred / USB_MIDI_EVENT_SIZE;
+		if (count) {
+			midi->recv_callback(midi, midi->rx_buf, count);
+		}
+	}
+
+	recv_from_host(midi);
+}
+
+static void recv_from_host(usbd_midi *midi)
+{
+	const usbd_transfer transfer = {
+		.ep_type = USBD_EP_BULK,
+		.ep_addr = midi->ep_out,
+		.ep_size = midi->ep_out_size,
+		.ep_interval = USBD_INTERVAL_NA,
+		.buffer = midi->rx_buf,
+		.length = midi->ep_out_size,
+		.flags = USBD_FLAG_SHORT_PACKET,
+		.timeout = USBD_TIMEOUT_NEVER,
+		.callback = recv_from_host_callback,
+		.user_data = midi
+	};
+
+	usbd_transfer_submit(midi->dev, &transfer);
+}
+
+/**
+ * Code Index Number for MIDI message with status byte @a status
+ * @param[out] len Number of bytes in message
+ * @return CIN
+ * @return 0xFF if @a status cannot be sent using usbd_midi_write_message()
+ */
+static uint8_t message_cin(uint8_t status, unsigned *len)
+{
+	switch (status & 0xF0) {
+	case 0x80:
+	case 0x90:
+	case 0xA0:
+	case 0xB0:
+	case 0xE0:
+		*len = 3;
+	return status >> 4;
+	case 0xC0:
+	case 0xD0:
+		*len = 2;
+	return status >> 4;
+	case 0xF0:
+	break;
+	default:
+		/* Data byte (running status not supported) */
+	return 0xFF;
+	}
+
+	switch (status) {
+	case 0xF1: /* MTC Quarter Frame */
+	case 0xF3: /* Song Select */
+		*len = 2;
+	return USB_MIDI_CIN_SYSCOMMON_2BYTE;
+	case 0xF2: /* Song Position Pointer */
+		*len = 3;
+	return USB_MIDI_CIN_SYSCOMMON_3BYTE;
+	case 0xF6: /* Tune Request */
+		*len = 1;
+	return USB_MIDI_CIN_SYSEX_END_1BYTE;
+	case 0xF0: /* SysEx: use usbd_midi_write_sysex() */
+	case 0xF7:
+	case 0xF4:
+	case 0xF5:
+	return 0xFF;
+	default: /* Real time */
+		*len = 1;
+	return USB_MIDI_CIN_SINGLE_BYTE;
+	}
+}
+
+/** @addtogroup usbd_midi */
+/** @{ */
+
+/**
+ * @brief Queue a raw USB-MIDI event packet
+ * @param[in] midi MIDI object
+ * @param[in] event Event packet (byte 0: Cable number and CIN, byte 1..3: MIDI)
+ * @return true on success
+ * @return false if queue is full
+ */
+bool usbd_midi_write_event(usbd_midi *midi, const uint8_t event[4])
+{
+	if (!queue_free(midi)) {
+		return false;
+	}
+
+	queue_push(midi, event[0], event[1], event[2], event[3]);
+	send_if_full(midi);
+	return true;
+}
+
+/**
+ * @brief Queue a MIDI (channel, system common or real time) message
+ * @param[in] midi MIDI object
+ * @param[in] cable Virtual cable number (0..15)
+ * @param[in] msg Message (starting with status byte)
+ * @param[in] len Length of @a msg
+ * @return true on success
+ * @return false if queue is full or @a msg is invalid
+ * @note SysEx message need to be sent using usbd_midi_write_sysex()
+ */
+bool usbd_midi_write_message(usbd_midi *midi, uint8_t cable,
+				const uint8_t *msg, unsigned len)
+{
+	unsigned msg_len;
+	uint8_t cin;
+
+	if (!len) {
+		return false;
+	}
+
+	cin = message_cin(msg[0], &msg_len);
+	if (cin == 0xFF || len < msg_len) {
+		return false;
+	}
+
+	if (!queue_free(midi)) {
+		return false;
+	}
+
+	queue_push(midi, USB_MIDI_EVENT_HEADER(cable, cin), msg[0],
+		(msg_len > 1) ? msg[1] : 0, (msg_len > 2) ? msg[2] : 0);
+	send_if_full(midi);
+	return true;
+}
+
+/**
+ * @brief Queue SysEx data
+ *
+ * The SysEx message can be provided in multiple calls.
+ * The first byte of the message must be 0xF0 and the last byte 0xF7.
+ * Data is packed 3 bytes per event packet, the remaining bytes are kept
+ *  internally till more data (or the 0xF7 terminator) is provided.
+ *
+ * @param[in] midi MIDI object
+ * @param[in] cable Virtual cable number (0..15)
+ * @param[in] data SysEx data
+ * @param[in] len Length of @a data
+ * @return Number of bytes consumed from @a data (less than @a len if queue full)
+ * @note Only one SysEx message can be in progress at a time.
+ */
+unsigned usbd_midi_write_sysex(usbd_midi *midi, uint8_t cable,
+				const uint8_t *data, unsigned len)
+{
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		uint8_t b = data[i];
+		uint8_t *buf = midi->sysex_buf;
+
+		/* Byte that will complete an event packet need space in queue */
+		if ((midi->sysex_len == 2 || b == 0xF7) && !queue_free(midi)) {
+			break;
+		}
+
+		if (b == 0xF0) {
+			/* Start of message, drop any unterminated data */
+			midi->sysex_len = 0;
+		}
+
+		buf[midi->sysex_len++] = b;
+
+		if (b == 0xF7) {
+			uint8_t cin = USB_MIDI_CIN_SYSEX_END_1BYTE + midi->sysex_len - 1;
+			queue_push(midi, USB_MIDI_EVENT_HEADER(cable, cin), buf[0],
+				(midi->sysex_len > 1) ? buf[1] : 0,
+				(midi->sysex_len > 2) ? buf[2] : 0);
+			midi->sysex_len = 0;
+			send_if_full(midi);
+		} else if (midi->sysex_len == 3) {
+			queue_push(midi,
+				USB_MIDI_EVENT_HEADER(cable, USB_MIDI_CIN_SYSEX_START),
+				buf[0], buf[1], buf[2]);
+			midi->sysex_len = 0;
+			send_if_full(midi);
+		}
+	}
+
+	return i;
+}
+
+/**
+ * @brief Send queued events to host
+ *
+ * Application should call this from SOF callback
+ *  (see usbd_register_sof_callback()) so that queued events
+ *  are sent in batch every frame.
+ * @param[in] midi MIDI object
+ */
+void usbd_midi_flush(usbd_midi *midi)
+{
+	send_to_host(midi);
+}
+
+/**
+ * @brief Number of event packets that can be queued
+ * @param[in] midi MIDI object
+ */
+unsigned usbd_midi_queue_free(usbd_midi *midi)
+{
+	return queue_free(midi);
+}
+
+/**
+ * @brief Start the MIDI streaming interface
+ * @param[in] midi MIDI object
+ * @note Before calling this function, application should prepare the endpoint.
+ */
+void usbd_midi_start(usbd_midi *midi)
+{
+	midi->tx_busy = false;
+	midi->sysex_len = 0;
+	recv_from_host(midi);
+	send_if_full(midi);
+}
+
+/**
+ * @brief Initializes the USB MIDI Streaming subsystem.
+ *
+ * @note Upto USBD_MIDI_MAX USB devices can have this profile active.
+ *  Calling again for the same @a dev reinitalize the object.
+ * @note All usbd_midi_*() function should be called from the same
+ *   context as usbd_poll()
+ *
+ * @param[in] dev The USB device to associate the MIDI with.
+ * @param[in] ep_in The USB 'IN' (bulk) endpoint.
+ * @param[in] ep_in_size The maximum endpoint size (upto USBD_MIDI_MAX_PACKET_SIZE)
+ * @param[in] ep_out The USB 'OUT' (bulk) endpoint.
+ * @param[in] ep_out_size The maximum endpoint size (upto USBD_MIDI_MAX_PACKET_SIZE)
+ * @param[in] recv_callback Called on events received from host (can be NULL)
+ * @return Pointer to the usbd_midi struct.
+ * @return NULL if no object is free
+ */
+usbd_midi *usbd_midi_init(usbd_device *dev,
+				uint8_t ep_in, uint16_t ep_in_size,
+				uint8_t ep_out, uint16_t ep_out_size,
+				usbd_midi_recv_callback recv_callback)
+{
+	usbd_midi *midi = NULL;
+	unsigned i;
+
+	/* Object already used by the device or a free one */
+	for (i = 0; i < USBD_MIDI_MAX; i++) {
+		if (_midi[i].dev == dev) {
+			midi = &_midi[i];
+			break;
+		}
+
+		if (midi == NULL && _midi[i].dev == NULL) {
+			midi = &_midi[i];
+		}
+	}
+
+	if (midi == NULL) {
+		return NULL;
+	}
+
+	midi->dev = dev;
+	midi->ep_in = ep_in;
+	midi->ep_in_size = MIN(ep_in_size, USBD_MIDI_MAX_PACKET_SIZE);
+	midi->ep_out = ep_out;
+	midi->ep_out_size = MIN(ep_out_size, USBD_MIDI_MAX_PACKET_SIZE);
+	midi->recv_callback = recv_callback;
+	midi->head = midi->tail = 0;
+	midi->tx_busy = false;
+	midi->sysex_len = 0;
+
+	return midi;
+}
+
+/** @} */
@@ -119,7 +119,7 @@ struct usbd_msc {
 	struct sbc_sense_info sense;
 };
 
-static usbd_msc _mass_storage;
+static usbd_msc _mass_storage[USBD_MSC_MAX];
 
 /*-- SCSI Base Responses -----------------------------------------------------*/
 
@@ -824,7 +824,8 @@ void usbd_msc_start(usbd_msc *ms)
 /**
  * @brief Initializes the USB Mass Storage subsystem.
  *
- * @note Currently you can only have this profile active.
+ * @note Upto USBD_MSC_MAX USB devices can have this profile active.
+ *  Calling again for the same @a dev reinitalize the object.
  *
  * @param[in] dev The USB device to associate the Mass Storage with.
  * @param[in] ep_in The USB 'IN' endpoint.
@@ -833,6 +834,7 @@ void usbd_msc_start(usbd_msc *ms)
  * @param[in] ep_out_size The maximum endpoint size.  Valid values: 8, 16, 32 or 64
  * @param[in] backend Backend (Cannot be NULL)
  * @return Pointer to the usbd_msc struct.
+ * @return NULL if no object is free
  * @note @a backend should be valid till the returned object is valid
 */
 usbd_msc *usbd_msc_init(usbd_device *dev,
@@ -840,7 +842,24 @@ usbd_msc *usbd_msc_init(usbd_device *dev,
 				uint8_t ep_out, uint8_t ep_out_size,
 				const usbd_msc_backend *backend)
 {
-	usbd_msc *ms = &_mass_storage;
+	usbd_msc *ms = NULL;
+	unsigned i;
+
+	/* Object already used by the device or a free one */
+	for (i = 0; i < USBD_MSC_MAX; i++) {
+		if (_mass_storage[i].dev == dev) {
+			ms = &_mass_storage[i];
+			break;
+		}
+
+		if (ms == NULL && _mass_storage[i].dev == NULL) {
+			ms = &_mass_storage[i];
+		}
+	}
+
+	if (ms == NULL) {
+		return NULL;
+	}
 
 	ms->dev = dev;
 	ms->ep_in = ep_in;
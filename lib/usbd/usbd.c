@@ -51,6 +51,8 @@ usbd_device* usbd_init(const usbd_backend *backend,
 	}
 
 	dev->info = info;
+	dev->set_address_value = 0;
+	usbd_string_select(dev, info->device.string);
 
 	dev->callback.reset = NULL;
 	dev->callback.sof = NULL;
@@ -60,6 +62,12 @@ usbd_device* usbd_init(const usbd_backend *backend,
 	dev->callback.set_interface = NULL;
 	dev->callback.setup = NULL;
 
+	dev->control.table = NULL;
+	dev->control.count = 0;
+	dev->control.user_data = NULL;
+
+	dev->composite = NULL;
+
 	dev->urbs.next_id = 1;
 
 	dev->urbs.force_all_new_urb_to_waiting = false;
@@ -84,6 +92,25 @@ void usbd_register_setup_callback(usbd_device *dev,
 	dev->callback.setup = callback;
 }
 
+void usbd_register_control_handlers(usbd_device *dev,
+		const usbd_control_handler *table, unsigned count, void *user_data)
+{
+#if defined(USBD_DEBUG)
+	unsigned i;
+	for (i = 1; i < count; i++) {
+		uint16_t prev = (table[i - 1].bmRequestType << 8) | table[i - 1].bRequest;
+		uint16_t curr = (table[i].bmRequestType << 8) | table[i].bRequest;
+		if (prev > curr) {
+			LOGF_LN("WARNING: control handler table not sorted at index %u", i);
+		}
+	}
+#endif
+
+	dev->control.table = table;
+	dev->control.count = (table != NULL) ? count : 0;
+	dev->control.user_data = user_data;
+}
+
 void usbd_register_set_config_callback(usbd_device *dev,
 				usbd_set_config_callback callback)
 {
@@ -0,0 +1,548 @@
+/**
+ * @defgroup usbd_composite_file USB Composite Device
+ *
+ * @ingroup USBD
+ *
+ * @brief <b>USB Composite Device builder</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <string.h>
+#include <unicore-mx/usbd/usbd.h>
+#include <unicore-mx/usbd/composite.h>
+#include "usbd_private.h"
+
+#if USBD_COMPOSITE_FUNCTION_MAX >= USBD_COMPOSITE_NO_OWNER
+# error "USBD_COMPOSITE_FUNCTION_MAX is too large"
+#endif
+
+#define EP_DIR_INDEX(ep_addr) (IS_IN_ENDPOINT(ep_addr) ? 1 : 0)
+
+static const uint8_t ep_attr_map[] = {
+	[USBD_EP_CONTROL] = USB_ENDPOINT_ATTR_CONTROL,
+	[USBD_EP_ISOCHRONOUS] = USB_ENDPOINT_ATTR_ISOCHRONOUS,
+	[USBD_EP_BULK] = USB_ENDPOINT_ATTR_BULK,
+	[USBD_EP_INTERRUPT] = USB_ENDPOINT_ATTR_INTERRUPT
+};
+
+/**
+ * Size of endpoint that will be used as start point for @a ep
+ * @param[in] ep Endpoint
+ * @param[in] speed Speed
+ * @return size
+ */
+static uint16_t ep_base_size(const struct usbd_composite_ep *ep,
+					usbd_speed speed)
+{
+	bool hs = (speed == USBD_SPEED_HIGH);
+	uint16_t limit;
+
+	switch (ep->type) {
+	case USBD_EP_BULK:
+		/* High speed bulk endpoint are always 512 */
+		if (hs) {
+			return 512;
+		}
+		limit = 64;
+	break;
+	case USBD_EP_INTERRUPT:
+		limit = hs ? 1024 : 64;
+	break;
+	case USBD_EP_ISOCHRONOUS:
+		limit = hs ? 1024 : 1023;
+	break;
+	case USBD_EP_CONTROL:
+	default:
+		limit = 64;
+	break;
+	}
+
+	/* 0: largest size allowed for the type and speed */
+	return ep->max_size ? MIN(ep->max_size, limit) : limit;
+}
+
+/**
+ * Assign interface number to all functions
+ * @return true on success
+ */
+static bool assign_interfaces(usbd_composite *comp)
+{
+	unsigned i, j, next = 0;
+
+	for (i = 0; i < comp->func_count; i++) {
+		usbd_composite_function *fn = comp->func[i];
+
+		if ((next + fn->iface_count) > USBD_COMPOSITE_INTERFACE_MAX) {
+			LOG_LN("composite: USBD_COMPOSITE_INTERFACE_MAX too small");
+			return false;
+		}
+
+		fn->first_iface = next;
+		for (j = 0; j < fn->iface_count; j++) {
+			comp->iface_owner[next++] = i;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Assign endpoint address to all functions.
+ * IN and OUT endpoint with same number are only paired if they are of the
+ *  same type (some peripheral share the type for both direction).
+ * @return true on success
+ */
+static bool assign_endpoints(usbd_composite *comp, uint8_t ep_count)
+{
+	usbd_ep_type type[2][16];
+	unsigned i, j, num;
+
+	for (i = 0; i < comp->func_count; i++) {
+		usbd_composite_function *fn = comp->func[i];
+
+		for (j = 0; j < fn->ep_count; j++) {
+			const struct usbd_composite_ep *ep = &fn->ep[j];
+			unsigned dir = EP_DIR_INDEX(ep->dir);
+
+			for (num = 1; num < MIN(ep_count, 16); num++) {
+				uint8_t other = comp->ep_owner[!dir][num];
+
+				if (comp->ep_owner[dir][num] != USBD_COMPOSITE_NO_OWNER) {
+					continue;
+				}
+
+				if (other == USBD_COMPOSITE_NO_OWNER ||
+						type[!dir][num] == ep->type) {
+					break;
+				}
+			}
+
+			if (num >= MIN(ep_count, 16)) {
+				LOG_LN("composite: not enough endpoints");
+				return false;
+			}
+
+			comp->ep_owner[dir][num] = i;
+			type[dir][num] = ep->type;
+			fn->ep_addr[j] = (ep->dir & 0x80) | num;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Endpoint memory used by endpoint @a j of @a fn with @a flags
+ * @return bytes (0 if the backend cannot honour @a flags)
+ */
+static uint16_t ep_mem_size(const struct usbd_composite_config *config,
+				const usbd_composite_function *fn, unsigned j,
+				usbd_ep_flags flags)
+{
+	const usbd_backend *backend = config->backend;
+	uint16_t size = fn->ep_size[j];
+
+	if (backend == NULL || backend->ep_mem_size == NULL) {
+		return (flags & USBD_EP_DOUBLE_BUFFER) ? (size * 2) : size;
+	}
+
+	return backend->ep_mem_size(fn->ep_addr[j], fn->ep[j].type, size, flags);
+}
+
+/**
+ * Compute endpoint sizes and double buffer flags.
+ *
+ * Memory is counted the way the backend allocate it (see
+ *  usbd_composite_config::backend).
+ * Full speed bulk endpoints are shrunk (largest first) till the total fit
+ *  in @a mem_size. Memory still left is then used to double buffer
+ *  isochronous and then bulk endpoints that want it (if the backend
+ *  support it).
+ */
+static void assign_sizes(usbd_composite *comp,
+					const struct usbd_composite_config *config)
+{
+	usbd_speed speed = config->speed;
+	uint16_t mem_size = config->mem_size;
+	unsigned i, j, pass;
+	uint32_t total = 0;
+
+	for (i = 0; i < comp->func_count; i++) {
+		usbd_composite_function *fn = comp->func[i];
+		for (j = 0; j < fn->ep_count; j++) {
+			fn->ep_size[j] = ep_base_size(&fn->ep[j], speed);
+			fn->ep_flags[j] = USBD_EP_NONE;
+			total += ep_mem_size(config, fn, j, USBD_EP_NONE);
+		}
+	}
+
+	if (!mem_size) {
+		return;
+	}
+
+	while (total > mem_size && speed != USBD_SPEED_HIGH) {
+		usbd_composite_function *largest = NULL;
+		unsigned index = 0;
+
+		for (i = 0; i < comp->func_count; i++) {
+			usbd_composite_function *fn = comp->func[i];
+			for (j = 0; j < fn->ep_count; j++) {
+				if (fn->ep[j].type == USBD_EP_BULK && fn->ep_size[j] > 8 &&
+					(largest == NULL ||
+					fn->ep_size[j] > largest->ep_size[index])) {
+					largest = fn;
+					index = j;
+				}
+			}
+		}
+
+		if (largest == NULL) {
+			LOG_LN("composite: endpoints do not fit in memory");
+			return;
+		}
+
+		total -= ep_mem_size(config, largest, index, USBD_EP_NONE);
+		largest->ep_size[index] /= 2;
+		total += ep_mem_size(config, largest, index, USBD_EP_NONE);
+	}
+
+	if (total >= mem_size) {
+		return;
+	}
+
+	/* Isochronous first (cannot be retried), then bulk */
+	for (pass = 0; pass < 2; pass++) {
+		usbd_ep_type want = pass ? USBD_EP_BULK : USBD_EP_ISOCHRONOUS;
+
+		for (i = 0; i < comp->func_count; i++) {
+			usbd_composite_function *fn = comp->func[i];
+			for (j = 0; j < fn->ep_count; j++) {
+				uint16_t single, dbl;
+
+				if (fn->ep[j].type != want || !fn->ep[j].want_double_buffer) {
+					continue;
+				}
+
+				dbl = ep_mem_size(config, fn, j, USBD_EP_DOUBLE_BUFFER);
+				if (!dbl) {
+					/* Not supported by backend */
+					continue;
+				}
+
+				single = ep_mem_size(config, fn, j, USBD_EP_NONE);
+				if ((total - single + dbl) <= mem_size) {
+					fn->ep_flags[j] |= USBD_EP_DOUBLE_BUFFER;
+					total += dbl - single;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Write the configuration descriptor in the descriptor buffer
+ * @return true on success
+ */
+static bool generate_descriptor(usbd_composite *comp,
+					const struct usbd_composite_config *config)
+{
+	struct usb_config_descriptor *cfg = (void *) comp->desc;
+	uint16_t off = USB_DT_CONFIGURATION_SIZE;
+	unsigned i, iface_count = 0;
+
+	if (comp->desc_size < off) {
+		return false;
+	}
+
+	for (i = 0; i < comp->func_count; i++) {
+		usbd_composite_function *fn = comp->func[i];
+		uint16_t len;
+
+		if (fn->iface_count > 1) {
+			struct usb_iface_assoc_descriptor *iad;
+
+			if ((comp->desc_size - off) < USB_DT_INTERFACE_ASSOCIATION_SIZE) {
+				return false;
+			}
+
+			iad = (void *) &comp->desc[off];
+			iad->bLength = USB_DT_INTERFACE_ASSOCIATION_SIZE;
+			iad->bDescriptorType = USB_DT_INTERFACE_ASSOCIATION;
+			iad->bFirstInterface = fn->first_iface;
+			iad->bInterfaceCount = fn->iface_count;
+			iad->bFunctionClass = fn->bFunctionClass;
+			iad->bFunctionSubClass = fn->bFunctionSubClass;
+			iad->bFunctionProtocol = fn->bFunctionProtocol;
+			iad->iFunction = fn->iFunction;
+			off += USB_DT_INTERFACE_ASSOCIATION_SIZE;
+		}
+
+		len = fn->descriptor(fn, &comp->desc[off], comp->desc_size - off);
+		if (!len) {
+			LOG_LN("composite: descriptor buffer too small");
+			return false;
+		}
+
+		off += len;
+		iface_count += fn->iface_count;
+	}
+
+	cfg->bLength = USB_DT_CONFIGURATION_SIZE;
+	cfg->bDescriptorType = USB_DT_CONFIGURATION;
+	cfg->wTotalLength = off;
+	cfg->bNumInterfaces = iface_count;
+	cfg->bConfigurationValue = config->bConfigurationValue;
+	cfg->iConfiguration = config->iConfiguration;
+	cfg->bmAttributes = config->bmAttributes;
+	cfg->bMaxPower = config->bMaxPower;
+
+	return true;
+}
+
+static inline usbd_composite_function *
+owner_function(usbd_composite *comp, uint8_t index)
+{
+	return (index < comp->func_count) ? comp->func[index] : NULL;
+}
+
+static void composite_setup(usbd_device *dev, uint8_t ep,
+					const struct usb_setup_data *setup_data)
+{
+	usbd_composite *comp = dev->composite;
+	usbd_composite_function *fn = NULL;
+	uint8_t type = setup_data->bmRequestType & USB_REQ_TYPE_TYPE;
+	uint8_t index = setup_data->wIndex;
+	unsigned i;
+
+	if (ep) {
+		LOGF_LN("composite: SETUP on 0x%"PRIx8" not supported (stalling...)",
+			ep);
+		usbd_set_ep_stall(dev, ENDPOINT_NUMBER(ep) | 0x80, true);
+		usbd_set_ep_stall(dev, ENDPOINT_NUMBER(ep), true);
+		return;
+	}
+
+	switch (setup_data->bmRequestType & USB_REQ_TYPE_RECIPIENT) {
+	case USB_REQ_TYPE_INTERFACE:
+		if (index < USBD_COMPOSITE_INTERFACE_MAX) {
+			fn = owner_function(comp, comp->iface_owner[index]);
+		}
+	break;
+	case USB_REQ_TYPE_ENDPOINT:
+		fn = owner_function(comp,
+			comp->ep_owner[EP_DIR_INDEX(index)][index & 0xF]);
+	break;
+	}
+
+	if (type == USB_REQ_TYPE_STANDARD) {
+		/* Interface specific descriptor (example: HID report) */
+		if (fn != NULL && fn->setup != NULL &&
+				setup_data->bRequest == USB_REQ_GET_DESCRIPTOR &&
+				fn->setup(fn, dev, setup_data)) {
+			return;
+		}
+
+		usbd_ep0_setup(dev, setup_data);
+		return;
+	}
+
+	if (fn != NULL) {
+		if (fn->setup != NULL && fn->setup(fn, dev, setup_data)) {
+			return;
+		}
+	} else if ((setup_data->bmRequestType & USB_REQ_TYPE_RECIPIENT) ==
+						USB_REQ_TYPE_DEVICE) {
+		/* No owner for device requests, ask every function */
+		for (i = 0; i < comp->func_count; i++) {
+			fn = comp->func[i];
+			if (fn->setup != NULL && fn->setup(fn, dev, setup_data)) {
+				return;
+			}
+		}
+	}
+
+	usbd_ep0_stall(dev);
+}
+
+static void composite_set_config(usbd_device *dev,
+					const struct usb_config_descriptor *cfg)
+{
+	usbd_composite *comp = dev->composite;
+	const struct usb_config_descriptor *own = (void *) comp->desc;
+	unsigned i, j;
+
+	/* Another configuration of the device (or unconfigured) */
+	if (cfg == NULL ||
+		cfg->bConfigurationValue != own->bConfigurationValue) {
+		return;
+	}
+
+	for (i = 0; i < comp->func_count; i++) {
+		usbd_composite_function *fn = comp->func[i];
+		for (j = 0; j < fn->ep_count; j++) {
+			usbd_ep_prepare(dev, fn->ep_addr[j], fn->ep[j].type,
+				fn->ep_size[j], fn->ep[j].interval, fn->ep_flags[j]);
+		}
+	}
+
+	for (i = 0; i < comp->func_count; i++) {
+		usbd_composite_function *fn = comp->func[i];
+		if (fn->set_config != NULL) {
+			fn->set_config(fn, dev);
+		}
+	}
+}
+
+static void composite_set_interface(usbd_device *dev,
+					const struct usb_interface_descriptor *iface)
+{
+	usbd_composite *comp = dev->composite;
+	usbd_composite_function *fn;
+	uint8_t num = iface->bInterfaceNumber;
+
+	if (num >= USBD_COMPOSITE_INTERFACE_MAX) {
+		return;
+	}
+
+	fn = owner_function(comp, comp->iface_owner[num]);
+	if (fn != NULL && fn->set_interface != NULL) {
+		fn->set_interface(fn, dev, iface);
+	}
+}
+
+/**
+ * Initalize composite device
+ * @param[in] comp Composite device
+ * @param[in] desc_buf Buffer to store the generated configuration descriptor
+ * @param[in] desc_buf_size Size of @a desc_buf
+ * @note @a desc_buf need to be valid as long as @a comp is used
+ */
+void usbd_composite_init(usbd_composite *comp, void *desc_buf,
+					uint16_t desc_buf_size)
+{
+	comp->func_count = 0;
+	comp->desc = desc_buf;
+	comp->desc_size = desc_buf_size;
+	memset(comp->iface_owner, USBD_COMPOSITE_NO_OWNER,
+			sizeof(comp->iface_owner));
+	memset(comp->ep_owner, USBD_COMPOSITE_NO_OWNER, sizeof(comp->ep_owner));
+}
+
+/**
+ * Add a function to composite device
+ * @param[in] comp Composite device
+ * @param[in] fn Function
+ * @return true on success
+ * @return false if no space left or @a fn is invalid
+ * @note Function are placed in configuration descriptor in the order added.
+ */
+bool usbd_composite_add(usbd_composite *comp, usbd_composite_function *fn)
+{
+	if (comp->func_count >= USBD_COMPOSITE_FUNCTION_MAX) {
+		return false;
+	}
+
+	if (fn->ep_count > USBD_COMPOSITE_FUNCTION_EP_MAX ||
+			fn->descriptor == NULL) {
+		return false;
+	}
+
+	comp->func[comp->func_count++] = fn;
+	return true;
+}
+
+/**
+ * Assign interface, endpoints and generate the configuration descriptor
+ * @param[in] comp Composite device
+ * @param[in] config Configuration parameters
+ * @return Configuration descriptor (to be placed in @ref usbd_info)
+ * @return NULL on failure
+ */
+const struct usb_config_descriptor *
+usbd_composite_build(usbd_composite *comp,
+					const struct usbd_composite_config *config)
+{
+	memset(comp->iface_owner, USBD_COMPOSITE_NO_OWNER,
+			sizeof(comp->iface_owner));
+	memset(comp->ep_owner, USBD_COMPOSITE_NO_OWNER, sizeof(comp->ep_owner));
+
+	if (!assign_interfaces(comp)) {
+		return NULL;
+	}
+
+	if (!assign_endpoints(comp, config->ep_count)) {
+		return NULL;
+	}
+
+	assign_sizes(comp, config);
+
+	if (!generate_descriptor(comp, config)) {
+		return NULL;
+	}
+
+	return (const struct usb_config_descriptor *) comp->desc;
+}
+
+/**
+ * Attach the composite device to @a dev.
+ * The setup, set-config and set-interface callbacks of @a dev are
+ *  used by the composite device.
+ * @param[in] comp Composite device
+ * @param[in] dev USB Device
+ */
+void usbd_composite_attach(usbd_composite *comp, usbd_device *dev)
+{
+	dev->composite = comp;
+	usbd_register_setup_callback(dev, composite_setup);
+	usbd_register_set_config_callback(dev, composite_set_config);
+	usbd_register_set_interface_callback(dev, composite_set_interface);
+}
+
+/**
+ * Write standard endpoint descriptor for endpoint @a index of @a fn
+ * @param[in] fn Function
+ * @param[in] index Index of endpoint (in @a fn->ep)
+ * @param[out] buf Buffer
+ * @param[in] len Length of @a buf
+ * @return Number of bytes written (0 if @a buf is too small)
+ */
+uint16_t usbd_composite_ep_descriptor(const usbd_composite_function *fn,
+					unsigned index, void *buf, uint16_t len)
+{
+	struct usb_endpoint_descriptor *desc = buf;
+
+	if (len < USB_DT_ENDPOINT_SIZE || index >= fn->ep_count) {
+		return 0;
+	}
+
+	desc->bLength = USB_DT_ENDPOINT_SIZE;
+	desc->bDescriptorType = USB_DT_ENDPOINT;
+	desc->bEndpointAddress = fn->ep_addr[index];
+	desc->bmAttributes = ep_attr_map[fn->ep[index].type];
+	desc->wMaxPacketSize = fn->ep_size[index];
+	desc->bInterval = fn->ep[index].interval;
+
+	return USB_DT_ENDPOINT_SIZE;
+}
+
+/**@}*/
@@ -71,6 +71,36 @@ static inline uint8_t descriptor_index(uint16_t wValue)
 	return wValue & 0xFF;
 }
 
+/**
+ * Search for the index of @a lang_id in string language list.
+ * Result of last search is cached (host usually use a single language).
+ * @param[in] dev USB Device
+ * @param[in] string String data
+ * @param[in] lang_id Language ID
+ * @return index
+ * @return 0xFF if not found
+ */
+static uint8_t string_lang_index(usbd_device *dev,
+			const struct usbd_info_string *string, uint16_t lang_id)
+{
+	unsigned i, avail_lang;
+
+	if (dev->string.lang_index != 0xFF && dev->string.lang_id == lang_id) {
+		return dev->string.lang_index;
+	}
+
+	avail_lang = (string->lang_list->bLength - 2) / 2;
+	for (i = 0; i < avail_lang; i++) {
+		if (string->lang_list->wData[i] == lang_id) {
+			dev->string.lang_id = lang_id;
+			dev->string.lang_index = i;
+			return i;
+		}
+	}
+
+	return 0xFF;
+}
+
 /**
  * Handle GET_DESCRIPTOR(string) request from host
  * @param[in] arg Arguments
@@ -78,24 +108,10 @@ static inline uint8_t descriptor_index(uint16_t wValue)
 static enum usbd_control_result
 standard_get_descriptor_string(struct usbd_control_arg *arg)
 {
-	const struct usbd_info_string *string = NULL;
+	const struct usbd_info_string *string = arg->device->string.info;
 	const struct usb_string_descriptor *send = NULL;
 	uint8_t index = descriptor_index(arg->setup->wValue);
-	uint16_t lang_id = arg->setup->wIndex;
-	unsigned i, avail_lang;
-	const struct usbd_info *info = arg->device->info;
-
-	/* Search for the string data */
-	if (arg->device->current_config != NULL) {
-		for (i = 0; i < info->device.desc->bNumConfigurations; i++) {
-			if (arg->device->current_config == info->config[i].desc) {
-				string = info->config[i].string;
-				break;
-			}
-		}
-	} else {
-		string = info->device.string;
-	}
+	uint8_t lang;
 
 	if (string == NULL) {
 		/* No string descriptor */
@@ -111,12 +127,19 @@ standard_get_descriptor_string(struct usbd_control_arg *arg)
 		send = string->lang_list;
 	} else {
 		/* Search for the data for the specified language id */
-		avail_lang = (string->lang_list->bLength - 2) / 2;
-		for (i = 0; i < avail_lang; i++) {
-			if (string->lang_list->wData[i] == lang_id) {
-				send = string->data[i][index - 1];
-				break;
-			}
+		lang = string_lang_index(arg->device, string, arg->setup->wIndex);
+		if (lang == 0xFF) {
+			/* Language not supported */
+			return USBD_REQ_STALL;
+		}
+
+		if (string->table != NULL) {
+			uint16_t off = string->table->offset[
+						(lang * string->count) + (index - 1)];
+			send = (off == USBD_STRING_DYNAMIC) ? string->table->dynamic :
+				(const struct usb_string_descriptor *) &string->table->data[off];
+		} else {
+			send = string->data[lang][index - 1];
 		}
 	}
 
@@ -194,15 +217,13 @@ standard_get_descriptor(struct usbd_control_arg *arg)
 	return USBD_REQ_STALL;
 }
 
-static uint8_t _set_addr_value;
-
 /**
  * Callback when the SET_ADDRESS stage as completed
  * @param[in] dev USB Device
  */
 static void _set_address_complete(usbd_device *dev)
 {
-	dev->backend->set_address(dev, _set_addr_value);
+	dev->backend->set_address(dev, dev->set_address_value);
 }
 
 /**
@@ -227,8 +248,8 @@ standard_set_address(struct usbd_control_arg *arg)
 	if (arg->device->backend->set_address_before_status) {
 		arg->device->backend->set_address(arg->device, new_addr);
 	} else {
-		/* Store the new address in EP0 buffer for complete callback */
-		_set_addr_value = new_addr;
+		/* Store the new address in device for complete callback */
+		arg->device->set_address_value = new_addr;
 		arg->complete =
 			(usbd_control_transfer_callback) _set_address_complete;
 	}
@@ -238,17 +259,20 @@ standard_set_address(struct usbd_control_arg *arg)
 
 /**
  * Search for the configuration with bConfigurationValue == @a value
+ * @param[out] string String data of the configuration
  * @return the found configuration (success)
  * @return NULL on failure (not found)
  */
 static const struct usb_config_descriptor*
-search_config(usbd_device *dev, uint8_t value)
+search_config(usbd_device *dev, uint8_t value,
+			const struct usbd_info_string **string)
 {
 	unsigned i;
 
 	for (i = 0; i < dev->info->device.desc->bNumConfigurations; i++) {
 		const struct usb_config_descriptor *cfg = dev->info->config[i].desc;
 		if (cfg->bConfigurationValue == value) {
+			*string = dev->info->config[i].string;
 			return cfg;
 		}
 	}
@@ -266,19 +290,23 @@ static enum usbd_control_result
 standard_set_configuration(struct usbd_control_arg *arg)
 {
 	const struct usb_config_descriptor *cfg = NULL;
+	const struct usbd_info_string *string = NULL;
 	uint8_t bConfigValue = arg->setup->wValue;
 	struct usbd_device *dev = arg->device;
 
 	LOGF_LN("SET_CONFIGURATION: %"PRIu8, bConfigValue);
 
 	if (bConfigValue > 0) {
-		cfg = search_config(dev, bConfigValue);
+		cfg = search_config(dev, bConfigValue, &string);
 		if (cfg == NULL) {
 			return USBD_REQ_STALL;
 		}
+	} else {
+		string = dev->info->device.string;
 	}
 
 	dev->current_config = cfg;
+	usbd_string_select(dev, string);
 
 #if (USBD_INTERFACE_MAX > 0)
 	if (cfg != NULL) {
@@ -609,6 +637,94 @@ standard_request(struct usbd_control_arg *arg)
 	}
 }
 
+static inline uint16_t control_handler_key(uint8_t bmRequestType,
+						uint8_t bRequest)
+{
+	return (bmRequestType << 8) | bRequest;
+}
+
+/**
+ * Search the control request dispatch table for the handler of @a setup_data
+ * @param[in] dev USB Device
+ * @param[in] setup_data Setup Data
+ * @return handler
+ * @return NULL if not found
+ */
+static const usbd_control_handler *
+search_control_handler(usbd_device *dev,
+				const struct usb_setup_data *setup_data)
+{
+	const usbd_control_handler *table = dev->control.table;
+	const usbd_control_handler *any = NULL;
+	uint16_t key = control_handler_key(setup_data->bmRequestType,
+							setup_data->bRequest);
+	unsigned low = 0, high = dev->control.count;
+
+	/* Lower bound (first entry with key) */
+	while (low < high) {
+		unsigned mid = (low + high) / 2;
+		if (control_handler_key(table[mid].bmRequestType,
+							table[mid].bRequest) < key) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	for (; low < dev->control.count; low++) {
+		const usbd_control_handler *h = &table[low];
+
+		if (control_handler_key(h->bmRequestType, h->bRequest) != key) {
+			break;
+		}
+
+		if (!(h->flags & USBD_CONTROL_HANDLER_MATCH_INDEX)) {
+			if (any == NULL) {
+				any = h;
+			}
+		} else if (h->wIndex == setup_data->wIndex) {
+			return h;
+		}
+	}
+
+	return any;
+}
+
+/**
+ * Resolve the request using the control request dispatch table
+ * @param[in] dev USB Device
+ * @param[in] setup_data Setup Data
+ * @return true if handled
+ * @return false if not found in table (or handler refused)
+ */
+bool usbd_ep0_dispatch(usbd_device *dev,
+				const struct usb_setup_data *setup_data)
+{
+	const usbd_control_handler *h = search_control_handler(dev, setup_data);
+
+	if (h == NULL) {
+		return false;
+	}
+
+	if (h->flags & USBD_CONTROL_HANDLER_CONST_DATA) {
+		if (!(setup_data->bmRequestType & USB_REQ_TYPE_IN)) {
+			/* Constant data can only be sent to host */
+			usbd_ep0_stall(dev);
+			return true;
+		}
+
+		usbd_ep0_transfer(dev, setup_data, (void *) h->data,
+				MIN(setup_data->wLength, h->length), NULL);
+		return true;
+	}
+
+	if (h->callback == NULL) {
+		return false;
+	}
+
+	return h->callback(dev, setup_data, dev->control.user_data);
+}
+
 void usbd_ep0_setup(usbd_device *dev, const struct usb_setup_data *setup_data)
 {
 	/* Only handle Standard request. */
@@ -120,6 +120,20 @@ struct usbd_device {
 	/** Device descriptor and other details. */
 	const struct usbd_info *info;
 
+	/** Address to set after SET_ADDRESS status stage */
+	uint8_t set_address_value;
+
+	struct {
+		/** String data for the current configuration (or device) */
+		const struct usbd_info_string *info;
+
+		/** Last language searched in @a info lang_list */
+		uint16_t lang_id;
+
+		/** Index of @a lang_id in lang_list (0xFF = not searched) */
+		uint8_t lang_index;
+	} string;
+
 	struct {
 		/** invoked on bus-reset */
 		usbd_generic_callback reset;
@@ -143,6 +157,16 @@ struct usbd_device {
 		usbd_set_interface_callback set_interface;
 	} callback;
 
+	/** Control request dispatch table (see usbd_ep0_dispatch()) */
+	struct {
+		const usbd_control_handler *table;
+		unsigned count;
+		void *user_data;
+	} control;
+
+	/** Composite device attached (NULL if not used) */
+	struct usbd_composite *composite;
+
 	/** Backend */
 	const struct usbd_backend *backend;
 
@@ -206,6 +230,15 @@ struct usbd_backend {
 	void (*ep_prepare)(usbd_device *dev, uint8_t addr, usbd_ep_type type,
 					uint16_t max_size, uint16_t interval, usbd_ep_flags flags);
 	void (*ep_prepare_end)(usbd_device *dev);
+
+	/*
+	 * Endpoint memory (bytes) used by an endpoint, rounded the way the
+	 *  hardware allocate it. 0 if @a flags cannot be honoured for the
+	 *  endpoint (ie. DOUBLE_BUFFER not supported).
+	 * Used by the composite builder, can be NULL (size used as is).
+	 */
+	uint16_t (*ep_mem_size)(uint8_t addr, usbd_ep_type type,
+					uint16_t max_size, usbd_ep_flags flags);
 	void (*set_ep_dtog)(usbd_device *dev, uint8_t addr,  bool dtog);
 	bool (*get_ep_dtog)(usbd_device *dev, uint8_t addr);
 	void (*set_ep_stall)(usbd_device *dev, uint8_t addr,  bool stall);
@@ -317,6 +350,9 @@ void usbd_put_all_urb_into_unused(usbd_device *dev);
 void usbd_purge_all_non_ep0_transfer(usbd_device *dev,
 			usbd_transfer_status status);
 
+bool usbd_ep0_dispatch(usbd_device *dev,
+			const struct usb_setup_data *setup_data);
+
 static inline uint32_t ep_free_mask(uint8_t ep_addr);
 static inline void usbd_handle_suspend(usbd_device *dev);
 static inline void usbd_handle_resume(usbd_device *dev);
@@ -324,6 +360,8 @@ static inline void usbd_handle_sof(usbd_device *dev);
 static inline void usbd_handle_setup(usbd_device *dev, uint8_t ep,
 					const struct usb_setup_data *setup_data);
 static inline void usbd_handle_reset(usbd_device *dev);
+static inline void usbd_string_select(usbd_device *dev,
+					const struct usbd_info_string *string);
 static inline bool is_ep_free(usbd_device *dev, uint8_t ep_addr);
 static inline void mark_ep_as_free(usbd_device *dev, uint8_t ep_addr, bool yes);
 
@@ -393,6 +431,11 @@ static inline void usbd_handle_sof(usbd_device *dev)
 static inline void usbd_handle_setup(usbd_device *dev, uint8_t ep,
 					const struct usb_setup_data *setup_data)
 {
+	if (!ep && dev->control.count && usbd_ep0_dispatch(dev, setup_data)) {
+		/* Resolved using the control request dispatch table */
+		return;
+	}
+
 	if (dev->callback.setup != NULL) {
 		dev->callback.setup(dev, ep, setup_data);
 	} else if (!ep) {
@@ -407,6 +450,18 @@ static inline void usbd_handle_setup(usbd_device *dev, uint8_t ep,
 	}
 }
 
+/**
+ * Select the string data used for GET_DESCRIPTOR(string)
+ * @param[in] dev USB Device
+ * @param[in] string String data
+ */
+static inline void usbd_string_select(usbd_device *dev,
+					const struct usbd_info_string *string)
+{
+	dev->string.info = string;
+	dev->string.lang_index = 0xFF;
+}
+
 /**
  * RESET detected on bus
  * @param[in] dev USB Device
@@ -420,6 +475,7 @@ static inline void usbd_handle_reset(usbd_device *dev)
 	dev->urbs.force_all_new_urb_to_waiting = false;
 
 	dev->current_config = NULL;
+	usbd_string_select(dev, dev->info->device.string);
 
 	if (dev->callback.reset != NULL) {
 		dev->callback.reset(dev);
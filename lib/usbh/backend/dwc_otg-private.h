@@ -61,6 +61,32 @@ enum usbh_dwc_otg_chan_state {
 
 typedef enum usbh_dwc_otg_chan_state usbh_dwc_otg_chan_state;
 
+/**
+ * Build the internal DMA support (USBH_DMA feature).
+ * 0 remove the DMA code and the per channel bounce buffers.
+ */
+#if !defined(USBH_DWC_OTG_DMA)
+# define USBH_DWC_OTG_DMA 1
+#endif
+
+/**
+ * Size of per channel buffer (bytes) used in DMA mode for setup packet
+ *  and transfer data that is not word aligned.
+ * Transfer with unaligned data need an endpoint size not greater than this.
+ *  (Must be a multiple of 4, of the cache line on STM32F7)
+ */
+#if !defined(USBH_DWC_OTG_DMA_BOUNCE)
+# define USBH_DWC_OTG_DMA_BOUNCE 64
+#endif
+
+/* DMA buffer do not share cache line with other data (D-cache maintenance) */
+#if defined(STM32F7)
+# include <unicore-mx/cm3/scb.h>
+# define USBH_DWC_OTG_DMA_ALIGNED SCB_DCACHE_ALIGNED
+#else
+# define USBH_DWC_OTG_DMA_ALIGNED
+#endif
+
 struct usbh_dwc_otg_chan {
 	usbh_urb *urb; /* prevent lookup */
 	usbh_dwc_otg_chan_state state;
@@ -74,12 +100,108 @@ struct usbh_dwc_otg_chan {
 	/* The frame in which the frame is submitted OR has to be submitted.
 	 *  Only used for periodic endpoint (isochronous and interrupt) */
 	uint16_t submit_frame;
+
+	/* Periodic schedule (isochronous and interrupt only).
+	 *  The channel perform IO in frames where
+	 *   (frame % period) == phase.
+	 *  "load" is the bus time (bytes) reserved in each of these frames. */
+	uint16_t period;
+	uint16_t phase;
+	uint16_t load;
+
+	/* Bulk/control NAK throttling.
+	 *  Number of NAK received since last retry with back-off
+	 *  and current back-off (frames, 0 for none) */
+	uint8_t nak_count;
+	uint8_t backoff;
+
+	/* Split transaction (low/full speed device behind a high speed hub).
+	 *  Every packet is a start split followed by complete split(s).
+	 *  "split_base" is transferred bytes at start of the packet,
+	 *  "split_len" the packet length and "split_pktcnt" the number of
+	 *  packets left (including the current one) */
+	bool split;
+	bool complete_split;
+	uint8_t split_errors;
+	uint8_t split_nyet;
+	uint16_t split_len;
+	uint16_t split_pktcnt;
+	uint16_t split_base;
+
+	/* Transaction Translator on which periodic split bandwidth is reserved
+	 *  and the bus time (full speed bytes) reserved in each of its frames */
+	struct usbh_dwc_otg_tt *tt;
+	uint16_t tt_load;
+
+	/* Internal DMA.
+	 *  "dma_len" is the number of bytes programmed in the channel
+	 *  (IN: received = dma_len - remaining XFRSIZ).
+	 *  "bounce" is used for setup packet and for data that is not
+	 *  word aligned (IN: copied to transfer on completion) */
+	uint16_t dma_len;
+	bool dma_bounce;
+#if USBH_DWC_OTG_DMA
+	uint32_t bounce[USBH_DWC_OTG_DMA_BOUNCE / 4] USBH_DWC_OTG_DMA_ALIGNED;
+#endif
+
+	/* Isochronous: packet in progress and bytes received in it */
+	uint16_t iso_index;
+	uint16_t iso_len;
+
+	/* URB cannot be performed, failed from poll */
+	bool invalid;
 };
 
 typedef struct usbh_dwc_otg_chan usbh_dwc_otg_chan;
 
+/**
+ * Number of frames (microframes for high speed) in the periodic schedule.
+ * Interval of periodic endpoint are rounded down to a power of 2
+ *  that is not greater than this value. (Must be a power of 2)
+ * The default cap the interval to 4ms at high speed and 32ms at
+ *  full/low speed, use 256 to reach 32ms at high speed
+ *  (costs 2 bytes of RAM per slot).
+ */
+#if !defined(USBH_DWC_OTG_PERIODIC_SLOTS)
+# define USBH_DWC_OTG_PERIODIC_SLOTS 32
+#endif
+
+/**
+ * Number of NAK on bulk/control channel that are retried right away.
+ * After that, the retry is delayed by 1, 2, 4... frames
+ *  (upto USBH_DWC_OTG_NAK_BACKOFF_MAX) till the device respond.
+ */
+#if !defined(USBH_DWC_OTG_NAK_RETRY)
+# define USBH_DWC_OTG_NAK_RETRY 8
+#endif
+
+/** Maximum delay (frames) between two retry of a NAK'ed transfer */
+#if !defined(USBH_DWC_OTG_NAK_BACKOFF_MAX)
+# define USBH_DWC_OTG_NAK_BACKOFF_MAX 8
+#endif
+
+/**
+ * Number of full speed frames in the periodic schedule (high speed).
+ * Periodic split transactions are budgeted per frame on the hub TT.
+ */
+#define USBH_DWC_OTG_TT_FRAMES ((USBH_DWC_OTG_PERIODIC_SLOTS + 7) / 8)
+
+/**
+ * Periodic bandwidth of a hub Transaction Translator
+ * @param hub Hub device (NULL if unused)
+ * @param users Number of channels with bandwidth reserved
+ * @param load Full speed bus time (bytes) reserved in each frame
+ */
+struct usbh_dwc_otg_tt {
+	usbh_device *hub;
+	uint8_t users;
+	uint16_t load[USBH_DWC_OTG_TT_FRAMES];
+};
+
 #define USBH_HOST_EXTRA									\
-	uint64_t wait_till;
+	uint64_t wait_till;									\
+	uint16_t periodic_load[USBH_DWC_OTG_PERIODIC_SLOTS];	\
+	struct usbh_dwc_otg_tt tt[USBH_HUB_MAX];
 
 #define USBH_BACKEND_EXTRA								\
 	uint32_t base_address;								\
@@ -34,6 +34,17 @@
 /* as per specs, 10ms to 20ms */
 #define RESET_HOLD_DURATION (MS2US(10))  /* unit: microseconds (us) */
 
+/** Internal DMA is used (packets are not moved through FIFO by CPU) */
+#if USBH_DWC_OTG_DMA
+# define USE_DMA(host) ((host)->config->feature & USBH_DMA)
+#else
+# define USE_DMA(host) 0
+#endif
+
+/** Channel interrupts unmasked while the channel is in use.
+ *  In DMA mode, everything is reported with the channel halt */
+#define CHAN_INTMSK(host) (USE_DMA(host) ? DWC_OTG_HCINTMSK_CHHM : 0xFFF)
+
 #define PREFIX_FRAME_NUM LOGF("[FRAME %"PRIu16"]: ",					\
 	(uint16_t)REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK);			\
 
@@ -92,6 +103,7 @@
 
 static void handle_rxflvl_interrupt(usbh_host *host);
 static void process_channel_interrupt(usbh_host *host, uint8_t i);
+static void fail_invalid_channels(usbh_host *host);
 static int get_any_free_channel(usbh_host *host);
 
 static void control_setup_stage(usbh_host *host, uint8_t i);
@@ -145,6 +157,311 @@ static inline uint16_t get_fifo_depth(usbh_host *host)
 	return value;
 }
 
+/*
+ * Periodic schedule
+ * =================
+ * Every periodic (interrupt, isochronous) channel get a period
+ *  (power of 2, <= USBH_DWC_OTG_PERIODIC_SLOTS) and a phase.
+ *  It perform IO in frames where (frame % period) == phase.
+ *
+ * At submit, the phase which has the least loaded worst frame is choosen.
+ *  If the transaction do not fit in budget, the URB is left pending
+ *  (retried from poll) instead of overcommitting the frame.
+ *
+ * Since 0x4000 (frame number range) is a multiple of the period,
+ *  the schedule do not break on frame number overflow.
+ *
+ * The period is capped to USBH_DWC_OTG_PERIODIC_SLOTS: with the default
+ *  32 slots, an endpoint with a longer interval is polled every 4ms
+ *  (high speed) or 32ms (full/low speed), ie. more often than asked.
+ *
+ * SOF interrupt is only unmasked while the schedule is not empty
+ *  (or a bulk/control channel is backing off from NAK).
+ */
+
+/** usb_20.pdf 5.7.4: 90% of frame (12000 bit times) for periodic (bytes) */
+#define PERIODIC_BUDGET_FS 1350
+
+/** usb_20.pdf 5.7.4: 80% of microframe (60000 bit times) for periodic (bytes) */
+#define PERIODIC_BUDGET_HS 6000
+
+/** Token, handshake, sync, CRC and inter packet delay (bytes, approx.) */
+#define PERIODIC_OVERHEAD 16
+
+/** Packet size part of wMaxPacketSize (bit 0-10) */
+#define EP_SIZE_PACKET(ep_size) ((ep_size) & 0x7FF)
+
+/** Transactions per microframe of high-bandwidth endpoint (bit 11-12) */
+#define EP_SIZE_MULT(ep_size) ((((ep_size) >> 11) & 0x3) + 1)
+
+/**
+ * Bus time (bytes) used by @a transfer in one (micro)frame
+ * @param transfer Transfer
+ * @return bus time
+ */
+static uint16_t periodic_bus_time(const usbh_transfer *transfer)
+{
+	uint16_t size = EP_SIZE_PACKET(transfer->ep_size);
+
+	/* worst case bit stuffing (1 bit every 6) */
+	uint16_t t = size + (size / 6) + PERIODIC_OVERHEAD;
+
+	if (transfer->device->speed == USBH_SPEED_LOW) {
+		/* low speed is 8 times slower than full speed */
+		t *= 8;
+	}
+
+	/* high-bandwidth endpoint (high speed only) */
+	return t * EP_SIZE_MULT(transfer->ep_size);
+}
+
+/**
+ * Unmask SOF interrupt only while the periodic schedule is not empty
+ *  or a channel is waiting for a frame (NAK back-off).
+ * @param host USB Host
+ */
+static void sof_irq_update(usbh_host *host)
+{
+	unsigned i;
+
+	for (i = 0; i < get_chan_count(host); i++) {
+		usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+
+		if (ch->load || ch->need_scheduling) {
+			REBASE(DWC_OTG_GINTMSK) |= DWC_OTG_GINTMSK_SOFM;
+			return;
+		}
+	}
+
+	REBASE(DWC_OTG_GINTMSK) &= ~DWC_OTG_GINTMSK_SOFM;
+}
+
+/*
+ * Split transaction
+ * =================
+ * Low/full speed devices behind a high speed hub are reached through
+ *  the hub Transaction Translator (TT). Every packet is sent as
+ *  a start split (SSPLIT: hub accept the transaction) followed by
+ *  complete split (CSPLIT: result of the transaction on full speed bus).
+ *  Only one packet is transferred per SSPLIT/CSPLIT pair.
+ *
+ * Periodic split get a period of atleast one frame (8 microframes).
+ *  SSPLIT is placed in microframe 0 to 3 of the frame so that
+ *  the CSPLIT (2 to 4 microframes later) complete in the same frame.
+ * Full speed periodic bandwidth is budgeted per hub.
+ *  (the stack use multi TT hub in single TT mode, alternate setting 0)
+ */
+
+/** Last microframe (of frame) in which a periodic SSPLIT is placed */
+#define SPLIT_SSPLIT_UFRAME_MAX 3
+
+/** Microframes between periodic SSPLIT and the first CSPLIT */
+#define SPLIT_CSPLIT_DELAY 2
+
+/** Number of NYET on periodic CSPLIT before the SSPLIT is retried */
+#define SPLIT_NYET_MAX 3
+
+/** Number of transaction errors on a split before the URB fail */
+#define SPLIT_ERRORS_MAX 3
+
+/**
+ * Get the TT object of @a hub (allocate if not in use)
+ * @param host USB Host
+ * @param hub Hub device with TT
+ * @return TT object
+ * @return NULL if no TT object is left
+ */
+static struct usbh_dwc_otg_tt *tt_get(usbh_host *host, usbh_device *hub)
+{
+	struct usbh_dwc_otg_tt *avail = NULL;
+	unsigned i;
+
+	for (i = 0; i < USBH_HUB_MAX; i++) {
+		struct usbh_dwc_otg_tt *tt = &host->tt[i];
+
+		if (tt->users && tt->hub == hub) {
+			return tt;
+		}
+
+		if (!tt->users && avail == NULL) {
+			avail = tt;
+		}
+	}
+
+	return avail;
+}
+
+/**
+ * Reserve the periodic bandwidth for @a transfer on channel @a ch
+ * @param host USB Host
+ * @param ch DWC OTG Channel data
+ * @param transfer Transfer
+ * @return true on success
+ * @return false if not enough bandwidth is left
+ */
+static bool periodic_reserve(usbh_host *host, usbh_dwc_otg_chan *ch,
+		const usbh_transfer *transfer)
+{
+	bool hs = (REBASE(DWC_OTG_HPRT) & DWC_OTG_HPRT_PSPD_MASK) ==
+				DWC_OTG_HPRT_PSPD_HIGH;
+	uint16_t budget = hs ? PERIODIC_BUDGET_HS : PERIODIC_BUDGET_FS;
+	uint16_t load = periodic_bus_time(transfer);
+	uint16_t interval = transfer->interval;
+	uint16_t period = 1, best = 0xFFFF;
+	unsigned phase, j, best_phase = 0;
+	struct usbh_dwc_otg_tt *tt = NULL;
+	usbh_device *hub = NULL;
+	uint16_t tt_load = 0;
+	uint8_t port;
+
+	if (hs) {
+		hub = usbh_hub_tt(transfer->device, &port);
+	}
+
+	if (hub != NULL) {
+		tt = tt_get(host, hub);
+		if (tt == NULL) {
+			LOG_LN("no TT object left for periodic split transfer");
+			return false;
+		}
+
+		/* full speed bus time on TT, only the split on high speed bus */
+		tt_load = load + (usbh_hub_tt_think_time(hub) / 8);
+		load = EP_SIZE_PACKET(transfer->ep_size) + (2 * PERIODIC_OVERHEAD);
+
+		/* interval of full/low speed device is in frames */
+		interval = (interval > (0xFFFF / 8)) ? 0xFFFF : (interval * 8);
+	}
+
+	while ((period << 1) <= interval &&
+			(period << 1) <= USBH_DWC_OTG_PERIODIC_SLOTS) {
+		period <<= 1;
+	}
+
+	if ((period << 1) <= interval) {
+		LOGF_LN("interval %"PRIu16" capped to %"PRIu16
+			" (USBH_DWC_OTG_PERIODIC_SLOTS)", interval, period);
+	}
+
+	for (phase = 0; phase < period; phase++) {
+		uint16_t worst = 0, tt_worst = 0;
+
+		if (tt != NULL && period >= 8 &&
+				(phase % 8) > SPLIT_SSPLIT_UFRAME_MAX) {
+			continue;
+		}
+
+		for (j = phase; j < USBH_DWC_OTG_PERIODIC_SLOTS; j += period) {
+			if (host->periodic_load[j] > worst) {
+				worst = host->periodic_load[j];
+			}
+
+			if (tt != NULL && tt->load[j / 8] > tt_worst) {
+				tt_worst = tt->load[j / 8];
+			}
+		}
+
+		if ((worst + load) > budget ||
+				(tt_worst + tt_load) > PERIODIC_BUDGET_FS) {
+			continue;
+		}
+
+		if (worst < best) {
+			best = worst;
+			best_phase = phase;
+		}
+	}
+
+	if (best == 0xFFFF) {
+		LOGF_LN("not enough periodic bandwidth (need %"PRIu16
+			", TT %"PRIu16")", load, tt_load);
+		return false;
+	}
+
+	for (j = best_phase; j < USBH_DWC_OTG_PERIODIC_SLOTS; j += period) {
+		host->periodic_load[j] += load;
+
+		if (tt != NULL) {
+			tt->load[j / 8] += tt_load;
+		}
+	}
+
+	if (tt != NULL) {
+		tt->hub = hub;
+		tt->users++;
+	}
+
+	ch->period = period;
+	ch->phase = best_phase;
+	ch->load = load;
+	ch->tt = tt;
+	ch->tt_load = tt_load;
+	sof_irq_update(host);
+
+	LOGF_LN("periodic schedule: period %"PRIu16" phase %"PRIu16
+		" load %"PRIu16, period, ch->phase, load);
+	return true;
+}
+
+/**
+ * Release the periodic bandwidth reserved by channel @a ch
+ * @param host USB Host
+ * @param ch DWC OTG Channel data
+ */
+static void periodic_release(usbh_host *host, usbh_dwc_otg_chan *ch)
+{
+	unsigned j;
+
+	if (!ch->load) {
+		return;
+	}
+
+	for (j = ch->phase; j < USBH_DWC_OTG_PERIODIC_SLOTS; j += ch->period) {
+		host->periodic_load[j] -= ch->load;
+
+		if (ch->tt != NULL) {
+			ch->tt->load[j / 8] -= ch->tt_load;
+		}
+	}
+
+	if (ch->tt != NULL && !--ch->tt->users) {
+		ch->tt->hub = NULL;
+	}
+
+	ch->load = 0;
+	ch->tt = NULL;
+	ch->tt_load = 0;
+	sof_irq_update(host);
+}
+
+/**
+ * Get the first frame after @a frame that belong to schedule of @a ch
+ * @param ch DWC OTG Channel data
+ * @param frame Frame number
+ * @return frame number
+ */
+static inline uint16_t periodic_next_frame(const usbh_dwc_otg_chan *ch,
+		uint16_t frame)
+{
+	uint16_t next = frame + 1;
+	next += (ch->phase - next) & (ch->period - 1);
+	return next & 0x3FFF;
+}
+
+/**
+ * Set the ODD/EVEN frame bit of channel @a i for the frame it is submitted
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static inline void periodic_odd_frame(usbh_host *host, uint8_t i)
+{
+	if (CHANNELS_ITEM(i)->submit_frame & 0x1) {
+		REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_ODDFRM;
+	} else {
+		REBASE(DWC_OTG_HCxCHAR, i) &= ~DWC_OTG_HCCHAR_ODDFRM;
+	}
+}
+
 #if defined(USBH_DEBUG)
 const char *chan_state[] = {
 	[USBH_DWC_OTG_CHAN_STATE_FREE] = "FREE",
@@ -193,6 +510,32 @@ void usbh_dwc_otg_init(usbh_host *host)
 	LOGF_LN("Transmit Non Periodic FIFO size: %"PRIu16, TX_NP_FIFO_SIZE);
 	LOGF_LN("Transmit Periodic FIFO size: %"PRIu16, TX_P_FIFO_SIZE);
 	LOGF_LN("Channel count: %"PRIu8, get_chan_count(host));
+
+	/* Periodic schedule is driven from SOF.
+	 *  Application can call usbh_poll() from the OTG interrupt handler
+	 *  (after enabling the interrupt in NVIC) to get called every frame
+	 *  while SOF is unmasked (see sof_irq_update()),
+	 *  the mask has no effect on polling. */
+	uint32_t gintmsk = DWC_OTG_GINTMSK_PRTIM |
+		DWC_OTG_GINTMSK_HCIM | DWC_OTG_GINTMSK_DISCINT;
+
+#if !USBH_DWC_OTG_DMA
+	if (host->config->feature & USBH_DMA) {
+		LOG_LN("USBH_DMA ignored (built without USBH_DWC_OTG_DMA)");
+	}
+#endif
+
+	if (USE_DMA(host)) {
+		/* RX FIFO is emptied by the core */
+		LOG_LN("Internal DMA enabled");
+		REBASE(DWC_OTG_GAHBCFG) |= DWC_OTG_GAHBCFG_DMAEN |
+									DWC_OTG_GAHBCFG_HBSTLEN_INCR4;
+	} else {
+		gintmsk |= DWC_OTG_GINTMSK_RXFLVLM;
+	}
+
+	REBASE(DWC_OTG_GINTMSK) = gintmsk;
+	REBASE(DWC_OTG_GAHBCFG) |= DWC_OTG_GAHBCFG_GINT;
 }
 
 /**
@@ -204,12 +547,20 @@ static void reset_channels(usbh_host *host)
 	unsigned i;
 	LOG_LN("reseting all channels");
 
+	memset(host->periodic_load, 0, sizeof(host->periodic_load));
+	memset(host->tt, 0, sizeof(host->tt));
+
 	for (i = 0; i < get_chan_count(host); i++) {
 		usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
 		ch->state = USBH_DWC_OTG_CHAN_STATE_CANCELLED;
+		ch->need_scheduling = false;
+		ch->load = 0;
+		ch->tt = NULL;
+		ch->split = false;
+		ch->invalid = false;
 
 		if (ch->urb != NULL) {
-			ch->urb->backend_tag = INVALID_BACKEND_TAG;
+			usbh_urb_requeue(host, ch->urb);
 			ch->urb = NULL;
 		}
 
@@ -219,6 +570,8 @@ static void reset_channels(usbh_host *host)
 		REBASE(DWC_OTG_HCxCHAR, i) = DWC_OTG_HCCHAR_CHENA |
 									DWC_OTG_HCCHAR_CHDIS;
 	}
+
+	sof_irq_update(host);
 }
 
 /**
@@ -242,32 +595,27 @@ static void prepare_fifo(usbh_host *host)
 }
 
 /**
- * Perform channel scheduling.
- * All channel that are marked as "need_scheduling" are scheduled when they
- *  reach the appropriate frame.
- * On reaching the appropriate frame, just enable the channel.
+ * Perform channel scheduling. (called once per frame, on SOF)
+ * All channel that are marked as "need_scheduling" are enabled in the frame
+ *  before their "submit_frame".
  *  (it assumes that data is already there in FIFO)
  *
- * periodic transfer (interrup and isochronous) can be enabled in frame before
+ * periodic transfer (interrupt and isochronous) can be enabled in frame before
  *  "submit_frame" because ODD/EVEN bit will make sure that the transmission
  *   is done "submit_frame" frame.
  *
- * transfer (periodic and non-periodic) are always enabled in frame
- *  which are equal or greater than "submit_frame".
- *
- * On downside of this design is that, if interval (only used for isochronous
- *  and interrupt endpoint) is too large, it can increase the frame 14bit
- *  value make it think that the frame has not reached.
- *
- * for the design to work, interval should be less than 0x1FFF.
- *  (most of the time large interval are not a problem)
- *
- * interval >= 0x3E8 [0x3E8 = 1000, 1 second for FS] should never be required
- * interval >= 0x1F40 [0x1F40 = 1000, 1 second for HS] should never be required
+ * If the frame has been missed (host not polled in time), the channel is
+ *  enabled for the next frame.
+ * "submit_frame" is never more than USBH_DWC_OTG_PERIODIC_SLOTS frame ahead,
+ *  so half of the frame number range (0x2000) is used to tell
+ *  "missed" from "in future".
  */
 static void schedule_channels(usbh_host *host)
 {
+	uint16_t frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+	uint16_t next = (frame + 1) & 0x3FFF;
 	unsigned i;
+
 	for (i = 0; i < get_chan_count(host); i++) {
 		usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
 
@@ -275,51 +623,26 @@ static void schedule_channels(usbh_host *host)
 			continue;
 		}
 
-		/* we are using range because in case the poll is performed after the
-		 *  the submit frame (example: proper polling not done),
-		 *  it can gracefully handle and enable the channel.
-		 *  0x1FFF is chosen because it is half of 0x3FFF.
-		 *
-		 * This method will fail if large interval value is used for
-		 *  isochronous or interrupt endpoint. */
-		uint16_t low = ch->submit_frame;
-		uint16_t upper = (ch->submit_frame + 0x1FFF) & 0x3FFF;
-
-		usbh_transfer *transfer = &ch->urb->transfer;
-		if (transfer->ep_type == USBH_EP_INTERRUPT ||
-			transfer->ep_type == USBH_EP_ISOCHRONOUS) {
-			/* we can enable the endpoint even before the submit_frame
-			 *  because ODD/EVEN bit will do trick of sending it in right frame
-			 */
-			low = low ? (low - 1) : 0x3FFF;
+		/* number of frames the channel is late */
+		uint16_t late = (next - ch->submit_frame) & 0x3FFF;
+		if (late >= 0x2000) {
+			/* in future */
+			continue;
 		}
 
-		uint16_t current_frame = REBASE(DWC_OTG_HFNUM) &
-									DWC_OTG_HFNUM_FRNUM_MASK;
-		bool perform_enable = false;
-
-		/* check if the current frame falls in the range of low and upper */
-
-		if (low < upper) {
-			/* upper has not overflow'd due to addition of 0x1FFF */
-			if (current_frame >= low && current_frame <= upper) {
-				perform_enable = true;
-			}
-		} else {
-			/* upper has overflow'd due to addition of 0x1FFF */
-			if (current_frame >= low || current_frame <= upper) {
-				perform_enable = true;
-			}
+		if (late) {
+			ch->submit_frame = next;
+			periodic_odd_frame(host, i);
 		}
 
-		if (perform_enable) {
-			PREFIX_FRAME_NUM
-			LOGF_LN("re-enabling channel %"PRIu8 " in frame %"PRIu16, i,
-				current_frame);
-			ch->need_scheduling = false;
-			REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_CHENA;
-		}
+		PREFIX_FRAME_NUM
+		LOGF_LN("re-enabling channel %"PRIu8 " for frame %"PRIu16, i,
+			ch->submit_frame);
+		ch->need_scheduling = false;
+		REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_CHENA;
 	}
+
+	sof_irq_update(host);
 }
 
 /** @copydoc usbh_backend::poll() */
@@ -468,15 +791,20 @@ void usbh_dwc_otg_poll(usbh_host *host, uint64_t now)
 		usbh_root_device_disconnected(host);
 	}
 
-	/* re-enabled channels.
+	/* re-enabled channels (once per frame).
 	 *  These channels are either disabled due to NAK or next interval.  */
-	schedule_channels(host);
+	if (REBASE(DWC_OTG_GINTSTS) & DWC_OTG_GINTSTS_SOF) {
+		REBASE(DWC_OTG_GINTSTS) = DWC_OTG_GINTSTS_SOF;
+		schedule_channels(host);
+	}
 
 	/* process channel rx data */
 	while (REBASE(DWC_OTG_GINTSTS) & DWC_OTG_GINTSTS_RXFLVL) {
 		handle_rxflvl_interrupt(host);
 	}
 
+	fail_invalid_channels(host);
+
 	/* process channel events */
 	if (REBASE(DWC_OTG_GINTSTS) & DWC_OTG_GINTSTS_HCINT) {
 		unsigned i;
@@ -541,6 +869,90 @@ static int get_any_free_channel(usbh_host *host)
 	return -1;
 }
 
+/**
+ * Halt channel @a i.
+ * If the channel is enabled, it is disabled and will be free on CHH
+ *  (the channel is not reused before the core has halted it).
+ * A channel that is not enabled (ie waiting for a back-off retry) will not
+ *  report CHH, it is free right away.
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void channel_halt(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	ch->urb = NULL;
+	ch->need_scheduling = false;
+	ch->invalid = false;
+	periodic_release(host, ch);
+
+	if (!(REBASE(DWC_OTG_HCxCHAR, i) & DWC_OTG_HCCHAR_CHENA)) {
+		ch->state = USBH_DWC_OTG_CHAN_STATE_FREE;
+		REBASE(DWC_OTG_HCxINTMSK, i) = 0;
+		REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
+		REBASE(DWC_OTG_HCxTSIZ, i) = 0;
+		return;
+	}
+
+	ch->state = USBH_DWC_OTG_CHAN_STATE_CANCELLED;
+	REBASE(DWC_OTG_HCxINTMSK, i) = DWC_OTG_HCINTMSK_CHHM;
+	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
+	REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_CHENA | DWC_OTG_HCCHAR_CHDIS;
+}
+
+/**
+ * Handle NAK on bulk/control channel @a i.
+ * The first USBH_DWC_OTG_NAK_RETRY NAK are retried right away, after that
+ *  the retry is delayed (exponential back-off in frames) so that a device
+ *  with nothing to send do not keep the core (and CPU) busy.
+ *
+ * A bulk IN channel that is backing off is given to a waiting URB
+ *  (if any). The URB is resubmitted from poll with the remaining length,
+ *  so more URB than hardware channels can be in progress.
+ *  (OUT is not preempted because the packet is already in FIFO)
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void nak_throttle(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_transfer *transfer = &ch->urb->transfer;
+
+	if (++ch->nak_count < USBH_DWC_OTG_NAK_RETRY) {
+		/* enable the channel for retry */
+		REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_CHENA;
+		return;
+	}
+
+	ch->nak_count = 0;
+	ch->backoff = ch->backoff ? (ch->backoff * 2) : 1;
+	if (ch->backoff > USBH_DWC_OTG_NAK_BACKOFF_MAX) {
+		ch->backoff = USBH_DWC_OTG_NAK_BACKOFF_MAX;
+	}
+
+	/* not while a complete split is pending, the TT may already have
+	 *  the data from device */
+	if (transfer->ep_type == USBH_EP_BULK && !ch->complete_split &&
+			IS_IN_ENDPOINT(transfer->ep_addr) && usbh_urb_pending(host)) {
+		PREFIX_FRAME_NUM
+		LOGF_LN("channel %"PRIu8" preempted from URB %"PRIu64" (NAK)",
+			i, ch->urb->id);
+		usbh_urb_requeue(host, ch->urb);
+		/* the URB can take another free channel right away,
+		 *  this one is reused only after CHH */
+		channel_halt(host, i);
+		return;
+	}
+
+	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+	ch->submit_frame = (ch->submit_frame + ch->backoff) & 0x3FFF;
+	ch->need_scheduling = true;
+	sof_irq_update(host);
+
+	PREFIX_FRAME_NUM
+	LOGF_LN("channel %"PRIu8" back-off for %"PRIu8" frame", i, ch->backoff);
+}
+
 /**
  * Write more data from URB to FIFO.
  * @param ch DWC OTG Channel data
@@ -577,69 +989,775 @@ static void push_packet_to_fifo(usbh_dwc_otg_chan *ch)
 	usbh_urb_inc_data_pointer(urb, len);
 }
 
+#if USBH_DWC_OTG_DMA
+/*
+ * Internal DMA
+ * ============
+ * The core read/write the packets from/to memory pointed by HCDMA,
+ *  retry NAK'ed bulk/control transactions itself and halt the channel
+ *  only when the transfer is complete, on error and on periodic NAK.
+ *  Everything is processed from CHH (cause in HCINT).
+ *
+ * HCDMA point directly to the transfer data if it is word aligned,
+ *  otherwise the data goes through the channel "bounce" buffer
+ *  (upto USBH_DWC_OTG_DMA_BOUNCE bytes at a time).
+ * Periodic transfer and transfer with per packet flags
+ *  (USBH_FLAG_PER_PACKET_CALLBACK, USBH_FLAG_NO_MEMORY_INCREMENT)
+ *  are programmed one packet at a time.
+ *
+ * On STM32F7 the D-cache is cleaned before the core read memory and
+ *  invalidated before the CPU read what the core wrote.
+ *  IN transfer data should be cache line aligned (SCB_DCACHE_ALIGNED)
+ *  so that the invalidation do not discard neighbouring data.
+ */
+
 /**
- * Perform SETUP stage for Control transfer
- * After this, control transfer will either goto data or status stage
+ * Point the DMA of channel @a i to @a data
  * @param host USB Host
  * @param i DWC OTG channel number
+ * @param data Data
+ * @param len Length of @a data
+ * @param out true if the core read @a data (OUT, setup)
  */
-static void control_setup_stage(usbh_host *host, uint8_t i)
+static void dma_address(usbh_host *host, uint8_t i, void *data, uint16_t len,
+		bool out)
 {
-	LOG_CALL
+#if defined(STM32F7)
+	if (out) {
+		scb_clean_dcache_range(data, len);
+	} else {
+		/* no dirty line can be evicted over the received data */
+		scb_clean_invalidate_dcache_range(data, len);
+	}
+#else
+	(void) len;
+	(void) out;
+#endif
 
-	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
-	usbh_transfer *transfer = &ch->urb->transfer;
-	usbh_device *dev = transfer->device;
-	struct usb_setup_data *setup = &transfer->setup;
+	REBASE(DWC_OTG_HCxDMA, i) = (uint32_t) (uintptr_t) data;
+}
 
-	ch->state = USBH_DWC_OTG_CHAN_STATE_CTRL_SETUP;
-	ch->need_scheduling = false;
-	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+/**
+ * Make the data written by the DMA visible to the CPU
+ * @param data Data
+ * @param len Length of @a data
+ */
+static void dma_sync_in(void *data, uint16_t len)
+{
+#if defined(STM32F7)
+	scb_invalidate_dcache_range(data, len);
+#else
+	(void) data;
+	(void) len;
+#endif
+}
 
-	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
-	REBASE(DWC_OTG_HCxINTMSK, i) = 0xFFF;
-	REBASE(DWC_OTG_HCxTSIZ, i) = DWC_OTG_HCTSIZ_DPID_MDATA | (1 << 19) | 8;
-	REBASE(DWC_OTG_HCxCHAR, i) =
-		DWC_OTG_HCCHAR_CHENA |
-		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
-		DWC_OTG_HCCHAR_MCNT_1 |
-		DWC_OTG_HCCHAR_EPTYP_CONTROL |
-		(dev->speed == USBH_SPEED_LOW ? DWC_OTG_HCCHAR_LSDEV : 0x00) |
-		DWC_OTG_HCCHAR_EPDIR_OUT |
-		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
-		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
+/**
+ * Check if @a transfer can be performed in DMA mode
+ * @param transfer Transfer
+ * @return true if possible
+ */
+static bool dma_possible(const usbh_transfer *transfer)
+{
+	if (transfer->ep_size <= USBH_DWC_OTG_DMA_BOUNCE) {
+		return true;
+	}
 
-	volatile uint32_t *fifo = &REBASE(DWC_OTG_FIFO, i);
-	fifo += RX_FIFO_SIZE;
-	memory_to_fifo(setup, fifo, 8);
+	/* packet do not fit in bounce buffer, data has to stay word aligned */
+	return !(((uintptr_t) transfer->data) & 0x3) &&
+		!(transfer->ep_size & 0x3);
 }
 
 /**
- * Perform DATA_IN/DATA_OUT for control transfer.
- * After this, will proceed to control STATUS_OUT/STATUS_IN (respectively)
- * @param host USB Host
- * @param i DWC OTG channel number
+ * Maximum number of bytes that can be programmed at once in DMA mode
+ * @param transfer Transfer
+ * @return number of bytes (multiple of endpoint size, 0xFFFF if no limit)
  */
-static void control_data_stage(usbh_host *host, uint8_t i)
+static uint16_t dma_chunk_max(const usbh_transfer *transfer)
 {
-	LOG_CALL
+	uintptr_t data = (uintptr_t) transfer->data + transfer->transferred;
 
+	if (transfer->ep_type == USBH_EP_INTERRUPT ||
+			transfer->ep_type == USBH_EP_ISOCHRONOUS ||
+			(transfer->flags & (USBH_FLAG_PER_PACKET_CALLBACK |
+				USBH_FLAG_NO_MEMORY_INCREMENT))) {
+		return transfer->ep_size;
+	}
+
+	if (data & 0x3) {
+		return (USBH_DWC_OTG_DMA_BOUNCE / transfer->ep_size) *
+				transfer->ep_size;
+	}
+
+	return 0xFFFF;
+}
+
+/**
+ * Point the DMA of channel @a i to the next @a len bytes of transfer.
+ * OUT data is consumed here (like push_packet_to_fifo()),
+ *  IN data is accounted in dma_received().
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @param len Number of bytes
+ * @param out true if OUT
+ */
+static void dma_prepare(usbh_host *host, uint8_t i, uint16_t len, bool out)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_urb *urb = ch->urb;
+	void *data = ch->bounce;
+
+	ch->dma_len = len;
+	ch->dma_bounce = false;
+
+	if (len) {
+		data = usbh_urb_get_data_pointer(urb, len);
+
+		if (((uintptr_t) data) & 0x3) {
+			if (out) {
+				memcpy(ch->bounce, data, len);
+			}
+
+			ch->dma_bounce = true;
+			data = ch->bounce;
+		}
+
+		if (out) {
+			usbh_urb_inc_data_pointer(urb, len);
+		}
+	}
+
+	dma_address(host, i, data, len, out);
+}
+
+/**
+ * Point the DMA of channel @a i to the setup packet
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void dma_prepare_setup(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+
+	memcpy(ch->bounce, &ch->urb->transfer.setup, 8);
+	ch->dma_len = 8;
+	ch->dma_bounce = true;
+
+	dma_address(host, i, ch->bounce, 8, true);
+}
+
+/**
+ * Limit the (sub)transfer of channel @a i to what can be done at once
+ *  in DMA mode and point the DMA to data.
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @param out true if OUT
+ * @param[in,out] pktcnt Packet count
+ * @param[in,out] xfrsiz Transfer size
+ */
+static void dma_data(usbh_host *host, uint8_t i, bool out,
+		uint16_t *pktcnt, uint32_t *xfrsiz)
+{
+	usbh_transfer *transfer = &CHANNELS_ITEM(i)->urb->transfer;
+	uint16_t max = dma_chunk_max(transfer);
+
+	if (*xfrsiz > max) {
+		*xfrsiz = max;
+		*pktcnt = max / transfer->ep_size;
+	}
+
+	dma_prepare(host, i, *xfrsiz, out);
+}
+
+/**
+ * Account the IN data written by DMA on channel @a i
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @return number of bytes received
+ */
+static uint16_t dma_received(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_urb *urb = ch->urb;
+	uint32_t left = REBASE(DWC_OTG_HCxTSIZ, i) & DWC_OTG_HCTSIZ_XFRSIZ_MASK;
+	uint16_t len = (left < ch->dma_len) ? (ch->dma_len - left) : 0;
+
+	if (!len) {
+		return 0;
+	}
+
+	if (ch->dma_bounce) {
+		dma_sync_in(ch->bounce, len);
+		memcpy(usbh_urb_get_data_pointer(urb, len), ch->bounce, len);
+	} else {
+		dma_sync_in(usbh_urb_get_data_pointer(urb, len), len);
+	}
+
+	usbh_urb_inc_data_pointer(urb, len);
+	return len;
+}
+
+/**
+ * Point the DMA of channel @a i to isochronous packet @a data
+ *  (dma_possible() make sure that the packet fit in bounce)
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @param data Packet data
+ * @param len Packet length
+ * @param out true if OUT
+ */
+static void dma_prepare_iso(usbh_host *host, uint8_t i, void *data,
+		uint16_t len, bool out)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+
+	ch->dma_len = len;
+	ch->dma_bounce = !!(((uintptr_t) data) & 0x3);
+
+	if (ch->dma_bounce) {
+		if (out) {
+			memcpy(ch->bounce, data, len);
+		}
+
+		data = ch->bounce;
+	}
+
+	dma_address(host, i, data, len, out);
+}
+
+/**
+ * Account the IN isochronous packet written by DMA on channel @a i
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @param data Packet data
+ * @return number of bytes received
+ */
+static uint16_t dma_received_iso(usbh_host *host, uint8_t i, void *data)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	uint32_t left = REBASE(DWC_OTG_HCxTSIZ, i) & DWC_OTG_HCTSIZ_XFRSIZ_MASK;
+	uint16_t len = (left < ch->dma_len) ? (ch->dma_len - left) : 0;
+
+	if (ch->dma_bounce && len) {
+		dma_sync_in(ch->bounce, len);
+		memcpy(data, ch->bounce, len);
+	} else if (len) {
+		dma_sync_in(data, len);
+	}
+
+	return len;
+}
+#else
+/* Built without DMA support: USE_DMA() is always false */
+static inline bool dma_possible(const usbh_transfer *transfer)
+{
+	(void) transfer;
+	return false;
+}
+
+static inline void dma_prepare(usbh_host *host, uint8_t i, uint16_t len,
+		bool out)
+{
+	(void) host;
+	(void) i;
+	(void) len;
+	(void) out;
+}
+
+static inline void dma_prepare_setup(usbh_host *host, uint8_t i)
+{
+	(void) host;
+	(void) i;
+}
+
+static inline void dma_data(usbh_host *host, uint8_t i, bool out,
+		uint16_t *pktcnt, uint32_t *xfrsiz)
+{
+	(void) host;
+	(void) i;
+	(void) out;
+	(void) pktcnt;
+	(void) xfrsiz;
+}
+
+static inline void dma_prepare_iso(usbh_host *host, uint8_t i, void *data,
+		uint16_t len, bool out)
+{
+	(void) host;
+	(void) i;
+	(void) data;
+	(void) len;
+	(void) out;
+}
+
+static inline uint16_t dma_received_iso(usbh_host *host, uint8_t i,
+		void *data)
+{
+	(void) host;
+	(void) i;
+	(void) data;
+	return 0;
+}
+#endif
+
+/**
+ * Program the split control of channel @a i for @a dev.
+ * Split transaction are used if @a dev is a low/full speed device
+ *  behind a high speed hub.
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @param dev USB Device
+ * @return true if split transaction are used
+ */
+static bool split_init(usbh_host *host, uint8_t i, usbh_device *dev)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	uint8_t port = 0;
+	usbh_device *hub = usbh_hub_tt(dev, &port);
+
+	ch->split = (hub != NULL);
+	ch->complete_split = false;
+
+	REBASE(DWC_OTG_HCxSPLT, i) = ch->split ? (DWC_OTG_HCSPLT_SPLITEN |
+		DWC_OTG_HCSPLT_XACTPOS_ALL |
+		DWC_OTG_HCSPLT_HUBADDR(hub->address) |
+		DWC_OTG_HCSPLT_PORTADDR(port)) : 0;
+
+	return ch->split;
+}
+
+/**
+ * Begin the next packet of a split transfer (start split)
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @param len Packet length
+ */
+static void split_begin(usbh_host *host, uint8_t i, uint16_t len)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+
+	ch->complete_split = false;
+	ch->split_errors = 0;
+	ch->split_nyet = 0;
+	ch->split_len = len;
+	ch->split_base = ch->urb->transfer.transferred;
+
+	REBASE(DWC_OTG_HCxSPLT, i) &= ~DWC_OTG_HCSPLT_COMPLSPLT;
+}
+
+/**
+ * (Re)program the current packet of split transfer on channel @a i.
+ * Start split carry the OUT data (written again to FIFO on retry),
+ *  complete split carry the IN data.
+ * The data PID is left as updated by the core.
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @note channel is not enabled
+ */
+static void split_packet(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_transfer *transfer = &ch->urb->transfer;
+	bool in = !!(REBASE(DWC_OTG_HCxCHAR, i) & DWC_OTG_HCCHAR_EPDIR_IN);
+	uint32_t dpid = REBASE(DWC_OTG_HCxTSIZ, i) & DWC_OTG_HCTSIZ_DPID_MASK;
+	uint16_t len = ch->split_len;
+
+	if (ch->complete_split) {
+		REBASE(DWC_OTG_HCxSPLT, i) |= DWC_OTG_HCSPLT_COMPLSPLT;
+		if (!in) {
+			/* OUT data was sent with start split */
+			len = 0;
+		}
+	} else {
+		REBASE(DWC_OTG_HCxSPLT, i) &= ~DWC_OTG_HCSPLT_COMPLSPLT;
+	}
+
+	REBASE(DWC_OTG_HCxTSIZ, i) = dpid | (1 << 19) |
+		(DWC_OTG_HCTSIZ_XFRSIZ_MASK & len);
+
+	if (in || ch->complete_split) {
+		if (USE_DMA(host) && in && ch->complete_split) {
+			dma_prepare(host, i, len, false);
+		}
+
+		return;
+	}
+
+	if (ch->state == USBH_DWC_OTG_CHAN_STATE_CTRL_SETUP) {
+		if (USE_DMA(host)) {
+			dma_prepare_setup(host, i);
+		} else {
+			volatile uint32_t *fifo = &REBASE(DWC_OTG_FIFO, i);
+			fifo += RX_FIFO_SIZE;
+			memory_to_fifo(&transfer->setup, fifo, 8);
+		}
+	} else {
+		transfer->transferred = ch->split_base;
+
+		if (USE_DMA(host)) {
+			dma_prepare(host, i, len, true);
+		} else {
+			push_packet_to_fifo(ch);
+		}
+	}
+}
+
+/**
+ * Enable channel @a i for the next transaction
+ *  (next split transaction or DMA transfer continuation)
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @param frames Periodic only: frames (after the current submit frame)
+ *   in which the transaction is performed.
+ *   0 for the next frame of schedule.
+ */
+static void channel_enable(usbh_host *host, uint8_t i, uint16_t frames)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_ep_type ep_type = ch->urb->transfer.ep_type;
+
+	if (ep_type != USBH_EP_INTERRUPT && ep_type != USBH_EP_ISOCHRONOUS) {
+		REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_CHENA;
+		return;
+	}
+
+	if (frames) {
+		ch->submit_frame = (ch->submit_frame + frames) & 0x3FFF;
+	} else {
+		ch->submit_frame = periodic_next_frame(ch, ch->submit_frame);
+	}
+
+	periodic_odd_frame(host, i);
+	ch->need_scheduling = true;
+}
+
+/**
+ * Retry the packet from start split (NAK or transaction error)
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void split_retry(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_ep_type ep_type = ch->urb->transfer.ep_type;
+
+	ch->complete_split = false;
+	ch->split_nyet = 0;
+	split_packet(host, i);
+
+	if (ep_type == USBH_EP_BULK || ep_type == USBH_EP_CONTROL) {
+		nak_throttle(host, i);
+	} else {
+		channel_enable(host, i, 0);
+	}
+}
+
+/**
+ * Handle channel @a i interrupt of a split transfer
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @return true if handled
+ * @return false if the generic path should continue
+ *   (packets are complete or error)
+ */
+static bool split_event(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_transfer *transfer = &ch->urb->transfer;
+	uint32_t hcint = REBASE(DWC_OTG_HCxINT, i);
+
+	if (hcint & DWC_OTG_HCINT_TXERR) {
+		if (++ch->split_errors >= SPLIT_ERRORS_MAX) {
+			return false;
+		}
+
+		REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_TXERR;
+		PREFIX_FRAME_NUM
+		LOGF_LN("channel %"PRIu8" split transaction error, retrying", i);
+		split_retry(host, i);
+		return true;
+	}
+
+	if (hcint & (DWC_OTG_HCINT_STALL | DWC_OTG_HCINT_DTERR |
+			DWC_OTG_HCINT_BBERR | DWC_OTG_HCINT_FRMOR)) {
+		return false;
+	}
+
+	if (hcint & DWC_OTG_HCINT_NAK) {
+		/* TT buffer full (start split) or device NAK (complete split) */
+		REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_NAK;
+		split_retry(host, i);
+		return true;
+	}
+
+	if (!ch->complete_split) {
+		if (hcint & (DWC_OTG_HCINT_ACK | DWC_OTG_HCINT_NYET)) {
+			/* hub accepted the start split */
+			REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_ACK |
+											DWC_OTG_HCINT_NYET;
+			ch->complete_split = true;
+			ch->split_nyet = 0;
+			split_packet(host, i);
+			channel_enable(host, i, SPLIT_CSPLIT_DELAY);
+		}
+
+		return true;
+	}
+
+	if (hcint & DWC_OTG_HCINT_NYET) {
+		/* TT has not completed the transaction yet */
+		REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_NYET;
+
+		if (transfer->ep_type == USBH_EP_BULK ||
+				transfer->ep_type == USBH_EP_CONTROL) {
+			nak_throttle(host, i);
+		} else if (++ch->split_nyet < SPLIT_NYET_MAX) {
+			channel_enable(host, i, 1);
+		} else {
+			/* missed the transaction, start again on next period */
+			split_retry(host, i);
+		}
+
+		return true;
+	}
+
+	if (!(hcint & DWC_OTG_HCINT_XFRC)) {
+		/* ACK of OUT complete split (XFRC follow) */
+		REBASE(DWC_OTG_HCxINT, i) = hcint & DWC_OTG_HCINT_ACK;
+		return true;
+	}
+
+	REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_ACK;
+
+	/* packet done. IN DTOG is updated in handle_rxflvl_interrupt()
+	 *  (DMA mode: DTOG is taken from the core in dma_channel_halted()) */
+	ch->nak_count = 0;
+	ch->backoff = 0;
+	if (!USE_DMA(host) && IS_OUT_ENDPOINT(transfer->ep_addr)) {
+		transfer->device->dtog ^= ep_dtog_mask(transfer->ep_addr);
+	}
+
+	uint16_t received = transfer->transferred - ch->split_base;
+	bool in = !!(REBASE(DWC_OTG_HCxCHAR, i) & DWC_OTG_HCCHAR_EPDIR_IN);
+	bool more = ch->split_pktcnt > 1 &&
+		(!in || (received == ch->split_len && received == transfer->ep_size));
+
+	if (!more) {
+		/* generic path: next control stage or transfer complete */
+		return false;
+	}
+
+	REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_XFRC;
+	ch->split_pktcnt--;
+
+	uint16_t remaining = transfer->length - transfer->transferred;
+	split_begin(host, i, MIN(remaining, transfer->ep_size));
+	split_packet(host, i);
+	channel_enable(host, i, 0);
+	return true;
+}
+
+/**
+ * Perform SETUP stage for Control transfer
+ * After this, control transfer will either goto data or status stage
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void control_setup_stage(usbh_host *host, uint8_t i)
+{
+	LOG_CALL
+
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_transfer *transfer = &ch->urb->transfer;
+	usbh_device *dev = transfer->device;
+	struct usb_setup_data *setup = &transfer->setup;
+
+	ch->state = USBH_DWC_OTG_CHAN_STATE_CTRL_SETUP;
+	ch->need_scheduling = false;
+	ch->nak_count = 0;
+	ch->backoff = 0;
+	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+
+	if (split_init(host, i, dev)) {
+		ch->split_pktcnt = 1;
+		split_begin(host, i, 8);
+	}
+
+	if (USE_DMA(host)) {
+		dma_prepare_setup(host, i);
+	}
+
+	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
+	REBASE(DWC_OTG_HCxINTMSK, i) = CHAN_INTMSK(host);
+	REBASE(DWC_OTG_HCxTSIZ, i) = DWC_OTG_HCTSIZ_DPID_MDATA | (1 << 19) | 8;
+	REBASE(DWC_OTG_HCxCHAR, i) =
+		DWC_OTG_HCCHAR_CHENA |
+		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
+		DWC_OTG_HCCHAR_MCNT_1 |
+		DWC_OTG_HCCHAR_EPTYP_CONTROL |
+		(dev->speed == USBH_SPEED_LOW ? DWC_OTG_HCCHAR_LSDEV : 0x00) |
+		DWC_OTG_HCCHAR_EPDIR_OUT |
+		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
+		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
+
+	if (!USE_DMA(host)) {
+		volatile uint32_t *fifo = &REBASE(DWC_OTG_FIFO, i);
+		fifo += RX_FIFO_SIZE;
+		memory_to_fifo(setup, fifo, 8);
+	}
+}
+
+/**
+ * Perform DATA_IN/DATA_OUT for control transfer.
+ * After this, will proceed to control STATUS_OUT/STATUS_IN (respectively)
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void control_data_stage(usbh_host *host, uint8_t i)
+{
+	LOG_CALL
+
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_transfer *transfer = &ch->urb->transfer;
+	usbh_device *dev = transfer->device;
+
+	bool host2dev = !(transfer->setup.bmRequestType & USB_REQ_TYPE_DIRECTION);
+	ch->state = host2dev ?
+		USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_OUT :
+		USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_IN;
+	ch->need_scheduling = false;
+	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+
+	uint16_t pktcnt = CALC_PKTCNT(transfer->length, transfer->ep_size);
+	uint32_t xfrsiz = CALC_XFRSIZ(out, pktcnt, transfer->length, transfer->ep_size);
+
+	if (ch->split) {
+		/* one packet per split */
+		ch->split_pktcnt = pktcnt;
+		split_begin(host, i, MIN(transfer->length, transfer->ep_size));
+		pktcnt = 1;
+		xfrsiz = ch->split_len;
+	}
+
+	if (USE_DMA(host)) {
+		dma_data(host, i, host2dev, &pktcnt, &xfrsiz);
+	}
+
+	REBASE(DWC_OTG_HCxTSIZ, i) =
+		DWC_OTG_HCTSIZ_DPID_DATA1 |
+		(DWC_OTG_HCTSIZ_PKTCNT_MASK & (pktcnt << 19)) |
+		(DWC_OTG_HCTSIZ_XFRSIZ_MASK & xfrsiz);
+
+	REBASE(DWC_OTG_HCxCHAR, i) =
+		DWC_OTG_HCCHAR_CHENA |
+		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
+		DWC_OTG_HCCHAR_MCNT_1 |
+		DWC_OTG_HCCHAR_EPTYP_CONTROL |
+		(dev->speed == USBH_SPEED_LOW ? DWC_OTG_HCCHAR_LSDEV : 0x00) |
+		(host2dev ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
+		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
+		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
+
+	if (host2dev && !USE_DMA(host)) {
+		push_packet_to_fifo(ch);
+	}
+}
+
+/**
+ * Perform STATUS_OUT/STATUS_IN for control transfer.
+ * After this, will proceed to control DONE
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void control_status_stage(usbh_host *host, uint8_t i)
+{
+	LOG_CALL
+
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_transfer *transfer = &ch->urb->transfer;
+	usbh_device *dev = transfer->device;
+
+	bool host2dev = !(transfer->setup.bmRequestType & USB_REQ_TYPE_DIRECTION);
+	ch->state = host2dev ?
+		USBH_DWC_OTG_CHAN_STATE_CTRL_STATUS_IN :
+		USBH_DWC_OTG_CHAN_STATE_CTRL_STATUS_OUT;
+	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+	ch->need_scheduling = false;
+
+	if (ch->split) {
+		ch->split_pktcnt = 1;
+		split_begin(host, i, 0);
+	}
+
+	if (USE_DMA(host)) {
+		dma_prepare(host, i, 0, false);
+	}
+
+	REBASE(DWC_OTG_HCxTSIZ, i) = DWC_OTG_HCTSIZ_DPID_DATA1 | 1 << 19 | 0;
+
+	REBASE(DWC_OTG_HCxCHAR, i) =
+		DWC_OTG_HCCHAR_CHENA |
+		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
+		DWC_OTG_HCCHAR_MCNT_1 |
+		DWC_OTG_HCCHAR_EPTYP_CONTROL |
+		(dev->speed == USBH_SPEED_LOW ? DWC_OTG_HCCHAR_LSDEV : 0x00) |
+		(!host2dev ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
+		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
+		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
+}
+
+/**
+ * Perform bulk transfer on the @a i channel
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void bulk_transfer(usbh_host *host, uint8_t i)
+{
+	/* FIXME: function not tested! */
 	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
 	usbh_transfer *transfer = &ch->urb->transfer;
 	usbh_device *dev = transfer->device;
 
-	bool host2dev = !(transfer->setup.bmRequestType & USB_REQ_TYPE_DIRECTION);
-	ch->state = host2dev ?
-		USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_OUT :
-		USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_IN;
+	bool out = IS_OUT_ENDPOINT(transfer->ep_addr);
+	bool dtog = !!(dev->dtog & ep_dtog_mask(transfer->ep_addr));
+
+	/* URB can be resubmitted after preemption (see nak_throttle()) */
+	uint16_t remaining = transfer->length - transfer->transferred;
+	uint16_t pktcnt = CALC_PKTCNT(remaining, transfer->ep_size);
+	uint32_t xfrsiz = CALC_XFRSIZ(out, pktcnt, remaining, transfer->ep_size);
+
+	ch->state = USBH_DWC_OTG_CHAN_STATE_CALLBACK;
 	ch->need_scheduling = false;
 	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+	ch->nak_count = 0;
+	ch->backoff = 0;
 
-	uint16_t pktcnt = CALC_PKTCNT(transfer->length, transfer->ep_size);
-	uint32_t xfrsiz = CALC_XFRSIZ(out, pktcnt, transfer->length, transfer->ep_size);
+	/* Check if we need to transmit a ZLP (Zero Length Packet) */
+	if (out && remaining) {
+		if ((transfer->flags & USBH_FLAG_ZERO_PACKET) &&
+				(pktcnt * transfer->ep_size) == remaining) {
+			/* There are absolutely N packets with transfer->ep_size.
+			 * So, at the end of transfer, transmit a zero length packet. */
+			pktcnt += 1;
+		}
+	}
+
+	if (split_init(host, i, dev)) {
+		/* one packet per split */
+		ch->split_pktcnt = pktcnt;
+		split_begin(host, i, MIN(remaining, transfer->ep_size));
+		pktcnt = 1;
+		xfrsiz = ch->split_len;
+	}
+
+	if (USE_DMA(host)) {
+		dma_data(host, i, out, &pktcnt, &xfrsiz);
+	}
 
+	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
+	REBASE(DWC_OTG_HCxINTMSK, i) = CHAN_INTMSK(host);
 	REBASE(DWC_OTG_HCxTSIZ, i) =
-		DWC_OTG_HCTSIZ_DPID_DATA1 |
+		(dtog ? DWC_OTG_HCTSIZ_DPID_DATA1 : DWC_OTG_HCTSIZ_DPID_DATA0) |
 		(DWC_OTG_HCTSIZ_PKTCNT_MASK & (pktcnt << 19)) |
 		(DWC_OTG_HCTSIZ_XFRSIZ_MASK & xfrsiz);
 
@@ -647,216 +1765,545 @@ static void control_data_stage(usbh_host *host, uint8_t i)
 		DWC_OTG_HCCHAR_CHENA |
 		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
 		DWC_OTG_HCCHAR_MCNT_1 |
-		DWC_OTG_HCCHAR_EPTYP_CONTROL |
+		DWC_OTG_HCCHAR_EPTYP_BULK |
 		(dev->speed == USBH_SPEED_LOW ? DWC_OTG_HCCHAR_LSDEV : 0x00) |
-		(host2dev ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
+		(out ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
 		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
 		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
 
-	if (host2dev) {
+	if (out && !USE_DMA(host)) {
 		push_packet_to_fifo(ch);
 	}
 }
 
 /**
- * Perform STATUS_OUT/STATUS_IN for control transfer.
- * After this, will proceed to control DONE
+ * Perform interrupt transfer on the @a i channel
  * @param host USB Host
  * @param i DWC OTG channel number
  */
-static void control_status_stage(usbh_host *host, uint8_t i)
+static void interrupt_transfer(usbh_host *host, uint8_t i)
 {
-	LOG_CALL
-
+	/* FIXME: function not tested! */
 	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
 	usbh_transfer *transfer = &ch->urb->transfer;
 	usbh_device *dev = transfer->device;
 
-	bool host2dev = !(transfer->setup.bmRequestType & USB_REQ_TYPE_DIRECTION);
-	ch->state = host2dev ?
-		USBH_DWC_OTG_CHAN_STATE_CTRL_STATUS_IN :
-		USBH_DWC_OTG_CHAN_STATE_CTRL_STATUS_OUT;
-	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
-	ch->need_scheduling = false;
+	bool out = IS_OUT_ENDPOINT(transfer->ep_addr);
+	bool dtog = !!(dev->dtog & ep_dtog_mask(transfer->ep_addr));
+	uint16_t pktcnt = CALC_PKTCNT(transfer->length, transfer->ep_size);
+	uint32_t xfrsiz = CALC_XFRSIZ(out, pktcnt, transfer->length, transfer->ep_size);
+	uint16_t frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
 
-	REBASE(DWC_OTG_HCxTSIZ, i) = DWC_OTG_HCTSIZ_DPID_DATA1 | 1 << 19 | 0;
+	/* transferred in the first frame of the schedule.
+	 *  If that is not the next frame, the channel is enabled from
+	 *  schedule_channels() */
+	ch->state = USBH_DWC_OTG_CHAN_STATE_CALLBACK;
+	ch->submit_frame = periodic_next_frame(ch, frame);
+	ch->need_scheduling = ch->submit_frame != ((frame + 1) & 0x3FFF);
+
+	if (split_init(host, i, dev)) {
+		/* one packet per split */
+		ch->split_pktcnt = pktcnt;
+		split_begin(host, i, MIN(transfer->length, transfer->ep_size));
+		pktcnt = 1;
+		xfrsiz = ch->split_len;
+	}
+
+	if (USE_DMA(host)) {
+		dma_data(host, i, out, &pktcnt, &xfrsiz);
+	}
+
+	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
+	REBASE(DWC_OTG_HCxINTMSK, i) = CHAN_INTMSK(host);
+	REBASE(DWC_OTG_HCxTSIZ, i) =
+		(dtog ? DWC_OTG_HCTSIZ_DPID_DATA1 : DWC_OTG_HCTSIZ_DPID_DATA0) |
+		(DWC_OTG_HCTSIZ_PKTCNT_MASK & (pktcnt << 19)) |
+		(DWC_OTG_HCTSIZ_XFRSIZ_MASK & xfrsiz);
 
 	REBASE(DWC_OTG_HCxCHAR, i) =
-		DWC_OTG_HCCHAR_CHENA |
+		(ch->need_scheduling ? 0 : DWC_OTG_HCCHAR_CHENA) |
 		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
 		DWC_OTG_HCCHAR_MCNT_1 |
-		DWC_OTG_HCCHAR_EPTYP_CONTROL |
+		((ch->submit_frame & 0x1) ? DWC_OTG_HCCHAR_ODDFRM : 0x00) |
+		DWC_OTG_HCCHAR_EPTYP_INTERRUPT |
 		(dev->speed == USBH_SPEED_LOW ? DWC_OTG_HCCHAR_LSDEV : 0x00) |
-		(!host2dev ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
+		(out ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
+		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
+		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
+
+	if (out && !USE_DMA(host)) {
+		push_packet_to_fifo(ch);
+	}
+}
+
+/**
+ * Check if isochronous @a transfer need split transaction
+ *  (isochronous split is not supported)
+ * @param transfer Transfer
+ * @return true if split is required
+ */
+static bool iso_split(const usbh_transfer *transfer)
+{
+	uint8_t port;
+	return usbh_hub_tt(transfer->device, &port) != NULL;
+}
+
+/**
+ * Program the current packet of isochronous channel @a i
+ *  for its "submit_frame" (channel is enabled now if that is the next frame).
+ * If the frame has already passed, the next frame of schedule is used.
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void iso_packet(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_urb *urb = ch->urb;
+	usbh_transfer *transfer = &urb->transfer;
+	usbh_device *dev = transfer->device;
+	bool out = IS_OUT_ENDPOINT(transfer->ep_addr);
+	uint16_t frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+	uint16_t len = transfer->ep_size;
+
+	void *data = usbh_urb_iso_data_pointer(urb, ch->iso_index);
+	if (ch->urb != urb) {
+		/* cancelled from packet callback */
+		return;
+	}
+
+	if (out) {
+		len = MIN(transfer->iso_packets[ch->iso_index].length, len);
+	}
+
+	ch->iso_len = out ? len : 0;
+
+	if (((ch->submit_frame - frame - 1) & 0x3FFF) >= 0x2000) {
+		PREFIX_FRAME_NUM
+		LOGF_LN("channel %"PRIu8" missed isochronous frame %"PRIu16,
+			i, ch->submit_frame);
+		ch->submit_frame = periodic_next_frame(ch, frame);
+	}
+
+	ch->need_scheduling = ch->submit_frame != ((frame + 1) & 0x3FFF);
+
+	if (USE_DMA(host)) {
+		dma_prepare_iso(host, i, data, len, out);
+	}
+
+	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
+	REBASE(DWC_OTG_HCxINTMSK, i) = CHAN_INTMSK(host);
+	REBASE(DWC_OTG_HCxTSIZ, i) = DWC_OTG_HCTSIZ_DPID_DATA0 | (1 << 19) |
+		(DWC_OTG_HCTSIZ_XFRSIZ_MASK & len);
+
+	REBASE(DWC_OTG_HCxCHAR, i) =
+		(ch->need_scheduling ? 0 : DWC_OTG_HCCHAR_CHENA) |
+		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
+		DWC_OTG_HCCHAR_MCNT_1 |
+		((ch->submit_frame & 0x1) ? DWC_OTG_HCCHAR_ODDFRM : 0x00) |
+		DWC_OTG_HCCHAR_EPTYP_ISOCHRONOUS |
+		(out ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
 		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
 		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
+
+	if (out && len && !USE_DMA(host)) {
+		volatile uint32_t *fifo = &REBASE(DWC_OTG_FIFO, i);
+		fifo += RX_FIFO_SIZE + TX_NP_FIFO_SIZE;
+		memory_to_fifo(data, fifo, len);
+	}
+}
+
+/**
+ * Perform isochronous transfer on the @a i channel.
+ * One packet (descriptor) per frame of schedule, the channel stay
+ *  assigned till all packet are done (or cancelled for ring).
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void iso_transfer(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	uint16_t frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
+
+	ch->state = USBH_DWC_OTG_CHAN_STATE_CALLBACK;
+	ch->split = false;
+	ch->iso_index = 0;
+	ch->submit_frame = periodic_next_frame(ch, frame);
+	REBASE(DWC_OTG_HCxSPLT, i) = 0;
+
+	iso_packet(host, i);
+}
+
+/**
+ * Process the URB and prepare some channel for transfer
+ * If no channel are currently free, ignore the call.
+ * @param host USB Host
+ * @param urb USB Request Block
+ */
+void usbh_dwc_otg_transfer_submit(usbh_host *host, usbh_urb *urb)
+{
+	LOG_CALL
+
+	int i = get_any_free_channel(host);
+	if (i == -1) {
+		return;
+	}
+
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+
+	if ((USE_DMA(host) && !dma_possible(&urb->transfer)) ||
+			(urb->transfer.ep_type == USBH_EP_ISOCHRONOUS &&
+				iso_split(&urb->transfer))) {
+		/* URB is failed from poll (cannot be freed while submitting) */
+		LOGF_LN("URB %"PRIu64" cannot be performed "
+			"(unaligned data with DMA or isochronous split)", urb->id);
+		urb->backend_tag = i;
+		ch->urb = urb;
+		ch->state = USBH_DWC_OTG_CHAN_STATE_CALLBACK;
+		ch->invalid = true;
+		return;
+	}
+
+	if (urb->transfer.ep_type == USBH_EP_INTERRUPT ||
+			urb->transfer.ep_type == USBH_EP_ISOCHRONOUS) {
+		if (!periodic_reserve(host, ch, &urb->transfer)) {
+			/* try again when bandwidth is released */
+			return;
+		}
+	}
+
+	urb->backend_tag = i;
+	ch->urb = urb;
+
+	LOGF_LN("Channel %"PRIu8" assigned to URB %"PRIu64, i, urb->id);
+
+	switch (urb->transfer.ep_type) {
+	case USBH_EP_CONTROL:
+		control_setup_stage(host, i);
+	break;
+	case USBH_EP_BULK:
+		bulk_transfer(host, i);
+	break;
+	case USBH_EP_INTERRUPT:
+		interrupt_transfer(host, i);
+	break;
+	case USBH_EP_ISOCHRONOUS:
+		iso_transfer(host, i);
+	break;
+	}
+}
+
+/**
+ * The URB has been cancelled. Remove any backend allocated resource to @a urb
+ * @param host USB Host
+ * @param urb USB Request Block
+ */
+void usbh_dwc_otg_transfer_cancel(usbh_host *host, usbh_urb *urb)
+{
+	LOG_CALL
+
+	if (urb->backend_tag == INVALID_BACKEND_TAG) {
+		LOG_LN("requesting to cancel a URB with invalid channel assigned");
+		return;
+	}
+
+	uint8_t i = urb->backend_tag;
+	urb->backend_tag = INVALID_BACKEND_TAG;
+
+	LOGF_LN("channel %"PRIu8" cancelled with state = %s", i,
+		chan_state[CHANNELS_ITEM(i)->state]);
+
+	channel_halt(host, i);
+}
+
+/**
+ * Fail the URB of channel @a i if an error is reported in HCINT
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ * @return true if an error was handled
+ */
+static bool channel_error(usbh_host *host, uint8_t i)
+{
+	static const struct {
+		uint32_t bit_mask;
+		usbh_transfer_status status;
+		const char *name;
+	} error_cond[] = {
+		{DWC_OTG_HCINT_STALL, USBH_ERR_STALL, "STALL"},
+		{DWC_OTG_HCINT_DTERR, USBH_ERR_DTOG, "DTERR"},
+		{DWC_OTG_HCINT_BBERR, USBH_ERR_BABBLE, "BBERR"},
+		{DWC_OTG_HCINT_FRMOR, USBH_ERR_IO, "FRMOR"},
+		{DWC_OTG_HCINT_TXERR, USBH_ERR_IO, "TXERR"},
+		{DWC_OTG_HCINT_AHBERR, USBH_ERR_IO, "AHBERR"},
+		{0}
+	};
+
+	/* handle multiple error bits with same code */
+	unsigned j;
+	for (j = 0; error_cond[j].bit_mask; j++) {
+		if (REBASE(DWC_OTG_HCxINT, i) & error_cond[j].bit_mask) {
+			LOGF_LN("got %s for channel %"PRIu8, error_cond[j].name, i);
+			REBASE(DWC_OTG_HCxINT, i) = error_cond[j].bit_mask;
+			usbh_urb_free(CHANNELS_ITEM(i)->urb, error_cond[j].status);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Current stage of channel @a i completed successfully.
+ * Move the control transfer to next stage or complete the URB.
+ * @param host USB Host
+ * @param i DWC OTG channel number
+ */
+static void channel_complete(usbh_host *host, uint8_t i)
+{
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+
+	LOGF_LN("success, channel %"PRIu8" in %s state. "
+		"now we will move to next state", i, chan_state[ch->state]);
+
+	/* lets move the channel to next state! */
+	switch (ch->state) {
+	case USBH_DWC_OTG_CHAN_STATE_CTRL_SETUP:
+		if (ch->urb->transfer.setup.wLength) {
+			/* place request for data */
+			LOGF_LN("moving channel %"PRIu8" from setup to data stage", i);
+			control_data_stage(host, i);
+			break;
+		}
+	case USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_IN:
+	case USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_OUT:
+		/* place request to read 0 byte packet */
+		LOGF_LN("moving channel %"PRIu8" from state %s to status stage",
+			i, (ch->state == USBH_DWC_OTG_CHAN_STATE_CTRL_SETUP) ?
+				"setup" : "data");
+		control_status_stage(host, i);
+	break;
+	case USBH_DWC_OTG_CHAN_STATE_CTRL_STATUS_IN:
+	case USBH_DWC_OTG_CHAN_STATE_CTRL_STATUS_OUT:
+	case USBH_DWC_OTG_CHAN_STATE_CALLBACK: {
+		LOGF_LN("backend marked urb %"PRIu64" as success (channel %"PRIu8")",
+			ch->urb->id, i);
+		usbh_urb_free(ch->urb, USBH_SUCCESS);
+	} break;
+	case USBH_DWC_OTG_CHAN_STATE_FREE:
+		LOG_LN("WARN: channel is in free state");
+	break;
+	case USBH_DWC_OTG_CHAN_STATE_CANCELLED:
+		LOG_LN("WARN: channel is in cancelled state");
+	break;
+	}
 }
 
 /**
- * Perform bulk transfer on the @a i channel
+ * Handle channel @a i interrupt of isochronous transfer.
+ * Packet is complete (XFRC) or failed (isochronous is not retried),
+ *  either way the next packet is programmed for next frame of schedule.
  * @param host USB Host
  * @param i DWC OTG channel number
  */
-static void bulk_transfer(usbh_host *host, uint8_t i)
+static void iso_event(usbh_host *host, uint8_t i)
 {
-	/* FIXME: function not tested! */
 	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
-	usbh_transfer *transfer = &ch->urb->transfer;
-	usbh_device *dev = transfer->device;
-
-	bool out = IS_OUT_ENDPOINT(transfer->ep_addr);
-	bool dtog = !!(dev->dtog & ep_dtog_mask(transfer->ep_addr));
-	uint16_t pktcnt = CALC_PKTCNT(transfer->length, transfer->ep_size);
-	uint32_t xfrsiz = CALC_XFRSIZ(out, pktcnt, transfer->length, transfer->ep_size);
-
-	ch->state = USBH_DWC_OTG_CHAN_STATE_CALLBACK;
-	ch->need_scheduling = false;
-	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
-
-	/* Check if we need to transmit a ZLP (Zero Length Packet) */
-	if (out && transfer->length) {
-		if ((transfer->flags & USBH_FLAG_ZERO_PACKET) &&
-				(pktcnt * transfer->ep_size) == transfer->length) {
-			/* There are absolutely N packets with transfer->ep_size.
-			 * So, at the end of transfer, transmit a zero length packet. */
-			pktcnt += 1;
+	usbh_urb *urb = ch->urb;
+	usbh_transfer *transfer = &urb->transfer;
+	uint32_t hcint = REBASE(DWC_OTG_HCxINT, i);
+	usbh_transfer_status status = USBH_SUCCESS;
+	uint16_t len = ch->iso_len;
+
+	if (hcint & DWC_OTG_HCINT_BBERR) {
+		status = USBH_ERR_BABBLE;
+	} else if (hcint & (DWC_OTG_HCINT_TXERR | DWC_OTG_HCINT_FRMOR |
+			DWC_OTG_HCINT_DTERR | DWC_OTG_HCINT_AHBERR)) {
+		status = USBH_ERR_IO;
+	} else if (!(hcint & DWC_OTG_HCINT_XFRC)) {
+		if (!USE_DMA(host)) {
+			/* not the end of packet (ie ACK) */
+			REBASE(DWC_OTG_HCxINT, i) = hcint;
+			return;
 		}
+
+		status = USBH_ERR_IO;
 	}
 
-	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
-	REBASE(DWC_OTG_HCxINTMSK, i) = 0xFFF;
-	REBASE(DWC_OTG_HCxTSIZ, i) =
-		(dtog ? DWC_OTG_HCTSIZ_DPID_DATA1 : DWC_OTG_HCTSIZ_DPID_DATA0) |
-		(DWC_OTG_HCTSIZ_PKTCNT_MASK & (pktcnt << 19)) |
-		(DWC_OTG_HCTSIZ_XFRSIZ_MASK & xfrsiz);
+	REBASE(DWC_OTG_HCxINT, i) = hcint;
 
-	REBASE(DWC_OTG_HCxCHAR, i) =
-		DWC_OTG_HCCHAR_CHENA |
-		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
-		DWC_OTG_HCCHAR_MCNT_1 |
-		DWC_OTG_HCCHAR_EPTYP_BULK |
-		(dev->speed == USBH_SPEED_LOW ? DWC_OTG_HCCHAR_LSDEV : 0x00) |
-		(out ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
-		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
-		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
+	if (status != USBH_SUCCESS) {
+		PREFIX_FRAME_NUM
+		LOGF_LN("channel %"PRIu8" isochronous packet %"PRIu16" failed "
+			"(HCINT = 0x%"PRIx32")", i, ch->iso_index, hcint);
+		len = 0;
+	} else if (USE_DMA(host) && IS_IN_ENDPOINT(transfer->ep_addr)) {
+		len = dma_received_iso(host, i,
+			transfer->data + (ch->iso_index * transfer->ep_size));
+	}
 
-	if (out) {
-		push_packet_to_fifo(ch);
+	if (!usbh_urb_iso_packet_done(urb, &ch->iso_index, len, status)) {
+		return;
 	}
+
+	ch->submit_frame = periodic_next_frame(ch, ch->submit_frame);
+	iso_packet(host, i);
 }
 
+#if USBH_DWC_OTG_DMA
 /**
- * Perform interrupt transfer on the @a i channel
+ * Continue the transfer on channel @a i with the remaining data (DMA)
  * @param host USB Host
  * @param i DWC OTG channel number
  */
-static void interrupt_transfer(usbh_host *host, uint8_t i)
+static void dma_next(usbh_host *host, uint8_t i)
 {
-	/* FIXME: function not tested! */
 	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
 	usbh_transfer *transfer = &ch->urb->transfer;
-	usbh_device *dev = transfer->device;
-
-	bool out = IS_OUT_ENDPOINT(transfer->ep_addr);
-	bool dtog = !!(dev->dtog & ep_dtog_mask(transfer->ep_addr));
-	uint16_t pktcnt = CALC_PKTCNT(transfer->length, transfer->ep_size);
-	uint32_t xfrsiz = CALC_XFRSIZ(out, pktcnt, transfer->length, transfer->ep_size);
+	bool out = !(REBASE(DWC_OTG_HCxCHAR, i) & DWC_OTG_HCCHAR_EPDIR_IN);
+	uint32_t dpid = REBASE(DWC_OTG_HCxTSIZ, i) & DWC_OTG_HCTSIZ_DPID_MASK;
+	uint16_t remaining = transfer->length - transfer->transferred;
+	uint16_t pktcnt = CALC_PKTCNT(remaining, transfer->ep_size);
+	uint32_t xfrsiz = CALC_XFRSIZ(out, pktcnt, remaining, transfer->ep_size);
+
+	if (out && transfer->ep_type == USBH_EP_BULK &&
+			(transfer->flags & USBH_FLAG_ZERO_PACKET) &&
+			(pktcnt * transfer->ep_size) == remaining) {
+		pktcnt += 1;
+	}
 
-	ch->state = USBH_DWC_OTG_CHAN_STATE_CALLBACK;
-	ch->need_scheduling = false;
-	ch->submit_frame = REBASE(DWC_OTG_HFNUM) & DWC_OTG_HFNUM_FRNUM_MASK;
-	ch->submit_frame += 1; /* transferred in next frame for first time */
-	ch->submit_frame &= 0x3FFF;
+	dma_data(host, i, out, &pktcnt, &xfrsiz);
 
-	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
-	REBASE(DWC_OTG_HCxINTMSK, i) = 0xFFF;
-	REBASE(DWC_OTG_HCxTSIZ, i) =
-		(dtog ? DWC_OTG_HCTSIZ_DPID_DATA1 : DWC_OTG_HCTSIZ_DPID_DATA0) |
+	REBASE(DWC_OTG_HCxTSIZ, i) = dpid |
 		(DWC_OTG_HCTSIZ_PKTCNT_MASK & (pktcnt << 19)) |
 		(DWC_OTG_HCTSIZ_XFRSIZ_MASK & xfrsiz);
 
-	REBASE(DWC_OTG_HCxCHAR, i) =
-		DWC_OTG_HCCHAR_CHENA |
-		(DWC_OTG_HCCHAR_DAD_MASK & (dev->address << 22)) |
-		DWC_OTG_HCCHAR_MCNT_1 |
-		((ch->submit_frame & 0x1) ? DWC_OTG_HCCHAR_ODDFRM : 0x00) |
-		DWC_OTG_HCCHAR_EPTYP_INTERRUPT |
-		(dev->speed == USBH_SPEED_LOW ? DWC_OTG_HCCHAR_LSDEV : 0x00) |
-		(out ? DWC_OTG_HCCHAR_EPDIR_OUT : DWC_OTG_HCCHAR_EPDIR_IN) |
-		(DWC_OTG_HCCHAR_EPNUM_MASK & (transfer->ep_addr << 11)) |
-		(DWC_OTG_HCCHAR_MPSIZ_MASK & transfer->ep_size);
-
-	if (out) {
-		push_packet_to_fifo(ch);
-	}
+	channel_enable(host, i, 0);
 }
 
 /**
- * Process the URB and prepare some channel for transfer
- * If no channel are currently free, ignore the call.
+ * Handle halt of active channel @a i in DMA mode.
+ * Halt is caused by transfer complete, error or NAK (periodic/split only).
  * @param host USB Host
- * @param urb USB Request Block
+ * @param i DWC OTG channel number
  */
-void usbh_dwc_otg_transfer_submit(usbh_host *host, usbh_urb *urb)
+static void dma_channel_halted(usbh_host *host, uint8_t i)
 {
-	LOG_CALL
+	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+	usbh_transfer *transfer = &ch->urb->transfer;
+	uint32_t hcint = REBASE(DWC_OTG_HCxINT, i);
+	bool in = !!(REBASE(DWC_OTG_HCxCHAR, i) & DWC_OTG_HCCHAR_EPDIR_IN);
+	uint16_t received = 0;
 
-	int i = get_any_free_channel(host);
-	if (i == -1) {
+	REBASE(DWC_OTG_HCxINTMSK, i) = DWC_OTG_HCINTMSK_CHHM;
+
+	if (transfer->ep_type == USBH_EP_ISOCHRONOUS) {
+		iso_event(host, i);
 		return;
 	}
 
-	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
-	urb->backend_tag = i;
-	ch->urb = urb;
+	if (hcint & DWC_OTG_HCINT_XFRC) {
+		if (transfer->ep_type != USBH_EP_CONTROL) {
+			/* core keep the data PID of the next transaction */
+			uint32_t dpid = REBASE(DWC_OTG_HCxTSIZ, i) &
+								DWC_OTG_HCTSIZ_DPID_MASK;
+			if (dpid == DWC_OTG_HCTSIZ_DPID_DATA1) {
+				transfer->device->dtog |= ep_dtog_mask(transfer->ep_addr);
+			} else {
+				transfer->device->dtog &= ~ep_dtog_mask(transfer->ep_addr);
+			}
+		}
 
-	LOGF_LN("Channel %"PRIu8" assigned to URB %"PRIu64, i, urb->id);
+		if (in) {
+			received = dma_received(host, i);
+			if (ch->urb == NULL) {
+				/* cancelled from packet callback */
+				return;
+			}
 
-	switch (urb->transfer.ep_type) {
-	case USBH_EP_CONTROL:
-		control_setup_stage(host, i);
-	break;
-	case USBH_EP_BULK:
-		bulk_transfer(host, i);
-	break;
-	case USBH_EP_INTERRUPT:
-		interrupt_transfer(host, i);
+			if ((transfer->flags & USBH_FLAG_NO_SHORT_PACKET) &&
+					(received < ch->dma_len ||
+						(received % transfer->ep_size))) {
+				LOGF_LN("got a short packet on channel %"PRIu8
+					" and NO_SHORT_PACKET flag is set", i);
+				usbh_urb_free(ch->urb, USBH_ERR_SHORT_PACKET);
+				return;
+			}
+		}
+	}
+
+	if (ch->split && split_event(host, i)) {
+		return;
+	}
+
+	if (channel_error(host, i)) {
+		return;
+	}
+
+	if (hcint & DWC_OTG_HCINT_NAK) {
+		/* periodic NAK: retry on next frame of schedule */
+		REBASE(DWC_OTG_HCxINT, i) = hcint;
+		channel_enable(host, i, 0);
+		return;
+	}
+
+	if (!(hcint & DWC_OTG_HCINT_XFRC)) {
+		PREFIX_FRAME_NUM
+		LOGF_LN("channel %"PRIu8" halted without reason "
+			"(HCINT = 0x%"PRIx32")", i, hcint);
+		usbh_urb_free(ch->urb, USBH_ERR_IO);
+		return;
+	}
+
+	REBASE(DWC_OTG_HCxINT, i) = hcint;
+
+	switch (ch->state) {
+	case USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_IN:
+	case USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_OUT:
+	case USBH_DWC_OTG_CHAN_STATE_CALLBACK:
+		/* data left (transfer programmed in parts) */
+		if (!ch->split && transfer->transferred < transfer->length &&
+				(!in || received == ch->dma_len)) {
+			dma_next(host, i);
+			return;
+		}
 	break;
-	case USBH_EP_ISOCHRONOUS:
-		/* TODO */
+	default:
 	break;
 	}
+
+	channel_complete(host, i);
 }
+#else
+static inline void dma_channel_halted(usbh_host *host, uint8_t i)
+{
+	(void) host;
+	(void) i;
+}
+#endif
 
 /**
- * The URB has been cancelled. Remove any backend allocated resource to @a urb
+ * Fail the URB of channels marked "invalid"
+ *  (transfer cannot be performed, see usbh_dwc_otg_transfer_submit()).
+ * Done from poll because the URB cannot be freed while it is submitted.
  * @param host USB Host
- * @param urb USB Request Block
  */
-void usbh_dwc_otg_transfer_cancel(usbh_host *host, usbh_urb *urb)
+static void fail_invalid_channels(usbh_host *host)
 {
-	LOG_CALL
-
-	if (urb->backend_tag == INVALID_BACKEND_TAG) {
-		LOG_LN("requesting to cancel a URB with invalid channel assigned");
-		return;
-	}
-
-	uint8_t i = urb->backend_tag;
-	urb->backend_tag = INVALID_BACKEND_TAG;
+	unsigned i;
 
-	LOGF_LN("channel %"PRIu8" cancelled with state = %s", i,
-		chan_state[CHANNELS_ITEM(i)->state]);
+	for (i = 0; i < get_chan_count(host); i++) {
+		usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
+		usbh_urb *urb = ch->urb;
 
-	usbh_dwc_otg_chan *ch = CHANNELS_ITEM(i);
-	ch->urb = NULL;
-	ch->state = USBH_DWC_OTG_CHAN_STATE_CANCELLED;
-	ch->need_scheduling = false;
+		if (!ch->invalid) {
+			continue;
+		}
 
-	REBASE(DWC_OTG_HCxINTMSK, i) = DWC_OTG_HCINTMSK_CHHM;
-	REBASE(DWC_OTG_HCxINT, i) = 0xFFF;
-	REBASE(DWC_OTG_HCxTSIZ, i) = 0;
-	REBASE(DWC_OTG_HCxCHAR, i) = DWC_OTG_HCCHAR_CHENA | DWC_OTG_HCCHAR_CHDIS;
+		ch->invalid = false;
+		ch->urb = NULL;
+		ch->state = USBH_DWC_OTG_CHAN_STATE_FREE;
+		urb->backend_tag = INVALID_BACKEND_TAG;
+		usbh_urb_free(urb, USBH_ERR_INVALID);
+	}
 }
 
 /**
@@ -876,6 +2323,14 @@ static void process_channel_interrupt(usbh_host *host, uint8_t i)
 		LOGF_LN("got CHH for channel %"PRIu8, i);
 
 		REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_CHH;
+
+		if (USE_DMA(host) &&
+				ch->state != USBH_DWC_OTG_CHAN_STATE_FREE &&
+				ch->state != USBH_DWC_OTG_CHAN_STATE_CANCELLED) {
+			dma_channel_halted(host, i);
+			return;
+		}
+
 		REBASE(DWC_OTG_HCxINTMSK, i) = 0;
 
 		switch (ch->state) {
@@ -899,6 +2354,7 @@ static void process_channel_interrupt(usbh_host *host, uint8_t i)
 				" (marking channel as free)", chan_state[ch->state], i);
 			ch->state = USBH_DWC_OTG_CHAN_STATE_FREE;
 			ch->need_scheduling = false;
+			periodic_release(host, ch);
 
 			usbh_urb *urb = ch->urb;
 			ch->urb = NULL;
@@ -924,35 +2380,39 @@ static void process_channel_interrupt(usbh_host *host, uint8_t i)
 	break;
 	}
 
+	if (ch->urb->transfer.ep_type == USBH_EP_ISOCHRONOUS) {
+		iso_event(host, i);
+		return;
+	}
+
+	if (ch->split && split_event(host, i)) {
+		return;
+	}
+
 	if (REBASE(DWC_OTG_HCxINT, i) & DWC_OTG_HCINT_NAK) {
 		/* retry, we only got NAK */
 
 		usbh_transfer *transfer = &ch->urb->transfer;
+		REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_NAK;
+
 		switch (transfer->ep_type) {
 		case USBH_EP_BULK:
 		case USBH_EP_CONTROL:
-			/* enable the channel for retry */
-			REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_CHENA;
+			nak_throttle(host, i);
 		break;
 		case USBH_EP_INTERRUPT:
 		case USBH_EP_ISOCHRONOUS:
-			ch->submit_frame += transfer->interval;
-			ch->submit_frame &= 0x3FFF;
-
-			if (ch->submit_frame & 0x1) {
-				REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_ODDFRM;
-			} else {
-				REBASE(DWC_OTG_HCxCHAR, i) &= ~DWC_OTG_HCCHAR_ODDFRM;
-			}
+			ch->submit_frame = periodic_next_frame(ch, ch->submit_frame);
+			periodic_odd_frame(host, i);
 
-			if (transfer->interval > 1) {
+			if (ch->period > 1) {
 				/* Channel will be enabled on next applicable frame.
 				 *  till then the channel is not enabled.
 				 *  and is marked for scheduling */
 				PREFIX_FRAME_NUM
 				LOGF_LN("channel %"PRIu8" got NAK, retry after "
-					"interval = %"PRIu16" and at frame = %"PRIu16, i,
-					transfer->interval, ch->submit_frame);
+					"period = %"PRIu16" and at frame = %"PRIu16, i,
+					ch->period, ch->submit_frame);
 				ch->need_scheduling = true;
 			} else {
 				/* Enabling the channel right here because packet will
@@ -964,7 +2424,6 @@ static void process_channel_interrupt(usbh_host *host, uint8_t i)
 		break;
 		}
 
-		REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_NAK;
 		LOGF_LN("got NAK for channel %"PRIu8, i);
 		return;
 	}
@@ -972,6 +2431,10 @@ static void process_channel_interrupt(usbh_host *host, uint8_t i)
 	if (REBASE(DWC_OTG_HCxINT, i) & DWC_OTG_HCINT_ACK) {
 		usbh_transfer *transfer = &ch->urb->transfer;
 
+		/* device is responding again */
+		ch->nak_count = 0;
+		ch->backoff = 0;
+
 		/* toggle the dtog */
 		if (IS_OUT_ENDPOINT(transfer->ep_addr)) {
 			/* Toggle the DTOG.
@@ -994,15 +2457,10 @@ static void process_channel_interrupt(usbh_host *host, uint8_t i)
 		case USBH_EP_ISOCHRONOUS:
 			/* next packet will be transmitted in next applicable frame. */
 			/* ch->need_scheduling = true; */
-			ch->submit_frame += transfer->interval;
-			ch->submit_frame &= 0x3FFF;
-			if (ch->submit_frame & 0x1) {
-				REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_ODDFRM;
-			} else {
-				REBASE(DWC_OTG_HCxCHAR, i) &= ~DWC_OTG_HCCHAR_ODDFRM;
-			}
+			ch->submit_frame = periodic_next_frame(ch, ch->submit_frame);
+			periodic_odd_frame(host, i);
 
-			if (transfer->interval > 1 &&
+			if (ch->period > 1 &&
 					/* we have more packets to send? */
 					REBASE(DWC_OTG_HCxTSIZ, i) & DWC_OTG_HCTSIZ_PKTCNT_MASK) {
 				/* we need to wait for the appropriate frame to come.
@@ -1011,8 +2469,8 @@ static void process_channel_interrupt(usbh_host *host, uint8_t i)
 				ch->need_scheduling = true;
 				PREFIX_FRAME_NUM
 				LOGF_LN("channel %"PRIu8" got ACK, resume transfer after "
-					"interval = %"PRIu16" and at frame = %"PRIu16, i,
-					transfer->interval, ch->submit_frame);
+					"period = %"PRIu16" and at frame = %"PRIu16, i,
+					ch->period, ch->submit_frame);
 				REBASE(DWC_OTG_HCxCHAR, i) |= DWC_OTG_HCCHAR_CHENA |
 												DWC_OTG_HCCHAR_CHDIS;
 			}
@@ -1033,67 +2491,12 @@ static void process_channel_interrupt(usbh_host *host, uint8_t i)
 		return;
 	}
 
-	static const struct {
-		uint32_t bit_mask;
-		usbh_transfer_status status;
-		const char *name;
-	} error_cond[] = {
-		{DWC_OTG_HCINT_STALL, USBH_ERR_STALL, "STALL"},
-		{DWC_OTG_HCINT_DTERR, USBH_ERR_DTOG, "DTERR"},
-		{DWC_OTG_HCINT_BBERR, USBH_ERR_BABBLE, "BBERR"},
-		{DWC_OTG_HCINT_FRMOR, USBH_ERR_IO, "FRMOR"},
-		{DWC_OTG_HCINT_TXERR, USBH_ERR_IO, "TXERR"},
-		{0}
-	};
-
-	/* handle multiple error bits with same code */
-	unsigned j;
-	for (j = 0; error_cond[j].bit_mask; j++) {
-		if (REBASE(DWC_OTG_HCxINT, i) & error_cond[j].bit_mask) {
-			LOGF_LN("got %s for channel %"PRIu8, error_cond[j].name, i);
-			REBASE(DWC_OTG_HCxINT, i) = error_cond[j].bit_mask;
-			usbh_urb_free(ch->urb, error_cond[j].status);
-			return;
-		}
+	if (channel_error(host, i)) {
+		return;
 	}
 
-	/* TODO: NYET not handled */
-
-	LOGF_LN("success, channel %"PRIu8" in %s state. "
-		"now we will move to next state", i, chan_state[ch->state]);
 	REBASE(DWC_OTG_HCxINT, i) = DWC_OTG_HCINT_XFRC;
-
-	/* lets move the channel to next state! */
-	switch (ch->state) {
-	case USBH_DWC_OTG_CHAN_STATE_CTRL_SETUP:
-		if (ch->urb->transfer.setup.wLength) {
-			/* place request for data */
-			LOGF_LN("moving channel %"PRIu8" from setup to data stage", i);
-			control_data_stage(host, i);
-			break;
-		}
-	case USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_IN:
-	case USBH_DWC_OTG_CHAN_STATE_CTRL_DATA_OUT:
-		/* place request to read 0 byte packet */
-		LOGF_LN("moving channel %"PRIu8" from state %s to status stage",
-			i, (ch->state == USBH_DWC_OTG_CHAN_STATE_CTRL_SETUP) ?
-				"setup" : "data");
-		control_status_stage(host, i);
-	break;
-	case USBH_DWC_OTG_CHAN_STATE_CTRL_STATUS_IN:
-	case USBH_DWC_OTG_CHAN_STATE_CTRL_STATUS_OUT:
-	case USBH_DWC_OTG_CHAN_STATE_CALLBACK: {
-		LOGF_LN("backend marked urb %"PRIu64" as success (channel %"PRIu8")",
-			ch->urb->id, i);
-		usbh_urb_free(ch->urb, USBH_SUCCESS);
-	} break;
-	case USBH_DWC_OTG_CHAN_STATE_FREE:
-		LOG_LN("WARN: channel is in free state");
-	break;
-	case USBH_DWC_OTG_CHAN_STATE_CANCELLED:
-		LOG_LN("WARN: channel is in cancelled state");
-	break;
-	}
+	channel_complete(host, i);
 }
 
 /**
@@ -1153,6 +2556,26 @@ static void handle_rxflvl_interrupt(usbh_host *host)
 
 	usbh_urb *urb = ch->urb;
 	usbh_transfer *transfer = &urb->transfer;
+	volatile uint32_t *fifo = &REBASE(DWC_OTG_FIFO, i);
+
+	if (transfer->ep_type == USBH_EP_ISOCHRONOUS) {
+		/* data of the packet in progress (descriptor updated on XFRC) */
+		uint16_t room = transfer->ep_size - ch->iso_len;
+		unsigned j;
+
+		if (len > room) {
+			LOGF_LN("isochronous packet too large on channel %"PRIu8, i);
+			for (j = 0; j < len; j += 4) {
+				(void)REBASE(DWC_OTG_FIFO, i);
+			}
+			return;
+		}
+
+		fifo_to_memory(fifo, transfer->data + ch->iso_len +
+			(ch->iso_index * transfer->ep_size), len);
+		ch->iso_len += len;
+		return;
+	}
 
 	if ((transfer->flags & USBH_FLAG_NO_SHORT_PACKET) &&
 			(len < transfer->ep_size)) {
@@ -1179,7 +2602,6 @@ static void handle_rxflvl_interrupt(usbh_host *host)
 
 	/* read from FIFO and copy to data */
 	void *data = usbh_urb_get_data_pointer(urb, len);
-	volatile uint32_t *fifo = &REBASE(DWC_OTG_FIFO, i);
 	fifo_to_memory(fifo, data, len);
 	usbh_urb_inc_data_pointer(urb, len);
 
@@ -0,0 +1,518 @@
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * CDC ACM (serial) host class.
+ *
+ * Receive: a bulk IN transfer is always armed on the free space of the
+ *  receive ring (as many packets as fit). The backend place packets
+ *  directly in the ring, and the transfer is armed again from its
+ *  completion callback (before the application is informed), so
+ *  reception do not depend on the application reading in time.
+ *  When the ring is full, the transfer is not armed and the device is
+ *  NAK'ed (flow control, no data is lost) till application read.
+ *  If no host channel was available, it is armed again from
+ *  usbh_cdc_poll().
+ *  Only one transfer is used: the data toggle of an endpoint is used at
+ *  channel programming time, two transfer cannot be on the same endpoint.
+ *
+ * Transmit: application writes are queued in the transmit ring.
+ *  All data queued while a transfer is in progress is sent in the next
+ *  transfer, so that packets are full (except the last one).
+ */
+
+#include <unicore-mx/usbh/class/cdc.h>
+#include <unicore-mx/usbh/helper/ctrlreq.h>
+#include <string.h>
+
+#if (USBH_CDC_RX_BUFFER & (USBH_CDC_RX_BUFFER - 1)) != 0
+# error "USBH_CDC_RX_BUFFER need to be power of 2"
+#endif
+
+#if (USBH_CDC_TX_BUFFER & (USBH_CDC_TX_BUFFER - 1)) != 0
+# error "USBH_CDC_TX_BUFFER need to be power of 2"
+#endif
+
+#if (USBH_CDC_RX_BUFFER > 0x8000) || (USBH_CDC_TX_BUFFER > 0x8000)
+# error "USBH_CDC_RX_BUFFER and USBH_CDC_TX_BUFFER need to fit in one transfer"
+#endif
+
+#if USBH_CDC_TX_PACKET_MAX > USBH_CDC_TX_BUFFER
+# error "USBH_CDC_TX_PACKET_MAX need to fit in USBH_CDC_TX_BUFFER"
+#endif
+
+#define RX_MASK (USBH_CDC_RX_BUFFER - 1)
+#define TX_MASK (USBH_CDC_TX_BUFFER - 1)
+
+#define MIN(a, b) (((a) > (b)) ? (b) : (a))
+
+struct usbh_cdc {
+	usbh_device *dev;
+	uint8_t interface;
+	uint8_t ep_in, ep_out;
+	uint16_t ep_in_size, ep_out_size;
+	usbh_cdc_rx_callback rx_callback;
+
+	/* Receive ring (free running index).
+	 * If a packet do not fit before the end of buffer, the
+	 *  remaining bytes are skipped (gap) */
+	uint32_t rx_head, rx_tail;
+	uint32_t rx_gap_pos;
+	uint16_t rx_gap_len;
+	bool rx_active;
+	bool rx_stopped;
+	usbh_urb_id rx_urb;
+
+	/* Transmit ring (free running index) */
+	uint32_t tx_head, tx_tail;
+	bool tx_active;
+	usbh_urb_id tx_urb;
+
+	bool ctrl_busy;
+	usbh_cdc_ctrl_callback ctrl_callback;
+	struct usb_cdc_line_coding line_coding;
+
+	uint8_t rx_buf[USBH_CDC_RX_BUFFER] __attribute__((aligned(4)));
+	uint8_t tx_buf[USBH_CDC_TX_BUFFER] __attribute__((aligned(4)));
+	/* Used to combine the end and start of transmit ring in one packet */
+	uint8_t tx_packet[USBH_CDC_TX_PACKET_MAX] __attribute__((aligned(4)));
+};
+
+static usbh_cdc _cdc[USBH_CDC_MAX];
+
+/**
+ * Get the CDC object from a transfer
+ * @param transfer Transfer
+ * @return CDC object
+ * @return NULL if the object has been released
+ */
+static usbh_cdc *cdc_from_transfer(const usbh_transfer *transfer)
+{
+	usbh_cdc *cdc = transfer->user_data;
+	return (cdc->dev != NULL && cdc->dev == transfer->device) ? cdc : NULL;
+}
+
+/**
+ * Get the CDC object of @a dev
+ * @param dev USB Device
+ * @return CDC object
+ * @return NULL if not found
+ */
+static usbh_cdc *cdc_from_device(usbh_device *dev)
+{
+	unsigned i;
+
+	for (i = 0; i < USBH_CDC_MAX; i++) {
+		if (_cdc[i].dev == dev) {
+			return &_cdc[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Submit a bulk transfer
+ * @param cdc CDC object
+ * @param in IN endpoint (else OUT endpoint)
+ * @param data Data
+ * @param len Length
+ * @param callback Callback
+ * @return URB ID
+ */
+static usbh_urb_id bulk_submit(usbh_cdc *cdc, bool in, void *data,
+		uint16_t len, usbh_transfer_callback callback)
+{
+	usbh_transfer transfer = {
+		.device = cdc->dev,
+		.ep_type = USBH_EP_BULK,
+		.ep_addr = in ? cdc->ep_in : cdc->ep_out,
+		.ep_size = in ? cdc->ep_in_size : cdc->ep_out_size,
+		.data = data,
+		.length = len,
+		.flags = USBH_FLAG_NONE,
+		.timeout = USBH_TIMEOUT_NEVER,
+		.callback = callback,
+		.user_data = cdc
+	};
+
+	return usbh_transfer_submit(&transfer);
+}
+
+static void rx_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id);
+
+/**
+ * Arm the bulk IN transfer on the free space of receive ring
+ * @param cdc CDC object
+ */
+static void rx_arm(usbh_cdc *cdc)
+{
+	if (cdc->dev == NULL || cdc->rx_active || cdc->rx_stopped) {
+		return;
+	}
+
+	uint32_t used = cdc->rx_head - cdc->rx_tail;
+	unsigned offset = cdc->rx_head & RX_MASK;
+	unsigned contig = USBH_CDC_RX_BUFFER - offset;
+
+	if (contig < cdc->ep_in_size) {
+		/* packet do not fit before end of buffer, continue from start */
+		if (cdc->rx_gap_len ||
+				(used + contig + cdc->ep_in_size) > USBH_CDC_RX_BUFFER) {
+			return;
+		}
+
+		cdc->rx_gap_pos = cdc->rx_head;
+		cdc->rx_gap_len = contig;
+		cdc->rx_head += contig;
+		used += contig;
+		offset = 0;
+		contig = USBH_CDC_RX_BUFFER;
+	}
+
+	unsigned len = MIN(USBH_CDC_RX_BUFFER - used, contig);
+	len -= len % cdc->ep_in_size;
+	if (!len) {
+		/* ring full, device is NAK'ed till application read */
+		return;
+	}
+
+	cdc->rx_active = true;
+	usbh_urb_id urb = bulk_submit(cdc, true, &cdc->rx_buf[offset], len,
+		rx_done);
+	if (urb != USBH_INVALID_URB_ID) {
+		cdc->rx_urb = urb;
+	}
+}
+
+static void rx_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	usbh_cdc *cdc = cdc_from_transfer(transfer);
+	if (cdc == NULL) {
+		return;
+	}
+
+	cdc->rx_active = false;
+
+	switch (status) {
+	case USBH_SUCCESS:
+	break;
+	case USBH_ERR_NO_DEVICE:
+	case USBH_ERR_INVALID:
+	case USBH_ERR_STALL:
+		cdc->rx_stopped = true;
+		return;
+	case USBH_ERR_RES_UNAVAIL:
+		/* try again from usbh_cdc_poll() (or next read) */
+		return;
+	default:
+		/* packets received before the error are valid */
+	break;
+	}
+
+	cdc->rx_head += transfer->transferred;
+
+	/* arm again before informing application */
+	rx_arm(cdc);
+
+	if (transfer->transferred && cdc->rx_callback != NULL) {
+		cdc->rx_callback(cdc, usbh_cdc_available(cdc));
+	}
+}
+
+static void tx_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id);
+
+/**
+ * Start transmission of queued data (if not already in progress)
+ * @param cdc CDC object
+ */
+static void tx_kick(usbh_cdc *cdc)
+{
+	if (cdc->dev == NULL || cdc->tx_active) {
+		return;
+	}
+
+	uint32_t used = cdc->tx_head - cdc->tx_tail;
+	if (!used) {
+		return;
+	}
+
+	unsigned offset = cdc->tx_tail & TX_MASK;
+	unsigned contig = USBH_CDC_TX_BUFFER - offset;
+	uint16_t packet = cdc->ep_out_size;
+	void *data = &cdc->tx_buf[offset];
+	unsigned len;
+
+	if (used <= contig) {
+		len = used;
+	} else if (contig >= packet) {
+		/* full packets till end of buffer, rest go with the wrapped data */
+		len = contig - (contig % packet);
+	} else {
+		/* combine end and start of buffer in one packet */
+		len = MIN(used, packet);
+		memcpy(cdc->tx_packet, data, contig);
+		memcpy(cdc->tx_packet + contig, cdc->tx_buf, len - contig);
+		data = cdc->tx_packet;
+	}
+
+	cdc->tx_active = true;
+	usbh_urb_id urb = bulk_submit(cdc, false, data, len, tx_done);
+	if (urb != USBH_INVALID_URB_ID) {
+		cdc->tx_urb = urb;
+	}
+}
+
+static void tx_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	usbh_cdc *cdc = cdc_from_transfer(transfer);
+	if (cdc == NULL) {
+		return;
+	}
+
+	cdc->tx_active = false;
+
+	switch (status) {
+	case USBH_SUCCESS:
+		cdc->tx_tail += transfer->transferred;
+	break;
+	case USBH_ERR_RES_UNAVAIL:
+		/* try again from usbh_cdc_poll() (or next write) */
+		return;
+	default:
+		/* data is dropped */
+		cdc->tx_tail += transfer->length;
+	break;
+	}
+
+	tx_kick(cdc);
+}
+
+static void ctrl_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	usbh_cdc *cdc = cdc_from_device(transfer->device);
+	if (cdc == NULL) {
+		return;
+	}
+
+	usbh_cdc_ctrl_callback callback = cdc->ctrl_callback;
+	cdc->ctrl_callback = NULL;
+	cdc->ctrl_busy = false;
+
+	if (callback != NULL) {
+		callback(cdc, status == USBH_SUCCESS);
+	}
+}
+
+/**
+ * Place a class request on the communication interface
+ * @param cdc CDC object
+ * @param bRequest Request
+ * @param wValue Value
+ * @param data Data
+ * @param wLength Length of @a data
+ * @param callback Called when done
+ * @return false if a control request is already in progress
+ */
+static bool ctrl_submit(usbh_cdc *cdc, uint8_t bRequest, uint16_t wValue,
+		void *data, uint16_t wLength, usbh_cdc_ctrl_callback callback)
+{
+	if (cdc->dev == NULL || cdc->ctrl_busy) {
+		return false;
+	}
+
+	/* callback is set once submitted, a submit failure is reported
+	 *  (to ctrl_done) before usbh_ctrlreq_ep0() return */
+	cdc->ctrl_busy = true;
+	cdc->ctrl_callback = NULL;
+
+	usbh_urb_id urb = usbh_ctrlreq_ep0(cdc->dev,
+		USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
+		bRequest, wValue, cdc->interface, data, wLength, ctrl_done);
+	if (urb == USBH_INVALID_URB_ID) {
+		cdc->ctrl_busy = false;
+		return false;
+	}
+
+	cdc->ctrl_callback = callback;
+	return true;
+}
+
+usbh_cdc *usbh_cdc_init(usbh_device *dev, uint8_t interface,
+	uint8_t ep_in, uint16_t ep_in_size,
+	uint8_t ep_out, uint16_t ep_out_size,
+	usbh_cdc_rx_callback rx_callback)
+{
+	usbh_cdc *cdc = cdc_from_device(dev);
+
+	if (cdc == NULL) {
+		cdc = cdc_from_device(NULL);
+	}
+
+	if (cdc == NULL || !ep_in_size || ep_in_size > USBH_CDC_RX_BUFFER ||
+			!ep_out_size || ep_out_size > USBH_CDC_TX_PACKET_MAX) {
+		return NULL;
+	}
+
+	cdc->dev = dev;
+	cdc->interface = interface;
+	cdc->ep_in = ep_in;
+	cdc->ep_in_size = ep_in_size;
+	cdc->ep_out = ep_out;
+	cdc->ep_out_size = ep_out_size;
+	cdc->rx_callback = rx_callback;
+	cdc->rx_head = cdc->rx_tail = 0;
+	cdc->rx_gap_len = 0;
+	cdc->rx_active = false;
+	cdc->rx_stopped = false;
+	cdc->tx_head = cdc->tx_tail = 0;
+	cdc->tx_active = false;
+	cdc->ctrl_busy = false;
+	cdc->ctrl_callback = NULL;
+
+	usbh_device_ep_dtog_set(dev, ep_in, false);
+	usbh_device_ep_dtog_set(dev, ep_out, false);
+
+	rx_arm(cdc);
+
+	return cdc;
+}
+
+void usbh_cdc_release(usbh_cdc *cdc)
+{
+	usbh_device *dev = cdc->dev;
+	if (dev == NULL) {
+		return;
+	}
+
+	/* callbacks of the cancelled transfer are ignored from now */
+	cdc->dev = NULL;
+
+	usbh_host *host = usbh_device_host(dev);
+	if (host == NULL) {
+		return;
+	}
+
+	if (cdc->rx_active) {
+		usbh_transfer_cancel(host, cdc->rx_urb);
+	}
+
+	if (cdc->tx_active) {
+		usbh_transfer_cancel(host, cdc->tx_urb);
+	}
+}
+
+void usbh_cdc_poll(usbh_cdc *cdc)
+{
+	rx_arm(cdc);
+	tx_kick(cdc);
+}
+
+unsigned usbh_cdc_available(usbh_cdc *cdc)
+{
+	return cdc->rx_head - cdc->rx_tail - cdc->rx_gap_len;
+}
+
+unsigned usbh_cdc_read(usbh_cdc *cdc, void *buf, unsigned len)
+{
+	uint8_t *out = buf;
+	unsigned count = 0;
+
+	while (count < len && cdc->rx_tail != cdc->rx_head) {
+		if (cdc->rx_gap_len && cdc->rx_tail == cdc->rx_gap_pos) {
+			cdc->rx_tail += cdc->rx_gap_len;
+			cdc->rx_gap_len = 0;
+			continue;
+		}
+
+		unsigned offset = cdc->rx_tail & RX_MASK;
+		unsigned chunk = MIN(len - count, cdc->rx_head - cdc->rx_tail);
+		chunk = MIN(chunk, USBH_CDC_RX_BUFFER - offset);
+		if (cdc->rx_gap_len) {
+			chunk = MIN(chunk, cdc->rx_gap_pos - cdc->rx_tail);
+		}
+
+		memcpy(out + count, &cdc->rx_buf[offset], chunk);
+		cdc->rx_tail += chunk;
+		count += chunk;
+	}
+
+	/* space has been freed */
+	rx_arm(cdc);
+
+	return count;
+}
+
+unsigned usbh_cdc_write_free(usbh_cdc *cdc)
+{
+	return USBH_CDC_TX_BUFFER - (cdc->tx_head - cdc->tx_tail);
+}
+
+unsigned usbh_cdc_write(usbh_cdc *cdc, const void *buf, unsigned len)
+{
+	const uint8_t *in = buf;
+	unsigned count = 0;
+
+	if (cdc->dev == NULL) {
+		return 0;
+	}
+
+	len = MIN(len, usbh_cdc_write_free(cdc));
+
+	while (count < len) {
+		unsigned offset = cdc->tx_head & TX_MASK;
+		unsigned chunk = MIN(len - count, USBH_CDC_TX_BUFFER - offset);
+		memcpy(&cdc->tx_buf[offset], in + count, chunk);
+		cdc->tx_head += chunk;
+		count += chunk;
+	}
+
+	tx_kick(cdc);
+
+	return count;
+}
+
+bool usbh_cdc_set_line_coding(usbh_cdc *cdc,
+	const struct usb_cdc_line_coding *coding, usbh_cdc_ctrl_callback callback)
+{
+	if (cdc->ctrl_busy) {
+		return false;
+	}
+
+	cdc->line_coding = *coding;
+	return ctrl_submit(cdc, USB_CDC_REQ_SET_LINE_CODING, 0, &cdc->line_coding,
+		sizeof(cdc->line_coding), callback);
+}
+
+bool usbh_cdc_set_control_line_state(usbh_cdc *cdc, bool dtr, bool rts,
+	usbh_cdc_ctrl_callback callback)
+{
+	uint16_t wValue = (rts ? (1 << 1) : 0) | (dtr ? (1 << 0) : 0);
+	return ctrl_submit(cdc, USB_CDC_REQ_SET_CONTROL_LINE_STATE, wValue, NULL, 0,
+		callback);
+}
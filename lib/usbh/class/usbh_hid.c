@@ -19,6 +19,9 @@
 
 #include <unicore-mx/usbh/class/hid.h>
 #include <unicore-mx/usbh/helper/ctrlreq.h>
+#include <string.h>
+
+#define MIN(a, b) (((a) > (b)) ? (b) : (a))
 
 usbh_urb_id usbh_hid_set_protocol(usbh_device *dev, uint8_t protocol,
 	uint8_t interface, usbh_transfer_callback callback)
@@ -45,3 +48,362 @@ usbh_urb_id usbh_hid_set_idle(usbh_device *dev, uint8_t duration,
 		USB_REQ_HID_SET_IDLE, (duration << 8) | report_id, interface, NULL, 0,
 		callback);
 }
+
+usbh_urb_id usbh_hid_read_report_desc(usbh_device *dev, uint8_t interface,
+	void *buf, uint16_t len, usbh_transfer_callback callback)
+{
+	return usbh_ctrlreq_ep0(dev,
+		USB_REQ_TYPE_IN | USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_INTERFACE,
+		USB_REQ_GET_DESCRIPTOR, USB_DT_REPORT << 8, interface, buf, len,
+		callback);
+}
+
+/*
+ * Report descriptor parser (HID 1.11, 6.2.2 "Report Descriptor").
+ * The descriptor is walked once and the location of each usage of
+ *  interest is stored in a struct usbh_hid_field.
+ * After that, usbh_hid_field_value() only need a few shifts and masks.
+ */
+
+/* bType */
+#define ITEM_MAIN	0
+#define ITEM_GLOBAL	1
+#define ITEM_LOCAL	2
+
+/* bTag (main) */
+#define MAIN_INPUT			0x8
+#define MAIN_OUTPUT			0x9
+#define MAIN_FEATURE		0xB
+#define MAIN_COLLECTION		0xA
+#define MAIN_END_COLLECTION	0xC
+
+/* bTag (global) */
+#define GLOBAL_USAGE_PAGE	0x0
+#define GLOBAL_LOGICAL_MIN	0x1
+#define GLOBAL_LOGICAL_MAX	0x2
+#define GLOBAL_REPORT_SIZE	0x7
+#define GLOBAL_REPORT_ID	0x8
+#define GLOBAL_REPORT_COUNT	0x9
+#define GLOBAL_PUSH			0xA
+#define GLOBAL_POP			0xB
+
+/* bTag (local) */
+#define LOCAL_USAGE		0x0
+#define LOCAL_USAGE_MIN	0x1
+#define LOCAL_USAGE_MAX	0x2
+
+/* Input item data */
+#define INPUT_CONSTANT	(1 << 0)
+#define INPUT_VARIABLE	(1 << 1)
+#define INPUT_RELATIVE	(1 << 2)
+
+#define LONG_ITEM_PREFIX	0xFE
+#define GLOBAL_STACK_DEPTH	4
+
+struct hid_global {
+	uint16_t usage_page;
+	int32_t logical_min;
+	uint32_t logical_max;
+	uint8_t logical_max_size;
+	uint8_t report_size;
+	uint8_t report_id;
+	uint16_t report_count;
+};
+
+struct hid_local {
+	uint32_t usage[USBH_HID_LOCAL_USAGE_MAX];
+	uint8_t usage_count;
+	bool range;
+	uint32_t usage_min;
+	uint32_t usage_max;
+};
+
+struct hid_parser {
+	const uint32_t *usages;
+	struct usbh_hid_field *fields;
+	unsigned count;
+	unsigned found;
+
+	/* Input report bit offset of each report ID */
+	uint8_t report_ids;
+	uint8_t report_id[USBH_HID_REPORT_ID_MAX];
+	uint32_t report_bits[USBH_HID_REPORT_ID_MAX];
+};
+
+/**
+ * Get the bit offset of input report @a id
+ * @param parser Parser
+ * @param id Report ID
+ * @return pointer to bit offset
+ * @return NULL if too many report ID
+ */
+static uint32_t *report_bits(struct hid_parser *parser, uint8_t id)
+{
+	unsigned i;
+
+	for (i = 0; i < parser->report_ids; i++) {
+		if (parser->report_id[i] == id) {
+			return &parser->report_bits[i];
+		}
+	}
+
+	if (parser->report_ids >= USBH_HID_REPORT_ID_MAX) {
+		return NULL;
+	}
+
+	i = parser->report_ids++;
+	parser->report_id[i] = id;
+	parser->report_bits[i] = 0;
+	return &parser->report_bits[i];
+}
+
+/**
+ * Store the extraction plan of @a usage (if it is of interest)
+ * @param parser Parser
+ * @param usage Usage
+ * @param global Global state
+ * @param logical_max Logical maximum
+ * @param bit Bit offset in report (excluding report ID byte)
+ * @param data Input item data
+ * @param index Array index (array only)
+ */
+static void field_store(struct hid_parser *parser, uint32_t usage,
+		const struct hid_global *global, int32_t logical_max, uint32_t bit,
+		uint32_t data, int32_t index)
+{
+	unsigned i;
+
+	for (i = 0; i < parser->count; i++) {
+		struct usbh_hid_field *field = &parser->fields[i];
+		if (field->size || parser->usages[i] != usage) {
+			continue;
+		}
+
+		bit += global->report_id ? 8 : 0;
+
+		field->report_id = global->report_id;
+		field->flags = 0;
+		field->size = global->report_size;
+		field->count = 0;
+		field->byte = bit / 8;
+		field->shift = bit % 8;
+		field->index = index;
+		field->logical_min = global->logical_min;
+		field->logical_max = logical_max;
+
+		if (global->logical_min < 0) {
+			field->flags |= USBH_HID_FIELD_SIGNED;
+		}
+
+		if (data & INPUT_RELATIVE) {
+			field->flags |= USBH_HID_FIELD_RELATIVE;
+		}
+
+		if (!(data & INPUT_VARIABLE)) {
+			field->flags |= USBH_HID_FIELD_ARRAY;
+			field->count = MIN(global->report_count, 0xFF);
+		}
+
+		parser->found++;
+		return;
+	}
+}
+
+/**
+ * Process an Input item
+ * @param parser Parser
+ * @param global Global state
+ * @param local Local state
+ * @param data Input item data
+ */
+static void input_item(struct hid_parser *parser,
+		const struct hid_global *global, const struct hid_local *local,
+		uint32_t data)
+{
+	uint32_t *bits = report_bits(parser, global->report_id);
+	if (bits == NULL) {
+		return;
+	}
+
+	/* logical maximum is signed only if logical minimum is negative */
+	int32_t logical_max = global->logical_max;
+	uint8_t size = global->logical_max_size * 8;
+	if (global->logical_min < 0 && size && size < 32 &&
+			(global->logical_max & (1UL << (size - 1)))) {
+		logical_max = (int32_t) (global->logical_max | ~((1UL << size) - 1));
+	}
+
+	unsigned i;
+	bool usable = !(data & INPUT_CONSTANT) && global->report_size &&
+		global->report_size <= 32;
+
+	if (usable && (data & INPUT_VARIABLE)) {
+		/* one usage per slot */
+		for (i = 0; i < global->report_count; i++) {
+			uint32_t usage;
+
+			if (local->range) {
+				usage = MIN(local->usage_min + i, local->usage_max);
+			} else if (local->usage_count) {
+				usage = local->usage[MIN(i, local->usage_count - 1u)];
+			} else {
+				break;
+			}
+
+			field_store(parser, usage, global, logical_max,
+				*bits + (i * global->report_size), data, 0);
+		}
+	} else if (usable) {
+		/* every slot contain the index of a usage in the list/range */
+		if (local->range) {
+			for (i = 0; i < parser->count; i++) {
+				uint32_t usage = parser->usages[i];
+				if (usage >= local->usage_min && usage <= local->usage_max) {
+					field_store(parser, usage, global, logical_max, *bits, data,
+						global->logical_min + (usage - local->usage_min));
+				}
+			}
+		} else {
+			for (i = 0; i < local->usage_count; i++) {
+				field_store(parser, local->usage[i], global, logical_max,
+					*bits, data, global->logical_min + i);
+			}
+		}
+	}
+
+	*bits += (uint32_t) global->report_size * global->report_count;
+}
+
+/**
+ * Convert local usage item data to usage (page << 16 | id)
+ * @param global Global state
+ * @param value Item data
+ * @param size Item data size
+ * @return usage
+ */
+static uint32_t item_usage(const struct hid_global *global, uint32_t value,
+		unsigned size)
+{
+	/* 4 byte usage is an extended usage (page included) */
+	return (size == 4) ? value : USBH_HID_USAGE(global->usage_page, value);
+}
+
+unsigned usbh_hid_compile(const uint8_t *desc, unsigned len,
+	const uint32_t *usages, struct usbh_hid_field *fields, unsigned count)
+{
+	struct hid_parser parser = {
+		.usages = usages,
+		.fields = fields,
+		.count = count,
+		.found = 0,
+		.report_ids = 0
+	};
+	struct hid_global stack[GLOBAL_STACK_DEPTH];
+	unsigned depth = 0;
+	struct hid_global global;
+	struct hid_local local;
+	unsigned i = 0;
+
+	memset(fields, 0, count * sizeof(*fields));
+	memset(&global, 0, sizeof(global));
+	memset(&local, 0, sizeof(local));
+
+	while (i < len) {
+		uint8_t prefix = desc[i++];
+
+		if (prefix == LONG_ITEM_PREFIX) {
+			/* long item: bDataSize, bLongItemTag, data */
+			if (i >= len) {
+				break;
+			}
+			i += 1 + 1 + desc[i];
+			continue;
+		}
+
+		static const uint8_t data_size[4] = {0, 1, 2, 4};
+		unsigned size = data_size[prefix & 0x3];
+		uint8_t type = (prefix >> 2) & 0x3;
+		uint8_t tag = prefix >> 4;
+
+		if (i + size > len) {
+			break;
+		}
+
+		uint32_t value = 0;
+		unsigned j;
+		for (j = 0; j < size; j++) {
+			value |= (uint32_t) desc[i + j] << (j * 8);
+		}
+
+		int32_t svalue = (int32_t) value;
+		if (size && size < 4 && (value & (1UL << ((size * 8) - 1)))) {
+			svalue = (int32_t) (value | ~((1UL << (size * 8)) - 1));
+		}
+
+		i += size;
+
+		switch (type) {
+		case ITEM_MAIN:
+			if (tag == MAIN_INPUT) {
+				input_item(&parser, &global, &local, value);
+			}
+
+			/* local items only apply to the next main item */
+			memset(&local, 0, sizeof(local));
+		break;
+		case ITEM_GLOBAL:
+			switch (tag) {
+			case GLOBAL_USAGE_PAGE:
+				global.usage_page = value;
+			break;
+			case GLOBAL_LOGICAL_MIN:
+				global.logical_min = svalue;
+			break;
+			case GLOBAL_LOGICAL_MAX:
+				global.logical_max = value;
+				global.logical_max_size = size;
+			break;
+			case GLOBAL_REPORT_SIZE:
+				global.report_size = value;
+			break;
+			case GLOBAL_REPORT_ID:
+				global.report_id = value;
+			break;
+			case GLOBAL_REPORT_COUNT:
+				global.report_count = value;
+			break;
+			case GLOBAL_PUSH:
+				if (depth < GLOBAL_STACK_DEPTH) {
+					stack[depth++] = global;
+				}
+			break;
+			case GLOBAL_POP:
+				if (depth) {
+					global = stack[--depth];
+				}
+			break;
+			}
+		break;
+		case ITEM_LOCAL:
+			switch (tag) {
+			case LOCAL_USAGE:
+				if (local.usage_count < USBH_HID_LOCAL_USAGE_MAX) {
+					local.usage[local.usage_count++] =
+						item_usage(&global, value, size);
+				}
+			break;
+			case LOCAL_USAGE_MIN:
+				local.range = true;
+				local.usage_min = item_usage(&global, value, size);
+			break;
+			case LOCAL_USAGE_MAX:
+				local.range = true;
+				local.usage_max = item_usage(&global, value, size);
+			break;
+			}
+		break;
+		}
+	}
+
+	return parser.found;
+}
@@ -0,0 +1,909 @@
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Mass Storage Class, Bulk-Only Transport (usbmassbulk_10.pdf) with
+ *  SCSI transparent command set.
+ *
+ * Every command is CBW (OUT) -> data (IN or OUT, optional) -> CSW (IN).
+ * BOT do not allow a CBW on the bus before the CSW of previous command,
+ *  so the CBW of the next queued request is prepared while the
+ *  current data phase is in flight, and submitted directly from
+ *  the CSW callback (no usbh_poll() round trip between commands).
+ *
+ * Data phase use the user buffer directly, split in transfers of
+ *  DATA_CHUNK_MAX bytes (usbh_transfer::length is 16bit).
+ *
+ * Error recovery (usbmassbulk_10.pdf 5.3 and 6.6):
+ *  - STALL in data phase: clear halt, then read CSW
+ *  - STALL on CSW: clear halt, read CSW again (once)
+ *  - invalid CSW, phase error or transport error: Reset Recovery
+ *     (Bulk-Only Mass Storage Reset, clear halt IN, clear halt OUT)
+ *  - command failed: REQUEST SENSE is performed automatically
+ */
+
+#include <unicore-mx/usbh/class/msc.h>
+#include <unicore-mx/usbh/helper/ctrlreq.h>
+#include <string.h>
+
+#if (USBH_MSC_QUEUE_LENGTH & (USBH_MSC_QUEUE_LENGTH - 1)) != 0
+# error "USBH_MSC_QUEUE_LENGTH need to be power of 2"
+#endif
+
+/* Largest data transfer, multiple of all bulk endpoint size */
+#define DATA_CHUNK_MAX 0xFE00
+
+#define CBW_SIZE 31
+#define CSW_SIZE 13
+#define SENSE_SIZE 18
+#define CAPACITY_SIZE 8
+
+#define MIN(a, b) (((a) > (b)) ? (b) : (a))
+
+enum msc_state {
+	MSC_IDLE,
+	MSC_CBW,
+	MSC_DATA,
+	MSC_CSW,
+	MSC_CTRL
+};
+
+/* Control request in progress (MSC_CTRL) */
+enum msc_ctrl {
+	CTRL_GET_MAX_LUN,
+	CTRL_RESET,
+	CTRL_RESET_CLEAR_IN,
+	CTRL_RESET_CLEAR_OUT,
+	CTRL_DATA_CLEAR_IN,
+	CTRL_DATA_CLEAR_OUT,
+	CTRL_CSW_CLEAR_IN
+};
+
+/**
+ * SCSI command
+ * @param opcode SCSI operation code
+ * @param in Data direction is device to host
+ * @param lba Logical block address (READ/WRITE)
+ * @param count Number of blocks (READ/WRITE)
+ * @param data Data buffer
+ * @param length Data length (bytes)
+ * @param callback Called on completion
+ * @param user_data Passed to @a callback
+ */
+struct usbh_msc_cmd {
+	uint8_t opcode;
+	bool in;
+	uint32_t lba;
+	uint16_t count;
+	uint8_t *data;
+	uint32_t length;
+	usbh_msc_callback callback;
+	void *user_data;
+};
+
+struct usbh_msc {
+	usbh_device *dev;
+	uint8_t interface;
+	uint8_t ep_in, ep_out;
+	uint16_t ep_in_size, ep_out_size;
+
+	uint8_t state;
+	uint8_t ctrl;
+	bool ready;
+	uint8_t max_lun;
+	uint8_t retry;
+	bool csw_retry;
+	usbh_msc_status recovery_status;
+
+	uint32_t block_count, block_size;
+	uint8_t sense_key, sense_asc, sense_ascq;
+
+	/* Current URB (for cancel on release) */
+	usbh_urb_id urb;
+
+	/* Command in progress and how much of data phase is done */
+	struct usbh_msc_cmd *cmd;
+	uint32_t transferred;
+
+	/* Tag of last CBW and tag of command in progress */
+	uint32_t tag, cmd_tag;
+
+	/* Command @a cbw has been prepared for (NULL if none) */
+	const struct usbh_msc_cmd *cbw_cmd;
+
+	/* Internal command (bring up, REQUEST SENSE), run before queue */
+	struct usbh_msc_cmd internal;
+	bool internal_pending;
+
+	struct usbh_msc_cmd queue[USBH_MSC_QUEUE_LENGTH];
+	uint8_t head, count;
+
+	usbh_msc_callback ready_callback;
+	void *ready_user_data;
+
+	struct usb_msc_cbw cbw __attribute__((aligned(4)));
+	struct usb_msc_csw csw __attribute__((aligned(4)));
+	uint8_t buf[20] __attribute__((aligned(4)));
+};
+
+static usbh_msc _msc[USBH_MSC_MAX];
+
+static void msc_kick(usbh_msc *msc);
+static void ctrl_submit(usbh_msc *msc, uint8_t ctrl);
+static void internal_cmd(usbh_msc *msc, uint8_t opcode, uint32_t length,
+		usbh_msc_callback callback);
+static void request_sense_done(usbh_msc *msc, usbh_msc_status status,
+		void *user_data);
+
+/**
+ * Get the MSC object from a bulk transfer
+ * @param transfer Transfer
+ * @return MSC object
+ * @return NULL if the object has been released
+ */
+static usbh_msc *msc_from_transfer(const usbh_transfer *transfer)
+{
+	usbh_msc *msc = transfer->user_data;
+	return (msc->dev != NULL && msc->dev == transfer->device) ? msc : NULL;
+}
+
+/**
+ * Get the MSC object of @a dev
+ * @param dev USB Device
+ * @return MSC object
+ * @return NULL if not found
+ */
+static usbh_msc *msc_from_device(usbh_device *dev)
+{
+	unsigned i;
+
+	for (i = 0; i < USBH_MSC_MAX; i++) {
+		if (_msc[i].dev == dev) {
+			return &_msc[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Submit a bulk transfer on @a ep
+ * @param msc MSC object
+ * @param in IN endpoint (else OUT endpoint)
+ * @param data Data
+ * @param len Length
+ * @param callback Callback
+ */
+static void bulk_submit(usbh_msc *msc, bool in, void *data, uint16_t len,
+		usbh_transfer_callback callback)
+{
+	usbh_transfer transfer = {
+		.device = msc->dev,
+		.ep_type = USBH_EP_BULK,
+		.ep_addr = in ? msc->ep_in : msc->ep_out,
+		.ep_size = in ? msc->ep_in_size : msc->ep_out_size,
+		.data = data,
+		.length = len,
+		.flags = USBH_FLAG_NONE,
+		.timeout = USBH_MSC_TIMEOUT,
+		.callback = callback,
+		.user_data = msc
+	};
+
+	/* on failure, callback has already been performed */
+	usbh_urb_id urb = usbh_transfer_submit(&transfer);
+	if (urb != USBH_INVALID_URB_ID) {
+		msc->urb = urb;
+	}
+}
+
+/**
+ * Complete the request at head of queue
+ * @param msc MSC object
+ * @param status Status
+ */
+static void queue_complete(usbh_msc *msc, usbh_msc_status status)
+{
+	struct usbh_msc_cmd *cmd = &msc->queue[msc->head];
+	usbh_msc_callback callback = cmd->callback;
+	void *user_data = cmd->user_data;
+
+	msc->head = (msc->head + 1) & (USBH_MSC_QUEUE_LENGTH - 1);
+	msc->count--;
+
+	if (callback != NULL) {
+		callback(msc, status, user_data);
+	}
+}
+
+/**
+ * Drive is unusable, fail everything.
+ * @param msc MSC object
+ * @param status Status
+ */
+static void msc_fail(usbh_msc *msc, usbh_msc_status status)
+{
+	msc->state = MSC_IDLE;
+	msc->cmd = NULL;
+	msc->cbw_cmd = NULL;
+	msc->internal_pending = false;
+	msc->ready = false;
+
+	if (msc->ready_callback != NULL) {
+		/* bring up in progress */
+		usbh_msc_callback callback = msc->ready_callback;
+		msc->ready_callback = NULL;
+		callback(msc, status, msc->ready_user_data);
+	}
+
+	while (msc->count) {
+		queue_complete(msc, status);
+	}
+}
+
+/**
+ * Command in progress has completed
+ * @param msc MSC object
+ * @param status Status
+ */
+static void cmd_done(usbh_msc *msc, usbh_msc_status status)
+{
+	struct usbh_msc_cmd *cmd = msc->cmd;
+	msc->cmd = NULL;
+	msc->state = MSC_IDLE;
+
+	if (cmd == &msc->internal) {
+		if (cmd->callback != NULL) {
+			cmd->callback(msc, status, cmd->user_data);
+		}
+	} else {
+		queue_complete(msc, status);
+	}
+
+	msc_kick(msc);
+}
+
+/**
+ * Start Reset Recovery, command in progress complete with @a status after it
+ * @param msc MSC object
+ * @param status Status
+ */
+static void reset_recovery(usbh_msc *msc, usbh_msc_status status)
+{
+	msc->recovery_status = status;
+	ctrl_submit(msc, CTRL_RESET);
+}
+
+/**
+ * Handle a failed bulk transfer
+ * @param msc MSC object
+ * @param status Transfer status
+ */
+static void transport_failed(usbh_msc *msc, usbh_transfer_status status)
+{
+	switch (status) {
+	case USBH_ERR_NO_DEVICE:
+	case USBH_ERR_INVALID:
+		msc_fail(msc, USBH_MSC_ERR_NO_DEVICE);
+	break;
+	case USBH_ERR_RES_UNAVAIL:
+		if (msc->state == MSC_CBW) {
+			/* nothing reached the device */
+			cmd_done(msc, USBH_MSC_ERR_IO);
+			break;
+		}
+	/* fall through */
+	default:
+		reset_recovery(msc, USBH_MSC_ERR_IO);
+	break;
+	}
+}
+
+/**
+ * Prepare the CBW for @a cmd
+ * @param msc MSC object
+ * @param cmd Command
+ */
+static void cbw_prepare(usbh_msc *msc, const struct usbh_msc_cmd *cmd)
+{
+	struct usb_msc_cbw *cbw = &msc->cbw;
+	uint8_t *cb = cbw->CBWCB;
+
+	memset(cbw, 0, sizeof(*cbw));
+	cbw->dCBWSignature = USB_MSC_CBW_SIGNATURE;
+	cbw->dCBWTag = ++msc->tag;
+	cbw->dCBWDataTransferLength = cmd->length;
+	cbw->bmCBWFlags = cmd->in ? 0x80 : 0x00;
+	cbw->bCBWLUN = 0;
+
+	cb[0] = cmd->opcode;
+
+	switch (cmd->opcode) {
+	case USB_MSC_SCSI_READ_10:
+	case USB_MSC_SCSI_WRITE_10:
+		cb[2] = cmd->lba >> 24;
+		cb[3] = cmd->lba >> 16;
+		cb[4] = cmd->lba >> 8;
+		cb[5] = cmd->lba;
+		cb[7] = cmd->count >> 8;
+		cb[8] = cmd->count;
+		cbw->bCBWCBLength = 10;
+	break;
+	case USB_MSC_SCSI_READ_CAPACITY:
+		cbw->bCBWCBLength = 10;
+	break;
+	case USB_MSC_SCSI_REQUEST_SENSE:
+		cb[4] = cmd->length;
+		cbw->bCBWCBLength = 6;
+	break;
+	default:
+		cbw->bCBWCBLength = 6;
+	break;
+	}
+
+	msc->cbw_cmd = cmd;
+}
+
+static void csw_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id);
+
+/**
+ * Read the CSW
+ * @param msc MSC object
+ */
+static void csw_stage(usbh_msc *msc)
+{
+	msc->state = MSC_CSW;
+	bulk_submit(msc, true, &msc->csw, CSW_SIZE, csw_done);
+}
+
+static void data_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id);
+
+/**
+ * Transfer the next part of data phase
+ * @param msc MSC object
+ */
+static void data_stage(usbh_msc *msc)
+{
+	struct usbh_msc_cmd *cmd = msc->cmd;
+	uint16_t len = MIN(cmd->length - msc->transferred, DATA_CHUNK_MAX);
+
+	msc->state = MSC_DATA;
+	bulk_submit(msc, cmd->in, cmd->data + msc->transferred, len, data_done);
+}
+
+static void cbw_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	usbh_msc *msc = msc_from_transfer(transfer);
+	if (msc == NULL) {
+		return;
+	}
+
+	if (status != USBH_SUCCESS) {
+		transport_failed(msc, status);
+		return;
+	}
+
+	/* CBW buffer is free, prepare it for the next request
+	 *  while this command is in progress */
+	if (msc->cmd != &msc->internal && msc->count > 1) {
+		cbw_prepare(msc,
+			&msc->queue[(msc->head + 1) & (USBH_MSC_QUEUE_LENGTH - 1)]);
+	}
+
+	if (msc->cmd->length) {
+		data_stage(msc);
+	} else {
+		csw_stage(msc);
+	}
+}
+
+static void data_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	usbh_msc *msc = msc_from_transfer(transfer);
+	if (msc == NULL) {
+		return;
+	}
+
+	struct usbh_msc_cmd *cmd = msc->cmd;
+
+	if (status == USBH_ERR_STALL) {
+		/* device has terminated the data phase, CSW tell what happened */
+		ctrl_submit(msc, cmd->in ? CTRL_DATA_CLEAR_IN : CTRL_DATA_CLEAR_OUT);
+		return;
+	}
+
+	if (status != USBH_SUCCESS) {
+		transport_failed(msc, status);
+		return;
+	}
+
+	msc->transferred += transfer->transferred;
+
+	if (transfer->transferred == transfer->length &&
+			msc->transferred < cmd->length) {
+		data_stage(msc);
+		return;
+	}
+
+	csw_stage(msc);
+}
+
+static void csw_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	usbh_msc *msc = msc_from_transfer(transfer);
+	if (msc == NULL) {
+		return;
+	}
+
+	struct usbh_msc_cmd *cmd = msc->cmd;
+	const struct usb_msc_csw *csw = &msc->csw;
+
+	if (status == USBH_ERR_STALL) {
+		if (msc->csw_retry) {
+			reset_recovery(msc, USBH_MSC_ERR_IO);
+		} else {
+			msc->csw_retry = true;
+			ctrl_submit(msc, CTRL_CSW_CLEAR_IN);
+		}
+		return;
+	}
+
+	if (status != USBH_SUCCESS) {
+		transport_failed(msc, status);
+		return;
+	}
+
+	if (transfer->transferred != CSW_SIZE ||
+			csw->dCSWSignature != USB_MSC_CSW_SIGNATURE ||
+			csw->dCSWTag != msc->cmd_tag) {
+		/* CSW not valid */
+		reset_recovery(msc, USBH_MSC_ERR_IO);
+		return;
+	}
+
+	switch (csw->bCSWStatus) {
+	case USB_MSC_CSW_STATUS_SUCCESS:
+		if (cmd != &msc->internal && csw->dCSWDataResidue) {
+			/* part of the blocks were not transferred */
+			cmd_done(msc, USBH_MSC_ERR_IO);
+		} else {
+			cmd_done(msc, USBH_MSC_SUCCESS);
+		}
+	break;
+	case USB_MSC_CSW_STATUS_FAILED:
+		if (cmd == &msc->internal) {
+			cmd_done(msc, USBH_MSC_ERR_CHECK);
+			break;
+		}
+
+		/* failed request stay at head of queue till sense is read */
+		msc->state = MSC_IDLE;
+		msc->cmd = NULL;
+		internal_cmd(msc, USB_MSC_SCSI_REQUEST_SENSE, SENSE_SIZE,
+			request_sense_done);
+	break;
+	default:
+		reset_recovery(msc, USBH_MSC_ERR_IO);
+	break;
+	}
+}
+
+static void ctrl_done(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	usbh_msc *msc = msc_from_device(transfer->device);
+	if (msc == NULL || msc->state != MSC_CTRL) {
+		return;
+	}
+
+	if (status == USBH_ERR_NO_DEVICE || status == USBH_ERR_INVALID) {
+		msc_fail(msc, USBH_MSC_ERR_NO_DEVICE);
+		return;
+	}
+
+	switch (msc->ctrl) {
+	case CTRL_GET_MAX_LUN:
+		/* single LUN device may STALL the request */
+		msc->max_lun = (status == USBH_SUCCESS) ? msc->buf[0] : 0;
+		msc->state = MSC_IDLE;
+		msc_kick(msc);
+	break;
+	case CTRL_RESET:
+		if (status != USBH_SUCCESS) {
+			msc_fail(msc, USBH_MSC_ERR_IO);
+			break;
+		}
+
+		ctrl_submit(msc, CTRL_RESET_CLEAR_IN);
+	break;
+	case CTRL_RESET_CLEAR_IN:
+		usbh_device_ep_dtog_set(msc->dev, msc->ep_in, false);
+		ctrl_submit(msc, CTRL_RESET_CLEAR_OUT);
+	break;
+	case CTRL_RESET_CLEAR_OUT:
+		usbh_device_ep_dtog_set(msc->dev, msc->ep_out, false);
+		cmd_done(msc, msc->recovery_status);
+	break;
+	case CTRL_DATA_CLEAR_IN:
+	case CTRL_DATA_CLEAR_OUT:
+		usbh_device_ep_dtog_set(msc->dev, (msc->ctrl == CTRL_DATA_CLEAR_IN) ?
+			msc->ep_in : msc->ep_out, false);
+
+		if (status != USBH_SUCCESS) {
+			reset_recovery(msc, USBH_MSC_ERR_IO);
+			break;
+		}
+
+		csw_stage(msc);
+	break;
+	case CTRL_CSW_CLEAR_IN:
+		usbh_device_ep_dtog_set(msc->dev, msc->ep_in, false);
+		csw_stage(msc);
+	break;
+	}
+}
+
+/**
+ * Place a control request on the default endpoint
+ * @param msc MSC object
+ * @param ctrl Request (enum msc_ctrl)
+ */
+static void ctrl_submit(usbh_msc *msc, uint8_t ctrl)
+{
+	uint8_t bmRequestType = USB_REQ_TYPE_ENDPOINT;
+	uint8_t bRequest = USB_REQ_CLEAR_FEATURE;
+	uint16_t wValue = USB_FEATURE_ENDPOINT_HALT;
+	uint16_t wIndex = msc->ep_in;
+	uint16_t wLength = 0;
+
+	msc->state = MSC_CTRL;
+	msc->ctrl = ctrl;
+
+	switch (ctrl) {
+	case CTRL_GET_MAX_LUN:
+		bmRequestType = USB_REQ_TYPE_IN | USB_REQ_TYPE_CLASS |
+			USB_REQ_TYPE_INTERFACE;
+		bRequest = USB_MSC_REQ_GET_MAX_LUN;
+		wValue = 0;
+		wIndex = msc->interface;
+		wLength = 1;
+	break;
+	case CTRL_RESET:
+		bmRequestType = USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE;
+		bRequest = USB_MSC_REQ_BULK_ONLY_RESET;
+		wValue = 0;
+		wIndex = msc->interface;
+	break;
+	case CTRL_RESET_CLEAR_OUT:
+	case CTRL_DATA_CLEAR_OUT:
+		wIndex = msc->ep_out;
+	break;
+	default:
+	break;
+	}
+
+	usbh_urb_id urb = usbh_ctrlreq_ep0(msc->dev, bmRequestType, bRequest,
+		wValue, wIndex, msc->buf, wLength, ctrl_done);
+	if (urb != USBH_INVALID_URB_ID) {
+		msc->urb = urb;
+	}
+}
+
+/**
+ * Start the next command (internal first, then queue)
+ * @param msc MSC object
+ */
+static void msc_kick(usbh_msc *msc)
+{
+	struct usbh_msc_cmd *cmd;
+
+	if (msc->dev == NULL || msc->state != MSC_IDLE) {
+		return;
+	}
+
+	if (msc->internal_pending) {
+		msc->internal_pending = false;
+		cmd = &msc->internal;
+	} else if (msc->ready && msc->count) {
+		cmd = &msc->queue[msc->head];
+	} else {
+		return;
+	}
+
+	if (msc->cbw_cmd != cmd) {
+		cbw_prepare(msc, cmd);
+	}
+
+	msc->cbw_cmd = NULL;
+	msc->cmd = cmd;
+	msc->cmd_tag = msc->cbw.dCBWTag;
+	msc->transferred = 0;
+	msc->csw_retry = false;
+	msc->state = MSC_CBW;
+
+	bulk_submit(msc, false, &msc->cbw, CBW_SIZE, cbw_done);
+}
+
+/**
+ * Place an internal command (data in msc->buf)
+ * @param msc MSC object
+ * @param opcode SCSI operation code
+ * @param length Data length (device to host)
+ * @param callback Called on completion
+ */
+static void internal_cmd(usbh_msc *msc, uint8_t opcode, uint32_t length,
+		usbh_msc_callback callback)
+{
+	struct usbh_msc_cmd *cmd = &msc->internal;
+
+	cmd->opcode = opcode;
+	cmd->in = true;
+	cmd->lba = 0;
+	cmd->count = 0;
+	cmd->data = msc->buf;
+	cmd->length = length;
+	cmd->callback = callback;
+	cmd->user_data = NULL;
+
+	msc->internal_pending = true;
+	msc_kick(msc);
+}
+
+/**
+ * Store the sense data read in msc->buf
+ * @param msc MSC object
+ */
+static void sense_store(usbh_msc *msc)
+{
+	msc->sense_key = msc->buf[2] & 0x0F;
+	msc->sense_asc = msc->buf[12];
+	msc->sense_ascq = msc->buf[13];
+}
+
+static void init_tur(usbh_msc *msc);
+
+static void init_capacity_done(usbh_msc *msc, usbh_msc_status status,
+		void *user_data)
+{
+	(void) user_data;
+
+	if (status != USBH_MSC_SUCCESS) {
+		msc_fail(msc, status);
+		return;
+	}
+
+	const uint8_t *buf = msc->buf;
+	uint32_t last_lba = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+	msc->block_count = last_lba + 1;
+	msc->block_size = (buf[4] << 24) | (buf[5] << 16) | (buf[6] << 8) | buf[7];
+
+	if (!msc->block_size) {
+		msc_fail(msc, USBH_MSC_ERR_INVALID);
+		return;
+	}
+
+	msc->ready = true;
+
+	usbh_msc_callback callback = msc->ready_callback;
+	msc->ready_callback = NULL;
+	if (callback != NULL) {
+		callback(msc, USBH_MSC_SUCCESS, msc->ready_user_data);
+	}
+}
+
+static void init_sense_done(usbh_msc *msc, usbh_msc_status status,
+		void *user_data)
+{
+	(void) user_data;
+
+	if (status != USBH_MSC_SUCCESS) {
+		msc_fail(msc, status);
+		return;
+	}
+
+	/* usually "unit attention" or "becoming ready" */
+	sense_store(msc);
+	init_tur(msc);
+}
+
+static void init_tur_done(usbh_msc *msc, usbh_msc_status status,
+		void *user_data)
+{
+	(void) user_data;
+
+	switch (status) {
+	case USBH_MSC_SUCCESS:
+		internal_cmd(msc, USB_MSC_SCSI_READ_CAPACITY, CAPACITY_SIZE,
+			init_capacity_done);
+	break;
+	case USBH_MSC_ERR_CHECK:
+		if (++msc->retry >= USBH_MSC_READY_RETRY) {
+			msc_fail(msc, USBH_MSC_ERR_INVALID);
+			break;
+		}
+
+		internal_cmd(msc, USB_MSC_SCSI_REQUEST_SENSE, SENSE_SIZE,
+			init_sense_done);
+	break;
+	default:
+		msc_fail(msc, status);
+	break;
+	}
+}
+
+static void init_tur(usbh_msc *msc)
+{
+	internal_cmd(msc, USB_MSC_SCSI_TEST_UNIT_READY, 0, init_tur_done);
+}
+
+/**
+ * REQUEST SENSE of a failed request complete.
+ * Complete the failed request (at head of queue)
+ */
+static void request_sense_done(usbh_msc *msc, usbh_msc_status status,
+		void *user_data)
+{
+	(void) user_data;
+
+	if (status == USBH_MSC_SUCCESS) {
+		sense_store(msc);
+		status = USBH_MSC_ERR_CHECK;
+	}
+
+	queue_complete(msc, status);
+}
+
+usbh_msc *usbh_msc_init(usbh_device *dev, uint8_t interface,
+	uint8_t ep_in, uint16_t ep_in_size,
+	uint8_t ep_out, uint16_t ep_out_size,
+	usbh_msc_callback ready, void *user_data)
+{
+	usbh_msc *msc = msc_from_device(dev);
+
+	if (msc == NULL) {
+		msc = msc_from_device(NULL);
+	}
+
+	if (msc == NULL) {
+		return NULL;
+	}
+
+	memset(msc, 0, sizeof(*msc));
+	msc->dev = dev;
+	msc->interface = interface;
+	msc->ep_in = ep_in;
+	msc->ep_in_size = ep_in_size;
+	msc->ep_out = ep_out;
+	msc->ep_out_size = ep_out_size;
+	msc->ready_callback = ready;
+	msc->ready_user_data = user_data;
+
+	usbh_device_ep_dtog_set(dev, ep_in, false);
+	usbh_device_ep_dtog_set(dev, ep_out, false);
+
+	/* GET MAX LUN, TEST UNIT READY is started when it complete */
+	ctrl_submit(msc, CTRL_GET_MAX_LUN);
+	init_tur(msc);
+
+	return msc;
+}
+
+void usbh_msc_release(usbh_msc *msc)
+{
+	usbh_device *dev = msc->dev;
+	if (dev == NULL) {
+		return;
+	}
+
+	/* callbacks of the cancelled transfer are ignored from now */
+	msc->dev = NULL;
+
+	usbh_host *host = usbh_device_host(dev);
+	if (msc->state != MSC_IDLE && host != NULL) {
+		usbh_transfer_cancel(host, msc->urb);
+	}
+
+	msc->ready_callback = NULL;
+	msc_fail(msc, USBH_MSC_ERR_NO_DEVICE);
+}
+
+bool usbh_msc_capacity(usbh_msc *msc, uint32_t *block_count,
+	uint32_t *block_size)
+{
+	if (!msc->ready) {
+		return false;
+	}
+
+	*block_count = msc->block_count;
+	*block_size = msc->block_size;
+	return true;
+}
+
+void usbh_msc_sense(usbh_msc *msc, uint8_t *key, uint8_t *asc, uint8_t *ascq)
+{
+	*key = msc->sense_key;
+	*asc = msc->sense_asc;
+	*ascq = msc->sense_ascq;
+}
+
+/**
+ * Queue a READ(10)/WRITE(10) request
+ * @param msc MSC object
+ * @param opcode SCSI operation code
+ * @param lba Logical block address
+ * @param count Number of blocks
+ * @param buf Data
+ * @param callback Called on completion
+ * @param user_data Passed to @a callback
+ * @return true on success
+ */
+static bool queue_rw(usbh_msc *msc, uint8_t opcode, uint32_t lba,
+		uint16_t count, void *buf, usbh_msc_callback callback, void *user_data)
+{
+	if (!msc->ready || !count || lba >= msc->block_count ||
+			count > (msc->block_count - lba) ||
+			msc->count >= USBH_MSC_QUEUE_LENGTH) {
+		return false;
+	}
+
+	unsigned i = (msc->head + msc->count) & (USBH_MSC_QUEUE_LENGTH - 1);
+	struct usbh_msc_cmd *cmd = &msc->queue[i];
+
+	if (msc->cbw_cmd == cmd) {
+		msc->cbw_cmd = NULL;
+	}
+
+	cmd->opcode = opcode;
+	cmd->in = (opcode == USB_MSC_SCSI_READ_10);
+	cmd->lba = lba;
+	cmd->count = count;
+	cmd->data = buf;
+	cmd->length = (uint32_t) count * msc->block_size;
+	cmd->callback = callback;
+	cmd->user_data = user_data;
+	msc->count++;
+
+	msc_kick(msc);
+	return true;
+}
+
+bool usbh_msc_read(usbh_msc *msc, uint32_t lba, uint16_t count, void *buf,
+	usbh_msc_callback callback, void *user_data)
+{
+	return queue_rw(msc, USB_MSC_SCSI_READ_10, lba, count, buf,
+		callback, user_data);
+}
+
+bool usbh_msc_write(usbh_msc *msc, uint32_t lba, uint16_t count,
+	const void *buf, usbh_msc_callback callback, void *user_data)
+{
+	return queue_rw(msc, USB_MSC_SCSI_WRITE_10, lba, count, (void *) buf,
+		callback, user_data);
+}
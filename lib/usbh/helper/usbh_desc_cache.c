@@ -0,0 +1,308 @@
+/*
+ * This file is part of the unicore-mx project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unicore-mx/usbh/helper/desc_cache.h>
+#include <unicore-mx/usbh/helper/ctrlreq.h>
+#include <string.h>
+
+/*
+ * Fetch procedure
+ *  - read device descriptor
+ *  - if iSerialNumber, read serial number string (hashed)
+ *     (not readable: done, not cached)
+ *  - search the cache, on hit: done
+ *  - on miss: read configuration descriptor (one request with
+ *     wLength = USBH_DESC_CACHE_CONFIG_MAX) into the fetch entry,
+ *     on success copy it to the least recently used entry
+ *     (too large or read failed: done, not cached)
+ */
+
+/* LANGID used to read serial number string (English, United States) */
+#define SERIAL_LANGID 0x0409
+
+/* Part of serial number string descriptor that is hashed */
+#define SERIAL_BUFFER 64
+
+/**
+ * Descriptor fetch in progress
+ * @param dev USB Device (NULL if unused)
+ * @param callback Callback
+ * @param buf Device descriptor or serial number string
+ * @param entry Device identity and configuration descriptor (cache miss),
+ *   given to callback when the device is not cached
+ */
+struct fetch {
+	usbh_device *dev;
+	usbh_desc_cache_callback callback;
+	union {
+		struct usb_device_descriptor device;
+		uint8_t string[SERIAL_BUFFER];
+	} buf;
+	struct usbh_desc_cache_entry entry;
+};
+
+static struct usbh_desc_cache_entry _entries[USBH_DESC_CACHE_ENTRIES];
+
+/* Last use of each entry (for replacement) */
+static uint32_t _entries_used[USBH_DESC_CACHE_ENTRIES];
+static uint32_t _clock;
+
+static struct fetch _fetch[USBH_DESC_CACHE_FETCH_MAX];
+
+static usbh_desc_cache_store_callback _store;
+
+/**
+ * Get the fetch object of @a dev
+ * @param dev USB Device
+ * @return fetch object
+ * @return NULL if not found
+ */
+static struct fetch *fetch_from_device(usbh_device *dev)
+{
+	unsigned i;
+
+	for (i = 0; i < USBH_DESC_CACHE_FETCH_MAX; i++) {
+		if (_fetch[i].dev == dev) {
+			return &_fetch[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Complete the fetch and free the object
+ * @param fetch Fetch object
+ * @param entry Entry (NULL on USBH_DESC_CACHE_ERR)
+ * @param status Fetch status
+ */
+static void fetch_done(struct fetch *fetch,
+		const struct usbh_desc_cache_entry *entry,
+		usbh_desc_cache_status status)
+{
+	usbh_device *dev = fetch->dev;
+	usbh_desc_cache_callback callback = fetch->callback;
+
+	fetch->dev = NULL;
+
+	callback(dev, entry, status);
+}
+
+/**
+ * Complete the fetch with the device descriptor only
+ * @param fetch Fetch object
+ */
+static void fetch_not_cached(struct fetch *fetch)
+{
+	fetch->entry.config_length = 0;
+	fetch_done(fetch, &fetch->entry, USBH_DESC_CACHE_NOT_CACHED);
+}
+
+/**
+ * 32bit FNV-1a hash of @a data
+ * @param data Data
+ * @param len Length of @a data
+ * @return non zero hash
+ */
+static uint32_t serial_hash(const uint8_t *data, unsigned len)
+{
+	uint32_t hash = 2166136261UL;
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ data[i]) * 16777619UL;
+	}
+
+	return hash ? hash : 1;
+}
+
+/**
+ * Find the entry to replace: an unused entry, else the least recently used
+ * @return entry
+ */
+static struct usbh_desc_cache_entry *victim_entry(void)
+{
+	unsigned i, victim = 0;
+
+	for (i = 0; i < USBH_DESC_CACHE_ENTRIES; i++) {
+		if (!_entries[i].config_length) {
+			_entries_used[i] = 0;
+		}
+
+		if (_entries_used[i] < _entries_used[victim]) {
+			victim = i;
+		}
+	}
+
+	_entries_used[victim] = ++_clock;
+	return &_entries[victim];
+}
+
+static void got_config_desc(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct fetch *fetch = fetch_from_device(transfer->device);
+	if (fetch == NULL) {
+		return;
+	}
+
+	struct usbh_desc_cache_entry *entry;
+	struct usb_config_descriptor *config = transfer->data;
+
+	if (status != USBH_SUCCESS ||
+			transfer->transferred < USB_DT_CONFIGURATION_SIZE ||
+			config->bDescriptorType != USB_DT_CONFIGURATION ||
+			config->wTotalLength != transfer->transferred) {
+		/* failed or too large to cache, caller read it */
+		fetch_not_cached(fetch);
+		return;
+	}
+
+	entry = victim_entry();
+	entry->device = fetch->entry.device;
+	entry->serial = fetch->entry.serial;
+	entry->config_length = config->wTotalLength;
+	memcpy(entry->config, fetch->entry.config, config->wTotalLength);
+
+	if (_store != NULL) {
+		_store(entry - _entries, entry);
+	}
+
+	fetch_done(fetch, entry, USBH_DESC_CACHE_MISS);
+}
+
+/**
+ * Search the cache for the fetched device identity.
+ * On miss, read the configuration descriptor from device.
+ * @param fetch Fetch object
+ */
+static void lookup(struct fetch *fetch)
+{
+	unsigned i;
+
+	for (i = 0; i < USBH_DESC_CACHE_ENTRIES; i++) {
+		struct usbh_desc_cache_entry *entry = &_entries[i];
+
+		if (entry->config_length && entry->serial == fetch->entry.serial &&
+				!memcmp(&entry->device, &fetch->entry.device,
+					sizeof(entry->device))) {
+			_entries_used[i] = ++_clock;
+			fetch_done(fetch, entry, USBH_DESC_CACHE_HIT);
+			return;
+		}
+	}
+
+	/* miss: the entry is only replaced once the read succeed */
+	usbh_ctrlreq_read_config_desc(fetch->dev, 0, fetch->entry.config,
+		sizeof(fetch->entry.config), got_config_desc);
+}
+
+static void got_serial(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct fetch *fetch = fetch_from_device(transfer->device);
+	if (fetch == NULL) {
+		return;
+	}
+
+	if (status != USBH_SUCCESS || transfer->transferred < 2) {
+		/* identity unknown, cannot be cached */
+		fetch_not_cached(fetch);
+		return;
+	}
+
+	fetch->entry.serial = serial_hash(transfer->data, transfer->transferred);
+	lookup(fetch);
+}
+
+static void got_dev_desc(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct fetch *fetch = fetch_from_device(transfer->device);
+	if (fetch == NULL) {
+		return;
+	}
+
+	if (status != USBH_SUCCESS || transfer->transferred < USB_DT_DEVICE_SIZE) {
+		fetch_done(fetch, NULL, USBH_DESC_CACHE_ERR);
+		return;
+	}
+
+	fetch->entry.device = fetch->buf.device;
+	fetch->entry.serial = 0;
+
+	if (fetch->entry.device.iSerialNumber) {
+		usbh_ctrlreq_ep0(fetch->dev, USB_REQ_TYPE_IN, USB_REQ_GET_DESCRIPTOR,
+			(USB_DT_STRING << 8) | fetch->entry.device.iSerialNumber,
+			SERIAL_LANGID, fetch->buf.string, sizeof(fetch->buf.string),
+			got_serial);
+		return;
+	}
+
+	lookup(fetch);
+}
+
+bool usbh_desc_cache_fetch(usbh_device *dev, usbh_desc_cache_callback callback)
+{
+	struct fetch *fetch = fetch_from_device(NULL);
+	if (fetch == NULL) {
+		return false;
+	}
+
+	fetch->dev = dev;
+	fetch->callback = callback;
+
+	usbh_ctrlreq_read_dev_desc(dev, &fetch->buf.device, USB_DT_DEVICE_SIZE,
+		got_dev_desc);
+	return true;
+}
+
+void usbh_desc_cache_register_store_callback(
+	usbh_desc_cache_store_callback store)
+{
+	_store = store;
+}
+
+bool usbh_desc_cache_load(unsigned index,
+	const struct usbh_desc_cache_entry *entry)
+{
+	if (index >= USBH_DESC_CACHE_ENTRIES || entry->config_length == 0 ||
+			entry->config_length > USBH_DESC_CACHE_CONFIG_MAX ||
+			entry->device.bDescriptorType != USB_DT_DEVICE) {
+		return false;
+	}
+
+	_entries[index] = *entry;
+	_entries_used[index] = ++_clock;
+	return true;
+}
+
+void usbh_desc_cache_invalidate(const struct usbh_desc_cache_entry *entry)
+{
+	unsigned i = entry - _entries;
+
+	if (i < USBH_DESC_CACHE_ENTRIES) {
+		_entries[i].config_length = 0;
+		_entries_used[i] = 0;
+	}
+}
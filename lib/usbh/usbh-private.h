@@ -55,7 +55,8 @@
  * Note
  * ====
  * Also, the stack manage external device connect/disconnect (on hub).
- * so, you can see the code as (usb-stack + hub-driver)  [WIP, not implemented]
+ * so, you can see the code as (usb-stack + hub-driver)
+ * Hubs are not reported to application via connected callback.
  *
  * Note
  * ====
@@ -65,7 +66,6 @@
 /*
  * TODO
  * ====
- * - HUB code NOT written. current code only handles root device connect/disconnect.
  * - Write helper/ functions to convert UTF-16 to UTF-8 (and possibly for ASCII too)
  * - Add more Standard request in helper/stdreq.{c, h}  (backend independent!)
  * - Bulk (IN, OUT) transfer need testing
@@ -89,8 +89,9 @@
  * @param disconnected Called when the device get disconnected.
  * @param hub_ports Number of port of the hub.
  *    If the device is not an hub, should be 0.
- * @param buffer a static buffer to fetch some descriptor internally
- *     Used at
+ * @param enum_buf Buffer to fetch the partial device descriptor
+ *    at enumeration (per device, so that devices on different hub
+ *    port can be enumerated at the same time)
  */
 struct usbh_device {
 	usbh_host *host;
@@ -108,6 +109,28 @@ struct usbh_device {
 	uint32_t dtog;
 	usbh_disconnected_callback disconnected;
 	uint8_t hub_ports;
+	uint8_t enum_buf[8];
+};
+
+/** No URB (end of list) */
+#define URB_INDEX_NONE 0xFF
+
+/**
+ * Link of URB in a list (index in host->urbs)
+ * @param prev Previous URB index
+ * @param next Next URB index
+ */
+struct usbh_urb_link {
+	uint8_t prev, next;
+};
+
+/**
+ * List of URB (index in host->urbs)
+ * @param head First URB index
+ * @param tail Last URB index
+ */
+struct usbh_urb_list {
+	uint8_t head, tail;
 };
 
 /**
@@ -129,6 +152,15 @@ struct usbh_urb {
 	 *   If the field is 0, that means the the timeout is not enabled.
 	 */
 	uint64_t timeout_on;
+
+	/** List the URB is on (free or pending submission) */
+	uint8_t queue;
+
+	/** Index of neighbour URB in the free or pending list */
+	struct usbh_urb_link queue_link;
+
+	/** Index of neighbour URB in the timeout list (only if timeout_on) */
+	struct usbh_urb_link timeout_link;
 };
 
 typedef struct usbh_urb usbh_urb;
@@ -172,11 +204,115 @@ struct usbh_backend {
 #endif
 };
 
+/** The maximum number of URB. (less than URB_INDEX_NONE) */
 #define URB_ARRAY_LENGTH 12
 
 /** The maximum number of devices the host can hold. */
 #define DEVICE_ARRAY_LENGTH 8
 
+/** The maximum number of hubs (excluding root port) the host can manage */
+#if !defined(USBH_HUB_MAX)
+# define USBH_HUB_MAX 2
+#endif
+
+/**
+ * The maximum number of ports managed per hub.
+ * Extra ports of a hub are left unpowered. (maximum 15)
+ */
+#if !defined(USBH_HUB_PORT_MAX)
+# define USBH_HUB_PORT_MAX 4
+#endif
+
+/**
+ * Buffer size for the hub configuration descriptor.
+ * A single TT hub need 25 bytes, a multi TT hub 41 bytes.
+ */
+#if !defined(USBH_HUB_CONFIG_DESC_MAX)
+# define USBH_HUB_CONFIG_DESC_MAX 64
+#endif
+
+enum usbh_hub_state {
+	USBH_HUB_UNUSED = 0,
+	USBH_HUB_READ_CONFIG,
+	USBH_HUB_SET_CONFIG,
+	USBH_HUB_READ_HUB_DESC,
+	USBH_HUB_POWER_ON,
+	USBH_HUB_POWER_GOOD,
+	USBH_HUB_RUNNING
+};
+
+enum usbh_hub_port_state {
+	USBH_HUB_PORT_DISCONNECTED = 0,
+	USBH_HUB_PORT_DEBOUNCE,
+	USBH_HUB_PORT_RESET_PENDING,
+	USBH_HUB_PORT_RESET,
+	USBH_HUB_PORT_RESET_RECOVERY,
+	USBH_HUB_PORT_ENABLED,
+	USBH_HUB_PORT_DISABLED
+};
+
+/**
+ * Hub port
+ * @param state Port state (enum usbh_hub_port_state)
+ * @param retry Number of reset/enumeration attempts
+ * @param status Last wPortStatus read from hub
+ * @param clear wPortChange bits that need to be cleared on hub
+ * @param timeout Time (microseconds) at which the current state expire
+ */
+struct usbh_hub_port {
+	uint8_t state;
+	uint8_t retry;
+	uint16_t status;
+	uint16_t clear;
+	uint64_t timeout;
+};
+
+/**
+ * Hub managed by the stack
+ * @param dev USB Device (NULL if unused)
+ * @param state Hub state (enum usbh_hub_state)
+ * @param ctrl_busy A control request to the hub is in progress
+ *    (only one is placed at a time)
+ * @param config bConfigurationValue of the hub
+ * @param ports Number of ports managed
+ * @param power_port Next port to be powered in USBH_HUB_POWER_ON
+ * @param next_port Port to start looking for work (round robin)
+ * @param pwr_on_good bPwrOn2PwrGood of hub descriptor (2ms unit)
+ * @param tt_think_time TT think time (full speed bit times)
+ *    0 if the hub do not have TT (ie not high speed)
+ * @param hub_clear wHubChange bits that need to be cleared on hub
+ * @param change Status change bitmap (BIT0 = hub, BITx = port x)
+ *    of which status need to be read
+ * @param timeout Time (microseconds) at which the current state expire
+ * @param status_urb Status change interrupt transfer
+ * @param ep_addr Status change endpoint address
+ * @param ep_size Status change endpoint size
+ * @param interval Status change endpoint interval
+ * @param status_buf Status change data
+ * @param buf Buffer for control requests
+ */
+struct usbh_hub {
+	usbh_device *dev;
+	uint8_t state;
+	bool ctrl_busy;
+	uint8_t config;
+	uint8_t ports;
+	uint8_t power_port;
+	uint8_t next_port;
+	uint8_t pwr_on_good;
+	uint8_t tt_think_time;
+	uint8_t hub_clear;
+	uint16_t change;
+	uint64_t timeout;
+	usbh_urb_id status_urb;
+	uint8_t ep_addr;
+	uint16_t ep_size;
+	uint16_t interval;
+	uint8_t status_buf[4];
+	uint8_t buf[USBH_HUB_CONFIG_DESC_MAX] __attribute__((aligned(4)));
+	struct usbh_hub_port port[USBH_HUB_PORT_MAX];
+};
+
 /**
  * USB Host
  * @param backend Host backend
@@ -186,19 +322,32 @@ struct usbh_backend {
  * @param devices Static array of devices to store information
  *    If the list become full, new devices will be dropped if item on available.
  *    The list will also INCLUDE ROOT HUB.
+ * @param address_map Bitmap of bus address in use (BITx = address x)
  * @param next_urb_id Next URB ID (start from 1)
- * @param buffer Buffer to fetch device descriptor for device at enumeration.
- *    Used for one device at a time.
+ *    The URB ID low byte is the index of URB in @a urbs
+ * @param urb_free URB not in use
+ * @param urb_pending URB waiting for backend resource (submit order)
+ * @param urb_timeout URB with timeout (sorted by timeout_on)
+ * @param addr0_owner Owner of the default address (address 0).
+ *    Only one device can be in reset or default state at a time,
+ *    hub port (from reset) and then device (till SET_ADDRESS) own it.
+ *    NULL if free.
+ * @param hubs Hubs managed by the stack
  */
 struct usbh_host {
 	const usbh_backend *backend;
 	uint64_t last_poll;
 	usbh_connected_callback connected;
 	uint8_t next_device_address;
+	uint32_t address_map[4];
 	usbh_device devices[DEVICE_ARRAY_LENGTH];
 	usbh_urb_id next_urb_id;
 	usbh_urb urbs[URB_ARRAY_LENGTH];
-	uint8_t buffer[8];
+	struct usbh_urb_list urb_free;
+	struct usbh_urb_list urb_pending;
+	struct usbh_urb_list urb_timeout;
+	const void *addr0_owner;
+	struct usbh_hub hubs[USBH_HUB_MAX];
 
 	/** Backend configuration */
 	const struct usbh_backend_config *config;
@@ -294,10 +443,50 @@ static inline uint32_t ep_dtog_mask(uint8_t ep_addr)
 	return 1 << (ep_num + (ep_in ? 16 : 0));
 }
 
+/**
+ * Acquire the default address (address 0) for @a owner
+ * @param host USB Host
+ * @param owner Owner
+ * @return true if @a owner has the address
+ */
+static inline bool usbh_addr0_lock(usbh_host *host, const void *owner)
+{
+	if (host->addr0_owner != NULL && host->addr0_owner != owner) {
+		return false;
+	}
+
+	host->addr0_owner = owner;
+	return true;
+}
+
+/**
+ * Release the default address (address 0) if owned by @a owner
+ * @param host USB Host
+ * @param owner Owner
+ */
+static inline void usbh_addr0_release(usbh_host *host, const void *owner)
+{
+	if (host->addr0_owner == owner) {
+		host->addr0_owner = NULL;
+	}
+}
+
+/**
+ * Mark bus @a address as free for next device
+ * @param host USB Host
+ * @param address Bus address (0 is ignored)
+ */
+static inline void usbh_address_free(usbh_host *host, uint8_t address)
+{
+	if (address) {
+		host->address_map[address / 32] &= ~(1UL << (address % 32));
+	}
+}
+
 void usbh_device_enum_start(usbh_device *dev);
 void usbh_device_invalidate(usbh_device *dev);
 void usbh_device_disconnected(usbh_device *dev);
-void usbh_device_connected(usbh_host *host, usbh_device *parent,
+usbh_device *usbh_device_connected(usbh_host *host, usbh_device *parent,
 		uint8_t port, usbh_speed speed);
 
 void usbh_root_device_disconnected(usbh_host *host);
@@ -305,9 +494,25 @@ void usbh_root_device_connected(usbh_host *host, usbh_speed speed);
 
 void *usbh_urb_get_data_pointer(usbh_urb *urb, uint16_t len);
 void usbh_urb_inc_data_pointer(usbh_urb *urb, uint16_t len);
+void *usbh_urb_iso_data_pointer(usbh_urb *urb, uint16_t index);
+bool usbh_urb_iso_packet_done(usbh_urb *urb, uint16_t *index, uint16_t len,
+		usbh_transfer_status status);
 void usbh_urb_free(usbh_urb *urb, usbh_transfer_status status);
-void usbh_urb_invalidate(usbh_urb *urb);
-
+void usbh_urb_init(usbh_host *host);
+usbh_urb *usbh_urb_alloc(usbh_host *host);
+usbh_urb *usbh_urb_find(usbh_host *host, usbh_urb_id urb_id);
+void usbh_urb_submit(usbh_host *host, usbh_urb *urb);
+void usbh_urb_requeue(usbh_host *host, usbh_urb *urb);
+void usbh_urb_poll(usbh_host *host, uint64_t now);
+bool usbh_urb_pending(usbh_host *host);
+
+void usbh_hub_init(usbh_host *host);
+bool usbh_hub_attach(usbh_device *dev);
+void usbh_hub_detach(usbh_device *dev);
+void usbh_hub_poll(usbh_host *host, uint64_t now);
 void usbh_hub_reset_port(usbh_device *dev, uint8_t port);
+void usbh_hub_enum_failed(usbh_device *dev, uint8_t port);
+usbh_device *usbh_hub_tt(usbh_device *dev, uint8_t *port);
+uint8_t usbh_hub_tt_think_time(usbh_device *dev);
 
 #endif
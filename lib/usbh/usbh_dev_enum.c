@@ -19,20 +19,35 @@
 
 #include "usbh-private.h"
 #include <unicore-mx/usbh/helper/ctrlreq.h>
+#include <unicore-mx/usb/class/hub.h>
 
 /**
  * procedure to enumerate a device
  *  - prepare the device object
  *  - set address
  *  - get device descriptor (get ep0 max size)
+ *  - if hub, hand over to the hub driver
+ *
+ * The device own the default address (address 0) till SET_ADDRESS complete.
+ * After that, other device (on hub port) can be reset and
+ *  enumerated while this device continue.
  */
 
 #define CONTROL_TIMEOUT 500
 
 static void enum_failed(usbh_device *dev)
 {
+	usbh_device *parent = dev->parent;
+	uint8_t port = dev->port;
+
 	LOG_LN("failed to enumerate device");
+	usbh_addr0_release(dev->host, dev);
+	usbh_address_free(dev->host, dev->address);
 	usbh_device_invalidate(dev);
+
+	if (parent != NULL) {
+		usbh_hub_enum_failed(parent, port);
+	}
 }
 
 static void enum_success(usbh_device *dev)
@@ -77,6 +92,13 @@ static void got_partial_dev_desc(const usbh_transfer *transfer,
 	LOGF_LN("bMaxPacketSize0: %"PRIu8, desc->bMaxPacketSize0);
 
 	dev->ep0_max_packet_size = desc->bMaxPacketSize0;
+
+	if (desc->bDeviceClass == USB_CLASS_HUB &&
+			usbh_hub_attach(dev)) {
+		LOG_LN("device is a hub, ports are managed by stack");
+		return;
+	}
+
 	enum_success(dev);
 }
 
@@ -94,6 +116,7 @@ static void address_assigned(const usbh_transfer *transfer,
 	usbh_device *dev = transfer->device;
 	if (status != USBH_SUCCESS) {
 		LOG_LN("failed to set address to device");
+		usbh_address_free(dev->host, transfer->setup.wValue);
 		enum_failed(dev);
 		return;
 	}
@@ -101,37 +124,46 @@ static void address_assigned(const usbh_transfer *transfer,
 	LOG_LN("succeeded in set address to device");
 	dev->address = transfer->setup.wValue;
 
+	/* default address is free for next device */
+	usbh_addr0_release(dev->host, dev);
+
 	LOG_LN("trying to read partial device descriptor from device");
-	usbh_ctrlreq_read_dev_desc(dev, dev->host->buffer, 8, got_partial_dev_desc);
+	usbh_ctrlreq_read_dev_desc(dev, dev->enum_buf, sizeof(dev->enum_buf),
+		got_partial_dev_desc);
 }
 
 /**
- * Allocate the next device address from the host
+ * Allocate the next device address from the host.
+ * Search the address bitmap starting from next_device_address
+ *  (recently freed address are not reused immediately)
  * @param host USB Host
  * @return valid non-zero 7bit address
  * @return zero on failure
  */
 static uint8_t alloc_device_address(usbh_host *host)
 {
-	unsigned i, j;
-	for (i = 0; i < 127; i++) {
-		/* fail after 127 attempts! (address space is full) */
-
-		uint8_t addr = host->next_device_address & 0x7F;
-		addr = (!addr) ? 1 : addr;
-		host->next_device_address = (addr == 0x7F) ? 1 : (addr + 1);
-
-		for (j = 0; j < DEVICE_ARRAY_LENGTH; j++) {
-			usbh_device *dev = &host->devices[j];
-			if (IS_DEVICE_VALID(dev) && dev->address == addr) {
-				/* address is being used! */
-				addr = 0;
-				break;
-			}
+	uint8_t start = host->next_device_address & 0x7F;
+	unsigned n;
+
+	/* 5 step: starting word (upper part), other 3 words,
+	 *  starting word (lower part) */
+	for (n = 0; n < 5; n++) {
+		unsigned w = ((start / 32) + n) % 4;
+		uint32_t avail = ~host->address_map[w];
+
+		if (n == 0) {
+			avail &= ~0UL << (start % 32);
+		}
+
+		if (w == 0) {
+			/* address 0 is the default address */
+			avail &= ~1UL;
 		}
 
-		if (addr) {
-			/* tada! we found a unused address */
+		if (avail) {
+			uint8_t addr = (w * 32) + __builtin_ctzl(avail);
+			host->address_map[w] |= 1UL << (addr % 32);
+			host->next_device_address = (addr == 0x7F) ? 1 : (addr + 1);
 			LOGF_LN("address 0x%"PRIx8" is free for use", addr);
 			return addr;
 		}
@@ -37,13 +37,16 @@ void usbh_device_invalidate(usbh_device *dev)
 }
 
 /**
- * A new root device has been attached.
+ * A new device has been attached.
  * @param host USB Host
  * @param parent USB Device parent
  * @param port USB Device parent port connected to
  * @param speed attached device speed
+ * @return USB Device
+ * @return NULL if no device object is available
+ * @note the device take the ownership of the default address
  */
-void usbh_device_connected(usbh_host *host, usbh_device *parent,
+usbh_device *usbh_device_connected(usbh_host *host, usbh_device *parent,
 		uint8_t port, usbh_speed speed)
 {
 	/* find a new device to store to */
@@ -60,7 +63,7 @@ void usbh_device_connected(usbh_host *host, usbh_device *parent,
 
 	if (dev == NULL) {
 		LOG_LN("no empty device object left to store newly connected device");
-		return;
+		return NULL;
 	}
 
 	/* prepare the object */
@@ -76,8 +79,13 @@ void usbh_device_connected(usbh_host *host, usbh_device *parent,
 	dev->speed = speed;
 	dev->dtog = 0;
 	dev->disconnected = NULL;
+	dev->hub_ports = 0;
+
+	/* device is in default state (address 0) till SET_ADDRESS */
+	host->addr0_owner = dev;
 
 	usbh_device_enum_start(dev);
+	return dev;
 }
 
 void usbh_device_disconnected(usbh_device *dev)
@@ -103,10 +111,14 @@ void usbh_device_disconnected(usbh_device *dev)
 		}
 	}
 
+	usbh_hub_detach(dev);
+
 	if (dev->disconnected != NULL) {
 		dev->disconnected(dev);
 	}
 
+	usbh_addr0_release(host, dev);
+	usbh_address_free(host, dev->address);
 	usbh_device_invalidate(dev);
 }
 
@@ -18,11 +18,824 @@
  */
 
 #include "usbh-private.h"
+#include <unicore-mx/usb/class/hub.h>
+#include <unicore-mx/usbh/helper/ctrlreq.h>
+
+/*
+ * Hub driver
+ * ==========
+ * Hubs are detected at enumeration (bDeviceClass = 0x09) and managed
+ *  by the stack.
+ *
+ * - read configuration descriptor (status change endpoint)
+ * - SET_CONFIGURATION
+ * - read hub descriptor (number of ports, power on time, TT think time)
+ * - power all ports and wait for power good
+ * - submit status change interrupt transfer
+ *
+ * Every port has its own state machine (debounce, reset, recovery).
+ * Only one control request is placed on the hub at a time, ports are
+ *  served in round robin. Timers are checked in usbh_hub_poll().
+ *
+ * The only resource that cannot be shared between ports is the default
+ *  address (address 0). A port take it before reset and the new device
+ *  release it as soon as SET_ADDRESS complete, so the next port is reset
+ *  while the previous device is still reading its descriptor.
+ *  (ie debounce, descriptor stage of multiple ports overlap)
+ *
+ * Multi TT hubs are not supported as such: the hub interface is left at
+ *  alternate setting 0, in which the hub use a single TT for all ports.
+ *  Split transfers of all ports are scheduled against that one TT.
+ */
+
+/** usb_20.pdf 7.1.7.3 TATTDB (debounce interval) */
+#define DEBOUNCE_TIME MS2US(100)
+
+/** Time to wait for C_PORT_RESET after SET_FEATURE(PORT_RESET) */
+#define RESET_TIMEOUT MS2US(500)
+
+/** usb_20.pdf 7.1.7.5 TRSTRCY (reset recovery time) */
+#define RESET_RECOVERY_TIME MS2US(10)
+
+/** Number of time a port is reset (and device enumerated) before giving up */
+#define RESET_RETRY 3
+
+static struct usbh_hub *hub_from_device(usbh_device *dev)
+{
+	usbh_host *host = dev->host;
+	unsigned i;
+
+	if (host == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < USBH_HUB_MAX; i++) {
+		if (host->hubs[i].dev == dev) {
+			return &host->hubs[i];
+		}
+	}
+
+	return NULL;
+}
+
+static inline struct usbh_hub_port *hub_port(struct usbh_hub *hub,
+		uint8_t port)
+{
+	return &hub->port[port - 1];
+}
+
+/**
+ * Place a control request on hub.
+ * @note callback is responsible to clear @a hub->ctrl_busy
+ */
+static void hub_ctrl(struct usbh_hub *hub, uint8_t bmRequestType,
+	uint8_t bRequest, uint16_t wValue, uint16_t wIndex, void *data,
+	uint16_t wLength, usbh_transfer_callback callback)
+{
+	hub->ctrl_busy = true;
+	usbh_ctrlreq_ep0(hub->dev, bmRequestType, bRequest, wValue, wIndex,
+		data, wLength, callback);
+}
+
+static void hub_port_feature(struct usbh_hub *hub, uint8_t bRequest,
+	uint16_t feature, uint8_t port, usbh_transfer_callback callback)
+{
+	hub_ctrl(hub, USB_REQ_TYPE_CLASS | USB_REQ_TYPE_OTHER, bRequest, feature,
+		port, NULL, 0, callback);
+}
+
+/**
+ * Hub failed to initalize, release it.
+ * The device remain on bus (and so its address) but is not used.
+ */
+static void hub_failed(struct usbh_hub *hub)
+{
+	LOG_LN("hub initalization failed");
+	hub->dev->hub_ports = 0;
+	hub->dev = NULL;
+	hub->state = USBH_HUB_UNUSED;
+}
+
+/**
+ * Common handling of the control request callback
+ * @return true if the request has succeeded
+ */
+static bool hub_ctrl_done(struct usbh_hub *hub, usbh_transfer_status status)
+{
+	hub->ctrl_busy = false;
+
+	switch (status) {
+	case USBH_SUCCESS:
+		return true;
+	case USBH_ERR_NO_DEVICE:
+	case USBH_ERR_CANCEL:
+	case USBH_ERR_RES_UNAVAIL:
+		/* hub going away or no resource (retry from poll) */
+	break;
+	default:
+		LOGF_LN("hub control request failed (%i)", status);
+		if (hub->state != USBH_HUB_RUNNING) {
+			hub_failed(hub);
+		}
+	break;
+	}
+
+	return false;
+}
+
+static void port_detach(struct usbh_hub *hub, uint8_t port)
+{
+	usbh_host *host = hub->dev->host;
+	unsigned i;
+
+	usbh_addr0_release(host, hub_port(hub, port));
+
+	for (i = 0; i < DEVICE_ARRAY_LENGTH; i++) {
+		usbh_device *child = &host->devices[i];
+		if (IS_DEVICE_VALID(child) && child->parent == hub->dev &&
+				child->port == port) {
+			LOGF_LN("hub port %"PRIu8" device removed", port);
+			usbh_device_disconnected(child);
+		}
+	}
+}
+
+static void port_reset_failed(struct usbh_hub *hub, uint8_t port)
+{
+	struct usbh_hub_port *p = hub_port(hub, port);
+
+	usbh_addr0_release(hub->dev->host, p);
+
+	if (++p->retry < RESET_RETRY) {
+		LOGF_LN("hub port %"PRIu8" retrying reset", port);
+		p->state = USBH_HUB_PORT_RESET_PENDING;
+	} else {
+		LOGF_LN("hub port %"PRIu8" disabled after %i attempts", port,
+			RESET_RETRY);
+		p->state = USBH_HUB_PORT_DISABLED;
+	}
+}
+
+/**
+ * Port has recovered from reset, create the device (enumeration start)
+ */
+static void port_enable(struct usbh_hub *hub, uint8_t port)
+{
+	struct usbh_hub_port *p = hub_port(hub, port);
+	usbh_host *host = hub->dev->host;
+	usbh_speed speed;
+
+	if (p->status & USB_HUB_PORT_STATUS_LOW_SPEED) {
+		speed = USBH_SPEED_LOW;
+	} else if (p->status & USB_HUB_PORT_STATUS_HIGH_SPEED) {
+		speed = USBH_SPEED_HIGH;
+	} else {
+		speed = USBH_SPEED_FULL;
+	}
+
+	LOGF_LN("hub port %"PRIu8" enabled, device speed %i", port, speed);
+	p->state = USBH_HUB_PORT_ENABLED;
+
+	if (usbh_device_connected(host, hub->dev, port, speed) == NULL) {
+		usbh_addr0_release(host, p);
+		p->state = USBH_HUB_PORT_DISABLED;
+	}
+}
+
+/**
+ * Process the status (and change) of a port
+ */
+static void port_event(struct usbh_hub *hub, uint8_t port, uint16_t status,
+		uint16_t change)
+{
+	struct usbh_hub_port *p = hub_port(hub, port);
+	uint64_t now = hub->dev->host->last_poll;
+
+	p->status = status;
+	p->clear |= change;
+
+	if (change & USB_HUB_PORT_CHANGE_OVER_CURRENT) {
+		LOGF_LN("hub port %"PRIu8" over current", port);
+	}
+
+	if ((change & USB_HUB_PORT_CHANGE_CONNECTION) ||
+			(!(status & USB_HUB_PORT_STATUS_CONNECTION) &&
+			p->state != USBH_HUB_PORT_DISCONNECTED)) {
+		port_detach(hub, port);
+
+		if (status & USB_HUB_PORT_STATUS_CONNECTION) {
+			LOGF_LN("hub port %"PRIu8" connected, debouncing", port);
+			p->state = USBH_HUB_PORT_DEBOUNCE;
+			p->timeout = now + DEBOUNCE_TIME;
+			p->retry = 0;
+		} else {
+			LOGF_LN("hub port %"PRIu8" disconnected", port);
+			p->state = USBH_HUB_PORT_DISCONNECTED;
+		}
+		return;
+	}
+
+	switch (p->state) {
+	case USBH_HUB_PORT_RESET:
+		if (!(status & USB_HUB_PORT_STATUS_RESET) &&
+				(change & USB_HUB_PORT_CHANGE_RESET)) {
+			if (status & USB_HUB_PORT_STATUS_ENABLE) {
+				p->state = USBH_HUB_PORT_RESET_RECOVERY;
+				p->timeout = now + RESET_RECOVERY_TIME;
+			} else {
+				port_reset_failed(hub, port);
+			}
+		}
+	break;
+	case USBH_HUB_PORT_ENABLED:
+		if (!(status & USB_HUB_PORT_STATUS_ENABLE)) {
+			/* hub disabled the port (babble, over current...) */
+			LOGF_LN("hub port %"PRIu8" disabled by hub", port);
+			port_detach(hub, port);
+			p->state = USBH_HUB_PORT_DISABLED;
+		}
+	break;
+	default:
+	break;
+	}
+}
+
+static void port_status_read(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	uint8_t port = transfer->setup.wIndex;
+
+	if (hub == NULL) {
+		return;
+	}
+
+	if (!hub_ctrl_done(hub, status)) {
+		if (status == USBH_ERR_RES_UNAVAIL) {
+			hub->change |= 1 << port;
+		}
+		return;
+	}
+
+	const struct usb_hub_status *st = transfer->data;
+	LOGF_LN("hub port %"PRIu8" status: 0x%04"PRIx16" change: 0x%04"PRIx16,
+		port, st->wStatus, st->wChange);
+	port_event(hub, port, st->wStatus, st->wChange);
+}
+
+static void port_change_cleared(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	uint8_t port = transfer->setup.wIndex;
+	uint8_t bit = transfer->setup.wValue - USB_FEAT_C_PORT_CONNECTION;
+
+	if (hub == NULL) {
+		return;
+	}
+
+	if (hub_ctrl_done(hub, status) || status != USBH_ERR_RES_UNAVAIL) {
+		hub_port(hub, port)->clear &= ~(1 << bit);
+	}
+}
+
+static void port_reset_placed(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	uint8_t port = transfer->setup.wIndex;
+
+	if (hub == NULL) {
+		return;
+	}
+
+	struct usbh_hub_port *p = hub_port(hub, port);
+
+	if (hub_ctrl_done(hub, status)) {
+		if (p->state == USBH_HUB_PORT_RESET_PENDING) {
+			p->state = USBH_HUB_PORT_RESET;
+			p->timeout = hub->dev->host->last_poll + RESET_TIMEOUT;
+		}
+	} else if (status != USBH_ERR_RES_UNAVAIL) {
+		port_reset_failed(hub, port);
+	}
+}
+
+static void hub_status_read(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	if (hub == NULL) {
+		return;
+	}
+
+	if (!hub_ctrl_done(hub, status)) {
+		if (status == USBH_ERR_RES_UNAVAIL) {
+			hub->change |= 1;
+		}
+		return;
+	}
+
+	const struct usb_hub_status *st = transfer->data;
+	if (st->wStatus & USB_HUB_STATUS_OVER_CURRENT) {
+		LOG_LN("hub over current");
+	}
+
+	hub->hub_clear |= st->wChange;
+}
+
+static void hub_change_cleared(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	if (hub == NULL) {
+		return;
+	}
+
+	if (hub_ctrl_done(hub, status) || status != USBH_ERR_RES_UNAVAIL) {
+		hub->hub_clear &= ~(1 << transfer->setup.wValue);
+	}
+}
+
+static void status_changed(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	if (hub == NULL) {
+		return;
+	}
+
+	/* resubmitted from poll */
+	hub->status_urb = USBH_INVALID_URB_ID;
+
+	if (status != USBH_SUCCESS) {
+		return;
+	}
+
+	const uint8_t *data = transfer->data;
+	uint16_t change = data[0];
+	if (transfer->transferred > 1) {
+		change |= data[1] << 8;
+	}
+
+	/* BIT0 is hub, BIT1...N ports */
+	hub->change |= change & ((2 << hub->ports) - 1);
+}
+
+static void hub_status_submit(struct usbh_hub *hub)
+{
+	usbh_transfer transfer = {
+		.device = hub->dev,
+		.ep_type = USBH_EP_INTERRUPT,
+		.ep_addr = hub->ep_addr,
+		.ep_size = hub->ep_size,
+		.data = hub->status_buf,
+		.length = MIN(hub->ep_size, sizeof(hub->status_buf)),
+		.flags = USBH_FLAG_NONE,
+		.interval = hub->interval,
+		.timeout = USBH_TIMEOUT_NEVER,
+		.callback = status_changed
+	};
+
+	hub->status_urb = usbh_transfer_submit(&transfer);
+}
+
+static void config_desc_read(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	if (hub == NULL || !hub_ctrl_done(hub, status)) {
+		return;
+	}
+
+	const uint8_t *buf = transfer->data;
+	uint16_t len = transfer->transferred;
+	uint16_t i;
+
+	hub->config = 0;
+	hub->ep_addr = 0;
+
+	for (i = 0; (i + 2) <= len && buf[i] >= 2; i += buf[i]) {
+		if ((i + buf[i]) > len) {
+			break;
+		}
+
+		if (buf[i + 1] == USB_DT_CONFIGURATION &&
+				buf[i] >= USB_DT_CONFIGURATION_SIZE) {
+			const struct usb_config_descriptor *cfg = (const void *) &buf[i];
+			hub->config = cfg->bConfigurationValue;
+			if (cfg->wTotalLength > len) {
+				LOGF_LN("hub configuration descriptor truncated to %"PRIu16
+					" bytes (USBH_HUB_CONFIG_DESC_MAX)", len);
+			}
+		} else if (buf[i + 1] == USB_DT_ENDPOINT &&
+				buf[i] >= USB_DT_ENDPOINT_SIZE) {
+			const struct usb_endpoint_descriptor *ep = (const void *) &buf[i];
+			if (IS_IN_ENDPOINT(ep->bEndpointAddress) &&
+				(ep->bmAttributes & USB_ENDPOINT_ATTR_TYPE) ==
+					USB_ENDPOINT_ATTR_INTERRUPT) {
+				hub->ep_addr = ep->bEndpointAddress;
+				hub->ep_size = ep->wMaxPacketSize & 0x7FF;
+				hub->interval = ep->bInterval ? ep->bInterval : 1;
+				break;
+			}
+		}
+	}
+
+	if (!hub->config || !hub->ep_addr) {
+		LOG_LN("hub status change endpoint not found");
+		hub_failed(hub);
+		return;
+	}
+
+	if (hub->dev->speed == USBH_SPEED_HIGH) {
+		/* 2^(bInterval - 1) microframes */
+		hub->interval = 1 << (MIN(hub->interval, 12) - 1);
+	}
+
+	hub->state = USBH_HUB_SET_CONFIG;
+}
+
+static void config_set(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	if (hub == NULL || !hub_ctrl_done(hub, status)) {
+		return;
+	}
+
+	usbh_device_ep_dtog_reset_all(hub->dev);
+	hub->state = USBH_HUB_READ_HUB_DESC;
+}
+
+static void hub_desc_read(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	if (hub == NULL || !hub_ctrl_done(hub, status)) {
+		return;
+	}
+
+	const struct usb_hub_descriptor *desc = transfer->data;
+	if (transfer->transferred < USB_DT_HUB_SIZE ||
+			desc->bDescriptorType != USB_DT_HUB) {
+		LOG_LN("invalid hub descriptor");
+		hub_failed(hub);
+		return;
+	}
+
+	LOGF_LN("hub has %"PRIu8" ports", desc->bNbrPorts);
+	if (desc->bNbrPorts > USBH_HUB_PORT_MAX) {
+		LOGF_LN("only %i ports of hub will be used", USBH_HUB_PORT_MAX);
+	}
+
+	hub->ports = MIN(desc->bNbrPorts, USBH_HUB_PORT_MAX);
+	hub->pwr_on_good = desc->bPwrOn2PwrGood;
+	hub->dev->hub_ports = hub->ports;
+
+	if (hub->dev->speed == USBH_SPEED_HIGH) {
+		/* 8, 16, 24 or 32 full speed bit times */
+		hub->tt_think_time = 8 * (1 + ((desc->wHubCharacteristics &
+			USB_HUB_CHAR_TTTT_MASK) >> USB_HUB_CHAR_TTTT_SHIFT));
+	}
+
+	hub->power_port = 1;
+	hub->state = USBH_HUB_POWER_ON;
+}
+
+static void port_powered(const usbh_transfer *transfer,
+		usbh_transfer_status status, usbh_urb_id urb_id)
+{
+	(void) urb_id;
+
+	struct usbh_hub *hub = hub_from_device(transfer->device);
+	if (hub == NULL || !hub_ctrl_done(hub, status)) {
+		return;
+	}
+
+	if (++hub->power_port > hub->ports) {
+		/* bPwrOn2PwrGood is in 2ms unit */
+		hub->timeout = hub->dev->host->last_poll +
+			MS2US(2 * hub->pwr_on_good);
+		hub->state = USBH_HUB_POWER_GOOD;
+	}
+}
+
+/**
+ * Look for work on ports (round robin) and place one control request.
+ * @return true if a request has been placed
+ */
+static bool hub_port_work(struct usbh_hub *hub)
+{
+	usbh_host *host = hub->dev->host;
+	unsigned i, j;
+
+	if (hub->change & 1) {
+		hub->change &= ~1;
+		hub_ctrl(hub, USB_REQ_TYPE_IN | USB_REQ_TYPE_CLASS |
+			USB_REQ_TYPE_DEVICE, USB_REQ_HUB_GET_STATUS, 0, 0,
+			hub->buf, sizeof(struct usb_hub_status), hub_status_read);
+		return true;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (hub->hub_clear & (1 << i)) {
+			hub_ctrl(hub, USB_REQ_TYPE_CLASS | USB_REQ_TYPE_DEVICE,
+				USB_REQ_HUB_CLEAR_FEATURE, USB_FEAT_C_HUB_LOCAL_POWER + i, 0,
+				NULL, 0, hub_change_cleared);
+			return true;
+		}
+	}
+
+	for (i = 0; i < hub->ports; i++) {
+		uint8_t port = ((hub->next_port + i) % hub->ports) + 1;
+		struct usbh_hub_port *p = hub_port(hub, port);
+
+		/* acknowledge change before reading status again */
+		for (j = 0; j < 5; j++) {
+			if (p->clear & (1 << j)) {
+				hub->next_port = port % hub->ports;
+				hub_port_feature(hub, USB_REQ_HUB_CLEAR_FEATURE,
+					USB_FEAT_C_PORT_CONNECTION + j, port, port_change_cleared);
+				return true;
+			}
+		}
+
+		if (hub->change & (1 << port)) {
+			hub->change &= ~(1 << port);
+			hub->next_port = port % hub->ports;
+			hub_ctrl(hub, USB_REQ_TYPE_IN | USB_REQ_TYPE_CLASS |
+				USB_REQ_TYPE_OTHER, USB_REQ_HUB_GET_STATUS, 0, port,
+				hub->buf, sizeof(struct usb_hub_status), port_status_read);
+			return true;
+		}
+
+		if (p->state == USBH_HUB_PORT_RESET_PENDING &&
+				usbh_addr0_lock(host, p)) {
+			LOGF_LN("hub port %"PRIu8" reset", port);
+			hub->next_port = port % hub->ports;
+			hub_port_feature(hub, USB_REQ_HUB_SET_FEATURE,
+				USB_FEAT_PORT_RESET, port, port_reset_placed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Check the port timers
+ */
+static void hub_port_timers(struct usbh_hub *hub, uint64_t now)
+{
+	uint8_t port;
+
+	for (port = 1; port <= hub->ports; port++) {
+		struct usbh_hub_port *p = hub_port(hub, port);
+
+		switch (p->state) {
+		case USBH_HUB_PORT_DEBOUNCE:
+			if (now >= p->timeout) {
+				p->state = USBH_HUB_PORT_RESET_PENDING;
+			}
+		break;
+		case USBH_HUB_PORT_RESET:
+			if (now >= p->timeout) {
+				LOGF_LN("hub port %"PRIu8" reset timeout", port);
+				port_reset_failed(hub, port);
+			}
+		break;
+		case USBH_HUB_PORT_RESET_RECOVERY:
+			if (now >= p->timeout) {
+				port_enable(hub, port);
+			}
+		break;
+		default:
+		break;
+		}
+	}
+}
+
+static void hub_poll(struct usbh_hub *hub, uint64_t now)
+{
+	if (hub->state == USBH_HUB_RUNNING) {
+		hub_port_timers(hub, now);
+
+		if (IS_URB_ID_INVALID(hub->status_urb)) {
+			hub_status_submit(hub);
+		}
+	}
+
+	if (hub->ctrl_busy) {
+		return;
+	}
+
+	switch (hub->state) {
+	case USBH_HUB_READ_CONFIG:
+		hub->ctrl_busy = true;
+		usbh_ctrlreq_read_config_desc(hub->dev, 0, hub->buf, sizeof(hub->buf),
+			config_desc_read);
+	break;
+	case USBH_HUB_SET_CONFIG:
+		hub->ctrl_busy = true;
+		usbh_ctrlreq_set_config(hub->dev, hub->config, config_set);
+	break;
+	case USBH_HUB_READ_HUB_DESC:
+		hub_ctrl(hub, USB_REQ_TYPE_IN | USB_REQ_TYPE_CLASS |
+			USB_REQ_TYPE_DEVICE, USB_REQ_HUB_GET_DESCRIPTOR, USB_DT_HUB << 8,
+			0, hub->buf, sizeof(hub->buf), hub_desc_read);
+	break;
+	case USBH_HUB_POWER_ON:
+		hub_port_feature(hub, USB_REQ_HUB_SET_FEATURE, USB_FEAT_PORT_POWER,
+			hub->power_port, port_powered);
+	break;
+	case USBH_HUB_POWER_GOOD:
+		if (now >= hub->timeout) {
+			LOG_LN("hub ports powered");
+			/* read all ports once, device may already be connected */
+			hub->change = (2 << hub->ports) - 2;
+			hub->state = USBH_HUB_RUNNING;
+		}
+	break;
+	case USBH_HUB_RUNNING:
+		hub_port_work(hub);
+	break;
+	default:
+	break;
+	}
+}
+
+void usbh_hub_init(usbh_host *host)
+{
+	unsigned i;
+	for (i = 0; i < USBH_HUB_MAX; i++) {
+		host->hubs[i].dev = NULL;
+		host->hubs[i].state = USBH_HUB_UNUSED;
+	}
+}
+
+/**
+ * Enumerated device is a hub, start managing it.
+ * @param dev USB Device
+ * @return true if the hub is managed by stack
+ * @return false if no hub object is left
+ */
+bool usbh_hub_attach(usbh_device *dev)
+{
+	struct usbh_hub *hub = NULL;
+	unsigned i;
+
+	for (i = 0; i < USBH_HUB_MAX; i++) {
+		if (dev->host->hubs[i].dev == NULL) {
+			hub = &dev->host->hubs[i];
+			break;
+		}
+	}
+
+	if (hub == NULL) {
+		LOG_LN("no empty hub object left to manage hub");
+		return false;
+	}
+
+	hub->dev = dev;
+	hub->state = USBH_HUB_READ_CONFIG;
+	hub->ctrl_busy = false;
+	hub->ports = 0;
+	hub->next_port = 0;
+	hub->tt_think_time = 0;
+	hub->hub_clear = 0;
+	hub->change = 0;
+	hub->status_urb = USBH_INVALID_URB_ID;
+
+	for (i = 0; i < USBH_HUB_PORT_MAX; i++) {
+		hub->port[i].state = USBH_HUB_PORT_DISCONNECTED;
+		hub->port[i].retry = 0;
+		hub->port[i].status = 0;
+		hub->port[i].clear = 0;
+	}
+
+	return true;
+}
+
+/**
+ * Device is disconnected, stop managing it (if a hub).
+ * @param dev USB Device
+ * @note child devices are already disconnected
+ */
+void usbh_hub_detach(usbh_device *dev)
+{
+	struct usbh_hub *hub = hub_from_device(dev);
+	unsigned i;
+
+	if (hub == NULL) {
+		return;
+	}
+
+	for (i = 0; i < USBH_HUB_PORT_MAX; i++) {
+		usbh_addr0_release(dev->host, &hub->port[i]);
+	}
+
+	hub->dev = NULL;
+	hub->state = USBH_HUB_UNUSED;
+}
+
+void usbh_hub_poll(usbh_host *host, uint64_t now)
+{
+	unsigned i;
+	for (i = 0; i < USBH_HUB_MAX; i++) {
+		struct usbh_hub *hub = &host->hubs[i];
+		if (hub->dev != NULL) {
+			hub_poll(hub, now);
+		}
+	}
+}
 
 void usbh_hub_reset_port(usbh_device *dev, uint8_t port)
 {
-	(void) dev;
-	(void) port;
+	struct usbh_hub *hub = hub_from_device(dev);
+
+	if (hub == NULL || !port || port > hub->ports) {
+		return;
+	}
+
+	struct usbh_hub_port *p = hub_port(hub, port);
+	if (p->state != USBH_HUB_PORT_DISCONNECTED) {
+		p->retry = 0;
+		p->state = USBH_HUB_PORT_RESET_PENDING;
+	}
+}
+
+/**
+ * Enumeration of device connected on hub @a port failed.
+ * @param dev Hub
+ * @param port Port
+ */
+void usbh_hub_enum_failed(usbh_device *dev, uint8_t port)
+{
+	struct usbh_hub *hub = hub_from_device(dev);
 
-	/* TODO */
+	if (hub == NULL || !port || port > hub->ports) {
+		return;
+	}
+
+	if (hub_port(hub, port)->state == USBH_HUB_PORT_ENABLED) {
+		port_reset_failed(hub, port);
+	}
+}
+
+/**
+ * Find the Transaction Translator for low/full speed @a dev
+ *  (nearest high speed hub upstream)
+ * @param dev USB Device
+ * @param[out] port Port of the hub at which @a dev (or its upstream hub)
+ *    is connected
+ * @return Hub device with TT
+ * @return NULL if no TT is involved
+ */
+usbh_device *usbh_hub_tt(usbh_device *dev, uint8_t *port)
+{
+	usbh_device *child;
+
+	if (dev->speed == USBH_SPEED_HIGH) {
+		return NULL;
+	}
+
+	for (child = dev; child->parent != NULL; child = child->parent) {
+		if (child->parent->speed == USBH_SPEED_HIGH) {
+			*port = child->port;
+			return child->parent;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Get the Transaction Translator think time of hub @a dev
+ * @param dev Hub device (as returned by usbh_hub_tt())
+ * @return think time (full speed bit times)
+ * @return 0 if @a dev is not a high speed hub managed by stack
+ */
+uint8_t usbh_hub_tt_think_time(usbh_device *dev)
+{
+	struct usbh_hub *hub = hub_from_device(dev);
+	return (hub != NULL) ? hub->tt_think_time : 0;
 }
@@ -40,14 +40,278 @@ static const char *stringify_transfer_status(usbh_transfer_status status) {
 }
 #endif
 
+/* URB list the URB is on */
+#define URB_QUEUE_NONE 0
+#define URB_QUEUE_FREE 1
+#define URB_QUEUE_PENDING 2
+
+#define URB_INDEX(host, urb) ((uint8_t) ((urb) - (host)->urbs))
+
+/**
+ * Get the link of URB @a i
+ * @param host USB Host
+ * @param i URB index
+ * @param timeout true for timeout list, false for free/pending list
+ * @return link
+ */
+static struct usbh_urb_link *urb_link(usbh_host *host, uint8_t i, bool timeout)
+{
+	usbh_urb *urb = &host->urbs[i];
+	return timeout ? &urb->timeout_link : &urb->queue_link;
+}
+
+/**
+ * Insert URB @a i in @a list before URB @a before
+ * @param host USB Host
+ * @param list List
+ * @param timeout true for timeout list, false for free/pending list
+ * @param i URB index
+ * @param before URB index (URB_INDEX_NONE to append)
+ */
+static void list_insert(usbh_host *host, struct usbh_urb_list *list,
+		bool timeout, uint8_t i, uint8_t before)
+{
+	struct usbh_urb_link *link = urb_link(host, i, timeout);
+	uint8_t prev = (before == URB_INDEX_NONE) ? list->tail :
+		urb_link(host, before, timeout)->prev;
+
+	link->prev = prev;
+	link->next = before;
+
+	if (prev == URB_INDEX_NONE) {
+		list->head = i;
+	} else {
+		urb_link(host, prev, timeout)->next = i;
+	}
+
+	if (before == URB_INDEX_NONE) {
+		list->tail = i;
+	} else {
+		urb_link(host, before, timeout)->prev = i;
+	}
+}
+
 /**
- * Invalidate the URB.
- * It will mark this as free for other use
+ * Remove URB @a i from @a list
+ * @param host USB Host
+ * @param list List
+ * @param timeout true for timeout list, false for free/pending list
+ * @param i URB index
+ */
+static void list_remove(usbh_host *host, struct usbh_urb_list *list,
+		bool timeout, uint8_t i)
+{
+	struct usbh_urb_link *link = urb_link(host, i, timeout);
+
+	if (link->prev == URB_INDEX_NONE) {
+		list->head = link->next;
+	} else {
+		urb_link(host, link->prev, timeout)->next = link->next;
+	}
+
+	if (link->next == URB_INDEX_NONE) {
+		list->tail = link->prev;
+	} else {
+		urb_link(host, link->next, timeout)->prev = link->prev;
+	}
+
+	link->prev = link->next = URB_INDEX_NONE;
+}
+
+/**
+ * Place the URB on pending submission list (if not already)
+ * @param host USB Host
  * @param urb USB Request Block
  */
-void usbh_urb_invalidate(usbh_urb *urb)
+static void pending_add(usbh_host *host, usbh_urb *urb)
 {
-	urb->id = USBH_INVALID_URB_ID;
+	if (urb->queue != URB_QUEUE_PENDING) {
+		urb->queue = URB_QUEUE_PENDING;
+		list_insert(host, &host->urb_pending, false, URB_INDEX(host, urb),
+			URB_INDEX_NONE);
+	}
+}
+
+/**
+ * Remove the URB from pending submission list (if on it)
+ * @param host USB Host
+ * @param urb USB Request Block
+ */
+static void pending_remove(usbh_host *host, usbh_urb *urb)
+{
+	if (urb->queue == URB_QUEUE_PENDING) {
+		urb->queue = URB_QUEUE_NONE;
+		list_remove(host, &host->urb_pending, false, URB_INDEX(host, urb));
+	}
+}
+
+/**
+ * Place the URB on timeout list.
+ * The list is sorted by timeout_on, so that only the head need to be checked.
+ * Search from tail since new URB usually expire last.
+ * @param host USB Host
+ * @param urb USB Request Block
+ */
+static void timeout_add(usbh_host *host, usbh_urb *urb)
+{
+	uint8_t before = URB_INDEX_NONE;
+	uint8_t i = host->urb_timeout.tail;
+
+	while (i != URB_INDEX_NONE && host->urbs[i].timeout_on > urb->timeout_on) {
+		before = i;
+		i = host->urbs[i].timeout_link.prev;
+	}
+
+	list_insert(host, &host->urb_timeout, true, URB_INDEX(host, urb), before);
+}
+
+/**
+ * Initalize the URB pool. All URB are free.
+ * @param host USB Host
+ */
+void usbh_urb_init(usbh_host *host)
+{
+	unsigned i;
+
+	host->urb_free.head = host->urb_free.tail = URB_INDEX_NONE;
+	host->urb_pending.head = host->urb_pending.tail = URB_INDEX_NONE;
+	host->urb_timeout.head = host->urb_timeout.tail = URB_INDEX_NONE;
+
+	for (i = 0; i < URB_ARRAY_LENGTH; i++) {
+		usbh_urb *urb = &host->urbs[i];
+		urb->id = USBH_INVALID_URB_ID;
+		urb->backend_tag = INVALID_BACKEND_TAG;
+		urb->timeout_on = 0;
+		urb->queue = URB_QUEUE_FREE;
+		urb->timeout_link.prev = urb->timeout_link.next = URB_INDEX_NONE;
+		list_insert(host, &host->urb_free, false, i, URB_INDEX_NONE);
+	}
+}
+
+/**
+ * Take a URB from the free list.
+ * The caller is expected to fill the URB and call usbh_urb_submit()
+ * @param host USB Host
+ * @return URB (with valid ID)
+ * @return NULL if all URB are in use
+ */
+usbh_urb *usbh_urb_alloc(usbh_host *host)
+{
+	uint8_t i = host->urb_free.head;
+	if (i == URB_INDEX_NONE) {
+		return NULL;
+	}
+
+	list_remove(host, &host->urb_free, false, i);
+
+	usbh_urb *urb = &host->urbs[i];
+	urb->queue = URB_QUEUE_NONE;
+	urb->id = (host->next_urb_id++ << 8) | i;
+	urb->backend_tag = INVALID_BACKEND_TAG;
+	urb->timeout_on = 0;
+	return urb;
+}
+
+/**
+ * Find the URB with @a urb_id
+ * @param host USB Host
+ * @param urb_id URB ID
+ * @return URB
+ * @return NULL if not found (not valid anymore)
+ */
+usbh_urb *usbh_urb_find(usbh_host *host, usbh_urb_id urb_id)
+{
+	uint8_t i = urb_id & 0xFF;
+
+	if (IS_URB_ID_INVALID(urb_id) || i >= URB_ARRAY_LENGTH) {
+		return NULL;
+	}
+
+	usbh_urb *urb = &host->urbs[i];
+	return (urb->id == urb_id) ? urb : NULL;
+}
+
+/**
+ * Start the URB (taken via usbh_urb_alloc()).
+ * If the backend do not have resource for it now,
+ *  the URB is submitted again from usbh_urb_poll()
+ * @param host USB Host
+ * @param urb USB Request Block
+ */
+void usbh_urb_submit(usbh_host *host, usbh_urb *urb)
+{
+	if (urb->timeout_on) {
+		timeout_add(host, urb);
+	}
+
+	host->backend->transfer_submit(host, urb);
+
+	if (urb->backend_tag == INVALID_BACKEND_TAG) {
+		pending_add(host, urb);
+	}
+}
+
+/**
+ * Called by backend when it take back the resource
+ *  from the URB without completing it (ie preemption).
+ * The URB is submitted again after the URB already waiting.
+ * @param host USB Host
+ * @param urb USB Request Block
+ */
+void usbh_urb_requeue(usbh_host *host, usbh_urb *urb)
+{
+	urb->backend_tag = INVALID_BACKEND_TAG;
+	pending_add(host, urb);
+}
+
+/**
+ * Expire time'd out URB and submit pending URB to backend.
+ * The cost depend on the number of URB expired and pending
+ *  (not on the number of URB in use).
+ * @param host USB Host
+ * @param now Current time (microseconds)
+ */
+void usbh_urb_poll(usbh_host *host, uint64_t now)
+{
+	unsigned n;
+	uint8_t i;
+
+	/* URB_ARRAY_LENGTH bound the work if a callback submit
+	 *  a new URB that has already expired */
+	for (n = 0; n < URB_ARRAY_LENGTH; n++) {
+		i = host->urb_timeout.head;
+		if (i == URB_INDEX_NONE || host->urbs[i].timeout_on > now) {
+			break;
+		}
+
+		LOGF_LN("urb %"PRIu64" time'd out", host->urbs[i].id);
+		usbh_urb_free(&host->urbs[i], USBH_ERR_TIMEOUT);
+	}
+
+	/* oldest first, URB added while walking are left for next poll.
+	 * A submit can complete (or fail) the URB right away and the callback
+	 *  can free or submit any URB, so the list is not walked by link:
+	 *  the pending URB are taken by ID and looked up again before submit. */
+	usbh_urb_id ids[URB_ARRAY_LENGTH];
+	unsigned count = 0;
+
+	for (i = host->urb_pending.head; i != URB_INDEX_NONE;
+			i = host->urbs[i].queue_link.next) {
+		ids[count++] = host->urbs[i].id;
+	}
+
+	for (n = 0; n < count; n++) {
+		usbh_urb *urb = usbh_urb_find(host, ids[n]);
+		if (urb == NULL || urb->queue != URB_QUEUE_PENDING) {
+			continue;
+		}
+
+		LOGF_LN("try to submit urb %"PRIu64" to backend", urb->id);
+		host->backend->transfer_submit(host, urb);
+		if (urb->backend_tag != INVALID_BACKEND_TAG) {
+			pending_remove(host, urb);
+		}
+	}
 }
 
 /**
@@ -59,14 +323,26 @@ void usbh_urb_free(usbh_urb *urb, usbh_transfer_status status)
 {
 	LOG_CALL
 
+	usbh_host *host = urb->transfer.device->host;
 	usbh_urb_id cached_urb_id = urb->id;
 	urb->id = USBH_INVALID_URB_ID;
 
 	if (urb->backend_tag != INVALID_BACKEND_TAG) {
-		usbh_host *host = urb->transfer.device->host;
 		host->backend->transfer_cancel(host, urb);
 	}
 
+	pending_remove(host, urb);
+
+	if (urb->timeout_on) {
+		list_remove(host, &host->urb_timeout, true, URB_INDEX(host, urb));
+		urb->timeout_on = 0;
+	}
+
+	/* free slot is reused last (stale ID are less likely to match) */
+	urb->queue = URB_QUEUE_FREE;
+	list_insert(host, &host->urb_free, false, URB_INDEX(host, urb),
+		URB_INDEX_NONE);
+
 	LOGF_LN("URB %"PRIu64" transfer status = %s", cached_urb_id,
 		stringify_transfer_status(status));
 
@@ -82,6 +358,16 @@ void usbh_urb_free(usbh_urb *urb, usbh_transfer_status status)
 	}
 }
 
+/**
+ * Check if any URB is waiting for backend resource (ie channel)
+ * @param host USB Host
+ * @return true if atleast one URB is waiting
+ */
+bool usbh_urb_pending(usbh_host *host)
+{
+	return host->urb_pending.head != URB_INDEX_NONE;
+}
+
 /**
  * Get the transfer direction
  * @param transfer USB Transfer
@@ -164,3 +450,73 @@ void usbh_urb_inc_data_pointer(usbh_urb *urb, uint16_t len)
 		}
 	}
 }
+
+/**
+ * Called by backend to get the data of isochronous packet @a index.
+ * For OUT, application is asked for the packet first (per packet callback).
+ * @param urb USB Request Block
+ * @param index Packet index
+ * @return pointer to data
+ * @note URB can be cancelled by the callback
+ */
+void *usbh_urb_iso_data_pointer(usbh_urb *urb, uint16_t index)
+{
+	usbh_transfer *transfer = &urb->transfer;
+
+	transfer->iso_index = index;
+
+	if ((transfer->flags & USBH_FLAG_PER_PACKET_CALLBACK) &&
+			IS_OUT_ENDPOINT(transfer->ep_addr)) {
+		URB_CALLBACK(urb, USBH_ONE_PACKET_DATA);
+	}
+
+	return transfer->data + (index * transfer->ep_size);
+}
+
+/**
+ * Called by backend when isochronous packet @a index is done.
+ * The descriptor is updated and the application is given the packet
+ *  (IN, per packet callback). URB is completed after the last packet
+ *  (except USBH_FLAG_ISO_RING).
+ * @param urb USB Request Block
+ * @param[in,out] index Packet index, next packet index on return
+ * @param len Number of bytes transferred
+ * @param status Packet status
+ * @return true if the backend should continue with packet @a index
+ * @return false if the URB is not valid anymore (completed or cancelled)
+ */
+bool usbh_urb_iso_packet_done(usbh_urb *urb, uint16_t *index, uint16_t len,
+		usbh_transfer_status status)
+{
+	usbh_transfer *transfer = &urb->transfer;
+	struct usbh_iso_packet *packet = &transfer->iso_packets[*index];
+	usbh_urb_id urb_id = urb->id;
+
+	packet->length = len;
+	packet->status = status;
+	transfer->transferred += len;
+	transfer->iso_index = *index;
+
+	if ((transfer->flags & USBH_FLAG_PER_PACKET_CALLBACK) &&
+			IS_IN_ENDPOINT(transfer->ep_addr)) {
+		URB_CALLBACK(urb, USBH_ONE_PACKET_DATA);
+
+		if (urb->id != urb_id) {
+			/* cancelled from callback */
+			return false;
+		}
+	}
+
+	if (++*index < transfer->iso_count) {
+		return true;
+	}
+
+	*index = 0;
+
+	if (transfer->flags & USBH_FLAG_ISO_RING) {
+		return true;
+	}
+
+	usbh_urb_free(urb, USBH_SUCCESS);
+	return false;
+}
@@ -0,0 +1,283 @@
+#!/usr/bin/env python
+
+import argparse
+import os
+import re
+import sys
+
+#
+# Use: Generate a packed USB string descriptor table (struct usbd_info_string)
+#      from UTF-8 strings.
+# How: $python usb-string-table.py [--name NAME] [--desig] [--header output.h]
+#          < input-file > output.c
+#
+# Input file:
+#  - UTF-8 strings. (seperated by newline)
+#  - "[0xLLLL]" start the strings of language LLLL (USB LANGID)
+#  - "@serial" (optionally followed by number of characters, default 24,
+#     maximum 126)
+#     is replaced by a RAM descriptor "<NAME>_serial" that application fill
+#     at runtime (same for all languages)
+#  - Empty lines and lines starting with "#" are ignored
+#  - String N (N = 1, 2, 3...) of every language is string index N,
+#     all languages must have the same number of strings.
+#
+# Example:
+#   [0x0409]
+#   unicore-mx
+#   Demo device
+#   @serial
+#   [0x0407]
+#   unicore-mx
+#   Demo-Geraet
+#   @serial
+#
+# Output:
+#  - <NAME>_data: all string descriptors packed in one flash array.
+#     (identical strings are stored once)
+#  - <NAME>_offset: [lang][index - 1] offset of descriptor in <NAME>_data
+#  - <NAME>: struct usbd_info_string to be placed in struct usbd_info
+#  - <NAME>_serial: (with "@serial") struct <NAME>_serial_descriptor,
+#     application fill wData and set bLength to the characters written
+#     (USB_DT_STRING_SIZE(n))
+#  - With --desig: <NAME>_serial_init() that fill the serial number from
+#     the unique device ID (desig_get_unique_id_as_utf16())
+#  - With --header: a header with the serial descriptor type and the
+#     extern declarations (included by the generated C file)
+#
+
+#
+# This file is part of unicore-mx.
+#
+# usb-string-table.py is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# usb-string-table.py is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with usb-string-table.py.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Special exception (same as GNU Bison)
+# As a special exception, you may create a larger work that contains
+# part or all of the usb-string-table.py output and distribute that work
+# under terms of your choice.
+#
+
+SERIAL = object()
+
+# Characters of a string descriptor (bLength is 8 bits, 2 byte header)
+STRING_MAX = (254 - 2) // 2
+
+def parse(lines):
+	langs = []
+	for num, line in enumerate(lines, 1):
+		line = line.strip()
+		if not len(line) or line.startswith('#'):
+			continue
+
+		if line.startswith('[') and line.endswith(']'):
+			langs.append((int(line[1:-1], 0), []))
+			continue
+
+		if not len(langs):
+			sys.exit("line %i: string before language" % num)
+
+		if line.startswith('@serial'):
+			size = line[len('@serial'):].strip()
+			try:
+				size = int(size) if len(size) else 24
+			except ValueError:
+				size = 0
+			if size < 1 or size > STRING_MAX:
+				sys.exit("line %i: serial size must be 1 to %i characters" %
+					(num, STRING_MAX))
+			langs[-1][1].append((SERIAL, size))
+		else:
+			langs[-1][1].append((line, None))
+
+	if not len(langs):
+		sys.exit("no language")
+
+	count = len(langs[0][1])
+	for lang_id, strings in langs:
+		if len(strings) != count:
+			sys.exit("language 0x%04x: %i strings (expected %i)" %
+				(lang_id, len(strings), count))
+
+	return langs, count
+
+def descriptor(string):
+	utf16 = bytearray(string.encode('utf-16le'))
+	if len(utf16) + 2 > 254:
+		sys.exit("string too long: %s" % string)
+	return bytearray([len(utf16) + 2, 3]) + utf16
+
+def comment(string):
+	# keep the string from ending the C comment it is echoed in
+	return "/* %s */" % string.replace('*/', '*\\/')
+
+def serial_struct(name, size):
+	return [
+		"struct %s_serial_descriptor {" % name,
+		"\tuint8_t bLength;",
+		"\tuint8_t bDescriptorType;",
+		"\tuint16_t wData[%i];" % size,
+		"};"
+	]
+
+def header(path, name, serial_type, desig):
+	guard = re.sub('[^A-Z0-9]', '_', os.path.basename(path).upper())
+	lines = [
+		"/* Generated by usb-string-table.py, do not edit */",
+		"",
+		"#ifndef %s" % guard,
+		"#define %s" % guard,
+		"",
+		"#include <unicore-mx/usbd/usbd.h>",
+		""
+	]
+
+	if len(serial_type):
+		lines += serial_type + [""]
+		lines.append("extern struct %s_serial_descriptor %s_serial;"
+			% (name, name))
+
+	lines.append("extern const struct usbd_info_string %s;" % name)
+
+	if desig:
+		lines.append("void %s_serial_init(void);" % name)
+
+	lines += ["", "#endif"]
+
+	with open(path, 'w') as f:
+		f.write("\n".join(lines) + "\n")
+
+def main():
+	parser = argparse.ArgumentParser()
+	parser.add_argument('--name', default='usb_strings')
+	parser.add_argument('--desig', action='store_true',
+		help='generate <NAME>_serial_init() using desig')
+	parser.add_argument('--header',
+		help='write the declarations to HEADER (included by the output)')
+	args = parser.parse_args()
+
+	if sys.hexversion < 0x03000000:
+		# stdin and stdout encoding to utf-8
+		# Python3 does the trick internally
+		import codecs
+		sys.stdin = codecs.getreader('utf-8')(sys.stdin)
+		sys.stdout = codecs.getwriter('utf-8')(sys.stdout)
+
+	name = args.name
+	langs, count = parse(sys.stdin)
+
+	data = bytearray()
+	known = {}
+	offsets = []
+	serial = None
+
+	for lang_id, strings in langs:
+		for string, size in strings:
+			if string is SERIAL:
+				serial = max(serial or 0, size)
+				offsets.append(None)
+				continue
+
+			if string not in known:
+				known[string] = len(data)
+				data += descriptor(string)
+
+			offsets.append(known[string])
+
+	if len(data) >= 0xFFFF:
+		sys.exit("string data too large")
+
+	serial_type = serial_struct(name, serial) if serial else []
+
+	if args.header:
+		header(args.header, name, serial_type, serial and args.desig)
+
+	print("/* Generated by usb-string-table.py, do not edit */")
+	print("")
+	print("#include <unicore-mx/usbd/usbd.h>")
+	if serial and args.desig:
+		print("#include <unicore-mx/stm32/desig.h>")
+	if args.header:
+		print("#include \"%s\"" % os.path.basename(args.header))
+	print("")
+
+	if serial and not args.header:
+		for line in serial_type:
+			print(line)
+		print("")
+
+	print("static const struct usb_string_descriptor %s_lang_list = {" % name)
+	print("\t.bLength = USB_DT_STRING_SIZE(%i)," % len(langs))
+	print("\t.bDescriptorType = USB_DT_STRING,")
+	print("\t.wData = {")
+	print("\t\t%s" % ", ".join("0x%04x" % l for l, s in langs))
+	print("\t}")
+	print("};")
+	print("")
+
+	print("static const uint8_t %s_data[] __attribute__((aligned(2))) = {" % name)
+	for string, off in sorted(known.items(), key=lambda k: k[1]):
+		desc = descriptor(string)
+		print("\t%s" % comment(string))
+		for i in range(0, len(desc), 12):
+			chunk = ", ".join("0x%02x" % b for b in desc[i:i + 12])
+			print("\t%s," % chunk)
+	print("};")
+	print("")
+
+	print("static const uint16_t %s_offset[%i] = {" % (name, len(offsets)))
+	for i, (lang_id, strings) in enumerate(langs):
+		row = offsets[i * count:(i + 1) * count]
+		row = ["USBD_STRING_DYNAMIC" if o is None else str(o) for o in row]
+		print("\t/* 0x%04x */ %s," % (lang_id, ", ".join(row)))
+	print("};")
+	print("")
+
+	if serial:
+		print("struct %s_serial_descriptor %s_serial = {" % (name, name))
+		print("\t.bLength = USB_DT_STRING_SIZE(%i)," % serial)
+		print("\t.bDescriptorType = USB_DT_STRING")
+		print("};")
+		print("")
+
+	print("static const struct usbd_string_table %s_table = {" % name)
+	print("\t.data = %s_data," % name)
+	print("\t.offset = %s_offset," % name)
+	if serial:
+		print("\t.dynamic = (const struct usb_string_descriptor *) &%s_serial"
+			% name)
+	else:
+		print("\t.dynamic = NULL")
+	print("};")
+	print("")
+
+	print("const struct usbd_info_string %s = {" % name)
+	print("\t.lang_list = &%s_lang_list," % name)
+	print("\t.count = %i," % count)
+	print("\t.data = NULL,")
+	print("\t.table = &%s_table" % name)
+	print("};")
+
+	if serial and args.desig:
+		print("")
+		if not args.header:
+			print("void %s_serial_init(void);" % name)
+		print("void %s_serial_init(void)" % name)
+		print("{")
+		print("\tunsigned n = desig_get_unique_id_as_utf16(%s_serial.wData, %i);"
+			% (name, serial))
+		print("\t%s_serial.bLength = USB_DT_STRING_SIZE(n);" % name)
+		print("}")
+
+if __name__ == '__main__':
+	main()
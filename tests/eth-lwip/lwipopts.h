@@ -0,0 +1,52 @@
+/*
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LWIPOPTS_H
+#define LWIPOPTS_H
+
+#define NO_SYS				1
+#define SYS_LIGHTWEIGHT_PROT		0
+#define LWIP_NETCONN			0
+#define LWIP_SOCKET			0
+
+#define LWIP_IPV4			1
+#define LWIP_IPV6			0
+#define LWIP_ARP			1
+#define LWIP_ICMP			1
+#define LWIP_UDP			1
+#define LWIP_TCP			1
+#define LWIP_DHCP			0
+#define LWIP_IGMP			0
+
+/* received frames stay in the MAC buffers (see lwip_netif.c) */
+#define LWIP_SUPPORT_CUSTOM_PBUF	1
+/* LM3S: frames are stored after the 2 byte FIFO length (ETH_RX_OFFSET) */
+#define ETH_PAD_SIZE			2
+#define LWIP_CHECKSUM_CTRL_PER_NETIF	1
+
+#define MEM_ALIGNMENT			4
+#define MEM_SIZE			(16 * 1024)
+#define PBUF_POOL_SIZE			4
+#define MEMP_NUM_TCP_PCB		4
+#define MEMP_NUM_TCP_SEG		32
+
+#define TCP_MSS				1460
+#define TCP_WND				(8 * TCP_MSS)
+#define TCP_SND_BUF			(4 * TCP_MSS)
+
+#define LWIP_STATS			1
+#define LINK_STATS			1
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <unicore-mx/cm3/nvic.h>
+#include <unicore-mx/cm3/systick.h>
+#include <unicore-mx/lm3s/rcc.h>
+#include <unicore-mx/lm3s/usart.h>
+#include <unicore-mx/ethernet/lwip_netif.h>
+
+#include "lwip/init.h"
+#include "lwip/timeouts.h"
+#include "lwip/apps/lwiperf.h"
+#include "netif/ethernet.h"
+
+/* pool buffers hold a full frame after ETH_RX_OFFSET, rounded to words */
+#define BUF_COUNT	20
+#define BUF_SIZE	1536
+#define RX_COUNT	8
+#define TX_COUNT	8
+
+static uint32_t bufs[BUF_COUNT * BUF_SIZE / 4];
+static uint32_t slots[(TX_COUNT + RX_COUNT) * ETH_RING_SLOT_SIZE / 4];
+static struct eth_netif_pbuf pbufs[BUF_COUNT];
+static struct eth_pool pool;
+static struct eth_netif eth = {
+	.pool = &pool,
+	.pbufs = pbufs,
+	.mac = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 }, /* QEMU default */
+};
+static struct netif netif;
+
+static volatile uint32_t ms;
+static volatile bool rx_pending;
+
+int _write(int file, char *ptr, int len);
+int _write(int file, char *ptr, int len)
+{
+	int i;
+
+	(void)file;
+	for (i = 0; i < len; i++) {
+		if (ptr[i] == '\n') {
+			usart_send_blocking(USART0_BASE, '\r');
+		}
+		usart_send_blocking(USART0_BASE, ptr[i]);
+	}
+	return i;
+}
+
+void sys_tick_handler(void)
+{
+	ms++;
+}
+
+u32_t sys_now(void)
+{
+	return ms;
+}
+
+void eth_isr(void)
+{
+	if (eth_rx_irq()) {
+		rx_pending = true;
+	}
+}
+
+static void link_changed(uint8_t phy, enum phy_status status)
+{
+	(void)phy;
+	eth_netif_set_link(&netif, status);
+	printf("link %s\n", status == LINK_DOWN ? "down" : "up");
+}
+
+static void iperf_report(void *arg, enum lwiperf_report_type type,
+			 const ip_addr_t *local_addr, u16_t local_port,
+			 const ip_addr_t *remote_addr, u16_t remote_port,
+			 u32_t bytes, u32_t ms_duration, u32_t kbps)
+{
+	struct eth_rx_stats stats;
+
+	(void)arg;
+	(void)local_addr;
+	(void)local_port;
+	(void)remote_addr;
+	(void)remote_port;
+
+	eth_rx_get_stats(&stats, true);
+
+	printf("iperf %d: %lu bytes in %lu ms, %lu kbit/s\n", (int)type,
+	       bytes, ms_duration, kbps);
+	printf("rx: %lu frames, %lu dropped, %lu missed, %lu overflow\n",
+	       stats.frames, stats.dropped, stats.missed, stats.overflow);
+}
+
+int main(void)
+{
+	struct phy_link link;
+	ip4_addr_t addr, mask, gw;
+	uint32_t last = 0;
+
+	rcc_clock_setup_in_xtal_8mhz_out_50mhz();
+
+	/* 1ms tick */
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(50000 - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
+
+	eth_init(PHY0, ETH_CLK_50MHZ);
+	eth_pool_init(&pool, bufs, BUF_COUNT, BUF_SIZE);
+	eth_ring_init((uint8_t *)slots, TX_COUNT, RX_COUNT, false, &pool);
+
+	lwip_init();
+	IP4_ADDR(&addr, 192, 168, 7, 2);
+	IP4_ADDR(&mask, 255, 255, 255, 0);
+	IP4_ADDR(&gw, 192, 168, 7, 1);
+	netif_add(&netif, &addr, &mask, &gw, &eth, eth_netif_init,
+		  ethernet_input);
+	netif_set_default(&netif);
+	netif_set_up(&netif);
+
+	/* QEMU does not model the PHY registers, so start with the link up.
+	 * On hardware the link state machine reports the real changes.
+	 */
+	netif_set_link_up(&netif);
+	phy_link_init(&link, PHY0, link_changed);
+
+	eth_start();
+	nvic_enable_irq(NVIC_ETH_IRQ);
+
+	lwiperf_start_tcp_server_default(iperf_report, NULL);
+	printf("iperf server on 192.168.7.2:%d\n", LWIPERF_TCP_PORT_DEFAULT);
+
+	while (1) {
+		if (rx_pending) {
+			rx_pending = false;
+			/* budget used up: more frames are waiting */
+			if (eth_netif_poll(&netif, ETH_RX_BUDGET) ==
+			    ETH_RX_BUDGET) {
+				rx_pending = true;
+			}
+		}
+
+		sys_check_timeouts();
+
+		if (ms - last >= 10) {
+			last = ms;
+			phy_link_tick(&link);
+			/* refill the ring with the buffers freed by lwIP */
+			eth_netif_poll(&netif, ETH_RX_BUDGET);
+		}
+	}
+}
@@ -0,0 +1,252 @@
+/*
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unicore-mx/stm32/gpio.h>
+#include <unicore-mx/stm32/rcc.h>
+#include <unicore-mx/stm32/syscfg.h>
+#include <unicore-mx/ethernet/mac.h>
+
+#define SEC		1000000000ULL
+#define MS		1000000ULL
+#define US		1000ULL
+
+#define BUF_COUNT	8
+#define BUF_SIZE	1536
+#define RX_COUNT	4
+#define TX_COUNT	4
+
+static uint32_t bufs[BUF_COUNT * BUF_SIZE / 4];
+static uint32_t desc[(TX_COUNT + RX_COUNT) * ETH_DES_EXT_SIZE / 4];
+static struct eth_pool pool;
+
+static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static uint8_t frame[64];
+static uint8_t big_frame[BUF_SIZE + 64];
+
+static volatile bool tx_stamped;
+static volatile uint64_t tx_stamp;
+
+static void tx_done(void *buf, uint64_t ns)
+{
+	(void)buf;
+	tx_stamp = ns;
+	tx_stamped = true;
+}
+
+static bool check(const char *name, bool ok)
+{
+	printf("%s: %s\n", name, ok ? "PASS" : "FAIL");
+	return ok;
+}
+
+/* Coarse corrections forward and backward, around a second boundary,
+ * and backward by whole seconds (no subseconds to subtract) */
+static bool test_adjust(void)
+{
+	bool ok = true;
+	uint64_t t;
+
+	eth_ptp_set_time(100 * SEC + 900 * MS);
+
+	eth_ptp_adjust_time(250 * MS);
+	t = eth_ptp_get_time();
+	ok &= check("adjust +250ms",
+		    t >= 101 * SEC + 150 * MS && t < 101 * SEC + 151 * MS);
+
+	eth_ptp_adjust_time(-250 * (int64_t)MS);
+	t = eth_ptp_get_time();
+	ok &= check("adjust -250ms",
+		    t >= 100 * SEC + 900 * MS && t < 100 * SEC + 901 * MS);
+
+	eth_ptp_adjust_time(-(int64_t)(2 * SEC + 950 * MS));
+	t = eth_ptp_get_time();
+	ok &= check("adjust -2.95s",
+		    t >= 97 * SEC + 950 * MS && t < 97 * SEC + 951 * MS);
+
+	eth_ptp_adjust_time(-(int64_t)SEC);
+	t = eth_ptp_get_time();
+	ok &= check("adjust -1s",
+		    t >= 96 * SEC + 950 * MS && t < 96 * SEC + 951 * MS);
+
+	return ok;
+}
+
+/* Frame sent to itself through the MAC loopback, both timestamps taken */
+static bool test_loopback(void)
+{
+	struct eth_tx_seg seg = { .buf = frame, .len = sizeof(frame) };
+	uint64_t rx_stamp, start;
+	uint32_t len;
+	void *buf = NULL;
+
+	memcpy(frame, mac, 6);
+	memcpy(frame + 6, mac, 6);
+	frame[12] = 0x88; /* PTP over ethernet */
+	frame[13] = 0xf7;
+
+	eth_ptp_set_tx_callback(tx_done);
+	if (!eth_tx_queue(&seg, 1)) {
+		return check("loopback queue", false);
+	}
+	eth_tx_flush();
+
+	start = eth_ptp_get_time();
+	while (buf == NULL || !tx_stamped) {
+		eth_tx_reclaim();
+		if (buf == NULL) {
+			buf = eth_rx_buf(&len);
+		}
+		if (eth_ptp_get_time() - start > 100 * MS) {
+			return check("loopback frame", false);
+		}
+	}
+	eth_ptp_set_tx_callback(NULL);
+
+	if (!check("loopback rx timestamp", eth_ptp_rx_timestamp(&rx_stamp))) {
+		return false;
+	}
+	eth_pool_free(&pool, buf);
+
+	printf("tx %lu.%09lu rx %lu.%09lu\n",
+	       (unsigned long)(tx_stamp / SEC), (unsigned long)(tx_stamp % SEC),
+	       (unsigned long)(rx_stamp / SEC), (unsigned long)(rx_stamp % SEC));
+
+	return check("loopback delay",
+		     rx_stamp >= tx_stamp && rx_stamp - tx_stamp < 100 * US);
+}
+
+/* Wait for the next frame of the ring, NULL after 100ms */
+static void *wait_frame(uint32_t *len)
+{
+	uint64_t start = eth_ptp_get_time();
+	void *buf;
+
+	while ((buf = eth_rx_buf(len)) == NULL) {
+		eth_tx_reclaim();
+		if (eth_ptp_get_time() - start > 100 * MS) {
+			break;
+		}
+	}
+
+	return buf;
+}
+
+/* A dropped frame (two receive buffers) followed by a good frame, for
+ * more than a turn of the ring: the ring must keep running and the
+ * buffers of the dropped frames go back to the pool */
+static bool test_rx_drop(void)
+{
+	struct eth_tx_seg big = { .buf = big_frame, .len = sizeof(big_frame) };
+	struct eth_tx_seg seg = { .buf = frame, .len = sizeof(frame) };
+	struct eth_rx_stats stats;
+	uint32_t avail = pool.avail, len, i;
+	bool ok = true;
+	void *buf;
+
+	memcpy(big_frame, frame, 14);
+	eth_rx_get_stats(&stats, true);
+
+	for (i = 0; i < 2 * RX_COUNT && ok; i++) {
+		if (!eth_tx_queue(&big, 1) || !eth_tx_queue(&seg, 1)) {
+			return check("drop queue", false);
+		}
+		eth_tx_flush();
+
+		buf = wait_frame(&len);
+		ok &= buf != NULL && len == sizeof(frame) + ETH_RX_FCS_LEN;
+		if (buf != NULL) {
+			eth_pool_free(&pool, buf);
+		}
+	}
+
+	ok = check("drop then receive", ok);
+
+	eth_tx_reclaim();
+	eth_rx_refill();
+	eth_rx_get_stats(&stats, false);
+	ok &= check("drop count",
+		    stats.dropped == 2 * RX_COUNT && stats.frames == 2 * RX_COUNT);
+	ok &= check("drop buffers", pool.avail == avail);
+
+	return ok;
+}
+
+int main(void)
+{
+	bool ok;
+
+	rcc_clock_setup_hse_3v3(&rcc_hse_8mhz_3v3[RCC_CLOCK_3V3_168MHZ]);
+
+	/* RMII to the LAN8742A, selected before the MAC leaves reset */
+	rcc_periph_clock_enable(RCC_SYSCFG);
+	SYSCFG_PMC |= SYSCFG_PMC_MII_RMII_SEL;
+
+	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_GPIOB);
+	rcc_periph_clock_enable(RCC_GPIOC);
+	rcc_periph_clock_enable(RCC_GPIOG);
+
+	/* REF_CLK, MDIO, CRS_DV */
+	gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_NONE,
+			GPIO1 | GPIO2 | GPIO7);
+	gpio_set_output_options(GPIOA, GPIO_OTYPE_PP, GPIO_OSPEED_100MHZ,
+			GPIO2);
+	gpio_set_af(GPIOA, GPIO_AF11, GPIO1 | GPIO2 | GPIO7);
+
+	/* TXD1 */
+	gpio_mode_setup(GPIOB, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO13);
+	gpio_set_output_options(GPIOB, GPIO_OTYPE_PP, GPIO_OSPEED_100MHZ,
+			GPIO13);
+	gpio_set_af(GPIOB, GPIO_AF11, GPIO13);
+
+	/* MDC, RXD0, RXD1 */
+	gpio_mode_setup(GPIOC, GPIO_MODE_AF, GPIO_PUPD_NONE,
+			GPIO1 | GPIO4 | GPIO5);
+	gpio_set_output_options(GPIOC, GPIO_OTYPE_PP, GPIO_OSPEED_100MHZ,
+			GPIO1);
+	gpio_set_af(GPIOC, GPIO_AF11, GPIO1 | GPIO4 | GPIO5);
+
+	/* TX_EN, TXD0 */
+	gpio_mode_setup(GPIOG, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO11 | GPIO13);
+	gpio_set_output_options(GPIOG, GPIO_OTYPE_PP, GPIO_OSPEED_100MHZ,
+			GPIO11 | GPIO13);
+	gpio_set_af(GPIOG, GPIO_AF11, GPIO11 | GPIO13);
+
+	rcc_periph_clock_enable(RCC_ETHMAC);
+	rcc_periph_clock_enable(RCC_ETHMACTX);
+	rcc_periph_clock_enable(RCC_ETHMACRX);
+	rcc_periph_clock_enable(RCC_ETHMACPTP);
+	rcc_periph_reset_pulse(RST_ETHMAC);
+
+	eth_init(0, ETH_CLK_150_168MHZ);
+	eth_set_mac(mac);
+	eth_pool_init(&pool, bufs, BUF_COUNT, BUF_SIZE);
+	eth_ring_init((uint8_t *)desc, TX_COUNT, RX_COUNT, true, &pool);
+	eth_ptp_init(rcc_ahb_frequency);
+
+	/* frames go back to the receiver inside the MAC, no link needed */
+	ETH_MACCR |= ETH_MACCR_LM;
+	eth_start();
+
+	ok = test_adjust();
+	ok &= test_loopback();
+	ok &= test_rx_drop();
+
+	printf("eth-ptp: %s\n", ok ? "PASS" : "FAIL");
+
+	while (1);
+}